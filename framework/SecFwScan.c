@@ -0,0 +1,328 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <malloc.h>
+#include <pthread.h>
+
+#include "SecFwScan.h"
+#include "TCSIndicator.h"
+
+
+#if defined(DEBUG)
+#define DEBUG_LOG(_fmt_, _param_...)    { \
+                                            printf("[SECFW] %s,%d: " _fmt_, __FILE__, __LINE__, ##_param_); \
+                                        }
+#else
+#define DEBUG_LOG(_fmt_, _param_...)
+#endif
+
+
+#define URL_HTTP_PREFIX "http://"
+
+
+/**
+ * Content passed to the engine as pPrivate.
+ */
+typedef struct ScanBuffer_struct
+{
+    unsigned char const *pData;
+    unsigned int uSize;
+} ScanBuffer;
+
+/**
+ * Batched URL lookup, run by a worker thread.
+ */
+typedef struct UrlLookup_struct
+{
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hConfigure;
+    TWPRequest *pRequest;
+    char const **ppUrls;
+    unsigned int uCount;
+    TWPResponseHandle hResponse;
+    TWP_RESULT Result;
+} UrlLookup;
+
+
+static unsigned int ExtractUrls(void const *pBuffer, unsigned int uSize, unsigned int uMax,
+                                char const ***pppUrls);
+static void *LookupUrlsThread(void *pArg);
+static int MergeVerdict(SecFwScanParam const *pParam, SecFwScanResult *pResult);
+static TCSOffset BufferGetSize(void *pPrivate);
+static unsigned int BufferRead(void *pPrivate, TCSOffset uOffset, void *pBuffer, unsigned int uCount);
+
+
+int SecFwScanData(TCSLIB_HANDLE hLib, void const *pBuffer, unsigned int uSize,
+                  SecFwScanParam const *pParam, SecFwScanResult *pResult)
+{
+    ScanBuffer Content;
+    TCSScanParam ScanParam;
+    UrlLookup Lookup;
+    pthread_t Thread;
+    int iThread = 0;
+    int iRet;
+
+    if (hLib == INVALID_TCSLIB_HANDLE || (pBuffer == NULL && uSize != 0) ||
+        pParam == NULL || pResult == NULL)
+    {
+        return -1;
+    }
+
+    memset(pResult, 0, sizeof(SecFwScanResult));
+    memset(&Lookup, 0, sizeof(Lookup));
+    Lookup.Result = TWP_NO_DATA;
+
+    if (pParam->hTwpLib != INVALID_TWPLIB_HANDLE && pParam->pRequest != NULL)
+    {
+        Lookup.hLib = pParam->hTwpLib;
+        Lookup.hConfigure = pParam->hConfigure;
+        Lookup.pRequest = pParam->pRequest;
+        Lookup.uCount = ExtractUrls(pBuffer, uSize,
+                                    pParam->uMaxUrls != 0 ? pParam->uMaxUrls : SECFW_SCAN_DEF_MAX_URLS,
+                                    &Lookup.ppUrls);
+        if (Lookup.uCount == 0)
+        {
+            Lookup.Result = Lookup.ppUrls != NULL ? TWP_SUCCESS : TWP_NOMEM;
+        }
+        else if (pthread_create(&Thread, NULL, LookupUrlsThread, &Lookup) == 0)
+        {
+            iThread = 1;
+        }
+        else
+        {
+            DEBUG_LOG("%s", "no lookup thread, looking up urls after the scan\n");
+        }
+    }
+
+    Content.pData = (unsigned char const *) pBuffer;
+    Content.uSize = uSize;
+    memset(&ScanParam, 0, sizeof(ScanParam));
+    ScanParam.iAction = TCS_SA_SCANONLY;
+    ScanParam.iDataType = pParam->iDataType;
+    ScanParam.iCompressFlag = pParam->iCompressFlag;
+    ScanParam.pPrivate = &Content;
+    ScanParam.pfGetSize = BufferGetSize;
+    ScanParam.pfRead = BufferRead;
+    iRet = TCSScanData(hLib, &ScanParam, &pResult->ContentResult);
+
+    if (iThread)
+        pthread_join(Thread, NULL);
+    else if (Lookup.uCount != 0)
+        LookupUrlsThread(&Lookup);
+    free((void *) Lookup.ppUrls);
+
+    pResult->UrlResult = Lookup.Result;
+    pResult->hResponse = Lookup.hResponse;
+    pResult->uUrlCount = Lookup.uCount;
+
+    if (iRet != 0)
+    {
+        DEBUG_LOG("content scan failed: %d\n", iRet);
+        SecFwScanResultFree(pParam->hTwpLib, pResult);
+        return -1;
+    }
+
+    pResult->iVerdict = MergeVerdict(pParam, pResult);
+
+    return 0;
+}
+
+
+void SecFwScanResultFree(TWPLIB_HANDLE hTwpLib, SecFwScanResult *pResult)
+{
+    if (pResult == NULL)
+        return;
+
+    if (pResult->ContentResult.pfFreeResult != NULL)
+        (*pResult->ContentResult.pfFreeResult)(&pResult->ContentResult);
+    if (pResult->hResponse != NULL)
+        TWPResponseDestroy(hTwpLib, &pResult->hResponse);
+    memset(pResult, 0, sizeof(SecFwScanResult));
+}
+
+
+/**
+ * Returns the distinct URLs of the content as a NULL terminated array, which
+ * is allocated together with the strings. *pppUrls is NULL on failure.
+ */
+static unsigned int ExtractUrls(void const *pBuffer, unsigned int uSize, unsigned int uMax,
+                                char const ***pppUrls)
+{
+    TCSIndicator *pInd;
+    char const **ppUrls;
+    char *pStr;
+    unsigned int uSpace = 0;
+    unsigned int uCount = 0;
+    unsigned int i;
+    unsigned int j;
+    int iFound;
+
+    *pppUrls = NULL;
+    pInd = (TCSIndicator *) malloc(uMax * sizeof(TCSIndicator));
+    if (pInd == NULL)
+        return 0;
+
+    iFound = TCSExtractIndicators(pBuffer, uSize, TCS_IND_URL, pInd, uMax);
+    if (iFound < 0)
+        iFound = 0;
+    if ((unsigned int) iFound > uMax)
+        iFound = (int) uMax;
+
+    for (i = 0; i < (unsigned int) iFound; i++)
+        uSpace += sizeof(URL_HTTP_PREFIX) + pInd[i].uLength;
+
+    ppUrls = (char const **) malloc((iFound + 1) * sizeof(char const *) + uSpace);
+    if (ppUrls == NULL)
+    {
+        free(pInd);
+        return 0;
+    }
+    pStr = (char *) (ppUrls + iFound + 1);
+
+    for (i = 0; i < (unsigned int) iFound; i++)
+    {
+        unsigned int uPrefix = 0;
+
+        if (pInd[i].uLength > 4 && strncasecmp(pInd[i].pData, "www.", 4) == 0)
+        {
+            memcpy(pStr, URL_HTTP_PREFIX, sizeof(URL_HTTP_PREFIX) - 1);
+            uPrefix = sizeof(URL_HTTP_PREFIX) - 1;
+        }
+        memcpy(pStr + uPrefix, pInd[i].pData, pInd[i].uLength);
+        pStr[uPrefix + pInd[i].uLength] = '\0';
+
+        for (j = 0; j < uCount; j++)
+        {
+            if (strcmp(ppUrls[j], pStr) == 0)
+                break;
+        }
+        if (j == uCount)
+        {
+            ppUrls[uCount++] = pStr;
+            pStr += uPrefix + pInd[i].uLength + 1;
+        }
+    }
+    ppUrls[uCount] = NULL;
+
+    free(pInd);
+    *pppUrls = ppUrls;
+
+    return uCount;
+}
+
+
+static void *LookupUrlsThread(void *pArg)
+{
+    UrlLookup *pLookup = (UrlLookup *) pArg;
+
+    pLookup->Result = TWPLookupUrls(pLookup->hLib, pLookup->hConfigure, pLookup->pRequest, 0,
+                                    pLookup->ppUrls, pLookup->uCount, &pLookup->hResponse);
+    if (pLookup->Result != TWP_SUCCESS)
+        pLookup->hResponse = NULL;
+
+    return NULL;
+}
+
+
+static int MergeVerdict(SecFwScanParam const *pParam, SecFwScanResult *pResult)
+{
+    int iVerdict = SECFW_VERDICT_CLEAN;
+    unsigned int uCount = 0;
+    unsigned int i;
+
+    if (pResult->ContentResult.iNumDetected > 0)
+        return SECFW_VERDICT_MALICIOUS;
+
+    if (pResult->UrlResult == TWP_NO_DATA)
+        return SECFW_VERDICT_CLEAN;
+
+    if (pResult->UrlResult != TWP_SUCCESS)
+        return SECFW_VERDICT_UNVERIFIED;
+
+    if (pResult->hResponse == NULL ||
+        TWPResponseGetUrlRatingsCount(pParam->hTwpLib, pResult->hResponse, &uCount) != TWP_SUCCESS)
+        return pResult->uUrlCount == 0 ? SECFW_VERDICT_CLEAN : SECFW_VERDICT_UNVERIFIED;
+
+    if (uCount < pResult->uUrlCount)
+        iVerdict = SECFW_VERDICT_UNVERIFIED;
+
+    for (i = 0; i < uCount; i++)
+    {
+        TWPUrlRatingHandle hRating = NULL;
+        int iScore = 0;
+        int iViolated = 0;
+
+        if (TWPResponseGetUrlRatingByIndex(pParam->hTwpLib, pResult->hResponse, i, &hRating) != TWP_SUCCESS ||
+            TWPUrlRatingGetScore(pParam->hTwpLib, hRating, &iScore) != TWP_SUCCESS)
+        {
+            if (iVerdict < SECFW_VERDICT_UNVERIFIED)
+                iVerdict = SECFW_VERDICT_UNVERIFIED;
+            continue;
+        }
+
+        if (iScore >= TWP_HighLow)
+            return SECFW_VERDICT_MALICIOUS;
+
+        if (pParam->hPolicy != NULL &&
+            TWPPolicyValidate(pParam->hTwpLib, pParam->hPolicy, hRating, &iViolated) == TWP_SUCCESS &&
+            iViolated)
+            return SECFW_VERDICT_MALICIOUS;
+
+        if (iScore >= TWP_MediumLow)
+            iVerdict = SECFW_VERDICT_SUSPICIOUS;
+        else if (iScore >= TWP_UnverifiedLow && iVerdict < SECFW_VERDICT_UNVERIFIED)
+            iVerdict = SECFW_VERDICT_UNVERIFIED;
+    }
+
+    return iVerdict;
+}
+
+
+static TCSOffset BufferGetSize(void *pPrivate)
+{
+    return ((ScanBuffer const *) pPrivate)->uSize;
+}
+
+
+static unsigned int BufferRead(void *pPrivate, TCSOffset uOffset, void *pBuffer, unsigned int uCount)
+{
+    ScanBuffer const *pContent = (ScanBuffer const *) pPrivate;
+
+    if (uOffset >= pContent->uSize)
+        return 0;
+    if (uCount > pContent->uSize - uOffset)
+        uCount = (unsigned int) (pContent->uSize - uOffset);
+    memcpy(pBuffer, pContent->pData + uOffset, uCount);
+
+    return uCount;
+}
@@ -0,0 +1,139 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SECFWSCAN_H
+#define SECFWSCAN_H
+
+#include "TCSImpl.h"
+#include "TWPImpl.h"
+
+#ifdef __cplusplus 
+extern "C" {
+#endif
+
+/**
+ * \file SecFwScan.h
+ * \brief Combined Content and URL Reputation Scan Header File
+ *  
+ * This file provides a function to scan a message with TCS and, at the same
+ * time, check the reputation of the URLs it contains with TWP.
+ */
+
+#define SECFW_SCAN_DEF_MAX_URLS 64 /* Default limit of URLs looked up per scan. */
+
+#define SECFW_VERDICT_CLEAN 0 /* No detection and all URLs are rated minimal risk. */
+
+#define SECFW_VERDICT_UNVERIFIED 1 /* No detection, but at least one URL is unverified
+                                      or the URL lookup failed. */
+
+#define SECFW_VERDICT_SUSPICIOUS 2 /* At least one URL is rated medium risk. */
+
+#define SECFW_VERDICT_MALICIOUS 3 /* Malware detected in the content, a URL is rated
+                                     high risk or violates the policy. */
+
+/**
+ * Parameters of a combined scan.
+ */
+typedef struct SecFwScanParam_struct
+{
+    int iDataType; /* TCS data type of the content, e.g. TCS_DTYPE_TEXT or TCS_DTYPE_HTML. */
+
+    int iCompressFlag; /* 0 - decompression disabled, 1 - decompression enabled. */
+
+    TWPLIB_HANDLE hTwpLib; /* TWP library handle, INVALID_TWPLIB_HANDLE to skip the URL lookup. */
+
+    TWPConfigurationHandle hConfigure; /* TWP configuration used for the lookup. */
+
+    TWPRequest *pRequest; /* Synchronous request (receivefunc set) used for the lookup. Its
+                             callbacks are called from a different thread than the caller's. */
+
+    TWPPolicyHandle hPolicy; /* Optional policy, a violating URL makes the verdict malicious. */
+
+    unsigned int uMaxUrls; /* Limit of URLs looked up, 0 for SECFW_SCAN_DEF_MAX_URLS. */
+} SecFwScanParam;
+
+/**
+ * Result of a combined scan, to be released with SecFwScanResultFree().
+ */
+typedef struct SecFwScanResult_struct
+{
+    int iVerdict; /* Merged verdict, one of SECFW_VERDICT_*. */
+
+    TCSScanResult ContentResult; /* Result of the content scan. */
+
+    TWP_RESULT UrlResult; /* Result of the URL lookup, TWP_NO_DATA if it was skipped. */
+
+    TWPResponseHandle hResponse; /* Response of the URL lookup, the ratings follow the
+                                    order of the URLs in the content. NULL if there was
+                                    no URL or the lookup failed. */
+
+    unsigned int uUrlCount; /* Number of distinct URLs looked up. */
+} SecFwScanResult;
+
+/**
+ * \brief Scans content with TCS and checks the URLs it contains with TWP.
+ *
+ * URLs are extracted from the content and sent in a single TWPLookupUrls()
+ * request, which runs while the content is being scanned. URLs starting with
+ * "www." are looked up with an "http://" prefix.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] hLib TCS library handle returned by TCSLibraryOpen().
+ * \param[in] pBuffer Content to be scanned.
+ * \param[in] uSize Size (in bytes) of pBuffer.
+ * \param[in] pParam Scan parameters.
+ * \param[out] pResult Merged result, released with SecFwScanResultFree().
+ *
+ * \return Return Type (int) \n
+ * 0 - on success, a failed URL lookup is reported in pResult. \n
+ * -1 - on failure of the content scan. \n
+ */
+int SecFwScanData(TCSLIB_HANDLE hLib, void const *pBuffer, unsigned int uSize,
+                  SecFwScanParam const *pParam, SecFwScanResult *pResult);
+
+/**
+ * \brief Releases the resources of a combined scan result.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] hTwpLib TWP library handle used for the scan.
+ * \param[in] pResult Result returned by SecFwScanData().
+ *
+ * \return None
+ */
+void SecFwScanResultFree(TWPLIB_HANDLE hTwpLib, SecFwScanResult *pResult);
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif  /* SECFWSCAN_H */
@@ -0,0 +1,547 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string.h>
+#include <stdint.h>
+
+#include "TCSIndicator.h"
+#include "TCSInternal.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define IND_BLOCK 32
+#define IND_BIT_SHIFT 0
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define IND_BLOCK 16
+#define IND_BIT_SHIFT 0
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define IND_BLOCK 16
+#define IND_BIT_SHIFT 2 /* The NEON block mask holds 4 bits per byte. */
+#endif
+
+
+#define IND_MIN_PHONE_DIGITS 7
+
+#define IND_MAX_PHONE_DIGITS 15
+
+#define IND_MAX_SCHEME_LEN 16
+
+#define IND_LOWER(c) ((unsigned char) ((c) | 0x20))
+
+#define IND_IS_DIGIT(c) ((unsigned char) ((c) - '0') <= 9)
+
+#define IND_IS_ALPHA(c) ((unsigned char) (IND_LOWER(c) - 'a') <= 'z' - 'a')
+
+#define IND_IS_ALNUM(c) (IND_IS_DIGIT(c) || IND_IS_ALPHA(c))
+
+
+/**
+ * Search state, positions are offsets in the buffer.
+ */
+typedef struct IndSearch_struct
+{
+    unsigned char const *pData;
+    unsigned int uSize;
+    int iTypes;
+    unsigned int uFloor; /* End of the last indicator, candidates never start before it. */
+    unsigned int uResume; /* Next position worth checking for an anchor. */
+    TCSIndicator *pIndicators;
+    unsigned int uMax;
+    unsigned int uFound;
+} IndSearch;
+
+
+static int ExtractIndicators(void const *pBuffer, unsigned int uSize, int iTypes,
+                             TCSIndicator *pIndicators, unsigned int uMax, int iBlocks);
+static int IsAnchor(IndSearch const *pSearch, unsigned int uPos);
+static void ExpandAnchor(IndSearch *pSearch, unsigned int uPos);
+static int ExpandUrl(IndSearch *pSearch, unsigned int uStart, unsigned int uPos);
+static int ExpandEmail(IndSearch *pSearch, unsigned int uPos);
+static int ExpandPhone(IndSearch *pSearch, unsigned int uPos);
+static void AddIndicator(IndSearch *pSearch, int iDataType, unsigned int uStart, unsigned int uEnd);
+static TCSOffset IndicatorGetSize(void *pPrivate);
+static unsigned int IndicatorRead(void *pPrivate, TCSOffset uOffset, void *pBuffer,
+                                  unsigned int uCount);
+
+#if defined(IND_BLOCK)
+static uint64_t BlockAnchors(unsigned char const *pData, int iTypes);
+#endif
+
+
+int TCSExtractIndicators(void const *pBuffer, unsigned int uSize, int iTypes,
+                         TCSIndicator *pIndicators, unsigned int uMax)
+{
+    return ExtractIndicators(pBuffer, uSize, iTypes, pIndicators, uMax, 1);
+}
+
+
+int TCSExtractIndicatorsScalar(void const *pBuffer, unsigned int uSize, int iTypes,
+                               TCSIndicator *pIndicators, unsigned int uMax)
+{
+    return ExtractIndicators(pBuffer, uSize, iTypes, pIndicators, uMax, 0);
+}
+
+
+void TCSIndicatorScanParam(TCSIndicator const *pIndicator, TCSScanParam *pParam)
+{
+    memset(pParam, 0, sizeof(TCSScanParam));
+    pParam->iAction = TCS_SA_SCANONLY;
+    pParam->iDataType = pIndicator->iDataType;
+    pParam->pPrivate = (void *) pIndicator;
+    pParam->pfGetSize = IndicatorGetSize;
+    pParam->pfRead = IndicatorRead;
+}
+
+
+/**
+ * Searches the buffer for anchors a block at a time if iBlocks is set and
+ * the build has a block search, then byte by byte up to the end.
+ */
+static int ExtractIndicators(void const *pBuffer, unsigned int uSize, int iTypes,
+                             TCSIndicator *pIndicators, unsigned int uMax, int iBlocks)
+{
+    IndSearch Search;
+    unsigned int uPos = 0;
+
+    if ((pBuffer == NULL && uSize != 0) || (pIndicators == NULL && uMax != 0) ||
+        (iTypes & TCS_IND_ALL) == 0 || (iTypes & ~TCS_IND_ALL) != 0)
+    {
+        return -1;
+    }
+
+    memset(&Search, 0, sizeof(Search));
+    Search.pData = (unsigned char const *) pBuffer;
+    Search.uSize = uSize;
+    Search.iTypes = iTypes;
+    Search.pIndicators = pIndicators;
+    Search.uMax = uMax;
+
+#if defined(IND_BLOCK)
+    /* Anchors are up to 4 bytes long, so a block also reads 3 bytes past its end. */
+    for (; iBlocks && uSize >= IND_BLOCK + 3 && uPos <= uSize - IND_BLOCK - 3; uPos += IND_BLOCK)
+    {
+        uint64_t uMask;
+
+        if (Search.uResume >= uPos + IND_BLOCK)
+            continue;
+
+        uMask = BlockAnchors(Search.pData + uPos, iTypes);
+        while (uMask != 0)
+        {
+            unsigned int uBit = (unsigned int) __builtin_ctzll(uMask) >> IND_BIT_SHIFT;
+
+            uMask &= ~((((uint64_t) 1 << (1 << IND_BIT_SHIFT)) - 1) << (uBit << IND_BIT_SHIFT));
+            if (uPos + uBit >= Search.uResume)
+                ExpandAnchor(&Search, uPos + uBit);
+        }
+    }
+#else
+    (void) iBlocks;
+#endif
+
+    for (; uPos < uSize; uPos++)
+    {
+        if (uPos >= Search.uResume && IsAnchor(&Search, uPos))
+            ExpandAnchor(&Search, uPos);
+    }
+
+    return (int) Search.uFound;
+}
+
+
+#if defined(__AVX2__)
+static __m256i BlockDigits(__m256i v)
+{
+    __m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(9)), t);
+}
+
+/**
+ * Returns a mask with one bit per byte set where an anchor of the requested
+ * types starts in the 32 bytes at pData.
+ */
+static uint64_t BlockAnchors(unsigned char const *pData, int iTypes)
+{
+    __m256i v0 = _mm256_loadu_si256((__m256i const *) pData);
+    __m256i v1 = _mm256_loadu_si256((__m256i const *) (pData + 1));
+    __m256i v2 = _mm256_loadu_si256((__m256i const *) (pData + 2));
+    __m256i v3 = _mm256_loadu_si256((__m256i const *) (pData + 3));
+    __m256i vMask = _mm256_setzero_si256();
+
+    if (iTypes & TCS_IND_URL)
+    {
+        __m256i vCase = _mm256_set1_epi8(0x20);
+        __m256i vW = _mm256_set1_epi8('w');
+        __m256i vSlash = _mm256_set1_epi8('/');
+        __m256i vScheme = _mm256_and_si256(_mm256_cmpeq_epi8(v0, _mm256_set1_epi8(':')),
+                                           _mm256_and_si256(_mm256_cmpeq_epi8(v1, vSlash),
+                                                            _mm256_cmpeq_epi8(v2, vSlash)));
+        __m256i vWww = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(_mm256_or_si256(v0, vCase), vW),
+                                                         _mm256_cmpeq_epi8(_mm256_or_si256(v1, vCase), vW)),
+                                        _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_or_si256(v2, vCase), vW),
+                                                         _mm256_cmpeq_epi8(v3, _mm256_set1_epi8('.'))));
+        vMask = _mm256_or_si256(vMask, _mm256_or_si256(vScheme, vWww));
+    }
+    if (iTypes & TCS_IND_EMAIL)
+    {
+        vMask = _mm256_or_si256(vMask, _mm256_cmpeq_epi8(v0, _mm256_set1_epi8('@')));
+    }
+    if (iTypes & TCS_IND_PHONE)
+    {
+        vMask = _mm256_or_si256(vMask, _mm256_and_si256(_mm256_and_si256(BlockDigits(v0), BlockDigits(v1)),
+                                                        _mm256_and_si256(BlockDigits(v2), BlockDigits(v3))));
+    }
+
+    return (uint32_t) _mm256_movemask_epi8(vMask);
+}
+#elif defined(__SSE2__)
+static __m128i BlockDigits(__m128i v)
+{
+    __m128i t = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(9)), t);
+}
+
+/**
+ * Returns a mask with one bit per byte set where an anchor of the requested
+ * types starts in the 16 bytes at pData.
+ */
+static uint64_t BlockAnchors(unsigned char const *pData, int iTypes)
+{
+    __m128i v0 = _mm_loadu_si128((__m128i const *) pData);
+    __m128i v1 = _mm_loadu_si128((__m128i const *) (pData + 1));
+    __m128i v2 = _mm_loadu_si128((__m128i const *) (pData + 2));
+    __m128i v3 = _mm_loadu_si128((__m128i const *) (pData + 3));
+    __m128i vMask = _mm_setzero_si128();
+
+    if (iTypes & TCS_IND_URL)
+    {
+        __m128i vCase = _mm_set1_epi8(0x20);
+        __m128i vW = _mm_set1_epi8('w');
+        __m128i vSlash = _mm_set1_epi8('/');
+        __m128i vScheme = _mm_and_si128(_mm_cmpeq_epi8(v0, _mm_set1_epi8(':')),
+                                        _mm_and_si128(_mm_cmpeq_epi8(v1, vSlash),
+                                                      _mm_cmpeq_epi8(v2, vSlash)));
+        __m128i vWww = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(_mm_or_si128(v0, vCase), vW),
+                                                   _mm_cmpeq_epi8(_mm_or_si128(v1, vCase), vW)),
+                                     _mm_and_si128(_mm_cmpeq_epi8(_mm_or_si128(v2, vCase), vW),
+                                                   _mm_cmpeq_epi8(v3, _mm_set1_epi8('.'))));
+        vMask = _mm_or_si128(vMask, _mm_or_si128(vScheme, vWww));
+    }
+    if (iTypes & TCS_IND_EMAIL)
+    {
+        vMask = _mm_or_si128(vMask, _mm_cmpeq_epi8(v0, _mm_set1_epi8('@')));
+    }
+    if (iTypes & TCS_IND_PHONE)
+    {
+        vMask = _mm_or_si128(vMask, _mm_and_si128(_mm_and_si128(BlockDigits(v0), BlockDigits(v1)),
+                                                  _mm_and_si128(BlockDigits(v2), BlockDigits(v3))));
+    }
+
+    return (uint32_t) _mm_movemask_epi8(vMask);
+}
+#elif defined(IND_BLOCK)
+static uint8x16_t BlockDigits(uint8x16_t v)
+{
+    return vcleq_u8(vsubq_u8(v, vdupq_n_u8('0')), vdupq_n_u8(9));
+}
+
+/**
+ * Returns a mask with four bits per byte set where an anchor of the requested
+ * types starts in the 16 bytes at pData.
+ */
+static uint64_t BlockAnchors(unsigned char const *pData, int iTypes)
+{
+    uint8x16_t v0 = vld1q_u8(pData);
+    uint8x16_t v1 = vld1q_u8(pData + 1);
+    uint8x16_t v2 = vld1q_u8(pData + 2);
+    uint8x16_t v3 = vld1q_u8(pData + 3);
+    uint8x16_t vMask = vdupq_n_u8(0);
+
+    if (iTypes & TCS_IND_URL)
+    {
+        uint8x16_t vCase = vdupq_n_u8(0x20);
+        uint8x16_t vW = vdupq_n_u8('w');
+        uint8x16_t vSlash = vdupq_n_u8('/');
+        uint8x16_t vScheme = vandq_u8(vceqq_u8(v0, vdupq_n_u8(':')),
+                                      vandq_u8(vceqq_u8(v1, vSlash), vceqq_u8(v2, vSlash)));
+        uint8x16_t vWww = vandq_u8(vandq_u8(vceqq_u8(vorrq_u8(v0, vCase), vW),
+                                            vceqq_u8(vorrq_u8(v1, vCase), vW)),
+                                   vandq_u8(vceqq_u8(vorrq_u8(v2, vCase), vW),
+                                            vceqq_u8(v3, vdupq_n_u8('.'))));
+        vMask = vorrq_u8(vMask, vorrq_u8(vScheme, vWww));
+    }
+    if (iTypes & TCS_IND_EMAIL)
+    {
+        vMask = vorrq_u8(vMask, vceqq_u8(v0, vdupq_n_u8('@')));
+    }
+    if (iTypes & TCS_IND_PHONE)
+    {
+        vMask = vorrq_u8(vMask, vandq_u8(vandq_u8(BlockDigits(v0), BlockDigits(v1)),
+                                         vandq_u8(BlockDigits(v2), BlockDigits(v3))));
+    }
+
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(vMask), 4)), 0);
+}
+#endif
+
+
+/**
+ * Scalar equivalent of BlockAnchors() for a single position.
+ */
+static int IsAnchor(IndSearch const *pSearch, unsigned int uPos)
+{
+    unsigned char const *p = pSearch->pData + uPos;
+    unsigned int uLeft = pSearch->uSize - uPos;
+
+    if ((pSearch->iTypes & TCS_IND_URL) && uLeft >= 3 &&
+        p[0] == ':' && p[1] == '/' && p[2] == '/')
+        return 1;
+
+    if ((pSearch->iTypes & TCS_IND_URL) && uLeft >= 4 &&
+        IND_LOWER(p[0]) == 'w' && IND_LOWER(p[1]) == 'w' && IND_LOWER(p[2]) == 'w' && p[3] == '.')
+        return 1;
+
+    if ((pSearch->iTypes & TCS_IND_EMAIL) && p[0] == '@')
+        return 1;
+
+    if ((pSearch->iTypes & TCS_IND_PHONE) && uLeft >= 4 &&
+        IND_IS_DIGIT(p[0]) && IND_IS_DIGIT(p[1]) && IND_IS_DIGIT(p[2]) && IND_IS_DIGIT(p[3]))
+        return 1;
+
+    return 0;
+}
+
+
+/**
+ * Expands the anchor at uPos into an indicator, and sets the position to
+ * resume the search from.
+ */
+static void ExpandAnchor(IndSearch *pSearch, unsigned int uPos)
+{
+    unsigned char const *p = pSearch->pData + uPos;
+    unsigned int uLeft = pSearch->uSize - uPos;
+
+    pSearch->uResume = uPos + 1;
+
+    if ((pSearch->iTypes & TCS_IND_URL) && uLeft >= 3 &&
+        p[0] == ':' && p[1] == '/' && p[2] == '/')
+    {
+        unsigned int uStart = uPos;
+
+        /* Scheme: a letter followed by letters, digits, '+', '-' or '.'. */
+        while (uStart > pSearch->uFloor && uPos - uStart < IND_MAX_SCHEME_LEN &&
+               (IND_IS_ALNUM(pSearch->pData[uStart - 1]) || pSearch->pData[uStart - 1] == '+' ||
+                pSearch->pData[uStart - 1] == '-' || pSearch->pData[uStart - 1] == '.'))
+            uStart--;
+        while (uStart < uPos && !IND_IS_ALPHA(pSearch->pData[uStart]))
+            uStart++;
+        if (uStart < uPos && ExpandUrl(pSearch, uStart, uPos + 3))
+            return;
+    }
+
+    if ((pSearch->iTypes & TCS_IND_URL) && uLeft >= 4 &&
+        IND_LOWER(p[0]) == 'w' && IND_LOWER(p[1]) == 'w' && IND_LOWER(p[2]) == 'w' && p[3] == '.')
+    {
+        /* "www." must not be the tail of a longer host name, e.g. "awww.". */
+        if (uPos == pSearch->uFloor || !(IND_IS_ALNUM(p[-1]) || p[-1] == '-' || p[-1] == '.'))
+        {
+            if (ExpandUrl(pSearch, uPos, uPos + 4))
+                return;
+        }
+    }
+
+    if ((pSearch->iTypes & TCS_IND_EMAIL) && p[0] == '@')
+    {
+        ExpandEmail(pSearch, uPos);
+        return;
+    }
+
+    if ((pSearch->iTypes & TCS_IND_PHONE) && uLeft >= 4 && IND_IS_DIGIT(p[0]))
+        ExpandPhone(pSearch, uPos);
+}
+
+
+static int IsUrlChar(unsigned char c)
+{
+    return c > ' ' && c < 0x7f && c != '"' && c != '\'' && c != '<' && c != '>' && c != '`';
+}
+
+
+/**
+ * Expands a URL starting at uStart, whose host starts at uHost.
+ */
+static int ExpandUrl(IndSearch *pSearch, unsigned int uStart, unsigned int uHost)
+{
+    unsigned char const *p = pSearch->pData;
+    unsigned int uEnd = uHost;
+
+    while (uEnd < pSearch->uSize && IsUrlChar(p[uEnd]))
+        uEnd++;
+
+    /* Punctuation ending a sentence or closing a bracket is not part of the URL. */
+    while (uEnd > uHost && strchr(".,;:!?)]}", p[uEnd - 1]) != NULL)
+        uEnd--;
+
+    if (uEnd == uHost)
+        return 0;
+
+    AddIndicator(pSearch, TCS_DTYPE_URL, uStart, uEnd);
+    return 1;
+}
+
+
+static int IsEmailLocalChar(unsigned char c)
+{
+    return IND_IS_ALNUM(c) || c == '.' || c == '_' || c == '%' || c == '+' || c == '-';
+}
+
+
+/**
+ * Expands an email-address around the '@' at uPos. The domain needs at least
+ * two labels and an alphabetic top level label.
+ */
+static int ExpandEmail(IndSearch *pSearch, unsigned int uPos)
+{
+    unsigned char const *p = pSearch->pData;
+    unsigned int uStart = uPos;
+    unsigned int uEnd = uPos + 1;
+    unsigned int uDot = 0;
+    unsigned int i;
+
+    while (uStart > pSearch->uFloor && IsEmailLocalChar(p[uStart - 1]))
+        uStart--;
+    while (uStart < uPos && p[uStart] == '.')
+        uStart++;
+    if (uStart == uPos)
+        return 0;
+
+    while (uEnd < pSearch->uSize && (IND_IS_ALNUM(p[uEnd]) || p[uEnd] == '-' || p[uEnd] == '.'))
+        uEnd++;
+    while (uEnd > uPos + 1 && (p[uEnd - 1] == '.' || p[uEnd - 1] == '-'))
+        uEnd--;
+
+    for (i = uPos + 1; i < uEnd; i++)
+    {
+        if (p[i] == '.')
+            uDot = i;
+    }
+    if (uDot <= uPos + 1 || uEnd - uDot < 3)
+        return 0;
+    for (i = uDot + 1; i < uEnd; i++)
+    {
+        if (!IND_IS_ALPHA(p[i]))
+            return 0;
+    }
+
+    AddIndicator(pSearch, TCS_DTYPE_EMAIL, uStart, uEnd);
+    return 1;
+}
+
+
+static int IsPhoneChar(unsigned char c)
+{
+    return IND_IS_DIGIT(c) || c == '*' || c == '#';
+}
+
+
+/**
+ * Expands a phone number around the digits at uPos. Runs glued to letters or
+ * followed by '@' (the local part of an email-address) are ignored.
+ */
+static int ExpandPhone(IndSearch *pSearch, unsigned int uPos)
+{
+    unsigned char const *p = pSearch->pData;
+    unsigned int uStart = uPos;
+    unsigned int uEnd = uPos;
+    unsigned int uDigits = 0;
+
+    while (uStart > pSearch->uFloor && IsPhoneChar(p[uStart - 1]))
+        uStart--;
+    while (uEnd < pSearch->uSize && IsPhoneChar(p[uEnd]))
+    {
+        if (IND_IS_DIGIT(p[uEnd]))
+            uDigits++;
+        uEnd++;
+    }
+
+    /* The whole run has been looked at. */
+    pSearch->uResume = uEnd;
+
+    if (uDigits < IND_MIN_PHONE_DIGITS || uDigits > IND_MAX_PHONE_DIGITS)
+        return 0;
+    if (uStart > 0 && IND_IS_ALPHA(p[uStart - 1]))
+        return 0;
+    if (uEnd < pSearch->uSize && (IND_IS_ALPHA(p[uEnd]) || p[uEnd] == '@'))
+        return 0;
+
+    AddIndicator(pSearch, TCS_DTYPE_PHONE, uStart, uEnd);
+    return 1;
+}
+
+
+static void AddIndicator(IndSearch *pSearch, int iDataType, unsigned int uStart, unsigned int uEnd)
+{
+    if (pSearch->uFound < pSearch->uMax)
+    {
+        TCSIndicator *pIndicator = &pSearch->pIndicators[pSearch->uFound];
+
+        pIndicator->iDataType = iDataType;
+        pIndicator->uOffset = uStart;
+        pIndicator->uLength = uEnd - uStart;
+        pIndicator->pData = (char const *) pSearch->pData + uStart;
+    }
+    pSearch->uFound++;
+    pSearch->uFloor = uEnd;
+    pSearch->uResume = uEnd;
+}
+
+
+static TCSOffset IndicatorGetSize(void *pPrivate)
+{
+    return ((TCSIndicator const *) pPrivate)->uLength;
+}
+
+
+static unsigned int IndicatorRead(void *pPrivate, TCSOffset uOffset, void *pBuffer,
+                                  unsigned int uCount)
+{
+    TCSIndicator const *pIndicator = (TCSIndicator const *) pPrivate;
+
+    if (uOffset >= pIndicator->uLength)
+        return 0;
+    if (uCount > pIndicator->uLength - uOffset)
+        uCount = (unsigned int) (pIndicator->uLength - uOffset);
+    memcpy(pBuffer, pIndicator->pData + uOffset, uCount);
+
+    return uCount;
+}
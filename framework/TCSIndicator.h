@@ -0,0 +1,117 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TCSINDICATOR_H
+#define TCSINDICATOR_H
+
+#include "TCSImpl.h"
+
+#ifdef __cplusplus 
+extern "C" {
+#endif
+
+/**
+ * \file TCSIndicator.h
+ * \brief TCS Indicator Extraction Header File
+ *  
+ * This file provides functions to find URL, email-address and phone number
+ * candidates in TCS_DTYPE_TEXT or TCS_DTYPE_HTML content, so they can be
+ * scanned with the matching TCS data type.
+ *
+ * The buffer is searched for anchors ("://", "www.", '@' and runs of four
+ * digits) 16 or 32 bytes at a time using SSE2, AVX2 or NEON, depending on the
+ * instruction set enabled at compile time (e.g. -mavx2), with a portable
+ * fallback. Candidates are only expanded around the anchors.
+ */
+
+#define TCS_IND_URL 0x01 /* Extract URLs (scheme:// or www. prefixed). */
+
+#define TCS_IND_EMAIL 0x02 /* Extract email-addresses. */
+
+#define TCS_IND_PHONE 0x04 /* Extract phone numbers, i.e. runs of '0' through '9', '#' and '*'
+                              holding 7 to 15 digits. Numbers written with separators
+                              (e.g. "555-0100") are not reported. */
+
+#define TCS_IND_ALL (TCS_IND_URL | TCS_IND_EMAIL | TCS_IND_PHONE) /* Extract all indicators. */
+
+/**
+ * Indicator found in a buffer. The indicator references the scanned buffer
+ * and is not null terminated.
+ */
+typedef struct TCSIndicator_struct
+{
+    int iDataType; /* TCS_DTYPE_URL, TCS_DTYPE_EMAIL or TCS_DTYPE_PHONE. */
+    unsigned int uOffset; /* Offset (in bytes) of the indicator in the buffer. */
+    unsigned int uLength; /* Length (in bytes) of the indicator. */
+    char const *pData; /* Start of the indicator in the buffer. */
+} TCSIndicator;
+
+/**
+ * \brief Finds URL, email-address and phone number candidates in a buffer.
+ *
+ * Indicators are reported in buffer order and never overlap, e.g. an email-
+ * address inside a URL is reported as part of the URL only.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] pBuffer Content to be searched.
+ * \param[in] uSize Size (in bytes) of pBuffer.
+ * \param[in] iTypes Combination of TCS_IND_URL, TCS_IND_EMAIL and TCS_IND_PHONE.
+ * \param[out] pIndicators Array receiving the indicators, may be NULL if uMax is 0.
+ * \param[in] uMax Number of elements in pIndicators.
+ *
+ * \return Return Type (int) \n
+ * Number of indicators found, which may be larger than uMax - on success. \n
+ * -1 - on failure. \n
+ */
+int TCSExtractIndicators(void const *pBuffer, unsigned int uSize, int iTypes,
+                         TCSIndicator *pIndicators, unsigned int uMax);
+
+/**
+ * \brief Prepares scan parameters to scan an indicator with TCSScanData().
+ *
+ * The data type and the I/O functions are set to read the indicator in
+ * place, pIndicator and its buffer must stay valid during the scan.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] pIndicator Indicator returned by TCSExtractIndicators().
+ * \param[out] pParam Scan parameters set for a TCS_SA_SCANONLY scan.
+ *
+ * \return None
+ */
+void TCSIndicatorScanParam(TCSIndicator const *pIndicator, TCSScanParam *pParam);
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif  /* TCSINDICATOR_H */
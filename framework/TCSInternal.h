@@ -0,0 +1,61 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TCSINTERNAL_H
+#define TCSINTERNAL_H
+
+#include "TCSIndicator.h"
+
+#ifdef __cplusplus 
+extern "C" {
+#endif
+
+/**
+ * \file TCSInternal.h
+ * \brief TCS Framework Internal Header File
+ *  
+ * This file is shared by the TCS framework sources and their tests and is
+ * not part of the public interface.
+ */
+
+/**
+ * \brief TCSExtractIndicators() with the portable byte by byte anchor search,
+ * whatever instruction set the library was built for. The results are the
+ * same, this lets the tests check both searches with one build.
+ */
+int TCSExtractIndicatorsScalar(void const *pBuffer, unsigned int uSize, int iTypes,
+                               TCSIndicator *pIndicators, unsigned int uMax);
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif  /* TCSINTERNAL_H */
@@ -0,0 +1,449 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "TCSParallelScan.h"
+#include "TCSResultCodec.h"
+
+
+#if defined(DEBUG)
+#define DEBUG_LOG(_fmt_, _param_...)    { \
+                                            printf("[TCS] %s,%d: " _fmt_, __FILE__, __LINE__, ##_param_); \
+                                        }
+#else
+#define DEBUG_LOG(_fmt_, _param_...)
+#endif
+
+
+/**
+ * A window of the scanned file, passed to the engine as pPrivate.
+ */
+typedef struct ScanWindow_struct
+{
+    int iFd;
+    TCSOffset Start;
+    TCSOffset Length;
+} ScanWindow;
+
+/**
+ * State shared by all the scanning threads of one TCSScanFileParallel() call.
+ */
+typedef struct ParallelScan_struct
+{
+    char const *pszFileName;
+    int iFd;
+    int iDataType;
+    int iCompressFlag;
+    TCSOffset FileSize;
+    TCSOffset WindowSize;
+    TCSOffset Step;
+    unsigned int uWindows;
+
+    pthread_mutex_t Mutex; /* Protects all the fields below. */
+    unsigned int uNextWindow;
+    int iFailed;
+    TCSDetected *pDetected; /* Merged detections, strings are owned by the array. */
+    unsigned int uDetected;
+    unsigned int uMaxDetected;
+} ParallelScan;
+
+typedef struct ScanWorker_struct
+{
+    ParallelScan *pScan;
+    TCSLIB_HANDLE hLib;
+    pthread_t Thread;
+} ScanWorker;
+
+
+static TCSOffset WindowGetSize(void *pPrivate);
+static unsigned int WindowRead(void *pPrivate, TCSOffset uOffset, void *pBuffer, unsigned int uCount);
+static void *ParallelWorker(void *pArg);
+static int ParallelMerge(ParallelScan *pScan, TCSScanResult *pResult);
+static int ParallelSameDetected(ParallelScan *pScan, TCSDetected const *pMerged, TCSDetected const *pNew);
+static int ParallelSameString(char const *pszA, char const *pszB);
+static char *ParallelFileName(char const *pszFileName, char const *pszReported);
+static int ParallelBuildResult(ParallelScan *pScan, TCSScanResult *pResult);
+static void ParallelFreeDetected(ParallelScan *pScan);
+
+
+int TCSScanFileParallel(TCSLIB_HANDLE hLib, char const *pszFileName, int iDataType,
+                        int iAction, int iCompressFlag, TCSParallelParam const *pParallel,
+                        TCSScanResult *pResult)
+{
+    int iRet = -1;
+    long lCpus;
+    unsigned int uThreads, uStarted, i;
+    struct stat FileStat;
+    TCSParallelParam Param;
+    ParallelScan Scan;
+    ScanWorker *pWorkers;
+
+    if (hLib == INVALID_TCSLIB_HANDLE || pszFileName == NULL || pResult == NULL)
+        return -1;
+
+    memset(&Param, 0, sizeof(Param));
+    if (pParallel != NULL)
+        Param = *pParallel;
+    if (Param.WindowSize <= 0)
+        Param.WindowSize = TCS_PARALLEL_DEF_WINDOW;
+    if (Param.Overlap <= 0)
+        Param.Overlap = TCS_PARALLEL_DEF_OVERLAP;
+    if (Param.MinFileSize <= 0)
+        Param.MinFileSize = TCS_PARALLEL_DEF_MIN_SIZE;
+    if (Param.Overlap >= Param.WindowSize)
+        return -1;
+
+    if (iAction != TCS_SA_SCANONLY)
+        return TCSScanFile(hLib, pszFileName, iDataType, iAction, iCompressFlag, pResult);
+
+    memset(&Scan, 0, sizeof(Scan));
+    Scan.iFd = open(pszFileName, O_RDONLY);
+    if (Scan.iFd < 0 || fstat(Scan.iFd, &FileStat) != 0 ||
+        (TCSOffset) FileStat.st_size < Param.MinFileSize ||
+        (TCSOffset) FileStat.st_size <= Param.WindowSize)
+    {
+        /* Let the engine handle small files and report open errors. */
+        if (Scan.iFd >= 0)
+            close(Scan.iFd);
+        return TCSScanFile(hLib, pszFileName, iDataType, iAction, iCompressFlag, pResult);
+    }
+
+    Scan.pszFileName = pszFileName;
+    Scan.iDataType = iDataType;
+    Scan.iCompressFlag = iCompressFlag;
+    Scan.FileSize = (TCSOffset) FileStat.st_size;
+    Scan.WindowSize = Param.WindowSize;
+    Scan.Step = Param.WindowSize - Param.Overlap;
+    Scan.uWindows = (unsigned int) (1 + (Scan.FileSize - Param.WindowSize + Scan.Step - 1) / Scan.Step);
+
+    uThreads = Param.uThreads;
+    if (uThreads == 0)
+    {
+        lCpus = sysconf(_SC_NPROCESSORS_ONLN);
+        uThreads = lCpus > 0 ? (unsigned int) lCpus : 1;
+    }
+    if (uThreads > Scan.uWindows)
+        uThreads = Scan.uWindows;
+
+    pWorkers = (ScanWorker *) calloc(uThreads, sizeof(ScanWorker));
+    if (pWorkers == NULL || pthread_mutex_init(&Scan.Mutex, NULL) != 0)
+    {
+        free(pWorkers);
+        close(Scan.iFd);
+        return -1;
+    }
+
+    DEBUG_LOG("parallel scan of %s: %u windows, %u threads\n", pszFileName, Scan.uWindows, uThreads);
+
+    /* The caller's handle is used by the calling thread, every other thread
+       works on a handle of its own. */
+    pWorkers[0].pScan = &Scan;
+    pWorkers[0].hLib = hLib;
+    for (uStarted = 1; uStarted < uThreads; uStarted++)
+    {
+        pWorkers[uStarted].pScan = &Scan;
+        pWorkers[uStarted].hLib = TCSLibraryOpen();
+        if (pWorkers[uStarted].hLib == INVALID_TCSLIB_HANDLE)
+            break;
+        if (pthread_create(&pWorkers[uStarted].Thread, NULL, ParallelWorker, &pWorkers[uStarted]) != 0)
+        {
+            TCSLibraryClose(pWorkers[uStarted].hLib);
+            break;
+        }
+    }
+
+    ParallelWorker(&pWorkers[0]);
+
+    for (i = 1; i < uStarted; i++)
+    {
+        pthread_join(pWorkers[i].Thread, NULL);
+        TCSLibraryClose(pWorkers[i].hLib);
+    }
+
+    if (!Scan.iFailed)
+        iRet = ParallelBuildResult(&Scan, pResult);
+
+    ParallelFreeDetected(&Scan);
+    pthread_mutex_destroy(&Scan.Mutex);
+    free(pWorkers);
+    close(Scan.iFd);
+
+    return iRet;
+}
+
+
+static TCSOffset WindowGetSize(void *pPrivate)
+{
+    return ((ScanWindow *) pPrivate)->Length;
+}
+
+
+static unsigned int WindowRead(void *pPrivate, TCSOffset uOffset, void *pBuffer, unsigned int uCount)
+{
+    ScanWindow *pWnd = (ScanWindow *) pPrivate;
+    unsigned int uRead = 0;
+    ssize_t Ret;
+
+    if (uOffset < 0 || uOffset >= pWnd->Length)
+        return 0;
+    if ((TCSOffset) uCount > pWnd->Length - uOffset)
+        uCount = (unsigned int) (pWnd->Length - uOffset);
+
+    while (uRead < uCount)
+    {
+        Ret = pread(pWnd->iFd, (char *) pBuffer + uRead, uCount - uRead,
+                    (off_t) (pWnd->Start + uOffset + uRead));
+        if (Ret < 0 && errno == EINTR)
+            continue;
+        if (Ret <= 0)
+            break;
+        uRead += (unsigned int) Ret;
+    }
+
+    return uRead;
+}
+
+
+static void *ParallelWorker(void *pArg)
+{
+    ScanWorker *pWorker = (ScanWorker *) pArg;
+    ParallelScan *pScan = pWorker->pScan;
+    unsigned int uWindow;
+    ScanWindow Window;
+    TCSScanParam SP;
+    TCSScanResult SR;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&pScan->Mutex);
+        if (pScan->iFailed || pScan->uNextWindow >= pScan->uWindows)
+        {
+            pthread_mutex_unlock(&pScan->Mutex);
+            break;
+        }
+        uWindow = pScan->uNextWindow++;
+        pthread_mutex_unlock(&pScan->Mutex);
+
+        Window.iFd = pScan->iFd;
+        Window.Start = (TCSOffset) uWindow * pScan->Step;
+        Window.Length = pScan->FileSize - Window.Start;
+        if (Window.Length > pScan->WindowSize)
+            Window.Length = pScan->WindowSize;
+
+        memset(&SP, 0, sizeof(SP));
+        SP.iAction = TCS_SA_SCANONLY;
+        SP.iDataType = pScan->iDataType;
+        SP.iCompressFlag = pScan->iCompressFlag;
+        SP.pPrivate = &Window;
+        SP.pfGetSize = WindowGetSize;
+        SP.pfRead = WindowRead;
+
+        memset(&SR, 0, sizeof(SR));
+        if (TCSScanData(pWorker->hLib, &SP, &SR) != 0)
+        {
+            DEBUG_LOG("failed to scan window %u\n", uWindow);
+            pthread_mutex_lock(&pScan->Mutex);
+            pScan->iFailed = 1;
+            pthread_mutex_unlock(&pScan->Mutex);
+            break;
+        }
+
+        pthread_mutex_lock(&pScan->Mutex);
+        if (ParallelMerge(pScan, &SR) != 0)
+            pScan->iFailed = 1;
+        pthread_mutex_unlock(&pScan->Mutex);
+
+        if (SR.pfFreeResult != NULL)
+            (*SR.pfFreeResult)(&SR);
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Adds the detections of one window which were not reported by another
+ * window yet. Called with the scan mutex held.
+ */
+static int ParallelMerge(ParallelScan *pScan, TCSScanResult *pResult)
+{
+    unsigned int i;
+    TCSDetected const *pSrc;
+    TCSDetected *pDst;
+
+    for (pSrc = pResult->pDList; pSrc != NULL; pSrc = pSrc->pNext)
+    {
+        for (i = 0; i < pScan->uDetected; i++)
+            if (ParallelSameDetected(pScan, &pScan->pDetected[i], pSrc))
+                break;
+        if (i < pScan->uDetected)
+            continue;
+
+        if (pScan->uDetected == pScan->uMaxDetected)
+        {
+            unsigned int uMax = pScan->uMaxDetected ? pScan->uMaxDetected * 2 : 8;
+            TCSDetected *pTmp = (TCSDetected *) realloc(pScan->pDetected, uMax * sizeof(TCSDetected));
+
+            if (pTmp == NULL)
+                return -1;
+            pScan->pDetected = pTmp;
+            pScan->uMaxDetected = uMax;
+        }
+
+        pDst = &pScan->pDetected[pScan->uDetected];
+        memset(pDst, 0, sizeof(*pDst));
+        pDst->uType = pSrc->uType;
+        pDst->uAction = pSrc->uAction;
+        pDst->pszName = pSrc->pszName != NULL ? strdup(pSrc->pszName) : NULL;
+        pDst->pszVariant = pSrc->pszVariant != NULL ? strdup(pSrc->pszVariant) : NULL;
+        pDst->pszFileName = ParallelFileName(pScan->pszFileName, pSrc->pszFileName);
+        pScan->uDetected++;
+        if ((pSrc->pszName != NULL && pDst->pszName == NULL) ||
+            (pSrc->pszVariant != NULL && pDst->pszVariant == NULL) ||
+            pDst->pszFileName == NULL)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * TCSDetected has no location information, a detection is identified by
+ * its names, type, action flags and archive path.
+ */
+static int ParallelSameDetected(ParallelScan *pScan, TCSDetected const *pMerged, TCSDetected const *pNew)
+{
+    size_t Len = strlen(pScan->pszFileName);
+    char const *pszPath = "";
+
+    if (pMerged->uType != pNew->uType || pMerged->uAction != pNew->uAction ||
+        !ParallelSameString(pMerged->pszName, pNew->pszName) ||
+        !ParallelSameString(pMerged->pszVariant, pNew->pszVariant))
+        return 0;
+
+    /* The merged name is the scanned file name followed by the archive path. */
+    if (pNew->pszFileName != NULL && pNew->pszFileName[0] == '|')
+        pszPath = pNew->pszFileName;
+
+    return strcmp(pMerged->pszFileName + Len, pszPath) == 0;
+}
+
+
+static int ParallelSameString(char const *pszA, char const *pszB)
+{
+    if (pszA == NULL || pszB == NULL)
+        return pszA == pszB;
+
+    return strcmp(pszA, pszB) == 0;
+}
+
+
+/**
+ * TCSScanData() leaves the first path component empty, replace it with the
+ * name of the scanned file.
+ */
+static char *ParallelFileName(char const *pszFileName, char const *pszReported)
+{
+    size_t Len;
+    char *pszName;
+
+    if (pszReported == NULL || pszReported[0] != '|')
+        return strdup(pszFileName);
+
+    Len = strlen(pszFileName);
+    pszName = (char *) malloc(Len + strlen(pszReported) + 1);
+    if (pszName != NULL)
+    {
+        memcpy(pszName, pszFileName, Len);
+        strcpy(pszName + Len, pszReported);
+    }
+
+    return pszName;
+}
+
+
+/**
+ * The merged list is passed through the result codec, which returns it in a
+ * single memory block released by pfFreeResult.
+ */
+static int ParallelBuildResult(ParallelScan *pScan, TCSScanResult *pResult)
+{
+    int iRet;
+    unsigned int i, uLength = 0;
+    void *pBuffer;
+    TCSScanResult Merged;
+
+    for (i = 0; i < pScan->uDetected; i++)
+        pScan->pDetected[i].pNext = i + 1 < pScan->uDetected ? &pScan->pDetected[i + 1] : NULL;
+
+    Merged.iNumDetected = (int) pScan->uDetected;
+    Merged.pDList = pScan->uDetected > 0 ? pScan->pDetected : NULL;
+    Merged.pfFreeResult = NULL;
+
+    TCSScanResultEncode(&Merged, NULL, 0, &uLength);
+    if (uLength == 0 || (pBuffer = malloc(uLength)) == NULL)
+        return -1;
+
+    iRet = TCSScanResultEncode(&Merged, pBuffer, uLength, &uLength);
+    if (iRet == 0)
+        iRet = TCSScanResultDecode(pBuffer, uLength, pResult);
+    free(pBuffer);
+
+    return iRet;
+}
+
+
+static void ParallelFreeDetected(ParallelScan *pScan)
+{
+    unsigned int i;
+
+    for (i = 0; i < pScan->uDetected; i++)
+    {
+        free((char *) pScan->pDetected[i].pszName);
+        free((char *) pScan->pDetected[i].pszVariant);
+        free((char *) pScan->pDetected[i].pszFileName);
+    }
+    free(pScan->pDetected);
+    pScan->pDetected = NULL;
+    pScan->uDetected = 0;
+    pScan->uMaxDetected = 0;
+}
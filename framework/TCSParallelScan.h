@@ -0,0 +1,112 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TCSPARALLELSCAN_H
+#define TCSPARALLELSCAN_H
+
+#include "TCSImpl.h"
+
+#ifdef __cplusplus 
+extern "C" {
+#endif
+
+/**
+ * \file TCSParallelScan.h
+ * \brief TCS Parallel Scan Header File
+ *  
+ * This file provides an opt-in scan mode which splits a large file into
+ * overlapping windows and scans the windows concurrently.
+ */
+
+#define TCS_PARALLEL_DEF_WINDOW (64 * 1024 * 1024) /* Default window size (in bytes). */
+
+#define TCS_PARALLEL_DEF_OVERLAP (1024 * 1024) /* Default window overlap (in bytes). */
+
+#define TCS_PARALLEL_DEF_MIN_SIZE (256 * 1024 * 1024) /* Default minimum file size (in bytes)
+                                                          for windowed scanning. */
+
+/**
+ * Windowing parameters for TCSScanFileParallel(). A zero field selects the
+ * corresponding default value.
+ */
+typedef struct TCSParallelParam_struct
+{
+    unsigned int uThreads; /* Maximum number of concurrent scans, 0 - one per online CPU. */
+
+    TCSOffset WindowSize; /* Size (in bytes) of each window. */
+
+    TCSOffset Overlap; /* Number of bytes shared by two adjacent windows. This must not be less
+                          than the maximum signature length of the installed engine, otherwise
+                          malware crossing a window boundary may be missed. */
+
+    TCSOffset MinFileSize; /* Files smaller than this are scanned by TCSScanFile() in one piece. */
+} TCSParallelParam;
+
+/**
+ * \brief TCSScanFileParallel() scans a large file as a set of overlapping
+ * windows, each window on its own library handle and thread, and merges the
+ * detections into one scan result.
+ *
+ * Each window is passed to the engine with TCSScanData(), so formats which
+ * need the whole file (e.g. archives indexed at the end) are not unpacked in
+ * this mode. A detection reported by several windows, typically because it
+ * lies in an overlap, is reported once. The file name of the scanned file is
+ * set as the first component of pszFileName of each detection.
+ *
+ * The call falls back to TCSScanFile() when the file is smaller than
+ * MinFileSize, when only one window is needed or when iAction is
+ * TCS_SA_SCANREPAIR.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] hLib instance handle obtained from a call to the
+ * TCSLibraryOpen() function. It is used by one of the scanning threads.
+ * \param[in] pszFileName Name of file to scan. The file name must include the
+ * absolute path.
+ * \param[in] iDataType Type of data contained in the file.
+ * \param[in] iAction Type of scanning to perform on file.
+ * \param[in] iCompressFlag 0 - decompression disabled, 1 - decompression enabled.
+ * \param[in] pParallel Windowing parameters, NULL for default values.
+ * \param[out] pResult Pointer to a structure containing data scan results.
+ *
+ * \return Return Type (int) \n
+ * 0 - on success. \n
+ * -1 - on failure. \n
+ */
+int TCSScanFileParallel(TCSLIB_HANDLE hLib, char const *pszFileName, int iDataType,
+                        int iAction, int iCompressFlag, TCSParallelParam const *pParallel,
+                        TCSScanResult *pResult);
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif  /* TCSPARALLELSCAN_H */
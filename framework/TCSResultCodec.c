@@ -0,0 +1,376 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string.h>
+#include <malloc.h>
+
+#include "TCSResultCodec.h"
+
+
+#define CODEC_MAGIC "TCSR"
+#define CODEC_RECORD_FIXED_SIZE 12 /* record size, uType and uAction */
+#define CODEC_STRING_MIN_SIZE 3 /* length field and terminating null character */
+#define CODEC_STRING_MAX_LEN (TCS_CODEC_NULL_STRING - 1)
+
+
+static void CodecPutU16(unsigned char *p, unsigned int uValue);
+static void CodecPutU32(unsigned char *p, unsigned int uValue);
+static unsigned int CodecGetU16(unsigned char const *p);
+static unsigned int CodecGetU32(unsigned char const *p);
+static int CodecStringSize(char const *psz, unsigned int *puSize);
+static unsigned char *CodecPutString(unsigned char *p, char const *psz);
+static unsigned char const *CodecGetString(unsigned char const *p, unsigned char const *pEnd,
+                                           char const **ppsz, unsigned int *puLen);
+static int CodecParseRecord(unsigned char const *p, unsigned char const *pEnd,
+                            TCSDetected *pDetected, unsigned int *puSize, unsigned int *puStrSize);
+static void CodecFreeResult(TCSScanResult *pResult);
+
+
+int TCSScanResultEncode(TCSScanResult const *pResult, void *pBuffer, unsigned int uSize,
+                        unsigned int *puLength)
+{
+    unsigned int uCount = 0, uLength = TCS_CODEC_HEADER_SIZE, uRecSize, uStrSize;
+    TCSDetected const *pDetected;
+    unsigned char *p;
+
+    if (pResult == NULL || puLength == NULL || (pBuffer == NULL && uSize != 0))
+        return -1;
+
+    for (pDetected = pResult->pDList; pDetected != NULL; pDetected = pDetected->pNext)
+    {
+        uRecSize = CODEC_RECORD_FIXED_SIZE;
+        if (CodecStringSize(pDetected->pszName, &uStrSize) != 0)
+            return -1;
+        uRecSize += uStrSize;
+        if (CodecStringSize(pDetected->pszVariant, &uStrSize) != 0)
+            return -1;
+        uRecSize += uStrSize;
+        if (CodecStringSize(pDetected->pszFileName, &uStrSize) != 0)
+            return -1;
+        uRecSize += uStrSize;
+
+        if (uLength + uRecSize < uLength)
+            return -1;
+        uLength += uRecSize;
+        uCount++;
+    }
+
+    *puLength = uLength;
+    if (uSize < uLength)
+        return -1;
+
+    p = (unsigned char *) pBuffer;
+    memcpy(p, CODEC_MAGIC, 4);
+    CodecPutU16(p + 4, TCS_CODEC_VERSION);
+    CodecPutU16(p + 6, TCS_CODEC_HEADER_SIZE);
+    CodecPutU32(p + 8, uCount);
+    CodecPutU32(p + 12, uLength - TCS_CODEC_HEADER_SIZE);
+    p += TCS_CODEC_HEADER_SIZE;
+
+    for (pDetected = pResult->pDList; pDetected != NULL; pDetected = pDetected->pNext)
+    {
+        unsigned char *pRecord = p;
+
+        CodecPutU32(p + 4, pDetected->uType);
+        CodecPutU32(p + 8, pDetected->uAction);
+        p += CODEC_RECORD_FIXED_SIZE;
+        p = CodecPutString(p, pDetected->pszName);
+        p = CodecPutString(p, pDetected->pszVariant);
+        p = CodecPutString(p, pDetected->pszFileName);
+        CodecPutU32(pRecord, (unsigned int) (p - pRecord));
+    }
+
+    return 0;
+}
+
+
+int TCSScanResultDecode(void const *pBuffer, unsigned int uLength, TCSScanResult *pResult)
+{
+    int iCount, i;
+    unsigned int uRecSize, uStrSize, uStrTotal = 0;
+    unsigned char const *p, *pEnd;
+    TCSScanResultView View;
+    TCSDetected *pList, Record;
+    char *pszStrings;
+
+    if (pResult == NULL)
+        return -1;
+
+    if ((iCount = TCSScanResultViewInit(&View, pBuffer, uLength)) < 0)
+        return -1;
+
+    for (p = View.pCur, pEnd = View.pEnd; p < pEnd; p += uRecSize)
+    {
+        CodecParseRecord(p, pEnd, &Record, &uRecSize, &uStrSize);
+        uStrTotal += uStrSize;
+    }
+
+    pList = NULL;
+    if (iCount > 0)
+    {
+        pList = (TCSDetected *) malloc(iCount * sizeof(TCSDetected) + uStrTotal);
+        if (pList == NULL)
+            return -1;
+    }
+    pszStrings = pList != NULL ? (char *) (pList + iCount) : NULL;
+
+    for (i = 0; TCSScanResultViewNext(&View, &Record) > 0; i++)
+    {
+        char const **ppszFields[3];
+        int j;
+
+        ppszFields[0] = &Record.pszName;
+        ppszFields[1] = &Record.pszVariant;
+        ppszFields[2] = &Record.pszFileName;
+        for (j = 0; j < 3; j++)
+        {
+            if (*ppszFields[j] != NULL)
+            {
+                size_t Len = strlen(*ppszFields[j]) + 1;
+
+                memcpy(pszStrings, *ppszFields[j], Len);
+                *ppszFields[j] = pszStrings;
+                pszStrings += Len;
+            }
+        }
+
+        Record.pNext = i + 1 < iCount ? &pList[i + 1] : NULL;
+        pList[i] = Record;
+    }
+
+    pResult->iNumDetected = iCount;
+    pResult->pDList = pList;
+    pResult->pfFreeResult = CodecFreeResult;
+
+    return 0;
+}
+
+
+int TCSScanResultViewInit(TCSScanResultView *pView, void const *pBuffer, unsigned int uLength)
+{
+    unsigned int uCount, uBodySize, uHdrSize, uRecSize, uStrSize, i;
+    unsigned char const *p = (unsigned char const *) pBuffer, *pEnd;
+    TCSDetected Record;
+
+    if (pView == NULL || p == NULL || uLength < TCS_CODEC_HEADER_SIZE ||
+        memcmp(p, CODEC_MAGIC, 4) != 0)
+        return -1;
+
+    /* Later versions only append fields, so any version can be walked
+       as long as the header is not shorter than the one known here. */
+    uHdrSize = CodecGetU16(p + 6);
+    uCount = CodecGetU32(p + 8);
+    uBodySize = CodecGetU32(p + 12);
+    if (CodecGetU16(p + 4) < 1 || uHdrSize < TCS_CODEC_HEADER_SIZE || uHdrSize > uLength ||
+        uBodySize > uLength - uHdrSize || uCount > 0x7fffffff)
+        return -1;
+
+    p += uHdrSize;
+    pEnd = p + uBodySize;
+    pView->pCur = p;
+    pView->pEnd = pEnd;
+
+    for (i = 0; i < uCount; i++, p += uRecSize)
+    {
+        if (CodecParseRecord(p, pEnd, &Record, &uRecSize, &uStrSize) != 0)
+            return -1;
+    }
+    if (p != pEnd)
+        return -1;
+
+    pView->iNumDetected = (int) uCount;
+    pView->iIndex = 0;
+
+    return (int) uCount;
+}
+
+
+int TCSScanResultViewNext(TCSScanResultView *pView, TCSDetected *pDetected)
+{
+    unsigned int uRecSize, uStrSize;
+
+    if (pView == NULL || pDetected == NULL || pView->iIndex >= pView->iNumDetected)
+        return 0;
+
+    if (CodecParseRecord(pView->pCur, pView->pEnd, pDetected, &uRecSize, &uStrSize) != 0)
+        return 0;
+    pView->pCur += uRecSize;
+    pView->iIndex++;
+
+    return 1;
+}
+
+
+static void CodecPutU16(unsigned char *p, unsigned int uValue)
+{
+    p[0] = (unsigned char) uValue;
+    p[1] = (unsigned char) (uValue >> 8);
+}
+
+
+static void CodecPutU32(unsigned char *p, unsigned int uValue)
+{
+    p[0] = (unsigned char) uValue;
+    p[1] = (unsigned char) (uValue >> 8);
+    p[2] = (unsigned char) (uValue >> 16);
+    p[3] = (unsigned char) (uValue >> 24);
+}
+
+
+static unsigned int CodecGetU16(unsigned char const *p)
+{
+    return (unsigned int) p[0] | ((unsigned int) p[1] << 8);
+}
+
+
+static unsigned int CodecGetU32(unsigned char const *p)
+{
+    return (unsigned int) p[0] | ((unsigned int) p[1] << 8) |
+           ((unsigned int) p[2] << 16) | ((unsigned int) p[3] << 24);
+}
+
+
+static int CodecStringSize(char const *psz, unsigned int *puSize)
+{
+    size_t Len;
+
+    if (psz == NULL)
+    {
+        *puSize = 2;
+        return 0;
+    }
+
+    Len = strlen(psz);
+    if (Len > CODEC_STRING_MAX_LEN)
+        return -1;
+    *puSize = (unsigned int) Len + CODEC_STRING_MIN_SIZE;
+
+    return 0;
+}
+
+
+static unsigned char *CodecPutString(unsigned char *p, char const *psz)
+{
+    size_t Len;
+
+    if (psz == NULL)
+    {
+        CodecPutU16(p, TCS_CODEC_NULL_STRING);
+        return p + 2;
+    }
+
+    Len = strlen(psz);
+    CodecPutU16(p, (unsigned int) Len);
+    memcpy(p + 2, psz, Len + 1);
+
+    return p + 2 + Len + 1;
+}
+
+
+static unsigned char const *CodecGetString(unsigned char const *p, unsigned char const *pEnd,
+                                           char const **ppsz, unsigned int *puLen)
+{
+    unsigned int uLen;
+
+    if (pEnd - p < 2)
+        return NULL;
+
+    uLen = CodecGetU16(p);
+    p += 2;
+    if (uLen == TCS_CODEC_NULL_STRING)
+    {
+        *ppsz = NULL;
+        *puLen = 0;
+        return p;
+    }
+    if ((unsigned int) (pEnd - p) < uLen + 1 || p[uLen] != '\0' ||
+        memchr(p, '\0', uLen) != NULL)
+        return NULL;
+
+    *ppsz = (char const *) p;
+    *puLen = uLen;
+
+    return p + uLen + 1;
+}
+
+
+/**
+ * Parses one record and returns its size and the memory needed to copy its
+ * strings. pEnd is the end of the record area.
+ */
+static int CodecParseRecord(unsigned char const *p, unsigned char const *pEnd,
+                            TCSDetected *pDetected, unsigned int *puSize, unsigned int *puStrSize)
+{
+    unsigned int uRecSize, uLen;
+    unsigned char const *pRecEnd, *q;
+
+    if (pEnd - p < CODEC_RECORD_FIXED_SIZE)
+        return -1;
+
+    uRecSize = CodecGetU32(p);
+    if (uRecSize < CODEC_RECORD_FIXED_SIZE || uRecSize > (unsigned int) (pEnd - p))
+        return -1;
+    pRecEnd = p + uRecSize;
+
+    pDetected->pNext = NULL;
+    pDetected->uType = CodecGetU32(p + 4);
+    pDetected->uAction = CodecGetU32(p + 8);
+    *puStrSize = 0;
+
+    q = p + CODEC_RECORD_FIXED_SIZE;
+    if ((q = CodecGetString(q, pRecEnd, &pDetected->pszName, &uLen)) == NULL)
+        return -1;
+    *puStrSize += pDetected->pszName != NULL ? uLen + 1 : 0;
+    if ((q = CodecGetString(q, pRecEnd, &pDetected->pszVariant, &uLen)) == NULL)
+        return -1;
+    *puStrSize += pDetected->pszVariant != NULL ? uLen + 1 : 0;
+    if ((q = CodecGetString(q, pRecEnd, &pDetected->pszFileName, &uLen)) == NULL)
+        return -1;
+    *puStrSize += pDetected->pszFileName != NULL ? uLen + 1 : 0;
+
+    *puSize = uRecSize;
+
+    return 0;
+}
+
+
+/**
+ * The detected list and its strings share the block starting at pDList.
+ */
+static void CodecFreeResult(TCSScanResult *pResult)
+{
+    if (pResult != NULL)
+    {
+        free(pResult->pDList);
+        pResult->pDList = NULL;
+        pResult->iNumDetected = 0;
+    }
+}
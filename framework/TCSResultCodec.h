@@ -0,0 +1,162 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TCSRESULTCODEC_H
+#define TCSRESULTCODEC_H
+
+#include "TCSImpl.h"
+
+#ifdef __cplusplus 
+extern "C" {
+#endif
+
+/**
+ * \file TCSResultCodec.h
+ * \brief TCS Scan Result Codec Header File
+ *  
+ * This file provides functions to encode a TCSScanResult into a flat, versioned
+ * binary buffer and to decode or walk such a buffer again. The encoding can be
+ * stored or transferred (IPC, cache, logging) without walking list pointers.
+ *
+ * All integers are stored little-endian. The buffer starts with a header:
+ *
+ *   magic "TCSR" (4 bytes), version (2 bytes), header size (2 bytes),
+ *   number of records (4 bytes), size of all records in bytes (4 bytes)
+ *
+ * followed by one record per detected malware:
+ *
+ *   record size in bytes including this field (4 bytes), uType (4 bytes),
+ *   uAction (4 bytes), pszName, pszVariant, pszFileName
+ *
+ * Each string is stored as its length (2 bytes, TCS_CODEC_NULL_STRING for a
+ * NULL pointer) followed by the characters and a terminating null character,
+ * so a string can be referenced in place. Decoders skip unknown trailing
+ * record fields by using the record size.
+ */
+
+#define TCS_CODEC_VERSION 1 /* Encoding version produced by TCSScanResultEncode(). */
+
+#define TCS_CODEC_HEADER_SIZE 16 /* Size (in bytes) of the encoding header. */
+
+#define TCS_CODEC_NULL_STRING 0xffff /* String length marking a NULL string pointer. */
+
+/**
+ * Cursor used to walk an encoded scan result in place.
+ */
+typedef struct TCSScanResultView_struct
+{
+    unsigned char const *pCur; /* Next record to be returned. */
+    unsigned char const *pEnd; /* End of the encoded records. */
+    int iNumDetected; /* Number of records in the encoded scan result. */
+    int iIndex; /* Number of records returned so far. */
+} TCSScanResultView;
+
+/**
+ * \brief Encodes a scan result into a caller provided buffer.
+ *
+ * The whole detected list of pResult is written, the iNumDetected field is
+ * not trusted. Call the function with a NULL buffer to query the size needed.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] pResult Scan result returned by TCSScanData() or TCSScanFile().
+ * \param[out] pBuffer Buffer to receive the encoding, may be NULL if uSize is 0.
+ * \param[in] uSize Size (in bytes) of pBuffer.
+ * \param[out] puLength Size (in bytes) of the encoding, set on success and when
+ * pBuffer is too small.
+ *
+ * \return Return Type (int) \n
+ * 0 - on success. \n
+ * -1 - on failure (invalid parameter, buffer too small or a string too long). \n
+ */
+int TCSScanResultEncode(TCSScanResult const *pResult, void *pBuffer, unsigned int uSize,
+                        unsigned int *puLength);
+
+/**
+ * \brief Decodes an encoded scan result into a TCSScanResult.
+ *
+ * The detected list and all of its strings are placed into one memory block,
+ * no per field allocation is made. The result must be released by calling its
+ * pfFreeResult function, exactly as a result returned by TCSScanData().
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] pBuffer Encoded scan result.
+ * \param[in] uLength Size (in bytes) of pBuffer.
+ * \param[out] pResult Decoded scan result.
+ *
+ * \return Return Type (int) \n
+ * 0 - on success. \n
+ * -1 - on failure (malformed or unsupported encoding, insufficient memory). \n
+ */
+int TCSScanResultDecode(void const *pBuffer, unsigned int uLength, TCSScanResult *pResult);
+
+/**
+ * \brief Validates an encoded scan result and prepares a view to walk it in
+ * place.
+ *
+ * The encoded buffer must stay valid and unchanged as long as the view and
+ * the records returned by TCSScanResultViewNext() are in use.
+ *
+ * This is a synchronous API.
+ *
+ * \param[out] pView View to be initialized.
+ * \param[in] pBuffer Encoded scan result.
+ * \param[in] uLength Size (in bytes) of pBuffer.
+ *
+ * \return Return Type (int) \n
+ * Number of records - on success. \n
+ * -1 - on failure (malformed or unsupported encoding). \n
+ */
+int TCSScanResultViewInit(TCSScanResultView *pView, void const *pBuffer, unsigned int uLength);
+
+/**
+ * \brief Returns the next record of a view without copying.
+ *
+ * The string fields of pDetected point into the encoded buffer and pNext is
+ * set to NULL.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] pView View initialized by TCSScanResultViewInit().
+ * \param[out] pDetected Record information.
+ *
+ * \return Return Type (int) \n
+ * 1 - a record is returned. \n
+ * 0 - no more records. \n
+ */
+int TCSScanResultViewNext(TCSScanResultView *pView, TCSDetected *pDetected);
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif  /* TCSRESULTCODEC_H */
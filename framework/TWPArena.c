@@ -0,0 +1,373 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "TWPArena.h"
+#include "TWPInternal.h"
+
+#if defined(DEBUG)
+#define DEBUG_LOG(_fmt_, _param_...)    { \
+                                            printf("[TWP] %s,%d: " _fmt_, __FILE__, __LINE__, ##_param_); \
+                                        }
+#else
+#define DEBUG_LOG(_fmt_, _param_...)
+#endif
+
+
+#define ARENA_ALIGN 16
+
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1))
+
+#define BLOCK_HEADER ARENA_ROUND(sizeof(FwBlock))
+
+#define BLOCK_DATA(b) ((char *) (b) + BLOCK_HEADER)
+
+/**
+ * Arena block, the allocations follow the header.
+ */
+typedef struct FwBlock_struct
+{
+    struct FwBlock_struct *pNext;
+    size_t uSize; /* Bytes after the header. */
+    size_t uUsed;
+} FwBlock;
+
+/**
+ * Arena of a response, kept at the start of its first block. Allocations
+ * are bump-allocated from the first block of the list, larger allocations
+ * have their own block after it.
+ */
+struct FwArena_struct
+{
+    TWPArenaPool *pPool;
+    FwBlock *pBlocks;
+    unsigned long ulAllocations;
+    unsigned long ulRequestedBytes;
+    unsigned long ulUsedBytes;
+    unsigned long ulEarlyFrees;
+};
+
+struct TWPArenaPool_struct
+{
+    pthread_mutex_t Lock;
+    size_t uBlockSize;
+    unsigned int uMaxPooled;
+    FwBlock *pFree;
+    TWPArenaStats Stats;
+};
+
+
+static FwBlock *GetBlock(TWPArenaPool *pPool, size_t uSize);
+static int OwnsAddress(FwArena const *pArena, void const *pAddress);
+
+
+static TWPFnMemAlloc pfHeapAlloc = NULL;
+static TWPFnMemFree pfHeapFree = NULL;
+
+/* Arena the plug-in calls of this thread belong to. */
+static __thread FwArena *pScopeArena = NULL;
+static __thread int iScopeAllocate = 0;
+
+
+TWP_RESULT TWPArenaConfigure(TWPLIB_HANDLE hLib, TWPArenaParam const *pParam)
+{
+    SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    TWPArenaPool *pPool = NULL;
+
+    if (pCtx == NULL)
+        return TWP_INVALID_HANDLE;
+
+    if (pParam != NULL)
+    {
+        pPool = (TWPArenaPool *) calloc(1, sizeof(TWPArenaPool));
+        if (pPool == NULL)
+            return TWP_NOMEM;
+        pthread_mutex_init(&pPool->Lock, NULL);
+        pPool->uBlockSize = ARENA_ROUND(pParam->uBlockSize != 0 ? pParam->uBlockSize : TWP_ARENA_DEF_BLOCK_SIZE);
+        if (pPool->uBlockSize < 4 * ARENA_ROUND(sizeof(FwArena)))
+            pPool->uBlockSize = 4 * ARENA_ROUND(sizeof(FwArena));
+        pPool->uMaxPooled = pParam->uPooledBlocks != 0 ? pParam->uPooledBlocks : TWP_ARENA_DEF_POOLED_BLOCKS;
+    }
+
+    if (pCtx->pArenaPool != NULL)
+        TWPArenaPoolDestroy(pCtx->pArenaPool);
+    pCtx->pArenaPool = pPool;
+
+    return TWP_SUCCESS;
+}
+
+TWP_RESULT TWPArenaGetStats(TWPLIB_HANDLE hLib, TWPArenaStats *pStats)
+{
+    SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    TWPArenaPool *pPool;
+
+    if (pCtx == NULL)
+        return TWP_INVALID_HANDLE;
+
+    if (pStats == NULL)
+        return TWP_INVALID_PARAMETER;
+
+    pPool = pCtx->pArenaPool;
+    if (pPool == NULL)
+    {
+        memset(pStats, 0, sizeof(TWPArenaStats));
+        return TWP_SUCCESS;
+    }
+
+    pthread_mutex_lock(&pPool->Lock);
+    *pStats = pPool->Stats;
+    pthread_mutex_unlock(&pPool->Lock);
+
+    return TWP_SUCCESS;
+}
+
+
+void TWPArenaPoolDestroy(TWPArenaPool *pPool)
+{
+    FwBlock *pBlock;
+
+    while ((pBlock = pPool->pFree) != NULL)
+    {
+        pPool->pFree = pBlock->pNext;
+        free(pBlock);
+    }
+    pthread_mutex_destroy(&pPool->Lock);
+    free(pPool);
+}
+
+
+void TWPArenaSetAllocator(TWPFnMemAlloc pfMemAlloc, TWPFnMemFree pfMemFree)
+{
+    pfHeapAlloc = pfMemAlloc;
+    pfHeapFree = pfMemFree;
+}
+
+
+void *TWPArenaMemAlloc(TWPMallocSizeT Size)
+{
+    FwArena *pArena = pScopeArena;
+    FwBlock *pBlock;
+    size_t uRounded;
+    void *pAddress;
+
+    if (pArena == NULL || !iScopeAllocate)
+        return pfHeapAlloc != NULL ? (*pfHeapAlloc)(Size) : malloc(Size);
+
+    if (Size > SIZE_MAX / 2)
+        return NULL;
+
+    uRounded = ARENA_ROUND(Size != 0 ? Size : 1);
+    pBlock = pArena->pBlocks;
+    if (pBlock->uSize - pBlock->uUsed < uRounded)
+    {
+        pBlock = GetBlock(pArena->pPool, uRounded);
+        if (pBlock == NULL)
+            return NULL;
+        if (uRounded > pArena->pPool->uBlockSize / 4)
+        {
+            /* Keep filling the current block. */
+            pBlock->pNext = pArena->pBlocks->pNext;
+            pArena->pBlocks->pNext = pBlock;
+        }
+        else
+        {
+            pBlock->pNext = pArena->pBlocks;
+            pArena->pBlocks = pBlock;
+        }
+    }
+
+    pAddress = BLOCK_DATA(pBlock) + pBlock->uUsed;
+    pBlock->uUsed += uRounded;
+    pArena->ulAllocations++;
+    pArena->ulRequestedBytes += Size;
+    pArena->ulUsedBytes += uRounded;
+
+    return pAddress;
+}
+
+
+void TWPArenaMemFree(void *pAddress)
+{
+    FwArena *pArena = pScopeArena;
+
+    if (pAddress == NULL)
+        return;
+
+    if (pArena != NULL && OwnsAddress(pArena, pAddress))
+    {
+        /* Released with the response. */
+        if (iScopeAllocate)
+            pArena->ulEarlyFrees++;
+        return;
+    }
+
+    if (pfHeapFree != NULL)
+        (*pfHeapFree)(pAddress);
+    else
+        free(pAddress);
+}
+
+
+FwArena *TWPArenaCreate(TWPArenaPool *pPool)
+{
+    FwBlock *pBlock;
+    FwArena *pArena;
+
+    pBlock = GetBlock(pPool, 0);
+    if (pBlock == NULL)
+        return NULL;
+
+    pArena = (FwArena *) BLOCK_DATA(pBlock);
+    memset(pArena, 0, sizeof(FwArena));
+    pBlock->pNext = NULL;
+    pBlock->uUsed = ARENA_ROUND(sizeof(FwArena));
+    pArena->pPool = pPool;
+    pArena->pBlocks = pBlock;
+
+    pthread_mutex_lock(&pPool->Lock);
+    pPool->Stats.ulLiveArenas++;
+    pthread_mutex_unlock(&pPool->Lock);
+
+    return pArena;
+}
+
+
+void TWPArenaRelease(FwArena *pArena)
+{
+    TWPArenaPool *pPool = pArena->pPool;
+    FwBlock *pBlock = pArena->pBlocks;
+    FwBlock *pNext;
+
+    pthread_mutex_lock(&pPool->Lock);
+    pPool->Stats.ulResponses++;
+    pPool->Stats.ulAllocations += pArena->ulAllocations;
+    pPool->Stats.ulRequestedBytes += pArena->ulRequestedBytes;
+    pPool->Stats.ulUsedBytes += pArena->ulUsedBytes;
+    pPool->Stats.ulEarlyFrees += pArena->ulEarlyFrees;
+    pPool->Stats.ulLiveArenas--;
+
+    /* The arena lives in one of the blocks, it is not read in the loop. */
+    for (; pBlock != NULL; pBlock = pNext)
+    {
+        pNext = pBlock->pNext;
+        if (pBlock->uSize == pPool->uBlockSize)
+        {
+            pPool->Stats.ulUnusedBytes += pBlock->uSize - pBlock->uUsed;
+            if (pPool->Stats.ulPooledBlocks < pPool->uMaxPooled)
+            {
+                pBlock->pNext = pPool->pFree;
+                pPool->pFree = pBlock;
+                pPool->Stats.ulPooledBlocks++;
+                continue;
+            }
+        }
+        pPool->Stats.ulReservedBlocks--;
+        pPool->Stats.ulReservedBytes -= pBlock->uSize;
+        free(pBlock);
+    }
+    pthread_mutex_unlock(&pPool->Lock);
+}
+
+
+void TWPArenaEnter(FwArena *pArena, int iAllocate, FwArenaScope *pSaved)
+{
+    pSaved->pArena = pScopeArena;
+    pSaved->iAllocate = iScopeAllocate;
+    pScopeArena = pArena;
+    iScopeAllocate = iAllocate;
+}
+
+
+void TWPArenaLeave(FwArenaScope const *pSaved)
+{
+    pScopeArena = pSaved->pArena;
+    iScopeAllocate = pSaved->iAllocate;
+}
+
+
+/**
+ * Takes a block from the pool, or allocates a block of at least uSize bytes.
+ * Blocks of the pool size are returned to the pool by TWPArenaRelease().
+ */
+static FwBlock *GetBlock(TWPArenaPool *pPool, size_t uSize)
+{
+    FwBlock *pBlock = NULL;
+
+    if (uSize <= pPool->uBlockSize / 4)
+        uSize = pPool->uBlockSize;
+
+    pthread_mutex_lock(&pPool->Lock);
+    if (uSize == pPool->uBlockSize && pPool->pFree != NULL)
+    {
+        pBlock = pPool->pFree;
+        pPool->pFree = pBlock->pNext;
+        pPool->Stats.ulPooledBlocks--;
+    }
+    pthread_mutex_unlock(&pPool->Lock);
+
+    if (pBlock == NULL)
+    {
+        pBlock = (FwBlock *) malloc(BLOCK_HEADER + uSize);
+        if (pBlock == NULL)
+            return NULL;
+        pBlock->uSize = uSize;
+        DEBUG_LOG("arena: new block of %lu bytes\n", (unsigned long) uSize);
+
+        pthread_mutex_lock(&pPool->Lock);
+        pPool->Stats.ulReservedBlocks++;
+        pPool->Stats.ulReservedBytes += uSize;
+        pthread_mutex_unlock(&pPool->Lock);
+    }
+    pBlock->pNext = NULL;
+    pBlock->uUsed = 0;
+
+    return pBlock;
+}
+
+
+static int OwnsAddress(FwArena const *pArena, void const *pAddress)
+{
+    FwBlock const *pBlock;
+    char const *pByte = (char const *) pAddress;
+
+    for (pBlock = pArena->pBlocks; pBlock != NULL; pBlock = pBlock->pNext)
+    {
+        if (pByte >= BLOCK_DATA(pBlock) && pByte < BLOCK_DATA(pBlock) + pBlock->uUsed)
+            return 1;
+    }
+
+    return 0;
+}
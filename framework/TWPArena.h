@@ -0,0 +1,131 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TWPARENA_H
+#define TWPARENA_H
+
+#include "TWPImpl.h"
+
+#ifdef __cplusplus 
+extern "C" {
+#endif
+
+/**
+ * \file TWPArena.h
+ * \brief TWP Response Arena Header File
+ *  
+ * This file provides functions to serve the plug-in allocations of a
+ * response from an arena released with the response.
+ *
+ * The framework gives the plug-in its own allocator, which forwards to the
+ * allocator given to TWPInitLibrary(). When arenas are enabled, the memory
+ * the plug-in allocates while a synchronous TWPLookupUrls() call without
+ * landing page (iRedirUrl is 0) looks up its URLs is bump-allocated from
+ * blocks owned by the response. Frees of this memory are ignored, the blocks
+ * are returned to a pool when TWPResponseDestroy() releases the response.
+ * Memory handed to the caller, such as category lists, still comes from the
+ * caller's allocator.
+ *
+ * Arenas are only usable with plug-ins which do not keep memory allocated
+ * during a lookup once its response is destroyed, and which free it only in
+ * the lookup or in TWPResponseDestroy(). They are not used when lookups are
+ * coalesced, see TWPCoalesce.h.
+ */
+
+#define TWP_ARENA_DEF_BLOCK_SIZE 4096 /* Default size (in bytes) of an arena block. */
+
+#define TWP_ARENA_DEF_POOLED_BLOCKS 64 /* Default number of free blocks kept for later responses. */
+
+/**
+ * Arena settings.
+ */
+typedef struct TWPArenaParam_struct
+{
+    unsigned int uBlockSize; /* Block size in bytes, 0 for TWP_ARENA_DEF_BLOCK_SIZE. */
+    unsigned int uPooledBlocks; /* Free blocks kept, 0 for TWP_ARENA_DEF_POOLED_BLOCKS. */
+} TWPArenaParam;
+
+/**
+ * Arena usage since arenas were configured. The allocation counters cover the
+ * destroyed responses, the block counters are current. Allocations larger
+ * than a quarter of a block get a block of their own, which is not pooled.
+ */
+typedef struct TWPArenaStats_struct
+{
+    unsigned long ulResponses; /* Destroyed responses which were served with an arena. */
+    unsigned long ulAllocations; /* Plug-in allocations of these responses. */
+    unsigned long ulRequestedBytes; /* Bytes requested by these allocations. */
+    unsigned long ulUsedBytes; /* Bytes used by these allocations, alignment included. */
+    unsigned long ulUnusedBytes; /* Bytes left at the end of their blocks. */
+    unsigned long ulEarlyFrees; /* Allocations freed before their response was destroyed. */
+    unsigned long ulLiveArenas; /* Arenas of the responses not destroyed yet. */
+    unsigned long ulReservedBlocks; /* Blocks of the live arenas and of the pool. */
+    unsigned long ulReservedBytes; /* Bytes of these blocks. */
+    unsigned long ulPooledBlocks; /* Free blocks in the pool. */
+} TWPArenaStats;
+
+/**
+ * \brief Enables, changes or disables the response arenas of a library
+ * handle.
+ *
+ * Arenas are disabled by default. This must not be called while other
+ * threads use the library handle, nor while responses served with an arena
+ * are alive.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] hLib Library handle returned by TWPInitLibrary().
+ * \param[in] pParam Arena settings, NULL to disable arenas.
+ *
+ * \return TWP_RESULT
+ */
+TWP_RESULT TWPArenaConfigure(TWPLIB_HANDLE hLib, TWPArenaParam const *pParam);
+
+/**
+ * \brief Gets the arena usage of a library handle.
+ *
+ * The counters are zero while arenas are disabled, they are reset when
+ * arenas are configured.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] hLib Library handle returned by TWPInitLibrary().
+ * \param[out] pStats Arena usage.
+ *
+ * \return TWP_RESULT
+ */
+TWP_RESULT TWPArenaGetStats(TWPLIB_HANDLE hLib, TWPArenaStats *pStats);
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif  /* TWPARENA_H */
@@ -0,0 +1,1258 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "TWPAsync.h"
+#include "TWPInternal.h"
+
+
+#if defined(DEBUG)
+#define DEBUG_LOG(_fmt_, _param_...)    { \
+                                            printf("[TWP] %s,%d: " _fmt_, __FILE__, __LINE__, ##_param_); \
+                                        }
+#else
+#define DEBUG_LOG(_fmt_, _param_...)
+#endif
+
+
+#define ASYNC_EVENTS 64 /* Events taken by one epoll_wait(). */
+
+#define ASYNC_ADDRESSES 8 /* Resolved servers kept by the event loop. */
+
+#define ASYNC_ADDRESS_TTL 60000 /* Lifetime (in milliseconds) of a resolved server. */
+
+#define ASYNC_FAILURE_TTL 5000 /* Lifetime (in milliseconds) of a failed resolution. */
+
+#define ASYNC_INPUT 4096 /* Receive buffer of a lookup, also bounds the reply header. */
+
+/*
+ * Parts of the reply the event loop is waiting for.
+ */
+#define READ_HEADER 0
+#define READ_LENGTH 1 /* Body of Content-Length bytes. */
+#define READ_CLOSE 2 /* Body ended by the server closing the connection. */
+#define READ_CHUNK_SIZE 3
+#define READ_CHUNK_DATA 4
+#define READ_CHUNK_END 5
+#define READ_TRAILER 6
+
+/*
+ * States of a server address.
+ */
+#define ADDRESS_FREE 0
+#define ADDRESS_QUEUED 1 /* Waiting for the resolver thread. */
+#define ADDRESS_RESOLVING 2
+#define ADDRESS_RESOLVED 3
+#define ADDRESS_FAILED 4
+
+
+/**
+ * Lookup handed to the event loop. The plug-in gets the embedded request and
+ * calls back with it.
+ */
+typedef struct FwLookup_struct
+{
+    TWPRequest Request; /* Must be first. */
+    struct FwLookup_struct *pNext;
+    struct FwLookup_struct *pPrev;
+    TWPAsyncLoop *pLoop;
+    TWPFnLookupDone pfDone;
+    void *pContext;
+    unsigned int uFlags; /* TWP_SUBMIT_ flags. */
+    TWP_RESULT Result;
+    TWPResponseHandle hResponse; /* Plug-in response being written. */
+    char *pszUrl; /* Set by the plug-in. */
+    char *pOut; /* HTTP request. */
+    unsigned int uOutLength;
+    unsigned int uOutSent;
+    char szHost[256];
+    char szPort[8];
+    struct sockaddr_storage Address;
+    socklen_t AddressLength;
+    int iResolving; /* Waiting for the address of the server. */
+    int iUnsupported; /* The plug-in URL is not plain HTTP. */
+    int iSocket;
+    int iSending;
+    int64_t iDeadline; /* Monotonic time (in milliseconds) the lookup fails at. */
+    uint64_t uSubmitted; /* TWPStatsClock() when the caller asked for the lookup. */
+    uint64_t uPhase; /* TWPStatsClock() when the current phase started. */
+    unsigned int uUrls;
+    int iRead; /* READ_ state. */
+    unsigned long ulRemaining; /* Bytes left in the body or chunk. */
+    unsigned int uInLength;
+    char In[ASYNC_INPUT];
+} FwLookup;
+
+/**
+ * Server address, resolved by the resolver thread.
+ */
+typedef struct FwAddress_struct
+{
+    char szHost[256];
+    char szPort[8];
+    int iState; /* ADDRESS_ state. */
+    struct sockaddr_storage Address;
+    socklen_t AddressLength;
+    int64_t iExpires;
+} FwAddress;
+
+struct TWPAsyncLoop_struct
+{
+    SitePluginContext *pCtx;
+    pthread_t Thread;
+    pthread_t Resolver;
+    pthread_mutex_t Lock;
+    pthread_cond_t Queued; /* Signaled on addresses to resolve and stop. */
+    int iEpollFd;
+    int iWakeFd; /* Signaled on new lookups and stop. */
+    int iEventFd; /* Signaled on completions, -1 if the callbacks run on the loop thread. */
+    unsigned int uTimeout;
+    int iStop;
+    int iResolved; /* The resolver thread finished an address since the loop last looked. */
+    FwLookup *pSubmitted; /* Lookups not yet taken by the loop, newest first. */
+    FwLookup *pCompleted; /* Lookups waiting for TWPAsyncDispatch(), newest first. */
+    FwLookup *pFirst; /* Lookups in flight, by deadline. Only used by the loop thread. */
+    FwLookup *pLast;
+    FwAddress Addresses[ASYNC_ADDRESSES];
+};
+
+
+static TWP_RESULT AsyncSetUrl(TWPRequest *pRequest, const char *pszUrl, unsigned int uLength);
+static TWP_RESULT AsyncSetMethod(TWPRequest *pRequest, TWPSubmitMethod Method);
+static TWP_RESULT AsyncSend(TWPRequest *pRequest, TWPResponseHandle hResponse, const void *pData,
+                            unsigned int uLength);
+static int FindAddress(TWPAsyncLoop *pLoop, FwLookup *pLookup);
+static void *RunResolver(void *pArg);
+static void *RunLoop(void *pArg);
+static void StartLookup(TWPAsyncLoop *pLoop, FwLookup *pLookup);
+static void Resume(TWPAsyncLoop *pLoop, FwLookup *pLookup);
+static void Connect(TWPAsyncLoop *pLoop, FwLookup *pLookup);
+static void Progress(TWPAsyncLoop *pLoop, FwLookup *pLookup);
+static int ParseInput(TWPAsyncLoop *pLoop, FwLookup *pLookup);
+static int ParseHeader(FwLookup *pLookup, char *pHeader, unsigned int uLength);
+static int FindText(char const *pData, unsigned int uStart, unsigned int uLength, char const *pszText);
+static TWP_RESULT WriteResponse(SitePluginContext *pCtx, FwLookup *pLookup, const void *pData, unsigned int uLength);
+static void Finish(TWPAsyncLoop *pLoop, FwLookup *pLookup, TWP_RESULT Result);
+static void Complete(TWPAsyncLoop *pLoop, FwLookup *pLookup);
+static void RunCallbacks(FwLookup *pList);
+static void FreeLookup(FwLookup *pLookup);
+static int64_t Now(void);
+
+
+TWP_RESULT TWPAsyncConfigure(TWPLIB_HANDLE hLib, TWPAsyncParam const *pParam, int *piEventFd)
+{
+    SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    TWPAsyncLoop *pLoop = NULL;
+    struct epoll_event Event;
+
+    if (pCtx == NULL)
+        return TWP_INVALID_HANDLE;
+
+    if (piEventFd != NULL)
+        *piEventFd = -1;
+
+    if (pCtx->pAsync != NULL)
+    {
+        TWPAsyncDestroy(pCtx->pAsync);
+        pCtx->pAsync = NULL;
+    }
+
+    if (pParam == NULL)
+        return TWP_SUCCESS;
+
+    pLoop = (TWPAsyncLoop *) calloc(1, sizeof(TWPAsyncLoop));
+    if (pLoop == NULL)
+        return TWP_NOMEM;
+    pLoop->pCtx = pCtx;
+    pLoop->uTimeout = pParam->uTimeout != 0 ? pParam->uTimeout : TWP_ASYNC_DEF_TIMEOUT;
+    pLoop->iEventFd = -1;
+    pLoop->iEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    pLoop->iWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((pParam->uFlags & TWP_ASYNC_EVENTFD) != 0)
+        pLoop->iEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    memset(&Event, 0, sizeof(Event));
+    Event.events = EPOLLIN;
+    Event.data.ptr = NULL;
+    if (pLoop->iEpollFd < 0 || pLoop->iWakeFd < 0 ||
+        ((pParam->uFlags & TWP_ASYNC_EVENTFD) != 0 && pLoop->iEventFd < 0) ||
+        epoll_ctl(pLoop->iEpollFd, EPOLL_CTL_ADD, pLoop->iWakeFd, &Event) != 0)
+    {
+        if (pLoop->iEpollFd >= 0)
+            close(pLoop->iEpollFd);
+        if (pLoop->iWakeFd >= 0)
+            close(pLoop->iWakeFd);
+        if (pLoop->iEventFd >= 0)
+            close(pLoop->iEventFd);
+        free(pLoop);
+        return TWP_ERROR;
+    }
+
+    pthread_mutex_init(&pLoop->Lock, NULL);
+    pthread_cond_init(&pLoop->Queued, NULL);
+    if (pthread_create(&pLoop->Resolver, NULL, RunResolver, pLoop) != 0)
+    {
+        pthread_cond_destroy(&pLoop->Queued);
+        pthread_mutex_destroy(&pLoop->Lock);
+        close(pLoop->iEpollFd);
+        close(pLoop->iWakeFd);
+        if (pLoop->iEventFd >= 0)
+            close(pLoop->iEventFd);
+        free(pLoop);
+        return TWP_ERROR;
+    }
+    if (pthread_create(&pLoop->Thread, NULL, RunLoop, pLoop) != 0)
+    {
+        pthread_mutex_lock(&pLoop->Lock);
+        pLoop->iStop = 1;
+        pthread_cond_signal(&pLoop->Queued);
+        pthread_mutex_unlock(&pLoop->Lock);
+        pthread_join(pLoop->Resolver, NULL);
+        pthread_cond_destroy(&pLoop->Queued);
+        pthread_mutex_destroy(&pLoop->Lock);
+        close(pLoop->iEpollFd);
+        close(pLoop->iWakeFd);
+        if (pLoop->iEventFd >= 0)
+            close(pLoop->iEventFd);
+        free(pLoop);
+        return TWP_ERROR;
+    }
+
+    pCtx->pAsync = pLoop;
+    if (piEventFd != NULL)
+        *piEventFd = pLoop->iEventFd;
+
+    return TWP_SUCCESS;
+}
+
+
+void TWPAsyncDestroy(TWPAsyncLoop *pLoop)
+{
+    uint64_t uValue = 1;
+
+    pthread_mutex_lock(&pLoop->Lock);
+    pLoop->iStop = 1;
+    pthread_cond_signal(&pLoop->Queued);
+    pthread_mutex_unlock(&pLoop->Lock);
+    if (write(pLoop->iWakeFd, &uValue, sizeof(uValue)) < 0)
+    {
+        DEBUG_LOG("async: failed to wake the event loop (%d)\n", errno);
+    }
+    pthread_join(pLoop->Thread, NULL);
+    /* A resolution in progress is not cut short, its thread ends after it. */
+    pthread_join(pLoop->Resolver, NULL);
+
+    /* The loop ended all lookups, the queued ones complete here */
+    RunCallbacks(pLoop->pCompleted);
+
+    pthread_cond_destroy(&pLoop->Queued);
+    pthread_mutex_destroy(&pLoop->Lock);
+    close(pLoop->iEpollFd);
+    close(pLoop->iWakeFd);
+    if (pLoop->iEventFd >= 0)
+        close(pLoop->iEventFd);
+    free(pLoop);
+}
+
+
+TWP_RESULT TWPLookupUrlsAsync(TWPLIB_HANDLE hLib, TWPConfigurationHandle hConfigure, int iRedirUrl,
+                              const char **ppUrls, unsigned int uCount, TWPFnLookupDone pfDone,
+                              void *pContext)
+{
+    SitePluginContext *pCtx = (SitePluginContext *) hLib;
+
+    if (pCtx == NULL || pCtx->pfLookupUrls == NULL)
+        return TWP_NOT_IMPLEMENTED;
+
+    if (pfDone == NULL)
+        return TWP_INVALID_PARAMETER;
+
+    return TWPAsyncSubmit(pCtx, hConfigure, iRedirUrl, ppUrls, uCount, pfDone, pContext, 0);
+}
+
+
+TWP_RESULT TWPAsyncDispatch(TWPLIB_HANDLE hLib)
+{
+    SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    TWPAsyncLoop *pLoop;
+    FwLookup *pList;
+    uint64_t uValue;
+
+    if (pCtx == NULL)
+        return TWP_INVALID_HANDLE;
+
+    pLoop = pCtx->pAsync;
+    if (pLoop == NULL || pLoop->iEventFd < 0)
+        return TWP_ERROR;
+
+    pthread_mutex_lock(&pLoop->Lock);
+    if (read(pLoop->iEventFd, &uValue, sizeof(uValue)) < 0 && errno != EAGAIN)
+    {
+        DEBUG_LOG("async: failed to clear the eventfd (%d)\n", errno);
+    }
+    pList = pLoop->pCompleted;
+    pLoop->pCompleted = NULL;
+    pthread_mutex_unlock(&pLoop->Lock);
+
+    RunCallbacks(pList);
+
+    return TWP_SUCCESS;
+}
+
+
+TWP_RESULT TWPAsyncSubmit(SitePluginContext *pCtx, TWPConfigurationHandle hConfigure, int iRedirUrl,
+                          const char **ppUrls, unsigned int uCount, TWPFnLookupDone pfDone, void *pContext,
+                          unsigned int uFlags)
+{
+    TWPAsyncLoop *pLoop;
+    FwLookup *pLookup;
+    TWPResponseHandle hResponse = NULL;
+    TWP_RESULT Result;
+    uint64_t uValue = 1;
+    int iStopped;
+
+    pLoop = pCtx->pAsync;
+    if (pLoop == NULL)
+        return TWP_ERROR;
+
+    pLookup = (FwLookup *) calloc(1, sizeof(FwLookup));
+    if (pLookup == NULL)
+        return TWP_NOMEM;
+    pLookup->Request.request_version = TWPREQUEST_VERSION;
+    pLookup->Request.seturlfunc = AsyncSetUrl;
+    pLookup->Request.setmethodfunc = AsyncSetMethod;
+    pLookup->Request.sendfunc = AsyncSend;
+    pLookup->Request.receivefunc = NULL;
+    pLookup->pLoop = pLoop;
+    pLookup->pfDone = pfDone;
+    pLookup->pContext = pContext;
+    pLookup->uFlags = uFlags;
+    pLookup->iSocket = -1;
+    pLookup->uSubmitted = TWPStatsClock();
+    pLookup->uUrls = uCount;
+    if ((uFlags & TWP_SUBMIT_INTERNAL) != 0)
+        TWP_STATS_ADD(pCtx, ulInternalLookups, 1);
+
+    Result = (*pCtx->pfLookupUrls)(hConfigure, &pLookup->Request, iRedirUrl, ppUrls, uCount, &hResponse);
+    pLookup->uPhase = TWPStatsAddPhase(pCtx, TWP_PHASE_PARSE, pLookup->uSubmitted);
+    if (Result == TWP_SUCCESS && pLookup->hResponse == NULL)
+    {
+        /* Answered without a request, e.g. from the plug-in cache */
+        if (hResponse == NULL)
+            Result = TWP_ERROR;
+        pLookup->hResponse = hResponse;
+        pLookup->iRead = -1;
+    }
+    if (Result != TWP_SUCCESS)
+    {
+        /* The caller may fall back to its own transport. */
+        if (pLookup->iUnsupported)
+            Result = TWP_NOT_IMPLEMENTED;
+        if ((uFlags & TWP_SUBMIT_INTERNAL) == 0)
+            TWPStatsLookup(pCtx, uCount, Result);
+        FreeLookup(pLookup);
+        return Result;
+    }
+
+    /* Callbacks run while stopping may not start new lookups, the loop would not see them. */
+    pthread_mutex_lock(&pLoop->Lock);
+    iStopped = pLoop->iStop;
+    if (!iStopped)
+    {
+        pLookup->pNext = pLoop->pSubmitted;
+        pLoop->pSubmitted = pLookup;
+    }
+    pthread_mutex_unlock(&pLoop->Lock);
+    if (iStopped)
+    {
+        (*pCtx->pfResponseDestroy)(&pLookup->hResponse);
+        FreeLookup(pLookup);
+        return TWP_ERROR;
+    }
+    if (write(pLoop->iWakeFd, &uValue, sizeof(uValue)) < 0)
+    {
+        DEBUG_LOG("async: failed to wake the event loop (%d)\n", errno);
+    }
+
+    return TWP_SUCCESS;
+}
+
+
+static TWP_RESULT AsyncSetUrl(TWPRequest *pRequest, const char *pszUrl, unsigned int uLength)
+{
+    FwLookup *pLookup = (FwLookup *) pRequest;
+
+    if (pszUrl == NULL)
+        return TWP_INVALID_PARAMETER;
+
+    free(pLookup->pszUrl);
+    pLookup->pszUrl = (char *) malloc(uLength + 1);
+    if (pLookup->pszUrl == NULL)
+        return TWP_NOMEM;
+    memcpy(pLookup->pszUrl, pszUrl, uLength);
+    pLookup->pszUrl[uLength] = 0;
+
+    return TWP_SUCCESS;
+}
+
+
+static TWP_RESULT AsyncSetMethod(TWPRequest *pRequest, TWPSubmitMethod Method)
+{
+    (void) pRequest;
+
+    return Method == TWPPOST ? TWP_SUCCESS : TWP_INVALID_PARAMETER;
+}
+
+
+/**
+ * \brief Finds the server of the plug-in URL and formats the HTTP request,
+ * the event loop sends it. The server is resolved by the resolver thread, the
+ * caller does not wait for it.
+ */
+static TWP_RESULT AsyncSend(TWPRequest *pRequest, TWPResponseHandle hResponse, const void *pData,
+                            unsigned int uLength)
+{
+    FwLookup *pLookup = (FwLookup *) pRequest;
+    char const *pszAuthority;
+    char const *pszHost;
+    char const *pszPath;
+    unsigned int uAuthority;
+    unsigned int uHost;
+    char const *pPort = NULL;
+    int iFound;
+    int iHeader;
+
+    if (pLookup->pszUrl == NULL || (pData == NULL && uLength != 0))
+        return TWP_INVALID_PARAMETER;
+
+    if (strncasecmp(pLookup->pszUrl, "https://", 8) == 0)
+    {
+        pLookup->iUnsupported = 1;
+        return TWP_NOT_IMPLEMENTED;
+    }
+    if (strncasecmp(pLookup->pszUrl, "http://", 7) != 0)
+        return TWP_INVALID_PARAMETER;
+
+    pszAuthority = pLookup->pszUrl + 7;
+    uAuthority = strcspn(pszAuthority, "/?#");
+    pszPath = pszAuthority[uAuthority] == '/' ? pszAuthority + uAuthority : "/";
+
+    if (pszAuthority[0] == '[')
+    {
+        char const *pEnd = memchr(pszAuthority, ']', uAuthority);
+
+        if (pEnd == NULL)
+            return TWP_INVALID_PARAMETER;
+        pszHost = pszAuthority + 1;
+        uHost = pEnd - pszHost;
+        if (pEnd + 1 < pszAuthority + uAuthority && pEnd[1] == ':')
+            pPort = pEnd + 2;
+    }
+    else
+    {
+        pszHost = pszAuthority;
+        pPort = memchr(pszAuthority, ':', uAuthority);
+        uHost = pPort != NULL ? (unsigned int) (pPort - pszAuthority) : uAuthority;
+        if (pPort != NULL)
+            pPort++;
+    }
+
+    if (uHost == 0 || uHost >= sizeof(pLookup->szHost))
+        return TWP_INVALID_PARAMETER;
+    memcpy(pLookup->szHost, pszHost, uHost);
+    pLookup->szHost[uHost] = 0;
+    if (pPort != NULL && pPort < pszAuthority + uAuthority)
+    {
+        unsigned int uPort = pszAuthority + uAuthority - pPort;
+
+        if (uPort >= sizeof(pLookup->szPort))
+            return TWP_INVALID_PARAMETER;
+        memcpy(pLookup->szPort, pPort, uPort);
+        pLookup->szPort[uPort] = 0;
+    }
+    else
+    {
+        strcpy(pLookup->szPort, "80");
+    }
+
+    iFound = FindAddress(pLookup->pLoop, pLookup);
+    if (iFound < 0)
+        return TWP_ERROR;
+    pLookup->iResolving = iFound == 0;
+
+    free(pLookup->pOut);
+    pLookup->pOut = (char *) malloc(strlen(pszPath) + uAuthority + uLength + 128);
+    if (pLookup->pOut == NULL)
+        return TWP_NOMEM;
+    iHeader = sprintf(pLookup->pOut,
+                      "POST %s HTTP/1.1\r\nHost: %.*s\r\nContent-Length: %u\r\nConnection: close\r\n\r\n",
+                      pszPath, (int) uAuthority, pszAuthority, uLength);
+    if (uLength != 0)
+        memcpy(pLookup->pOut + iHeader, pData, uLength);
+    pLookup->uOutLength = iHeader + uLength;
+    pLookup->hResponse = hResponse;
+
+    return TWP_SUCCESS;
+}
+
+
+/**
+ * \brief Looks up the address of the server of a lookup, queuing it for the
+ * resolver thread when it is not known yet.
+ *
+ * \return Return Type (int) \n
+ * 1 - if the address is in pLookup->Address. \n
+ * 0 - if the address is being resolved. \n
+ * -1 - if the server could not be resolved. \n
+ */
+static int FindAddress(TWPAsyncLoop *pLoop, FwLookup *pLookup)
+{
+    FwAddress *pAddress;
+    FwAddress *pFree = NULL;
+    int64_t iNow = Now();
+    int iFound = 0;
+    unsigned int i;
+
+    pthread_mutex_lock(&pLoop->Lock);
+    for (i = 0; i < ASYNC_ADDRESSES; i++)
+    {
+        pAddress = &pLoop->Addresses[i];
+        if (pAddress->iState == ADDRESS_QUEUED || pAddress->iState == ADDRESS_RESOLVING)
+        {
+            if (strcmp(pAddress->szHost, pLookup->szHost) == 0 && strcmp(pAddress->szPort, pLookup->szPort) == 0)
+                break;
+            continue;
+        }
+        if (pAddress->iState != ADDRESS_FREE && pAddress->iExpires > iNow &&
+            strcmp(pAddress->szHost, pLookup->szHost) == 0 && strcmp(pAddress->szPort, pLookup->szPort) == 0)
+        {
+            iFound = pAddress->iState == ADDRESS_RESOLVED ? 1 : -1;
+            memcpy(&pLookup->Address, &pAddress->Address, pAddress->AddressLength);
+            pLookup->AddressLength = pAddress->AddressLength;
+            break;
+        }
+        /* Addresses being resolved are never replaced, the others in turn. */
+        if (pFree == NULL || (pFree->iState != ADDRESS_FREE &&
+                              (pAddress->iState == ADDRESS_FREE || pAddress->iExpires < pFree->iExpires)))
+            pFree = pAddress;
+    }
+    if (i == ASYNC_ADDRESSES)
+    {
+        if (pFree != NULL)
+        {
+            strcpy(pFree->szHost, pLookup->szHost);
+            strcpy(pFree->szPort, pLookup->szPort);
+            pFree->iState = ADDRESS_QUEUED;
+            pthread_cond_signal(&pLoop->Queued);
+        }
+        else
+        {
+            DEBUG_LOG("async: too many servers being resolved\n");
+            iFound = -1;
+        }
+    }
+    pthread_mutex_unlock(&pLoop->Lock);
+
+    return iFound;
+}
+
+
+/**
+ * \brief Resolves the queued servers one at a time so neither the callers
+ * nor the event loop wait for getaddrinfo().
+ */
+static void *RunResolver(void *pArg)
+{
+    TWPAsyncLoop *pLoop = (TWPAsyncLoop *) pArg;
+    struct addrinfo Hints;
+    struct addrinfo *pInfo;
+    FwAddress *pAddress;
+    char szHost[256];
+    char szPort[8];
+    uint64_t uValue = 1;
+    unsigned int i;
+    int iRet;
+
+    memset(&Hints, 0, sizeof(Hints));
+    Hints.ai_family = AF_UNSPEC;
+    Hints.ai_socktype = SOCK_STREAM;
+
+    pthread_mutex_lock(&pLoop->Lock);
+    while (!pLoop->iStop)
+    {
+        for (i = 0; i < ASYNC_ADDRESSES && pLoop->Addresses[i].iState != ADDRESS_QUEUED; i++)
+            ;
+        if (i == ASYNC_ADDRESSES)
+        {
+            pthread_cond_wait(&pLoop->Queued, &pLoop->Lock);
+            continue;
+        }
+        pAddress = &pLoop->Addresses[i];
+        pAddress->iState = ADDRESS_RESOLVING;
+        strcpy(szHost, pAddress->szHost);
+        strcpy(szPort, pAddress->szPort);
+        pthread_mutex_unlock(&pLoop->Lock);
+
+        pInfo = NULL;
+        iRet = getaddrinfo(szHost, szPort, &Hints, &pInfo);
+
+        pthread_mutex_lock(&pLoop->Lock);
+        if (iRet == 0 && pInfo != NULL && pInfo->ai_addrlen <= sizeof(pAddress->Address))
+        {
+            memcpy(&pAddress->Address, pInfo->ai_addr, pInfo->ai_addrlen);
+            pAddress->AddressLength = pInfo->ai_addrlen;
+            pAddress->iState = ADDRESS_RESOLVED;
+            pAddress->iExpires = Now() + ASYNC_ADDRESS_TTL;
+        }
+        else
+        {
+            DEBUG_LOG("async: failed to resolve %s\n", szHost);
+            pAddress->AddressLength = 0;
+            pAddress->iState = ADDRESS_FAILED;
+            pAddress->iExpires = Now() + ASYNC_FAILURE_TTL;
+        }
+        pLoop->iResolved = 1;
+        if (pInfo != NULL)
+            freeaddrinfo(pInfo);
+        if (write(pLoop->iWakeFd, &uValue, sizeof(uValue)) < 0)
+        {
+            DEBUG_LOG("async: failed to wake the event loop (%d)\n", errno);
+        }
+    }
+    pthread_mutex_unlock(&pLoop->Lock);
+
+    return NULL;
+}
+
+
+static void *RunLoop(void *pArg)
+{
+    TWPAsyncLoop *pLoop = (TWPAsyncLoop *) pArg;
+    struct epoll_event Events[ASYNC_EVENTS];
+    FwLookup *pLookup;
+    FwLookup *pNext;
+    FwLookup *pOrdered;
+    int iStop = 0;
+    int iResolved;
+    int iTimeout;
+    int iCount;
+    int i;
+
+    while (!iStop)
+    {
+        iTimeout = -1;
+        if (pLoop->pFirst != NULL)
+        {
+            int64_t iLeft = pLoop->pFirst->iDeadline - Now();
+
+            iTimeout = iLeft > 0 ? (int) iLeft : 0;
+        }
+
+        iCount = epoll_wait(pLoop->iEpollFd, Events, ASYNC_EVENTS, iTimeout);
+        if (iCount < 0 && errno != EINTR)
+        {
+            DEBUG_LOG("async: epoll_wait failed (%d)\n", errno);
+            break;
+        }
+
+        for (i = 0; i < iCount; i++)
+        {
+            if (Events[i].data.ptr != NULL)
+            {
+                Progress(pLoop, (FwLookup *) Events[i].data.ptr);
+                continue;
+            }
+
+            {
+                uint64_t uValue;
+
+                if (read(pLoop->iWakeFd, &uValue, sizeof(uValue)) < 0 && errno != EAGAIN)
+                {
+                    DEBUG_LOG("async: failed to clear the wake eventfd (%d)\n", errno);
+                }
+            }
+            pthread_mutex_lock(&pLoop->Lock);
+            pLookup = pLoop->pSubmitted;
+            pLoop->pSubmitted = NULL;
+            iStop = pLoop->iStop;
+            iResolved = pLoop->iResolved;
+            pLoop->iResolved = 0;
+            pthread_mutex_unlock(&pLoop->Lock);
+
+            /* Start the lookups in the order they were made */
+            for (pOrdered = NULL; pLookup != NULL; pLookup = pNext)
+            {
+                pNext = pLookup->pNext;
+                pLookup->pNext = pOrdered;
+                pOrdered = pLookup;
+            }
+            for (pLookup = pOrdered; pLookup != NULL; pLookup = pNext)
+            {
+                pNext = pLookup->pNext;
+                StartLookup(pLoop, pLookup);
+            }
+
+            /* Lookups waiting for a server connect once it is resolved */
+            for (pLookup = iResolved ? pLoop->pFirst : NULL; pLookup != NULL; pLookup = pNext)
+            {
+                pNext = pLookup->pNext;
+                if (pLookup->iResolving)
+                    Resume(pLoop, pLookup);
+            }
+        }
+
+        while (pLoop->pFirst != NULL && pLoop->pFirst->iDeadline <= Now())
+        {
+            DEBUG_LOG("async: lookup timed out\n");
+            Finish(pLoop, pLoop->pFirst, TWP_ERROR);
+        }
+    }
+
+    while (pLoop->pFirst != NULL)
+        Finish(pLoop, pLoop->pFirst, TWP_ERROR);
+
+    return NULL;
+}
+
+
+static void StartLookup(TWPAsyncLoop *pLoop, FwLookup *pLookup)
+{
+    pLookup->uPhase = TWPStatsAddPhase(pLoop->pCtx, TWP_PHASE_QUEUE, pLookup->uPhase);
+    pLookup->iDeadline = Now() + pLoop->uTimeout;
+    pLookup->pNext = NULL;
+    pLookup->pPrev = pLoop->pLast;
+    if (pLoop->pLast != NULL)
+        pLoop->pLast->pNext = pLookup;
+    else
+        pLoop->pFirst = pLookup;
+    pLoop->pLast = pLookup;
+
+    if (pLookup->iRead < 0)
+    {
+        Finish(pLoop, pLookup, TWP_SUCCESS);
+        return;
+    }
+
+    /* The server may have been resolved since the lookup was made */
+    if (pLookup->iResolving)
+        Resume(pLoop, pLookup);
+    else
+        Connect(pLoop, pLookup);
+}
+
+
+/**
+ * \brief Connects a lookup waiting for its server once the resolver thread
+ * is done with it.
+ */
+static void Resume(TWPAsyncLoop *pLoop, FwLookup *pLookup)
+{
+    int iFound = FindAddress(pLoop, pLookup);
+
+    if (iFound == 0)
+        return;
+    pLookup->iResolving = 0;
+    if (iFound > 0)
+        Connect(pLoop, pLookup);
+    else
+        Finish(pLoop, pLookup, TWP_ERROR);
+}
+
+
+/**
+ * \brief Connects a lookup to its resolved server, the request is sent once
+ * the socket is writable.
+ */
+static void Connect(TWPAsyncLoop *pLoop, FwLookup *pLookup)
+{
+    struct epoll_event Event;
+
+    TWP_STATS_ADD(pLoop->pCtx, ulRequests, 1);
+    pLookup->iSocket = socket(pLookup->Address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (pLookup->iSocket < 0 ||
+        (connect(pLookup->iSocket, (struct sockaddr *) &pLookup->Address, pLookup->AddressLength) != 0 &&
+         errno != EINPROGRESS))
+    {
+        DEBUG_LOG("async: failed to connect (%d)\n", errno);
+        Finish(pLoop, pLookup, TWP_ERROR);
+        return;
+    }
+
+    memset(&Event, 0, sizeof(Event));
+    Event.events = EPOLLOUT;
+    Event.data.ptr = pLookup;
+    pLookup->iSending = 1;
+    if (epoll_ctl(pLoop->iEpollFd, EPOLL_CTL_ADD, pLookup->iSocket, &Event) != 0)
+        Finish(pLoop, pLookup, TWP_ERROR);
+}
+
+
+/**
+ * \brief Sends the request or reads the reply of a lookup as far as the
+ * socket allows.
+ */
+static void Progress(TWPAsyncLoop *pLoop, FwLookup *pLookup)
+{
+    SitePluginContext *pCtx = pLoop->pCtx;
+    struct epoll_event Event;
+    ssize_t lDone;
+    int iRet;
+
+    if (pLookup->iSending)
+    {
+        int iError = 0;
+        socklen_t ErrorLength = sizeof(iError);
+
+        if (pLookup->uOutSent == 0 &&
+            (getsockopt(pLookup->iSocket, SOL_SOCKET, SO_ERROR, &iError, &ErrorLength) != 0 || iError != 0))
+        {
+            DEBUG_LOG("async: failed to connect (%d)\n", iError);
+            Finish(pLoop, pLookup, TWP_ERROR);
+            return;
+        }
+
+        while (pLookup->uOutSent < pLookup->uOutLength)
+        {
+            lDone = send(pLookup->iSocket, pLookup->pOut + pLookup->uOutSent,
+                         pLookup->uOutLength - pLookup->uOutSent, MSG_NOSIGNAL);
+            if (lDone < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    Finish(pLoop, pLookup, TWP_ERROR);
+                return;
+            }
+            pLookup->uOutSent += lDone;
+            TWP_STATS_ADD(pCtx, ulBytesSent, lDone);
+        }
+        pLookup->uPhase = TWPStatsAddPhase(pCtx, TWP_PHASE_SEND, pLookup->uPhase);
+
+        memset(&Event, 0, sizeof(Event));
+        Event.events = EPOLLIN;
+        Event.data.ptr = pLookup;
+        pLookup->iSending = 0;
+        pLookup->iRead = READ_HEADER;
+        if (epoll_ctl(pLoop->iEpollFd, EPOLL_CTL_MOD, pLookup->iSocket, &Event) != 0)
+            Finish(pLoop, pLookup, TWP_ERROR);
+        return;
+    }
+
+    for (;;)
+    {
+        lDone = recv(pLookup->iSocket, pLookup->In + pLookup->uInLength,
+                     sizeof(pLookup->In) - pLookup->uInLength, 0);
+        if (lDone < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                Finish(pLoop, pLookup, TWP_ERROR);
+            return;
+        }
+
+        if (lDone == 0)
+        {
+            iRet = pLookup->iRead == READ_CLOSE ? 1 : -1;
+            pLookup->Result = TWP_ERROR;
+        }
+        else
+        {
+            TWP_STATS_ADD(pCtx, ulBytesReceived, lDone);
+            pLookup->uInLength += lDone;
+            iRet = ParseInput(pLoop, pLookup);
+        }
+
+        if (iRet > 0)
+        {
+            Finish(pLoop, pLookup, WriteResponse(pCtx, pLookup, "", 0));
+            return;
+        }
+        if (iRet < 0)
+        {
+            Finish(pLoop, pLookup, pLookup->Result);
+            return;
+        }
+    }
+}
+
+
+/**
+ * \brief Writes the body bytes received so far to the plug-in response.
+ *
+ * \return Return Type (int) \n
+ * 0 - if more input is needed. \n
+ * 1 - if the reply is complete. \n
+ * -1 - on error, the reason is in pLookup->Result. \n
+ */
+static int ParseInput(TWPAsyncLoop *pLoop, FwLookup *pLookup)
+{
+    SitePluginContext *pCtx = pLoop->pCtx;
+    char *pIn = pLookup->In;
+    unsigned int uPos = 0;
+    unsigned int uAvail;
+    unsigned int uStart;
+    unsigned long ulSize;
+    TWP_RESULT Result;
+    int iLine;
+    int iRet = 0;
+    int iWait = 0;
+
+    pLookup->Result = TWP_ERROR;
+    while (iRet == 0 && !iWait)
+    {
+        uAvail = pLookup->uInLength - uPos;
+        switch (pLookup->iRead)
+        {
+        case READ_HEADER:
+            iLine = FindText(pIn, 0, pLookup->uInLength, "\r\n\r\n");
+            if (iLine < 0)
+            {
+                iRet = pLookup->uInLength == sizeof(pLookup->In) ? -1 : 0;
+                iWait = 1;
+                break;
+            }
+            iRet = ParseHeader(pLookup, pIn, iLine + 2);
+            uPos = iLine + 4;
+            if (iRet == 0 && pLookup->iRead == READ_LENGTH && pLookup->ulRemaining == 0)
+                iRet = 1;
+            break;
+
+        case READ_LENGTH:
+        case READ_CLOSE:
+        case READ_CHUNK_DATA:
+            if (uAvail == 0)
+            {
+                iWait = 1;
+                break;
+            }
+            if (pLookup->iRead != READ_CLOSE && uAvail > pLookup->ulRemaining)
+                uAvail = pLookup->ulRemaining;
+            Result = WriteResponse(pCtx, pLookup, pIn + uPos, uAvail);
+            if (Result != TWP_SUCCESS)
+            {
+                pLookup->Result = Result;
+                iRet = -1;
+                break;
+            }
+            uPos += uAvail;
+            if (pLookup->iRead == READ_CLOSE)
+                break;
+            pLookup->ulRemaining -= uAvail;
+            if (pLookup->ulRemaining == 0)
+            {
+                if (pLookup->iRead == READ_LENGTH)
+                    iRet = 1;
+                else
+                    pLookup->iRead = READ_CHUNK_END;
+            }
+            break;
+
+        case READ_CHUNK_SIZE:
+            iLine = FindText(pIn, uPos, pLookup->uInLength, "\r\n");
+            if (iLine < 0)
+            {
+                iRet = uPos == 0 && pLookup->uInLength == sizeof(pLookup->In) ? -1 : 0;
+                iWait = 1;
+                break;
+            }
+            uStart = uPos;
+            for (ulSize = 0; uPos < (unsigned int) iLine; uPos++)
+            {
+                int iDigit = pIn[uPos] >= '0' && pIn[uPos] <= '9' ? pIn[uPos] - '0' :
+                             (pIn[uPos] | 0x20) >= 'a' && (pIn[uPos] | 0x20) <= 'f' ? (pIn[uPos] | 0x20) - 'a' + 10 : -1;
+
+                if (iDigit < 0)
+                    break;
+                if (ulSize > (unsigned long) -1 >> 4)
+                    iRet = -1;
+                ulSize = (ulSize << 4) | iDigit;
+            }
+            if (uPos == uStart)
+                iRet = -1;
+            uPos = iLine + 2;
+            pLookup->ulRemaining = ulSize;
+            pLookup->iRead = ulSize != 0 ? READ_CHUNK_DATA : READ_TRAILER;
+            break;
+
+        case READ_CHUNK_END:
+            if (uAvail < 2)
+            {
+                iWait = 1;
+                break;
+            }
+            if (pIn[uPos] != '\r' || pIn[uPos + 1] != '\n')
+                iRet = -1;
+            uPos += 2;
+            pLookup->iRead = READ_CHUNK_SIZE;
+            break;
+
+        case READ_TRAILER:
+            iLine = FindText(pIn, uPos, pLookup->uInLength, "\r\n");
+            if (iLine < 0)
+            {
+                iRet = uPos == 0 && pLookup->uInLength == sizeof(pLookup->In) ? -1 : 0;
+                iWait = 1;
+                break;
+            }
+            if ((unsigned int) iLine == uPos)
+                iRet = 1;
+            uPos = iLine + 2;
+            break;
+
+        default:
+            iRet = -1;
+            break;
+        }
+    }
+
+    memmove(pIn, pIn + uPos, pLookup->uInLength - uPos);
+    pLookup->uInLength -= uPos;
+
+    return iRet;
+}
+
+
+/**
+ * \brief Checks the status line of a reply and finds how its body ends.
+ *
+ * \param[in] pHeader Status line and header fields, each ending with CRLF.
+ * The byte following them is overwritten.
+ *
+ * \return Return Type (int) \n
+ * 0 - on success. \n
+ * -1 - if the reply is malformed or not successful. \n
+ */
+static int ParseHeader(FwLookup *pLookup, char *pHeader, unsigned int uLength)
+{
+    char *pLine;
+    char *pEnd;
+    char *pValue;
+    int iStatus;
+    int iChunked = 0;
+
+    pHeader[uLength] = 0;
+    if (uLength < 12 || strncmp(pHeader, "HTTP/1.", 7) != 0 || pHeader[8] != ' ')
+        return -1;
+
+    iStatus = atoi(pHeader + 9);
+    if (iStatus < 200 || iStatus > 299)
+    {
+        DEBUG_LOG("async: server replied %d\n", iStatus);
+        return -1;
+    }
+
+    pLookup->iRead = READ_CLOSE;
+    for (pLine = strstr(pHeader, "\r\n"); pLine != NULL; pLine = pEnd)
+    {
+        pLine += 2;
+        pEnd = strstr(pLine, "\r\n");
+        if (pEnd == NULL)
+            break;
+
+        if (strncasecmp(pLine, "Content-Length:", 15) == 0)
+        {
+            pLookup->ulRemaining = strtoul(pLine + 15, &pValue, 10);
+            if (pValue == pLine + 15)
+                return -1;
+            pLookup->iRead = READ_LENGTH;
+        }
+        else if (strncasecmp(pLine, "Transfer-Encoding:", 18) == 0)
+        {
+            for (pValue = pLine + 18; pValue + 7 <= pEnd; pValue++)
+            {
+                if (strncasecmp(pValue, "chunked", 7) == 0)
+                    iChunked = 1;
+            }
+        }
+    }
+
+    /* The transfer coding wins over the length */
+    if (iChunked)
+        pLookup->iRead = READ_CHUNK_SIZE;
+
+    return 0;
+}
+
+
+/**
+ * \brief Finds a text in pData[uStart, uLength).
+ *
+ * \return Offset of the text, -1 if not found.
+ */
+static int FindText(char const *pData, unsigned int uStart, unsigned int uLength, char const *pszText)
+{
+    unsigned int uText = strlen(pszText);
+    unsigned int i;
+
+    for (i = uStart; i + uText <= uLength; i++)
+    {
+        if (pData[i] == pszText[0] && memcmp(pData + i, pszText, uText) == 0)
+            return (int) i;
+    }
+
+    return -1;
+}
+
+
+/**
+ * \brief Hands reply bytes to the plug-in response, timing the parse.
+ */
+static TWP_RESULT WriteResponse(SitePluginContext *pCtx, FwLookup *pLookup, const void *pData, unsigned int uLength)
+{
+    uint64_t uStart = TWPStatsClock();
+    TWP_RESULT Result;
+
+    Result = (*pCtx->pfResponseWrite)(pLookup->hResponse, pData, uLength);
+    TWPStatsAddPhase(pCtx, TWP_PHASE_PARSE, uStart);
+
+    return Result;
+}
+
+
+/**
+ * \brief Ends a lookup in flight, the plug-in response is kept on success
+ * only.
+ */
+static void Finish(TWPAsyncLoop *pLoop, FwLookup *pLookup, TWP_RESULT Result)
+{
+    SitePluginContext *pCtx = pLoop->pCtx;
+
+    if (pLookup->pPrev != NULL)
+        pLookup->pPrev->pNext = pLookup->pNext;
+    else
+        pLoop->pFirst = pLookup->pNext;
+    if (pLookup->pNext != NULL)
+        pLookup->pNext->pPrev = pLookup->pPrev;
+    else
+        pLoop->pLast = pLookup->pPrev;
+
+    if (pLookup->uOutLength != 0 && pLookup->uOutSent == pLookup->uOutLength && !pLookup->iSending)
+        TWPStatsAddPhase(pCtx, TWP_PHASE_RECEIVE, pLookup->uPhase);
+    /* Lookups of the library itself are only counted in ulInternalLookups. */
+    if ((pLookup->uFlags & TWP_SUBMIT_INTERNAL) == 0)
+    {
+        TWPStatsLookup(pCtx, pLookup->uUrls, Result);
+        TWPStatsAddPhase(pCtx, TWP_PHASE_LOOKUP, pLookup->uSubmitted);
+    }
+
+    if (pLookup->iSocket >= 0)
+    {
+        close(pLookup->iSocket);
+        pLookup->iSocket = -1;
+    }
+
+    if (Result != TWP_SUCCESS && pLookup->hResponse != NULL)
+    {
+        (*pCtx->pfResponseDestroy)(&pLookup->hResponse);
+        pLookup->hResponse = NULL;
+    }
+    pLookup->Result = Result;
+
+    Complete(pLoop, pLookup);
+}
+
+
+static void Complete(TWPAsyncLoop *pLoop, FwLookup *pLookup)
+{
+    uint64_t uValue = 1;
+
+    if (pLoop->iEventFd < 0 || (pLookup->uFlags & TWP_SUBMIT_ON_LOOP) != 0)
+    {
+        pLookup->pNext = NULL;
+        RunCallbacks(pLookup);
+        return;
+    }
+
+    pthread_mutex_lock(&pLoop->Lock);
+    pLookup->pNext = pLoop->pCompleted;
+    pLoop->pCompleted = pLookup;
+    pthread_mutex_unlock(&pLoop->Lock);
+    if (write(pLoop->iEventFd, &uValue, sizeof(uValue)) < 0)
+    {
+        DEBUG_LOG("async: failed to signal the eventfd (%d)\n", errno);
+    }
+}
+
+
+/**
+ * \brief Calls and releases a list of completed lookups, newest first.
+ */
+static void RunCallbacks(FwLookup *pList)
+{
+    FwLookup *pOrdered = NULL;
+    FwLookup *pNext;
+
+    for (; pList != NULL; pList = pNext)
+    {
+        pNext = pList->pNext;
+        pList->pNext = pOrdered;
+        pOrdered = pList;
+    }
+
+    for (; pOrdered != NULL; pOrdered = pNext)
+    {
+        pNext = pOrdered->pNext;
+        (*pOrdered->pfDone)(pOrdered->pContext, pOrdered->Result, pOrdered->hResponse);
+        FreeLookup(pOrdered);
+    }
+}
+
+
+static void FreeLookup(FwLookup *pLookup)
+{
+    free(pLookup->pszUrl);
+    free(pLookup->pOut);
+    free(pLookup);
+}
+
+
+static int64_t Now(void)
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+
+    return (int64_t) Time.tv_sec * 1000 + Time.tv_nsec / 1000000;
+}
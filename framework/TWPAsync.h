@@ -0,0 +1,145 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TWPASYNC_H
+#define TWPASYNC_H
+
+#include "TWPImpl.h"
+
+#ifdef __cplusplus 
+extern "C" {
+#endif
+
+/**
+ * \file TWPAsync.h
+ * \brief TWP Asynchronous Lookup Header File
+ *  
+ * This file provides functions to look up URLs without blocking the caller.
+ *
+ * The lookups are sent by an event loop thread of the library handle, which
+ * does the HTTP exchange itself, so a single thread can have many lookups in
+ * flight. The transport speaks plain HTTP/1.1 with one connection per lookup,
+ * plug-ins configured for HTTPS are not supported. The servers are resolved
+ * by a resolver thread of the library handle, neither the caller nor the
+ * event loop waits for the DNS.
+ *
+ * Each lookup ends with a call to its completion callback. By default the
+ * callbacks run on the event loop thread and must not block. With
+ * TWP_ASYNC_EVENTFD, the completions are queued instead and signaled on an
+ * eventfd the caller polls, TWPAsyncDispatch() then runs the callbacks in the
+ * calling thread.
+ *
+ * Asynchronous lookups bypass the rating cache and coalescing.
+ */
+
+#define TWP_ASYNC_DEF_TIMEOUT 30000 /* Default time limit (in milliseconds) of a lookup. */
+
+#define TWP_ASYNC_EVENTFD 0x1 /* Queue the completions and signal them on an eventfd. */
+
+/**
+ * \brief Completion callback of TWPLookupUrlsAsync().
+ *
+ * \param[in] pContext Context given to TWPLookupUrlsAsync().
+ * \param[in] Result TWP_SUCCESS, or the reason of the failure.
+ * \param[in] hResponse Response on success, NULL otherwise. It belongs to the
+ * callback and is released with TWPResponseDestroy().
+ */
+typedef void (*TWPFnLookupDone)(void *pContext, TWP_RESULT Result, TWPResponseHandle hResponse);
+
+/**
+ * Event loop settings.
+ */
+typedef struct TWPAsyncParam_struct
+{
+    unsigned int uFlags; /* TWP_ASYNC_ flags. */
+    unsigned int uTimeout; /* Time limit (in milliseconds) of a lookup, 0 for TWP_ASYNC_DEF_TIMEOUT. */
+} TWPAsyncParam;
+
+/**
+ * \brief Starts, restarts or stops the event loop of a library handle.
+ *
+ * The event loop is stopped by default. Stopping it ends the lookups in
+ * flight with TWP_ERROR and runs all pending callbacks before returning. This
+ * must not be called while other threads use the library handle.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] hLib Library handle returned by TWPInitLibrary().
+ * \param[in] pParam Event loop settings, NULL to stop the event loop.
+ * \param[out] piEventFd Eventfd signaled on completions with TWP_ASYNC_EVENTFD,
+ * -1 otherwise. It is closed when the event loop stops. May be NULL.
+ *
+ * \return TWP_RESULT
+ */
+TWP_RESULT TWPAsyncConfigure(TWPLIB_HANDLE hLib, TWPAsyncParam const *pParam, int *piEventFd);
+
+/**
+ * \brief Looks up URLs without waiting for the reply.
+ *
+ * The plug-in request is built in the calling thread, the HTTP exchange is
+ * then left to the event loop. pfDone is called exactly once when this
+ * returns TWP_SUCCESS, and never otherwise.
+ *
+ * This is an asynchronous API.
+ *
+ * \param[in] hLib Library handle returned by TWPInitLibrary().
+ * \param[in] hConfigure Configuration handle.
+ * \param[in] iRedirUrl Whether to get landing page.
+ * \param[in] ppUrls URLs to check.
+ * \param[in] uCount Number of URLs.
+ * \param[in] pfDone Completion callback.
+ * \param[in] pContext Context passed to pfDone.
+ *
+ * \return TWP_RESULT, TWP_ERROR if the event loop is not started or is
+ * stopping.
+ */
+TWP_RESULT TWPLookupUrlsAsync(TWPLIB_HANDLE hLib, TWPConfigurationHandle hConfigure, int iRedirUrl,
+                              const char **ppUrls, unsigned int uCount, TWPFnLookupDone pfDone,
+                              void *pContext);
+
+/**
+ * \brief Runs the callbacks of the completed lookups and clears the eventfd.
+ *
+ * Only needed with TWP_ASYNC_EVENTFD, call it when the eventfd is readable.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] hLib Library handle returned by TWPInitLibrary().
+ *
+ * \return TWP_RESULT
+ */
+TWP_RESULT TWPAsyncDispatch(TWPLIB_HANDLE hLib);
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif  /* TWPASYNC_H */
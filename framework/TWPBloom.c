@@ -0,0 +1,380 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "TWPUrl.h"
+#include "TWPBloom.h"
+#include "TWPInternal.h"
+
+#if defined(DEBUG)
+#define DEBUG_LOG(_fmt_, _param_...)    { \
+                                            printf("[TWP] %s,%d: " _fmt_, __FILE__, __LINE__, ##_param_); \
+                                        }
+#else
+#define DEBUG_LOG(_fmt_, _param_...)
+#endif
+
+
+#define BLOOM_MAGIC 0x3146425057545754ULL /* "TWTWPBF1" */
+
+#define BLOOM_VERSION 1
+
+#define BLOOM_BLOCK_BITS 512 /* Bits of a block, one cache line. */
+
+#define BLOOM_BLOCK_WORDS (BLOOM_BLOCK_BITS / 64)
+
+#define BLOOM_MAX_HASHES 7 /* Bit positions taken 9 bits at a time from a 64-bit hash. */
+
+#define BLOOM_MAX_BITS_PER_KEY 64
+
+
+/**
+ * File header, padded to a block so the blocks stay aligned on cache lines.
+ */
+typedef struct BloomHeader_struct
+{
+    uint64_t uMagic;
+    uint32_t uVersion;
+    uint32_t uHashes; /* Bits set per key. */
+    uint32_t uBlocks;
+    uint32_t uCount; /* Keys added. */
+    uint64_t Reserved[BLOOM_BLOCK_WORDS - 3];
+} BloomHeader;
+
+typedef struct BloomMap_struct
+{
+    void *pMap;
+    size_t Size;
+    uint32_t uHashes;
+    uint32_t uBlocks;
+    uint64_t const *puBlocks;
+} BloomMap;
+
+struct TWPBloom_struct
+{
+    char *pszPath;
+    pthread_rwlock_t Lock; /* Held for reading while testing, for writing to switch files. */
+    BloomMap Map;
+    struct stat Stat; /* File of Map. */
+    time_t Checked; /* Last time the file was checked for a new version. */
+};
+
+
+static int MapOpen(char const *pszPath, BloomMap *pMap, struct stat *pStat);
+static void MapClose(BloomMap *pMap);
+static void Refresh(TWPBloom *pBloom);
+static uint64_t KeyHash(char const *pKey, unsigned int uLength);
+static void SetKey(uint64_t *puBlocks, uint32_t uBlocks, uint32_t uHashes, uint64_t uHash);
+static int TestKey(BloomMap const *pMap, uint64_t uHash);
+
+
+TWP_RESULT TWPBloomConfigure(TWPLIB_HANDLE hLib, TWPBloomParam const *pParam)
+{
+    SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    TWPBloom *pBloom = NULL;
+
+    if (pCtx == NULL)
+        return TWP_INVALID_HANDLE;
+
+    if (pParam != NULL)
+    {
+        if (pParam->pszPath == NULL)
+            return TWP_INVALID_PARAMETER;
+        pBloom = (TWPBloom *) calloc(1, sizeof(TWPBloom));
+        if (pBloom == NULL)
+            return TWP_NOMEM;
+        pBloom->pszPath = strdup(pParam->pszPath);
+        if (pBloom->pszPath == NULL)
+        {
+            free(pBloom);
+            return TWP_NOMEM;
+        }
+        if (MapOpen(pBloom->pszPath, &pBloom->Map, &pBloom->Stat) != 0)
+        {
+            free(pBloom->pszPath);
+            free(pBloom);
+            return TWP_ERROR;
+        }
+        pthread_rwlock_init(&pBloom->Lock, NULL);
+        pBloom->Checked = time(NULL);
+    }
+
+    if (pCtx->pBloom != NULL)
+        TWPBloomClose(pCtx->pBloom);
+    pCtx->pBloom = pBloom;
+    pCtx->uBloomFlags = pParam != NULL ? pParam->uFlags : 0;
+
+    return TWP_SUCCESS;
+}
+
+
+TWP_RESULT TWPBloomBuild(char const *pszPath, const char **ppHosts, unsigned int uCount,
+                         unsigned int uBitsPerKey)
+{
+    char Key[TWP_MAX_URL_LENGTH];
+    unsigned int uKeyLength;
+    unsigned int uHostStart;
+    unsigned int uHostLength;
+    BloomHeader *pHeader;
+    uint64_t uBlocks;
+    size_t Size;
+    unsigned int i;
+    int iRet;
+
+    if (pszPath == NULL || (ppHosts == NULL && uCount != 0))
+        return TWP_INVALID_PARAMETER;
+
+    if (uBitsPerKey == 0)
+        uBitsPerKey = TWP_BLOOM_DEF_BITS_PER_KEY;
+    if (uBitsPerKey > BLOOM_MAX_BITS_PER_KEY)
+        uBitsPerKey = BLOOM_MAX_BITS_PER_KEY;
+
+    uBlocks = ((uint64_t) uCount * uBitsPerKey + BLOOM_BLOCK_BITS - 1) / BLOOM_BLOCK_BITS;
+    if (uBlocks == 0)
+        uBlocks = 1;
+    if (uBlocks > UINT32_MAX)
+        return TWP_INVALID_PARAMETER;
+
+    Size = sizeof(BloomHeader) + (size_t) uBlocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t);
+    pHeader = (BloomHeader *) calloc(1, Size);
+    if (pHeader == NULL)
+        return TWP_NOMEM;
+
+    pHeader->uMagic = BLOOM_MAGIC;
+    pHeader->uVersion = BLOOM_VERSION;
+    /* bits per key * ln(2) hashes minimize the false positives. */
+    pHeader->uHashes = (uBitsPerKey * 69 + 50) / 100;
+    if (pHeader->uHashes < 1)
+        pHeader->uHashes = 1;
+    if (pHeader->uHashes > BLOOM_MAX_HASHES)
+        pHeader->uHashes = BLOOM_MAX_HASHES;
+    pHeader->uBlocks = (uint32_t) uBlocks;
+    pHeader->uCount = uCount;
+
+    for (i = 0; i < uCount; i++)
+    {
+        if (ppHosts[i] == NULL ||
+            TWPUrlCanonicalize(ppHosts[i], strlen(ppHosts[i]), Key, sizeof(Key), &uKeyLength,
+                               NULL) != TWP_SUCCESS ||
+            TWPUrlGetHost(Key, uKeyLength, &uHostStart, &uHostLength) != 0)
+        {
+            free(pHeader);
+            return TWP_INVALID_PARAMETER;
+        }
+        SetKey((uint64_t *) (pHeader + 1), pHeader->uBlocks, pHeader->uHashes,
+               KeyHash(Key + uHostStart, uHostLength));
+    }
+
+    iRet = TWPFileReplace(pszPath, pHeader, Size);
+    DEBUG_LOG("bloom: %u keys, %u blocks, %u hashes\n", uCount, pHeader->uBlocks, pHeader->uHashes);
+
+    free(pHeader);
+
+    return iRet == 0 ? TWP_SUCCESS : TWP_ERROR;
+}
+
+
+void TWPBloomClose(TWPBloom *pBloom)
+{
+    MapClose(&pBloom->Map);
+    pthread_rwlock_destroy(&pBloom->Lock);
+    free(pBloom->pszPath);
+    free(pBloom);
+}
+
+
+int TWPBloomMayContain(TWPBloom *pBloom, char const *pKey, unsigned int uKeyLength)
+{
+    uint64_t Hashes[2];
+    unsigned int uHashes = 0;
+    unsigned int uHostStart;
+    unsigned int uHostLength;
+    unsigned int uDomainStart;
+    unsigned int i;
+    time_t Now = time(NULL);
+    time_t Checked = __atomic_load_n(&pBloom->Checked, __ATOMIC_RELAXED);
+    int iRet = 0;
+
+    /* URLs without host are not decided by the filter. */
+    if (TWPUrlGetHost(pKey, uKeyLength, &uHostStart, &uHostLength) != 0)
+        return 1;
+
+    /* One thread a second looks for a new file. */
+    if (Now != Checked &&
+        __atomic_compare_exchange_n(&pBloom->Checked, &Checked, Now, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        Refresh(pBloom);
+
+    Hashes[uHashes++] = KeyHash(pKey + uHostStart, uHostLength);
+    if (TWPUrlGetDomain(pKey + uHostStart, uHostLength, &uDomainStart) == 0 && uDomainStart != 0)
+        Hashes[uHashes++] = KeyHash(pKey + uHostStart + uDomainStart, uHostLength - uDomainStart);
+
+    pthread_rwlock_rdlock(&pBloom->Lock);
+    for (i = 0; i < uHashes && iRet == 0; i++)
+        iRet = TestKey(&pBloom->Map, Hashes[i]);
+    pthread_rwlock_unlock(&pBloom->Lock);
+
+    return iRet;
+}
+
+
+static int MapOpen(char const *pszPath, BloomMap *pMap, struct stat *pStat)
+{
+    BloomHeader const *pHeader;
+    int iFd;
+
+    iFd = open(pszPath, O_RDONLY | O_CLOEXEC);
+    if (iFd < 0)
+    {
+        DEBUG_LOG("bloom: cannot open %s, errno %d\n", pszPath, errno);
+        return -1;
+    }
+
+    if (fstat(iFd, pStat) != 0 || pStat->st_size < (off_t) sizeof(BloomHeader))
+    {
+        close(iFd);
+        return -1;
+    }
+
+    pMap->Size = (size_t) pStat->st_size;
+    pMap->pMap = mmap(NULL, pMap->Size, PROT_READ, MAP_SHARED, iFd, 0);
+    close(iFd);
+    if (pMap->pMap == MAP_FAILED)
+        return -1;
+
+    pHeader = (BloomHeader const *) pMap->pMap;
+    if (pHeader->uMagic == BLOOM_MAGIC && pHeader->uVersion == BLOOM_VERSION &&
+        pHeader->uHashes >= 1 && pHeader->uHashes <= BLOOM_MAX_HASHES && pHeader->uBlocks != 0 &&
+        pMap->Size == sizeof(BloomHeader) + (size_t) pHeader->uBlocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t))
+    {
+        pMap->uHashes = pHeader->uHashes;
+        pMap->uBlocks = pHeader->uBlocks;
+        pMap->puBlocks = (uint64_t const *) (pHeader + 1);
+        return 0;
+    }
+
+    DEBUG_LOG("bloom: %s is not a filter\n", pszPath);
+    munmap(pMap->pMap, pMap->Size);
+
+    return -1;
+}
+
+
+static void MapClose(BloomMap *pMap)
+{
+    munmap(pMap->pMap, pMap->Size);
+}
+
+
+/**
+ * Switches to the filter file if it was replaced. The old file stays in use
+ * if the new one cannot be opened.
+ */
+static void Refresh(TWPBloom *pBloom)
+{
+    BloomMap Map;
+    BloomMap Old;
+    struct stat Stat;
+
+    if (stat(pBloom->pszPath, &Stat) != 0 ||
+        (Stat.st_dev == pBloom->Stat.st_dev && Stat.st_ino == pBloom->Stat.st_ino &&
+         Stat.st_size == pBloom->Stat.st_size && Stat.st_mtime == pBloom->Stat.st_mtime))
+        return;
+
+    if (MapOpen(pBloom->pszPath, &Map, &Stat) != 0)
+        return;
+
+    pthread_rwlock_wrlock(&pBloom->Lock);
+    Old = pBloom->Map;
+    pBloom->Map = Map;
+    pBloom->Stat = Stat;
+    pthread_rwlock_unlock(&pBloom->Lock);
+    MapClose(&Old);
+    DEBUG_LOG("bloom: switched to the new %s\n", pBloom->pszPath);
+}
+
+
+/**
+ * Hashes a host name. FNV-1a is mixed further since the block and the bits
+ * are taken from different parts of the hash.
+ */
+static uint64_t KeyHash(char const *pKey, unsigned int uLength)
+{
+    uint64_t uHash = TWPUrlHash(pKey, uLength);
+
+    uHash ^= uHash >> 33;
+    uHash *= 0xFF51AFD7ED558CCDULL;
+    uHash ^= uHash >> 33;
+    uHash *= 0xC4CEB9FE1A85EC53ULL;
+    uHash ^= uHash >> 33;
+
+    return uHash;
+}
+
+
+/**
+ * The top 32 bits of the hash select the block, its bits come from the hash
+ * multiplied by the golden ratio, 9 bits per position.
+ */
+static void SetKey(uint64_t *puBlocks, uint32_t uBlocks, uint32_t uHashes, uint64_t uHash)
+{
+    uint64_t *puBlock = puBlocks + (size_t) (((uHash >> 32) * uBlocks) >> 32) * BLOOM_BLOCK_WORDS;
+    uint64_t uBits = uHash * 0x9E3779B97F4A7C15ULL;
+    uint32_t i;
+
+    for (i = 0; i < uHashes; i++, uBits >>= 9)
+        puBlock[(uBits & 511) >> 6] |= (uint64_t) 1 << (uBits & 63);
+}
+
+
+static int TestKey(BloomMap const *pMap, uint64_t uHash)
+{
+    uint64_t const *puBlock = pMap->puBlocks + (size_t) (((uHash >> 32) * pMap->uBlocks) >> 32) * BLOOM_BLOCK_WORDS;
+    uint64_t uBits = uHash * 0x9E3779B97F4A7C15ULL;
+    uint32_t i;
+
+    for (i = 0; i < pMap->uHashes; i++, uBits >>= 9)
+    {
+        if ((puBlock[(uBits & 511) >> 6] & ((uint64_t) 1 << (uBits & 63))) == 0)
+            return 0;
+    }
+
+    return 1;
+}
@@ -0,0 +1,141 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TWPBLOOM_H
+#define TWPBLOOM_H
+
+#include "TWPImpl.h"
+
+#ifdef __cplusplus 
+extern "C" {
+#endif
+
+/**
+ * \file TWPBloom.h
+ * \brief TWP Host Filter Header File
+ *  
+ * This file provides functions to answer URLs of hosts known to be harmless
+ * without network, from a Bloom filter of the malicious and suspicious
+ * hosts and domains.
+ *
+ * When a filter is opened, synchronous TWPLookupUrls() calls without landing
+ * page (iRedirUrl is 0) test the host and the registrable domain of the URLs
+ * not found in the local database nor in the rating cache. URLs matching
+ * neither go through the plug-in as usual. The others get at once a
+ * provisional rating of score TWP_MinimalLow with the TWP_OverallRiskMinimal
+ * category, no landing page and no DLA URL, see TWPUrlRatingIsProvisional().
+ * The filter has no false negatives: a listed host or domain always takes the
+ * full lookup, an unlisted one does so with the false positive rate of the
+ * filter (about 1% with TWP_BLOOM_DEF_BITS_PER_KEY).
+ *
+ * With TWP_BLOOM_CONFIRM, the URLs rated provisionally are also looked up in
+ * the background on the event loop (see TWPAsync.h) and their ratings are
+ * added to the rating cache, so later lookups get the plug-in's rating. The
+ * configuration handle of the lookup must then stay valid until the event
+ * loop is stopped. Nothing is confirmed while the event loop is stopped or
+ * the rating cache is disabled.
+ *
+ * The filter is split in blocks of 64 bytes, all the bits of a key are in the
+ * same block so a test reads one cache line. The file is memory mapped.
+ * TWPBloomBuild() writes a new file and renames it over the old one. Opened
+ * filters notice the new file within a second and switch to it.
+ */
+
+#define TWP_BLOOM_DEF_BITS_PER_KEY 10 /* Default size of the filter per host or domain. */
+
+#define TWP_BLOOM_CONFIRM 0x1 /* Confirm the provisional ratings in the background. */
+
+/**
+ * Filter settings.
+ */
+typedef struct TWPBloomParam_struct
+{
+    char const *pszPath; /* Filter file written by TWPBloomBuild(). */
+    unsigned int uFlags; /* TWP_BLOOM_ flags. */
+} TWPBloomParam;
+
+/**
+ * \brief Writes a filter file.
+ *
+ * Each entry is a host name or a URL of the host. A registrable domain (e.g.
+ * "example.com") covers all of its hosts, any other host only covers itself.
+ * The file is written next to pszPath and renamed to it once complete.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] pszPath Filter file.
+ * \param[in] ppHosts Hosts and domains of the filter.
+ * \param[in] uCount Number of hosts and domains.
+ * \param[in] uBitsPerKey Size of the filter per entry, 0 for
+ * TWP_BLOOM_DEF_BITS_PER_KEY.
+ *
+ * \return TWP_RESULT \n
+ * TWP_INVALID_PARAMETER - if an entry has no host. \n
+ * TWP_ERROR - if the file could not be written. \n
+ */
+TWP_RESULT TWPBloomBuild(char const *pszPath, const char **ppHosts, unsigned int uCount,
+                         unsigned int uBitsPerKey);
+
+/**
+ * \brief Opens, replaces or closes the host filter of a library handle.
+ *
+ * The filter is disabled by default. This must not be called while other
+ * threads use the library handle.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] hLib Library handle returned by TWPInitLibrary().
+ * \param[in] pParam Filter settings, NULL to close the filter.
+ *
+ * \return TWP_RESULT \n
+ * TWP_ERROR - if the file is missing or is not a filter. \n
+ */
+TWP_RESULT TWPBloomConfigure(TWPLIB_HANDLE hLib, TWPBloomParam const *pParam);
+
+/**
+ * \brief Tells whether a rating is a provisional rating of the host filter
+ * or a deadline verdict (see TWPDeadline.h).
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] hLib Library handle returned by TWPInitLibrary().
+ * \param[in] hRating URL rating handle.
+ * \param[out] piProvisional 1 if the URL was not looked up, 0 otherwise.
+ *
+ * \return TWP_RESULT
+ */
+TWP_RESULT TWPUrlRatingIsProvisional(TWPLIB_HANDLE hLib, TWPUrlRatingHandle hRating, int *piProvisional);
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif  /* TWPBLOOM_H */
@@ -0,0 +1,380 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "TWPCache.h"
+#include "TWPInternal.h"
+
+
+#define CACHE_SHARDS 16 /* Independent locks, must be a power of 2. */
+
+#define CACHE_LINE_SIZE 64
+
+#define CACHE_REFRESH_RETRY 10 /* Seconds before a stale rating whose refresh got no reply is refreshed again. */
+
+
+/**
+ * Cached rating, the key and the DLA URL follow the structure.
+ */
+typedef struct CacheEntry_struct
+{
+    struct CacheEntry_struct *pChain; /* Next entry of the hash bucket. */
+    struct CacheEntry_struct *pPrev; /* More recently used entry. */
+    struct CacheEntry_struct *pNext; /* Less recently used entry. */
+    uint64_t uHash;
+    time_t Expires;
+    time_t Stale; /* Time the rating gets refreshed in the background. */
+    int iScore;
+    uint64_t Categories[TWP_CATEGORY_WORDS];
+    unsigned int uKeyLength;
+    unsigned int uDlaLength;
+    char *pszDlaUrl; /* NULL if the URL has no DLA URL. */
+    char Key[1];
+} CacheEntry;
+
+/**
+ * Part of the cache selected by the hash of the key.
+ */
+typedef struct CacheShard_struct
+{
+    pthread_mutex_t Lock;
+    CacheEntry **ppBuckets;
+    unsigned int uMask;
+    CacheEntry *pHead; /* Most recently used entry. */
+    CacheEntry *pTail; /* Least recently used entry. */
+    unsigned int uCount;
+    unsigned int uMax;
+} __attribute__((aligned(CACHE_LINE_SIZE))) CacheShard;
+
+struct TWPCache_struct
+{
+    CacheShard Shards[CACHE_SHARDS];
+    unsigned int uTtl;
+    unsigned int uSoftTtl; /* Equal to uTtl if ratings are not refreshed. */
+};
+
+
+static TWPCache *CacheCreate(unsigned int uMaxEntries, unsigned int uTtl, unsigned int uSoftTtl);
+static void ShardFlush(CacheShard *pShard);
+static CacheEntry **FindEntry(CacheShard *pShard, uint64_t uHash, char const *pKey, unsigned int uKeyLength);
+static void RemoveEntry(CacheShard *pShard, CacheEntry **ppEntry);
+static void LruUnlink(CacheShard *pShard, CacheEntry *pEntry);
+static void LruPushHead(CacheShard *pShard, CacheEntry *pEntry);
+static time_t CacheNow(void);
+
+
+TWP_RESULT TWPCacheConfigure(TWPLIB_HANDLE hLib, TWPCacheParam const *pParam)
+{
+    SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    TWPCache *pCache = NULL;
+    unsigned int uTtl;
+
+    if (pCtx == NULL)
+        return TWP_INVALID_HANDLE;
+
+    if (pParam != NULL)
+    {
+        uTtl = pParam->uTtl != 0 ? pParam->uTtl : TWP_CACHE_DEF_TTL;
+        pCache = CacheCreate(pParam->uMaxEntries != 0 ? pParam->uMaxEntries : TWP_CACHE_DEF_ENTRIES, uTtl,
+                             pParam->uSoftTtl != 0 && pParam->uSoftTtl < uTtl ? pParam->uSoftTtl : uTtl);
+        if (pCache == NULL)
+            return TWP_NOMEM;
+    }
+
+    if (pCtx->pCache != NULL)
+        TWPCacheDestroy(pCtx->pCache);
+    pCtx->pCache = pCache;
+
+    return TWP_SUCCESS;
+}
+
+
+TWP_RESULT TWPCacheFlush(TWPLIB_HANDLE hLib)
+{
+    SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    unsigned int i;
+
+    if (pCtx == NULL)
+        return TWP_INVALID_HANDLE;
+
+    if (pCtx->pCache != NULL)
+    {
+        for (i = 0; i < CACHE_SHARDS; i++)
+        {
+            pthread_mutex_lock(&pCtx->pCache->Shards[i].Lock);
+            ShardFlush(&pCtx->pCache->Shards[i]);
+            pthread_mutex_unlock(&pCtx->pCache->Shards[i].Lock);
+        }
+    }
+    if (pCtx->pDiskCache != NULL)
+        TWPDiskCacheFlush(pCtx->pDiskCache);
+
+    return TWP_SUCCESS;
+}
+
+
+void TWPCacheDestroy(TWPCache *pCache)
+{
+    unsigned int i;
+
+    for (i = 0; i < CACHE_SHARDS; i++)
+    {
+        ShardFlush(&pCache->Shards[i]);
+        free(pCache->Shards[i].ppBuckets);
+        pthread_mutex_destroy(&pCache->Shards[i].Lock);
+    }
+    free(pCache);
+}
+
+
+int TWPCacheGet(TWPCache *pCache, uint64_t uHash, char const *pKey, unsigned int uKeyLength,
+                FwRating *pRating)
+{
+    CacheShard *pShard = &pCache->Shards[uHash >> 60 & (CACHE_SHARDS - 1)];
+    CacheEntry **ppEntry;
+    CacheEntry *pEntry;
+    time_t Now = CacheNow();
+    int iRet = -1;
+
+    pthread_mutex_lock(&pShard->Lock);
+    ppEntry = FindEntry(pShard, uHash, pKey, uKeyLength);
+    if (ppEntry != NULL)
+    {
+        pEntry = *ppEntry;
+        if (pEntry->Expires <= Now)
+        {
+            RemoveEntry(pShard, ppEntry);
+        }
+        else
+        {
+            pRating->iScore = pEntry->iScore;
+            memcpy(pRating->Categories, pEntry->Categories, sizeof(pRating->Categories));
+            pRating->pszDlaUrl = NULL;
+            pRating->uDlaLength = 0;
+            pRating->iRevalidate = 0;
+            pRating->uLifetime = 0;
+            if (pEntry->Stale <= Now)
+            {
+                /* Only the first reader refreshes it. */
+                pEntry->Stale = Now + CACHE_REFRESH_RETRY;
+                pRating->iRevalidate = 1;
+            }
+            iRet = 0;
+            if (pEntry->pszDlaUrl != NULL)
+            {
+                pRating->pszDlaUrl = strdup(pEntry->pszDlaUrl);
+                pRating->uDlaLength = pEntry->uDlaLength;
+                if (pRating->pszDlaUrl == NULL)
+                    iRet = -1;
+            }
+            LruUnlink(pShard, pEntry);
+            LruPushHead(pShard, pEntry);
+        }
+    }
+    pthread_mutex_unlock(&pShard->Lock);
+
+    return iRet;
+}
+
+
+void TWPCachePut(TWPCache *pCache, uint64_t uHash, char const *pKey, unsigned int uKeyLength,
+                 FwRating const *pRating)
+{
+    CacheShard *pShard = &pCache->Shards[uHash >> 60 & (CACHE_SHARDS - 1)];
+    CacheEntry **ppEntry;
+    CacheEntry *pEntry;
+    unsigned int uDlaSize = pRating->pszDlaUrl != NULL ? pRating->uDlaLength + 1 : 0;
+    unsigned int uTtl = pCache->uTtl;
+
+    pEntry = (CacheEntry *) malloc(sizeof(CacheEntry) + uKeyLength + uDlaSize);
+    if (pEntry == NULL)
+        return;
+
+    /* A rating from the cache file keeps the rest of its lifetime, it may already be stale. */
+    if (pRating->uLifetime != 0 && pRating->uLifetime < uTtl)
+        uTtl = pRating->uLifetime;
+    pEntry->uHash = uHash;
+    pEntry->Expires = CacheNow() + uTtl;
+    pEntry->Stale = pEntry->Expires - (pCache->uTtl - pCache->uSoftTtl);
+    pEntry->iScore = pRating->iScore;
+    memcpy(pEntry->Categories, pRating->Categories, sizeof(pEntry->Categories));
+    pEntry->uKeyLength = uKeyLength;
+    memcpy(pEntry->Key, pKey, uKeyLength);
+    pEntry->Key[uKeyLength] = '\0';
+    pEntry->pszDlaUrl = NULL;
+    pEntry->uDlaLength = 0;
+    if (pRating->pszDlaUrl != NULL)
+    {
+        pEntry->pszDlaUrl = pEntry->Key + uKeyLength + 1;
+        pEntry->uDlaLength = pRating->uDlaLength;
+        memcpy(pEntry->pszDlaUrl, pRating->pszDlaUrl, pRating->uDlaLength);
+        pEntry->pszDlaUrl[pRating->uDlaLength] = '\0';
+    }
+
+    pthread_mutex_lock(&pShard->Lock);
+    ppEntry = FindEntry(pShard, uHash, pKey, uKeyLength);
+    if (ppEntry != NULL)
+        RemoveEntry(pShard, ppEntry);
+    else if (pShard->uCount >= pShard->uMax)
+        RemoveEntry(pShard, FindEntry(pShard, pShard->pTail->uHash, pShard->pTail->Key,
+                                      pShard->pTail->uKeyLength));
+
+    ppEntry = &pShard->ppBuckets[uHash & pShard->uMask];
+    pEntry->pChain = *ppEntry;
+    *ppEntry = pEntry;
+    LruPushHead(pShard, pEntry);
+    pShard->uCount++;
+    pthread_mutex_unlock(&pShard->Lock);
+}
+
+
+static TWPCache *CacheCreate(unsigned int uMaxEntries, unsigned int uTtl, unsigned int uSoftTtl)
+{
+    TWPCache *pCache = NULL;
+    unsigned int uShardMax = (uMaxEntries + CACHE_SHARDS - 1) / CACHE_SHARDS;
+    unsigned int uBuckets = 1;
+    unsigned int i;
+
+    if (posix_memalign((void **) &pCache, CACHE_LINE_SIZE, sizeof(TWPCache)) != 0)
+        return NULL;
+    memset(pCache, 0, sizeof(TWPCache));
+    pCache->uTtl = uTtl;
+    pCache->uSoftTtl = uSoftTtl;
+
+    while (uBuckets < uShardMax)
+        uBuckets <<= 1;
+
+    for (i = 0; i < CACHE_SHARDS; i++)
+    {
+        CacheShard *pShard = &pCache->Shards[i];
+
+        pthread_mutex_init(&pShard->Lock, NULL);
+        pShard->uMax = uShardMax;
+        pShard->uMask = uBuckets - 1;
+        pShard->ppBuckets = (CacheEntry **) calloc(uBuckets, sizeof(CacheEntry *));
+        if (pShard->ppBuckets == NULL)
+        {
+            TWPCacheDestroy(pCache);
+            return NULL;
+        }
+    }
+
+    return pCache;
+}
+
+
+static void ShardFlush(CacheShard *pShard)
+{
+    CacheEntry *pEntry = pShard->pHead;
+
+    while (pEntry != NULL)
+    {
+        CacheEntry *pNext = pEntry->pNext;
+
+        free(pEntry);
+        pEntry = pNext;
+    }
+    if (pShard->ppBuckets != NULL)
+        memset(pShard->ppBuckets, 0, (pShard->uMask + 1) * sizeof(CacheEntry *));
+    pShard->pHead = NULL;
+    pShard->pTail = NULL;
+    pShard->uCount = 0;
+}
+
+
+/**
+ * Returns the link pointing to the entry of the key, NULL if not cached.
+ */
+static CacheEntry **FindEntry(CacheShard *pShard, uint64_t uHash, char const *pKey, unsigned int uKeyLength)
+{
+    CacheEntry **ppEntry = &pShard->ppBuckets[uHash & pShard->uMask];
+
+    for (; *ppEntry != NULL; ppEntry = &(*ppEntry)->pChain)
+    {
+        if ((*ppEntry)->uHash == uHash && (*ppEntry)->uKeyLength == uKeyLength &&
+            memcmp((*ppEntry)->Key, pKey, uKeyLength) == 0)
+            return ppEntry;
+    }
+
+    return NULL;
+}
+
+
+static void RemoveEntry(CacheShard *pShard, CacheEntry **ppEntry)
+{
+    CacheEntry *pEntry = *ppEntry;
+
+    *ppEntry = pEntry->pChain;
+    LruUnlink(pShard, pEntry);
+    pShard->uCount--;
+    free(pEntry);
+}
+
+
+static void LruUnlink(CacheShard *pShard, CacheEntry *pEntry)
+{
+    if (pEntry->pPrev != NULL)
+        pEntry->pPrev->pNext = pEntry->pNext;
+    else
+        pShard->pHead = pEntry->pNext;
+
+    if (pEntry->pNext != NULL)
+        pEntry->pNext->pPrev = pEntry->pPrev;
+    else
+        pShard->pTail = pEntry->pPrev;
+}
+
+
+static void LruPushHead(CacheShard *pShard, CacheEntry *pEntry)
+{
+    pEntry->pPrev = NULL;
+    pEntry->pNext = pShard->pHead;
+    if (pShard->pHead != NULL)
+        pShard->pHead->pPrev = pEntry;
+    else
+        pShard->pTail = pEntry;
+    pShard->pHead = pEntry;
+}
+
+
+static time_t CacheNow(void)
+{
+    struct timespec Now;
+
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+
+    return Now.tv_sec;
+}
@@ -0,0 +1,168 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TWPCACHE_H
+#define TWPCACHE_H
+
+#include "TWPImpl.h"
+
+#ifdef __cplusplus 
+extern "C" {
+#endif
+
+/**
+ * \file TWPCache.h
+ * \brief TWP Rating Cache Header File
+ *  
+ * This file provides functions to keep URL ratings in memory, so URLs
+ * looked up again are answered without the plug-in.
+ *
+ * When the cache is enabled, synchronous TWPLookupUrls() calls without
+ * landing page (iRedirUrl is 0) only forward the URLs not found in the cache
+ * to the plug-in. The returned response lists the ratings in the order of the
+ * URLs passed in, and all the response and rating functions accept it. Ratings
+ * served from the cache have no landing page, TWPResponseGetRedirUrlFor()
+ * returns TWP_NO_DATA for them.
+ *
+ * Cached ratings can be refreshed before they expire. After uSoftTtl seconds,
+ * a rating is stale: it is still served at once, and the first lookup serving
+ * it also looks its URL up again in the background on the event loop (see
+ * TWPAsync.h), which replaces the rating when the reply arrives. Lookups only
+ * wait for the plug-in once the rating has expired after uTtl seconds, so
+ * URLs looked up often never wait. Without the event loop, stale ratings are
+ * served until they expire.
+ *
+ * Ratings can also be kept in a file shared by all processes, so they survive
+ * restarts. The in-memory cache is searched first, then the file, then the
+ * plug-in is asked.
+ *
+ * A rating may cover the whole host or registrable domain of its URL, e.g.
+ * a malicious domain blocks all its paths. Plug-ins report it with the
+ * optional function
+ *
+ *     TWP_RESULT TWPPUrlRatingGetScope(TWPUrlRatingHandle hRating, int *piScope);
+ *
+ * which sets *piScope to one of the TWP_SCOPE values. Such ratings are cached
+ * for the host or domain, and later URLs under it are answered from the cache.
+ * The registrable domain (one label below the public suffix, e.g. example.co.uk)
+ * is found with the public suffix list, including its wildcard and exception
+ * rules, compiled in at build time (TCS_PSL names the list file). Ratings of
+ * plug-ins without TWPPUrlRatingGetScope() only apply to their URL.
+ */
+
+#define TWP_CACHE_DEF_ENTRIES 4096 /* Default number of cached ratings. */
+
+#define TWP_CACHE_DEF_TTL 1800 /* Default lifetime (in seconds) of a cached rating. */
+
+#define TWP_DISK_CACHE_DEF_ENTRIES 8192 /* Default number of ratings in a new cache file. */
+
+#define TWP_DISK_CACHE_DEF_TTL 86400 /* Default lifetime (in seconds) of a rating in the cache file. */
+
+#define TWP_SCOPE_URL 0 /* The rating only applies to its URL. */
+
+#define TWP_SCOPE_HOST 1 /* The rating applies to all URLs of the host. */
+
+#define TWP_SCOPE_DOMAIN 2 /* The rating applies to all URLs of the registrable domain and its subdomains. */
+
+/**
+ * Cache settings.
+ */
+typedef struct TWPCacheParam_struct
+{
+    unsigned int uMaxEntries; /* Number of cached ratings, 0 for TWP_CACHE_DEF_ENTRIES. When the
+                                 cache is full, the least recently used rating is dropped. */
+    unsigned int uTtl; /* Lifetime (in seconds) of a cached rating, 0 for TWP_CACHE_DEF_TTL. */
+    unsigned int uSoftTtl; /* Age (in seconds) a cached rating is refreshed at, 0 or from uTtl on to
+                              never refresh it. */
+} TWPCacheParam;
+
+/**
+ * Cache file settings.
+ */
+typedef struct TWPDiskCacheParam_struct
+{
+    char const *pszPath; /* Cache file, created if missing or unusable. */
+    unsigned int uMaxEntries; /* Number of ratings when the file is created, 0 for
+                                 TWP_DISK_CACHE_DEF_ENTRIES. An existing file keeps its size. */
+    unsigned int uTtl; /* Lifetime (in seconds) of the ratings written, 0 for TWP_DISK_CACHE_DEF_TTL. */
+} TWPDiskCacheParam;
+
+/**
+ * \brief Enables, resizes or disables the rating cache of a library handle.
+ *
+ * The cache is disabled by default. Cached ratings are dropped. This must not
+ * be called while other threads use the library handle.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] hLib Library handle returned by TWPInitLibrary().
+ * \param[in] pParam Cache settings, NULL to disable the cache.
+ *
+ * \return TWP_RESULT
+ */
+TWP_RESULT TWPCacheConfigure(TWPLIB_HANDLE hLib, TWPCacheParam const *pParam);
+
+/**
+ * \brief Drops all cached ratings, e.g. after the rating policy of the cloud changed.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] hLib Library handle returned by TWPInitLibrary().
+ *
+ * \return TWP_RESULT
+ */
+TWP_RESULT TWPCacheFlush(TWPLIB_HANDLE hLib);
+
+/**
+ * \brief Opens, replaces or closes the cache file of a library handle.
+ *
+ * The file is memory mapped and may be used by several processes at once.
+ * Readers take no lock, writers are serialized with flock(). A rating being
+ * written when a process crashes is ignored by the readers. Ratings longer
+ * than a slot of the file (about 440 bytes of URL and DLA URL) are not written.
+ *
+ * The cache file is disabled by default. This must not be called while other
+ * threads use the library handle. TWPCacheFlush() empties the file too.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] hLib Library handle returned by TWPInitLibrary().
+ * \param[in] pParam Cache file settings, NULL to close the cache file.
+ *
+ * \return TWP_RESULT
+ */
+TWP_RESULT TWPDiskCacheConfigure(TWPLIB_HANDLE hLib, TWPDiskCacheParam const *pParam);
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif  /* TWPCACHE_H */
@@ -0,0 +1,303 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "TWPCoalesce.h"
+#include "TWPInternal.h"
+
+
+/**
+ * Plug-in lookup shared by several callers, the URLs follow the structure.
+ */
+struct FwBatch_struct
+{
+    struct FwBatch_struct *pNext; /* Next batch still accepting URLs. */
+    TWPConfigurationHandle hConfigure;
+    TWPRequest *pRequest; /* Request of the thread sending the lookup. */
+    unsigned int uCount;
+    int iOpen; /* Still accepting URLs. */
+    int iDone;
+    TWP_RESULT Result;
+    FwRating *pRatings; /* Copies of the ratings, each caller moves its own out. */
+    unsigned int uRefs; /* Callers holding the batch. */
+    pthread_cond_t Full; /* Signaled when the batch stops accepting URLs. */
+    pthread_cond_t Done;
+    const char *ppUrls[1];
+};
+
+struct TWPCoalescer_struct
+{
+    pthread_mutex_t Lock;
+    FwBatch *pOpen;
+    unsigned int uWindow;
+    unsigned int uMaxUrls;
+};
+
+
+static FwBatch *FindBatch(TWPCoalescer *pCoalescer, TWPConfigurationHandle hConfigure, TWPRequest *pRequest,
+                          unsigned int uCount);
+static void CloseBatch(TWPCoalescer *pCoalescer, FwBatch *pBatch);
+static TWP_RESULT CopyRatings(SitePluginContext *pCtx, FwBatch *pBatch, TWPResponseHandle hResponse);
+static TWP_RESULT TakeRatings(SitePluginContext *pCtx, FwBatch *pBatch, unsigned int uFirst, unsigned int uCount,
+                              FwRating *pRatings, unsigned int const *puSlots);
+static void FreeBatch(FwBatch *pBatch);
+
+
+TWP_RESULT TWPCoalesceConfigure(TWPLIB_HANDLE hLib, TWPCoalesceParam const *pParam)
+{
+    SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    TWPCoalescer *pCoalescer = NULL;
+
+    if (pCtx == NULL)
+        return TWP_INVALID_HANDLE;
+
+    if (pParam != NULL)
+    {
+        pCoalescer = (TWPCoalescer *) calloc(1, sizeof(TWPCoalescer));
+        if (pCoalescer == NULL)
+            return TWP_NOMEM;
+        pthread_mutex_init(&pCoalescer->Lock, NULL);
+        pCoalescer->uWindow = pParam->uWindow != 0 ? pParam->uWindow : TWP_COALESCE_DEF_WINDOW;
+        pCoalescer->uMaxUrls = pParam->uMaxUrls != 0 ? pParam->uMaxUrls : TWP_COALESCE_DEF_MAX_URLS;
+    }
+
+    if (pCtx->pCoalescer != NULL)
+        TWPCoalesceDestroy(pCtx->pCoalescer);
+    pCtx->pCoalescer = pCoalescer;
+
+    return TWP_SUCCESS;
+}
+
+
+void TWPCoalesceDestroy(TWPCoalescer *pCoalescer)
+{
+    pthread_mutex_destroy(&pCoalescer->Lock);
+    free(pCoalescer);
+}
+
+
+TWP_RESULT TWPCoalesceLookup(SitePluginContext *pCtx, TWPConfigurationHandle hConfigure, TWPRequest *pRequest,
+                             const char **ppUrls, unsigned int uCount, FwRating *pRatings,
+                             unsigned int const *puSlots)
+{
+    TWPCoalescer *pCoalescer = pCtx->pCoalescer;
+    FwBatch *pBatch;
+    pthread_condattr_t Attr;
+    struct timespec Deadline;
+    uint64_t uStart;
+    TWPResponseHandle hResponse = NULL;
+    TWP_RESULT Result;
+    unsigned int uFirst;
+
+    if (uCount > pCoalescer->uMaxUrls)
+        return TWP_NOT_IMPLEMENTED;
+
+    pthread_mutex_lock(&pCoalescer->Lock);
+    pBatch = FindBatch(pCoalescer, hConfigure, pRequest, uCount);
+    if (pBatch != NULL)
+    {
+        /* Another thread sends the lookup. */
+        uFirst = pBatch->uCount;
+        memcpy(&pBatch->ppUrls[uFirst], ppUrls, uCount * sizeof(const char *));
+        pBatch->uCount += uCount;
+        pBatch->uRefs++;
+        if (pBatch->uCount == pCoalescer->uMaxUrls)
+            CloseBatch(pCoalescer, pBatch);
+        while (!pBatch->iDone)
+            pthread_cond_wait(&pBatch->Done, &pCoalescer->Lock);
+        pthread_mutex_unlock(&pCoalescer->Lock);
+
+        return TakeRatings(pCtx, pBatch, uFirst, uCount, pRatings, puSlots);
+    }
+
+    pBatch = (FwBatch *) calloc(1, sizeof(FwBatch) + pCoalescer->uMaxUrls * sizeof(const char *));
+    if (pBatch != NULL)
+        pBatch->pRatings = (FwRating *) calloc(pCoalescer->uMaxUrls, sizeof(FwRating));
+    if (pBatch == NULL || pBatch->pRatings == NULL)
+    {
+        pthread_mutex_unlock(&pCoalescer->Lock);
+        free(pBatch);
+        return TWP_NOT_IMPLEMENTED;
+    }
+
+    pthread_condattr_init(&Attr);
+    pthread_condattr_setclock(&Attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&pBatch->Full, &Attr);
+    pthread_condattr_destroy(&Attr);
+    pthread_cond_init(&pBatch->Done, NULL);
+    pBatch->hConfigure = hConfigure;
+    pBatch->pRequest = pRequest;
+    pBatch->uRefs = 1;
+    pBatch->uCount = uCount;
+    memcpy(pBatch->ppUrls, ppUrls, uCount * sizeof(const char *));
+    pBatch->iOpen = 1;
+    pBatch->pNext = pCoalescer->pOpen;
+    pCoalescer->pOpen = pBatch;
+
+    /* Wait for other lookups until the window ends or the batch is full. */
+    uStart = TWPStatsClock();
+    clock_gettime(CLOCK_MONOTONIC, &Deadline);
+    Deadline.tv_sec += pCoalescer->uWindow / 1000000;
+    Deadline.tv_nsec += (long) (pCoalescer->uWindow % 1000000) * 1000;
+    if (Deadline.tv_nsec >= 1000000000)
+    {
+        Deadline.tv_sec++;
+        Deadline.tv_nsec -= 1000000000;
+    }
+    while (pBatch->iOpen && pBatch->uCount < pCoalescer->uMaxUrls)
+    {
+        if (pthread_cond_timedwait(&pBatch->Full, &pCoalescer->Lock, &Deadline) == ETIMEDOUT)
+            break;
+    }
+    if (pBatch->iOpen)
+        CloseBatch(pCoalescer, pBatch);
+    pthread_mutex_unlock(&pCoalescer->Lock);
+    TWPStatsAddPhase(pCtx, TWP_PHASE_QUEUE, uStart);
+
+    Result = TWPStatsLookupUrls(pCtx, hConfigure, pRequest, 0, pBatch->ppUrls, pBatch->uCount, &hResponse);
+    if (Result == TWP_SUCCESS)
+    {
+        Result = CopyRatings(pCtx, pBatch, hResponse);
+        (*pCtx->pfResponseDestroy)(&hResponse);
+    }
+
+    pthread_mutex_lock(&pCoalescer->Lock);
+    pBatch->Result = Result;
+    pBatch->iDone = 1;
+    pthread_cond_broadcast(&pBatch->Done);
+    pthread_mutex_unlock(&pCoalescer->Lock);
+
+    return TakeRatings(pCtx, pBatch, 0, uCount, pRatings, puSlots);
+}
+
+
+/**
+ * Returns an open batch of the same configuration and request callbacks with
+ * room for uCount URLs.
+ */
+static FwBatch *FindBatch(TWPCoalescer *pCoalescer, TWPConfigurationHandle hConfigure, TWPRequest *pRequest,
+                          unsigned int uCount)
+{
+    FwBatch *pBatch;
+
+    for (pBatch = pCoalescer->pOpen; pBatch != NULL; pBatch = pBatch->pNext)
+    {
+        if (pBatch->hConfigure == hConfigure && pBatch->uCount + uCount <= pCoalescer->uMaxUrls &&
+            pBatch->pRequest->seturlfunc == pRequest->seturlfunc &&
+            pBatch->pRequest->setmethodfunc == pRequest->setmethodfunc &&
+            pBatch->pRequest->sendfunc == pRequest->sendfunc &&
+            pBatch->pRequest->receivefunc == pRequest->receivefunc)
+            return pBatch;
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Stops a batch from accepting URLs and wakes up its sender.
+ */
+static void CloseBatch(TWPCoalescer *pCoalescer, FwBatch *pBatch)
+{
+    FwBatch **ppLink;
+
+    for (ppLink = &pCoalescer->pOpen; *ppLink != pBatch; ppLink = &(*ppLink)->pNext)
+        ;
+    *ppLink = pBatch->pNext;
+    pBatch->iOpen = 0;
+    pthread_cond_signal(&pBatch->Full);
+}
+
+
+/**
+ * Copies the ratings of the batch out of the plug-in response. The plug-in is
+ * not called by several threads on the same response.
+ */
+static TWP_RESULT CopyRatings(SitePluginContext *pCtx, FwBatch *pBatch, TWPResponseHandle hResponse)
+{
+    TWP_RESULT Result = TWP_SUCCESS;
+    unsigned int i;
+
+    for (i = 0; Result == TWP_SUCCESS && i < pBatch->uCount; i++)
+        Result = TWPCopyRating(pCtx, hResponse, i, pBatch->ppUrls[i], &pBatch->pRatings[i]);
+
+    if (Result != TWP_SUCCESS)
+    {
+        for (i = 0; i < pBatch->uCount; i++)
+        {
+            free(pBatch->pRatings[i].pszUrl);
+            free(pBatch->pRatings[i].pszDlaUrl);
+        }
+        memset(pBatch->pRatings, 0, pBatch->uCount * sizeof(FwRating));
+    }
+
+    return Result;
+}
+
+
+/**
+ * Moves the ratings of a caller out of a finished batch and releases it, the
+ * last caller frees the batch.
+ */
+static TWP_RESULT TakeRatings(SitePluginContext *pCtx, FwBatch *pBatch, unsigned int uFirst, unsigned int uCount,
+                              FwRating *pRatings, unsigned int const *puSlots)
+{
+    TWP_RESULT Result = pBatch->Result;
+    unsigned int uRefs;
+    unsigned int i;
+
+    for (i = 0; Result == TWP_SUCCESS && i < uCount; i++)
+        pRatings[puSlots[i]] = pBatch->pRatings[uFirst + i];
+
+    pthread_mutex_lock(&pCtx->pCoalescer->Lock);
+    uRefs = --pBatch->uRefs;
+    pthread_mutex_unlock(&pCtx->pCoalescer->Lock);
+
+    if (uRefs == 0)
+        FreeBatch(pBatch);
+
+    return Result;
+}
+
+
+static void FreeBatch(FwBatch *pBatch)
+{
+    free(pBatch->pRatings);
+    pthread_cond_destroy(&pBatch->Full);
+    pthread_cond_destroy(&pBatch->Done);
+    free(pBatch);
+}
@@ -0,0 +1,95 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TWPCOALESCE_H
+#define TWPCOALESCE_H
+
+#include "TWPImpl.h"
+
+#ifdef __cplusplus 
+extern "C" {
+#endif
+
+/**
+ * \file TWPCoalesce.h
+ * \brief TWP Lookup Coalescing Header File
+ *  
+ * This file provides functions to merge the lookups of several threads into
+ * a single plug-in lookup.
+ *
+ * When coalescing is enabled, the first synchronous TWPLookupUrls() call
+ * without landing page (iRedirUrl is 0) waits up to the configured window
+ * for other threads looking up URLs with the same configuration handle and
+ * request callbacks. Their URLs are then sent in one plug-in lookup through
+ * the request of the first thread, the other threads wait for it. That
+ * thread alone reads the plug-in response: it copies the ratings out before
+ * waking the others. Every caller gets a response with its own copies,
+ * served like cached ratings, which all the response and rating functions
+ * accept. The lookup is sent early when the batch is
+ * full, and calls with more URLs than a batch holds are not merged.
+ *
+ * URLs served by the rating cache are not sent, see TWPCache.h.
+ */
+
+#define TWP_COALESCE_DEF_WINDOW 5000 /* Default wait (in microseconds) for other lookups. */
+
+#define TWP_COALESCE_DEF_MAX_URLS 32 /* Default number of URLs of a merged lookup. */
+
+/**
+ * Coalescing settings.
+ */
+typedef struct TWPCoalesceParam_struct
+{
+    unsigned int uWindow; /* Wait (in microseconds) for other lookups, 0 for TWP_COALESCE_DEF_WINDOW. */
+    unsigned int uMaxUrls; /* Number of URLs of a merged lookup, 0 for TWP_COALESCE_DEF_MAX_URLS. */
+} TWPCoalesceParam;
+
+/**
+ * \brief Enables, changes or disables the coalescing of the lookups of a
+ * library handle.
+ *
+ * Coalescing is disabled by default. This must not be called while other
+ * threads use the library handle.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] hLib Library handle returned by TWPInitLibrary().
+ * \param[in] pParam Coalescing settings, NULL to disable coalescing.
+ *
+ * \return TWP_RESULT
+ */
+TWP_RESULT TWPCoalesceConfigure(TWPLIB_HANDLE hLib, TWPCoalesceParam const *pParam);
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif  /* TWPCOALESCE_H */
@@ -0,0 +1,202 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "TWPDeadline.h"
+#include "TWPAsync.h"
+#include "TWPInternal.h"
+
+
+#if defined(DEBUG)
+#define DEBUG_LOG(_fmt_, _param_...)    { \
+                                            printf("[TWP] %s,%d: " _fmt_, __FILE__, __LINE__, ##_param_); \
+                                        }
+#else
+#define DEBUG_LOG(_fmt_, _param_...)
+#endif
+
+
+/**
+ * Lookup waited for by a caller. The caller frees it once the reply is in,
+ * DeadlineDone() frees it if the caller gave up.
+ */
+typedef struct FwDeadline_struct
+{
+    SitePluginContext *pCtx;
+    pthread_mutex_t Lock;
+    pthread_cond_t Done;
+    int iDone;
+    int iAbandoned; /* The caller returned, the reply goes to the cache. */
+    TWP_RESULT Result;
+    TWPResponseHandle hResponse;
+    unsigned int uCount;
+    const char **ppUrls; /* Copied, the caller's URLs may be gone when the reply arrives. */
+} FwDeadline;
+
+
+static void DeadlineDone(void *pContext, TWP_RESULT Result, TWPResponseHandle hResponse);
+static void FreeDeadline(FwDeadline *pDeadline);
+
+
+TWP_RESULT TWPDeadlineConfigure(TWPLIB_HANDLE hLib, TWPDeadlineParam const *pParam)
+{
+    SitePluginContext *pCtx = (SitePluginContext *) hLib;
+
+    if (pCtx == NULL)
+        return TWP_INVALID_HANDLE;
+
+    if (pParam != NULL && pParam->uVerdict != TWP_DEADLINE_FAIL_OPEN && pParam->uVerdict != TWP_DEADLINE_FAIL_CLOSED)
+        return TWP_INVALID_PARAMETER;
+
+    pCtx->uDeadline = pParam != NULL ? pParam->uTimeout : 0;
+    pCtx->uDeadlineVerdict = pParam != NULL ? pParam->uVerdict : TWP_DEADLINE_FAIL_OPEN;
+
+    return TWP_SUCCESS;
+}
+
+
+TWP_RESULT TWPDeadlineLookup(SitePluginContext *pCtx, TWPConfigurationHandle hConfigure, const char **ppUrls,
+                             unsigned int uCount, unsigned int uTimeout, TWPResponseHandle *phResponse)
+{
+    FwDeadline *pDeadline;
+    pthread_condattr_t Attr;
+    struct timespec Deadline;
+    size_t Size = sizeof(FwDeadline) + uCount * sizeof(char *);
+    char *pNext;
+    TWP_RESULT Result;
+    unsigned int i;
+
+    *phResponse = NULL;
+    for (i = 0; i < uCount; i++)
+        Size += strlen(ppUrls[i]) + 1;
+
+    pDeadline = (FwDeadline *) calloc(1, Size);
+    if (pDeadline == NULL)
+        return TWP_NOMEM;
+    pDeadline->pCtx = pCtx;
+    pDeadline->uCount = uCount;
+    pDeadline->ppUrls = (const char **) (pDeadline + 1);
+    pNext = (char *) (pDeadline->ppUrls + uCount);
+    for (i = 0; i < uCount; i++)
+    {
+        size_t Length = strlen(ppUrls[i]) + 1;
+
+        memcpy(pNext, ppUrls[i], Length);
+        pDeadline->ppUrls[i] = pNext;
+        pNext += Length;
+    }
+    pthread_mutex_init(&pDeadline->Lock, NULL);
+    pthread_condattr_init(&Attr);
+    pthread_condattr_setclock(&Attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&pDeadline->Done, &Attr);
+    pthread_condattr_destroy(&Attr);
+
+    clock_gettime(CLOCK_MONOTONIC, &Deadline);
+    Deadline.tv_sec += uTimeout / 1000;
+    Deadline.tv_nsec += (long) (uTimeout % 1000) * 1000000;
+    if (Deadline.tv_nsec >= 1000000000)
+    {
+        Deadline.tv_sec++;
+        Deadline.tv_nsec -= 1000000000;
+    }
+
+    /* The callback runs on the event loop thread, TWPAsyncDispatch() may not be called while we wait. */
+    Result = TWPAsyncSubmit(pCtx, hConfigure, 0, pDeadline->ppUrls, uCount, DeadlineDone, pDeadline,
+                            TWP_SUBMIT_ON_LOOP | TWP_SUBMIT_INTERNAL);
+    if (Result != TWP_SUCCESS)
+    {
+        FreeDeadline(pDeadline);
+        return Result;
+    }
+
+    pthread_mutex_lock(&pDeadline->Lock);
+    while (!pDeadline->iDone)
+    {
+        if (pthread_cond_timedwait(&pDeadline->Done, &pDeadline->Lock, &Deadline) == ETIMEDOUT)
+            break;
+    }
+    if (!pDeadline->iDone)
+    {
+        pDeadline->iAbandoned = 1;
+        pthread_mutex_unlock(&pDeadline->Lock);
+        DEBUG_LOG("deadline: %u urls late after %u ms\n", uCount, uTimeout);
+        TWP_STATS_ADD(pCtx, ulDeadlines, 1);
+        return TWP_NO_DATA;
+    }
+    pthread_mutex_unlock(&pDeadline->Lock);
+
+    Result = pDeadline->Result;
+    *phResponse = pDeadline->hResponse;
+    FreeDeadline(pDeadline);
+
+    return Result;
+}
+
+
+static void DeadlineDone(void *pContext, TWP_RESULT Result, TWPResponseHandle hResponse)
+{
+    FwDeadline *pDeadline = (FwDeadline *) pContext;
+    SitePluginContext *pCtx = pDeadline->pCtx;
+
+    pthread_mutex_lock(&pDeadline->Lock);
+    if (!pDeadline->iAbandoned)
+    {
+        pDeadline->Result = Result;
+        pDeadline->hResponse = hResponse;
+        pDeadline->iDone = 1;
+        pthread_cond_signal(&pDeadline->Done);
+        pthread_mutex_unlock(&pDeadline->Lock);
+        return;
+    }
+    pthread_mutex_unlock(&pDeadline->Lock);
+
+    if (Result == TWP_SUCCESS)
+        TWPCacheResponse(pCtx, hResponse, pDeadline->ppUrls, pDeadline->uCount);
+    DEBUG_LOG("deadline: late reply for %u urls (%d)\n", pDeadline->uCount, Result);
+
+    if (hResponse != NULL)
+        (*pCtx->pfResponseDestroy)(&hResponse);
+    FreeDeadline(pDeadline);
+}
+
+
+static void FreeDeadline(FwDeadline *pDeadline)
+{
+    pthread_cond_destroy(&pDeadline->Done);
+    pthread_mutex_destroy(&pDeadline->Lock);
+    free(pDeadline);
+}
@@ -0,0 +1,130 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TWPDEADLINE_H
+#define TWPDEADLINE_H
+
+#include "TWPImpl.h"
+
+#ifdef __cplusplus 
+extern "C" {
+#endif
+
+/**
+ * \file TWPDeadline.h
+ * \brief TWP Lookup Deadline Header File
+ *  
+ * This file provides functions to bound the time a synchronous lookup waits
+ * for the cloud.
+ *
+ * With a deadline, the URLs of a TWPLookupUrls() call without landing page
+ * that are not rated by the local database, the rating cache or the host
+ * filter are looked up on the event loop (see TWPAsync.h) instead of through
+ * the caller's TWPRequest, and the call waits for the reply until the
+ * deadline. If the reply is late, these URLs get the verdict of the
+ * configuration: with TWP_DEADLINE_FAIL_OPEN a score of TWP_UnverifiedLow
+ * and the TWP_OverallRiskUnverified category, with TWP_DEADLINE_FAIL_CLOSED
+ * a score of TWP_HighHigh and the TWP_OverallRiskHigh category. Such ratings
+ * have no landing page nor DLA URL and are provisional (see
+ * TWPUrlRatingIsProvisional()). The lookup goes on, its ratings are added to
+ * the rating cache when the reply arrives.
+ *
+ * The deadline covers the whole lookup, the server is resolved by the event
+ * loop (see TWPAsync.h) while the caller waits. It has two limits:
+ * - The event loop only speaks plain HTTP. With a plug-in configured for
+ *   HTTPS, the lookups are made through the caller's TWPRequest and are not
+ *   bounded.
+ * - Lookups on the event loop are not coalesced (see TWPCoalesce.h), each
+ *   bounded call sends its own request.
+ *
+ * Without the event loop, lookups are made through the caller's TWPRequest
+ * and are not bounded.
+ */
+
+#define TWP_DEADLINE_FAIL_OPEN 0 /* Late URLs are unverified. */
+
+#define TWP_DEADLINE_FAIL_CLOSED 1 /* Late URLs are high risk. */
+
+/**
+ * Deadline settings.
+ */
+typedef struct TWPDeadlineParam_struct
+{
+    unsigned int uTimeout; /* Time limit (in milliseconds) of a TWPLookupUrls() call, 0 for none. */
+    unsigned int uVerdict; /* TWP_DEADLINE_FAIL_OPEN or TWP_DEADLINE_FAIL_CLOSED. */
+} TWPDeadlineParam;
+
+/**
+ * \brief Sets the deadline of the TWPLookupUrls() calls and the verdict of
+ * late URLs.
+ *
+ * There is no deadline by default and late URLs of TWPLookupUrlsWithin()
+ * fail open. This must not be called while other threads use the library
+ * handle.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] hLib Library handle returned by TWPInitLibrary().
+ * \param[in] pParam Deadline settings, NULL to remove the deadline.
+ *
+ * \return TWP_RESULT
+ */
+TWP_RESULT TWPDeadlineConfigure(TWPLIB_HANDLE hLib, TWPDeadlineParam const *pParam);
+
+/**
+ * \brief Looks up URLs, waiting for the cloud at most uTimeout milliseconds.
+ *
+ * Same as TWPLookupUrls() without landing page, with its own deadline in
+ * place of the configured one. The verdict of late URLs is the configured
+ * one.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] hLib Library handle returned by TWPInitLibrary().
+ * \param[in] hConfigure Configuration handle.
+ * \param[in] pRequest Request used when the URLs are not looked up on the
+ * event loop.
+ * \param[in] ppUrls URLs to check.
+ * \param[in] uCount Number of URLs.
+ * \param[in] uTimeout Time limit in milliseconds, 0 for none.
+ * \param[out] phResponse Response handle, released with TWPResponseDestroy().
+ *
+ * \return TWP_RESULT
+ */
+TWP_RESULT TWPLookupUrlsWithin(TWPLIB_HANDLE hLib, TWPConfigurationHandle hConfigure, TWPRequest *pRequest,
+                               const char **ppUrls, unsigned int uCount, unsigned int uTimeout,
+                               TWPResponseHandle *phResponse);
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif  /* TWPDEADLINE_H */
@@ -0,0 +1,481 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "TWPCache.h"
+#include "TWPInternal.h"
+
+
+#define DISK_CACHE_MAGIC 0x3143525057545754ULL /* "TWTWPRC1" */
+
+#define DISK_CACHE_VERSION 2
+
+#define DISK_HEADER_SIZE 4096 /* The slots start on the next page. */
+
+#define DISK_SLOT_SIZE 512
+
+#define DISK_MAX_SLOTS 0x100000
+
+#define DISK_SLOT_DATA (DISK_SLOT_SIZE - 64) /* Room for the key and the DLA URL of a slot. */
+
+#define DISK_PROBE_SLOTS 8 /* Slots searched from the home slot of a key. */
+
+#define DISK_READ_RETRIES 16 /* A slot still being changed after that many reads is skipped. */
+
+#define DISK_OPEN_RETRIES 4
+
+
+/**
+ * File header, the slots follow at DISK_HEADER_SIZE.
+ */
+typedef struct DiskHeader_struct
+{
+    uint64_t uMagic;
+    uint32_t uVersion;
+    uint32_t uSlotSize;
+    uint32_t uSlots; /* Power of 2. */
+} DiskHeader;
+
+/**
+ * Cached rating. Writers make uSeq odd while they change the slot, readers
+ * retry when uSeq is odd or changed during the read. uCheck covers the rest of
+ * the slot so slots torn by a crash are ignored.
+ */
+typedef struct DiskSlot_struct
+{
+    uint32_t uSeq;
+    uint32_t uCheck;
+    uint64_t uHash; /* 0 for an empty slot. */
+    int64_t Expires; /* Wall clock time, survives reboots. */
+    int32_t iScore;
+    uint16_t uKeyLength;
+    uint16_t uDlaLength; /* 0 if the URL has no DLA URL. */
+    uint64_t Categories[TWP_CATEGORY_WORDS];
+    uint64_t uReserved;
+    char Data[DISK_SLOT_DATA]; /* The key followed by the DLA URL, not null terminated. */
+} DiskSlot;
+
+struct TWPDiskCache_struct
+{
+    int iFd;
+    void *pMap;
+    size_t Size;
+    DiskSlot *pSlots;
+    uint32_t uMask;
+    unsigned int uTtl;
+    pthread_mutex_t Lock; /* flock() does not exclude the threads sharing iFd. */
+};
+
+
+static TWPDiskCache *DiskCacheOpen(char const *pszPath, unsigned int uMaxEntries, unsigned int uTtl);
+static int DiskCacheCheck(int iFd, size_t Size);
+static int DiskCacheCreate(char const *pszPath, unsigned int uMaxEntries);
+static uint32_t SlotChecksum(DiskSlot const *pSlot);
+static int SlotRead(DiskSlot *pSlot, DiskSlot *pCopy);
+static void SlotWriteBegin(DiskSlot *pSlot);
+static void SlotWriteEnd(DiskSlot *pSlot);
+static void WriteLock(TWPDiskCache *pCache);
+static void WriteUnlock(TWPDiskCache *pCache);
+
+
+TWP_RESULT TWPDiskCacheConfigure(TWPLIB_HANDLE hLib, TWPDiskCacheParam const *pParam)
+{
+    SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    TWPDiskCache *pCache = NULL;
+
+    if (pCtx == NULL)
+        return TWP_INVALID_HANDLE;
+
+    if (pParam != NULL)
+    {
+        if (pParam->pszPath == NULL)
+            return TWP_INVALID_PARAMETER;
+        pCache = DiskCacheOpen(pParam->pszPath,
+                               pParam->uMaxEntries != 0 ? pParam->uMaxEntries : TWP_DISK_CACHE_DEF_ENTRIES,
+                               pParam->uTtl != 0 ? pParam->uTtl : TWP_DISK_CACHE_DEF_TTL);
+        if (pCache == NULL)
+            return TWP_ERROR;
+    }
+
+    if (pCtx->pDiskCache != NULL)
+        TWPDiskCacheClose(pCtx->pDiskCache);
+    pCtx->pDiskCache = pCache;
+
+    return TWP_SUCCESS;
+}
+
+
+void TWPDiskCacheClose(TWPDiskCache *pCache)
+{
+    munmap(pCache->pMap, pCache->Size);
+    close(pCache->iFd);
+    pthread_mutex_destroy(&pCache->Lock);
+    free(pCache);
+}
+
+
+void TWPDiskCacheFlush(TWPDiskCache *pCache)
+{
+    uint32_t i;
+
+    WriteLock(pCache);
+    for (i = 0; i <= pCache->uMask; i++)
+    {
+        DiskSlot *pSlot = &pCache->pSlots[i];
+
+        if (pSlot->uHash == 0 && (pSlot->uSeq & 1) == 0)
+            continue;
+        SlotWriteBegin(pSlot);
+        pSlot->uHash = 0;
+        pSlot->uCheck = SlotChecksum(pSlot);
+        SlotWriteEnd(pSlot);
+    }
+    WriteUnlock(pCache);
+}
+
+
+int TWPDiskCacheGet(TWPDiskCache *pCache, uint64_t uHash, char const *pKey, unsigned int uKeyLength,
+                    FwRating *pRating)
+{
+    DiskSlot Copy;
+    int64_t Now = (int64_t) time(NULL);
+    uint32_t i;
+
+    if (uHash == 0)
+        uHash = 1;
+
+    for (i = 0; i < DISK_PROBE_SLOTS; i++)
+    {
+        DiskSlot *pSlot = &pCache->pSlots[(uHash + i) & pCache->uMask];
+
+        /* Compare the hash before copying the whole slot. */
+        if (__atomic_load_n(&pSlot->uHash, __ATOMIC_RELAXED) != uHash)
+            continue;
+        if (SlotRead(pSlot, &Copy) != 0 || Copy.uHash != uHash || Copy.uKeyLength != uKeyLength ||
+            memcmp(Copy.Data, pKey, uKeyLength) != 0)
+            continue;
+        if (Copy.Expires <= Now)
+            return -1;
+
+        pRating->iScore = Copy.iScore;
+        memcpy(pRating->Categories, Copy.Categories, sizeof(pRating->Categories));
+        pRating->uLifetime = (unsigned int) (Copy.Expires - Now);
+        pRating->pszDlaUrl = NULL;
+        pRating->uDlaLength = 0;
+        if (Copy.uDlaLength != 0)
+        {
+            pRating->pszDlaUrl = (char *) malloc(Copy.uDlaLength + 1);
+            if (pRating->pszDlaUrl == NULL)
+                return -1;
+            memcpy(pRating->pszDlaUrl, Copy.Data + uKeyLength, Copy.uDlaLength);
+            pRating->pszDlaUrl[Copy.uDlaLength] = '\0';
+            pRating->uDlaLength = Copy.uDlaLength;
+        }
+        return 0;
+    }
+
+    return -1;
+}
+
+
+void TWPDiskCachePut(TWPDiskCache *pCache, uint64_t uHash, char const *pKey, unsigned int uKeyLength,
+                     FwRating const *pRating)
+{
+    unsigned int uDlaLength = pRating->pszDlaUrl != NULL ? pRating->uDlaLength : 0;
+    int64_t Now = (int64_t) time(NULL);
+    DiskSlot *pVictim = NULL;
+    int64_t VictimExpires = 0;
+    DiskSlot *pSlot;
+    uint32_t i;
+
+    if (uKeyLength + uDlaLength > DISK_SLOT_DATA)
+        return;
+    if (uHash == 0)
+        uHash = 1;
+
+    WriteLock(pCache);
+    /*
+     * Writers are serialized, a slot with an odd sequence was left by a writer
+     * that crashed and is free. Reuse the slot of the key, else a free slot,
+     * else the slot expiring first.
+     */
+    for (i = 0; i < DISK_PROBE_SLOTS; i++)
+    {
+        int64_t Expires;
+
+        pSlot = &pCache->pSlots[(uHash + i) & pCache->uMask];
+        if (pSlot->uHash == uHash && (pSlot->uSeq & 1) == 0 && pSlot->uKeyLength == uKeyLength &&
+            memcmp(pSlot->Data, pKey, uKeyLength) == 0)
+        {
+            pVictim = pSlot;
+            break;
+        }
+        Expires = (pSlot->uHash == 0 || (pSlot->uSeq & 1) != 0) ? INT64_MIN : pSlot->Expires;
+        if (pVictim == NULL || Expires < VictimExpires)
+        {
+            pVictim = pSlot;
+            VictimExpires = Expires;
+        }
+    }
+
+    SlotWriteBegin(pVictim);
+    pVictim->uHash = uHash;
+    pVictim->Expires = Now + pCache->uTtl;
+    pVictim->iScore = pRating->iScore;
+    pVictim->uKeyLength = (uint16_t) uKeyLength;
+    pVictim->uDlaLength = (uint16_t) uDlaLength;
+    memcpy(pVictim->Categories, pRating->Categories, sizeof(pVictim->Categories));
+    memcpy(pVictim->Data, pKey, uKeyLength);
+    if (uDlaLength != 0)
+        memcpy(pVictim->Data + uKeyLength, pRating->pszDlaUrl, uDlaLength);
+    pVictim->uCheck = SlotChecksum(pVictim);
+    SlotWriteEnd(pVictim);
+    WriteUnlock(pCache);
+}
+
+
+static TWPDiskCache *DiskCacheOpen(char const *pszPath, unsigned int uMaxEntries, unsigned int uTtl)
+{
+    TWPDiskCache *pCache;
+    int iFd = -1;
+    size_t Size = 0;
+    void *pMap;
+    unsigned int i;
+
+    /*
+     * A missing or unusable file is replaced by an empty one. Another process
+     * may replace it while this one waits for the lock, the file is opened
+     * again until the lock is held on the file at pszPath.
+     */
+    for (i = 0; i < DISK_OPEN_RETRIES; i++)
+    {
+        struct stat St;
+        struct stat PathSt;
+
+        iFd = open(pszPath, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (iFd < 0)
+            return NULL;
+        if (flock(iFd, LOCK_EX) != 0 || fstat(iFd, &St) != 0)
+            break;
+        if (stat(pszPath, &PathSt) == 0 && PathSt.st_dev == St.st_dev && PathSt.st_ino == St.st_ino)
+        {
+            if (DiskCacheCheck(iFd, (size_t) St.st_size) == 0)
+            {
+                Size = (size_t) St.st_size;
+                flock(iFd, LOCK_UN);
+                break;
+            }
+            if (DiskCacheCreate(pszPath, uMaxEntries) != 0)
+                break;
+        }
+        close(iFd);
+        iFd = -1;
+    }
+    if (Size == 0)
+    {
+        if (iFd >= 0)
+            close(iFd);
+        return NULL;
+    }
+
+    pMap = mmap(NULL, Size, PROT_READ | PROT_WRITE, MAP_SHARED, iFd, 0);
+    pCache = (TWPDiskCache *) calloc(1, sizeof(TWPDiskCache));
+    if (pMap == MAP_FAILED || pCache == NULL)
+    {
+        if (pMap != MAP_FAILED)
+            munmap(pMap, Size);
+        free(pCache);
+        close(iFd);
+        return NULL;
+    }
+
+    pCache->iFd = iFd;
+    pCache->pMap = pMap;
+    pCache->Size = Size;
+    pCache->pSlots = (DiskSlot *) ((char *) pMap + DISK_HEADER_SIZE);
+    pCache->uMask = (uint32_t) ((Size - DISK_HEADER_SIZE) / DISK_SLOT_SIZE) - 1;
+    pCache->uTtl = uTtl;
+    pthread_mutex_init(&pCache->Lock, NULL);
+
+    return pCache;
+}
+
+
+/**
+ * Returns 0 if the file has a valid header and the matching size.
+ */
+static int DiskCacheCheck(int iFd, size_t Size)
+{
+    DiskHeader Header;
+
+    if (pread(iFd, &Header, sizeof(Header), 0) != (ssize_t) sizeof(Header))
+        return -1;
+    if (Header.uMagic != DISK_CACHE_MAGIC || Header.uVersion != DISK_CACHE_VERSION ||
+        Header.uSlotSize != DISK_SLOT_SIZE || Header.uSlots < DISK_PROBE_SLOTS ||
+        (Header.uSlots & (Header.uSlots - 1)) != 0 ||
+        Size != DISK_HEADER_SIZE + (size_t) Header.uSlots * DISK_SLOT_SIZE)
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * Writes an empty cache to a temporary file and renames it to pszPath, so
+ * the file at pszPath is always complete.
+ */
+static int DiskCacheCreate(char const *pszPath, unsigned int uMaxEntries)
+{
+    DiskHeader Header;
+    uint32_t uSlots = DISK_PROBE_SLOTS;
+    size_t Length = strlen(pszPath);
+    char *pszTemp;
+    int iFd;
+    int iRet = -1;
+
+    while (uSlots < uMaxEntries && uSlots < DISK_MAX_SLOTS)
+        uSlots <<= 1;
+
+    pszTemp = (char *) malloc(Length + sizeof(".XXXXXX"));
+    if (pszTemp == NULL)
+        return -1;
+    memcpy(pszTemp, pszPath, Length);
+    memcpy(pszTemp + Length, ".XXXXXX", sizeof(".XXXXXX"));
+
+    iFd = mkstemp(pszTemp);
+    if (iFd < 0)
+    {
+        free(pszTemp);
+        return -1;
+    }
+
+    memset(&Header, 0, sizeof(Header));
+    Header.uMagic = DISK_CACHE_MAGIC;
+    Header.uVersion = DISK_CACHE_VERSION;
+    Header.uSlotSize = DISK_SLOT_SIZE;
+    Header.uSlots = uSlots;
+    if (ftruncate(iFd, (off_t) (DISK_HEADER_SIZE + (size_t) uSlots * DISK_SLOT_SIZE)) == 0 &&
+        pwrite(iFd, &Header, sizeof(Header), 0) == (ssize_t) sizeof(Header) &&
+        fsync(iFd) == 0 && rename(pszTemp, pszPath) == 0)
+        iRet = 0;
+    else
+        unlink(pszTemp);
+
+    close(iFd);
+    free(pszTemp);
+
+    return iRet;
+}
+
+
+static uint32_t SlotChecksum(DiskSlot const *pSlot)
+{
+    unsigned int uLength = offsetof(DiskSlot, Data) - offsetof(DiskSlot, uHash);
+    uint64_t uHash;
+
+    if (pSlot->uKeyLength + pSlot->uDlaLength <= DISK_SLOT_DATA)
+        uLength += pSlot->uKeyLength + pSlot->uDlaLength;
+    uHash = TWPUrlHash((char const *) &pSlot->uHash, uLength);
+
+    return (uint32_t) (uHash ^ (uHash >> 32));
+}
+
+
+/**
+ * Copies a slot, returns -1 if the slot keeps changing or the copy is damaged.
+ */
+static int SlotRead(DiskSlot *pSlot, DiskSlot *pCopy)
+{
+    unsigned int i;
+
+    for (i = 0; i < DISK_READ_RETRIES; i++)
+    {
+        uint32_t uSeq = __atomic_load_n(&pSlot->uSeq, __ATOMIC_ACQUIRE);
+
+        if ((uSeq & 1) != 0)
+            continue;
+        memcpy(pCopy, pSlot, sizeof(DiskSlot));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&pSlot->uSeq, __ATOMIC_RELAXED) != uSeq)
+            continue;
+
+        if (pCopy->uKeyLength + pCopy->uDlaLength > DISK_SLOT_DATA || pCopy->uCheck != SlotChecksum(pCopy))
+            return -1;
+        return 0;
+    }
+
+    return -1;
+}
+
+
+static void SlotWriteBegin(DiskSlot *pSlot)
+{
+    /* A slot left odd by a crashed writer stays odd. */
+    if ((pSlot->uSeq & 1) == 0)
+        __atomic_store_n(&pSlot->uSeq, pSlot->uSeq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+
+static void SlotWriteEnd(DiskSlot *pSlot)
+{
+    __atomic_store_n(&pSlot->uSeq, pSlot->uSeq + 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Serializes the writers of this process and of other processes.
+ */
+static void WriteLock(TWPDiskCache *pCache)
+{
+    pthread_mutex_lock(&pCache->Lock);
+    while (flock(pCache->iFd, LOCK_EX) != 0 && errno == EINTR)
+        ;
+}
+
+
+static void WriteUnlock(TWPDiskCache *pCache)
+{
+    flock(pCache->iFd, LOCK_UN);
+    pthread_mutex_unlock(&pCache->Lock);
+}
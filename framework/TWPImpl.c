@@ -30,15 +30,53 @@
 */
 
 
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <dlfcn.h>
 #include <malloc.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
-#include "TWPImpl.h"
+#include "TWPCache.h"
+#include "TWPUrl.h"
+#include "TWPPolicy.h"
+#include "TWPAsync.h"
+#include "TWPBloom.h"
+#include "TWPDeadline.h"
+#include "TWPInternal.h"
 
 
 #define SITE_PLUGIN_PATH "/opt/usr/share/sec_plugin/libwpengine.so"
 
+#define CACHE_HIT ((unsigned int) -1) /* Miss index of the URLs served from the cache. */
+
+#define PROVISIONAL_FILTER 1 /* FwRating::iProvisional of the host filter ratings. */
+
+#define PROVISIONAL_DEADLINE 2 /* FwRating::iProvisional of the deadline verdicts. */
+
+#define POLICY_LANES 4 /* Policies checked by one vector operation. */
+
+#define POLICY_LOCAL_BLOCKS 16 /* Blocks of POLICY_LANES policies sliced on the stack. */
+
+/*
+ * One category word of POLICY_LANES policies. The compiler maps it to the
+ * vector unit of the target (NEON, SSE or AVX).
+ */
+typedef uint64_t FwVector __attribute__((vector_size(POLICY_LANES * sizeof(uint64_t))));
+
+/*
+ * URLs rated without the plug-in and being looked up again, the pointers and
+ * the URLs follow.
+ */
+typedef struct FwRevalidate_struct
+{
+    SitePluginContext *pCtx;
+    unsigned int uCount;
+    const char **ppUrls;
+} FwRevalidate;
+
 #if defined(DEBUG)
 #define DEBUG_LOG(_fmt_, _param_...)    { \
                                             printf("[TCS] %s,%d: " _fmt_, __FILE__, __LINE__, ##_param_); \
@@ -48,76 +86,73 @@
 #endif
 
 
-typedef TWP_RESULT (*FuncInitLibrary)(TWPAPIInit *pApiInit);
-typedef void (*FuncUninitLibrary)(void);
-typedef TWP_RESULT (*FuncConfigurationCreate)(TWPConfiguration *pConfigure, TWPConfigurationHandle *phConfigure);
-typedef TWP_RESULT (*FuncConfigurationDestroy)(TWPConfigurationHandle *hConfigure);
-typedef TWP_RESULT (*FuncLookupUrls)(TWPConfigurationHandle hConfigure, TWPRequest *pRequest, int iRedirUrl,
-                                     const char **ppUrls, unsigned int uCount, TWPResponseHandle *phResponse);
-typedef TWP_RESULT (*FuncResponseWrite)(TWPResponseHandle hResponse, const void *pData, unsigned uLength);
-typedef TWP_RESULT (*FuncResponseGetUrlRatingByIndex)(TWPResponseHandle hResponse, unsigned int iIndex,
-                                                      TWPUrlRatingHandle *hRating);
-typedef TWP_RESULT (*FuncResponseGetUrlRatingByUrl)(TWPResponseHandle hResponse, const char *pUrl,
-                                                    unsigned int iUrlLength, TWPUrlRatingHandle *hRating);
-typedef TWP_RESULT (*FuncResponseGetRedirUrlFor)(TWPResponseHandle hResponse, TWPUrlRatingHandle hRating,
-                                                 TWPPolicyHandle hPolicy, char **ppUrl, unsigned int *puLength);
-typedef TWP_RESULT (*FuncResponseGetUrlRatingsCount)(TWPResponseHandle hResponse, unsigned int *puCount);
-typedef TWP_RESULT (*FuncResponseDestroy)(TWPResponseHandle *handle_response);
-typedef TWP_RESULT (*FuncPolicyCreate)(TWPConfigurationHandle hCfg, TWPCategories *pCategories, unsigned int uCount,
-                                       TWPPolicyHandle *phPolicy);
-typedef TWP_RESULT (*FuncPolicyValidate)(TWPPolicyHandle hPolicy, TWPUrlRatingHandle hRating, int *piViolated);
-typedef TWP_RESULT (*FuncPolicyGetViolations)(TWPPolicyHandle hPolicy, TWPUrlRatingHandle hRating,
-                                              TWPCategories **ppViolated, unsigned *puLength);
-typedef TWP_RESULT (*FuncPolicyDestroy)(TWPPolicyHandle *hPolicy);
-typedef TWP_RESULT (*FuncUrlRatingGetScore)(TWPUrlRatingHandle hRating, int *piScore);
-typedef TWP_RESULT (*FuncUrlRatingGetUrl)(TWPUrlRatingHandle hRating, const char **ppUrl,
-                                          unsigned int *puLength);
-typedef TWP_RESULT (*FuncUrlRatingGetDLAUrl)(TWPUrlRatingHandle hRating, const char **ppDlaUrl,
-                                             unsigned int *puLength);
-typedef TWP_RESULT (*FuncUrlRatingHasCategory)(TWPUrlRatingHandle hRating, TWPCategories Category,
-                                               int *piPresent);
-typedef TWP_RESULT (*FuncUrlRatingGetCategories)(TWPUrlRatingHandle hRating, TWPCategories **ppCategories,
-                                                 unsigned int *puLength);
-
-
-typedef struct SitePluginContext_struct
-{
-    void *pPlugin;
-    FuncUninitLibrary pfUninitLibrary;
-    FuncInitLibrary pfInitLibrary;
-    FuncConfigurationCreate pfConfigurationCreate;
-    FuncConfigurationDestroy pfConfigurationDestroy;
-    FuncLookupUrls pfLookupUrls;
-    FuncResponseWrite pfResponseWrite;
-    FuncResponseGetUrlRatingByIndex pfResponseGetUrlRatingByIndex;
-    FuncResponseGetUrlRatingByUrl pfResponseGetUrlRatingByUrl;
-    FuncResponseGetRedirUrlFor pfResponseGetRedirUrlFor;
-    FuncResponseGetUrlRatingsCount pfResponseGetUrlRatingsCount;
-    FuncResponseDestroy pfResponseDestroy;
-    FuncPolicyCreate pfPolicyCreate;
-    FuncPolicyValidate pfPolicyValidate;
-    FuncPolicyGetViolations pfPolicyGetViolations;
-    FuncPolicyDestroy pfPolicyDestroy;
-    FuncUrlRatingGetScore pfUrlRatingGetScore;
-    FuncUrlRatingGetUrl pfUrlRatingGetUrl;
-    FuncUrlRatingGetDLAUrl pfUrlRatingGetDLAUrl;
-    FuncUrlRatingHasCategory pfUrlRatingHasCategory;
-    FuncUrlRatingGetCategories pfUrlRatingGetCategories;
-} SitePluginContext;
+static SitePluginContext *LoadPlugin(void);
+static void ReleasePlugin(void);
+static int ReadInterface(void *pPlugin, SitePluginContext *pFunctions);
+static int ReadSymbols(void *pPlugin, SitePluginContext *pFunctions);
+static void *DefaultMemAlloc(TWPMallocSizeT Size);
+static void DefaultMemFree(void *pAddress);
+static TWP_RESULT LookupUrls(SitePluginContext *pCtx, TWPConfigurationHandle hConfigure, TWPRequest *pRequest,
+                             int iRedirUrl, const char **ppUrls, unsigned int uCount, unsigned int uTimeout,
+                             TWPResponseHandle *phResponse);
+static TWP_RESULT LookupCached(SitePluginContext *pCtx, TWPConfigurationHandle hConfigure, TWPRequest *pRequest,
+                               const char **ppUrls, unsigned int uCount, unsigned int uTimeout,
+                               TWPResponseHandle *phResponse);
+static int HasDuplicates(const char **ppUrls, unsigned int uCount);
+static int CompareHash(void const *pLeft, void const *pRight);
+static unsigned int *FindMiss(unsigned int *puTable, unsigned int uTableMask, const char **ppMisses,
+                              uint64_t const *puMissHashes, char const *pKey, unsigned int uKeyLength,
+                              uint64_t uHash);
+static int GetCachedUrl(SitePluginContext *pCtx, char const *pKey, unsigned int uKeyLength, FwRating *pRating);
+static int GetCached(SitePluginContext *pCtx, char const *pKey, unsigned int uKeyLength, FwRating *pRating);
+static void PutCached(SitePluginContext *pCtx, char const *pKey, unsigned int uKeyLength, FwRating const *pRating);
+static void CacheRating(SitePluginContext *pCtx, char const *pKey, unsigned int uKeyLength, FwRating const *pRating);
+static void SetProvisional(FwRating *pRating);
+static void SetVerdict(FwRating *pRating, unsigned int uVerdict);
+static void Revalidate(SitePluginContext *pCtx, TWPConfigurationHandle hConfigure, FwResponse const *pResp,
+                       unsigned int uRevalidate);
+static void RevalidateDone(void *pContext, TWP_RESULT Result, TWPResponseHandle hResponse);
+static TWP_RESULT FillRating(SitePluginContext *pCtx, FwRating *pRating);
+static TWP_RESULT CompileRating(SitePluginContext *pCtx, FwRating *pRating);
+static TWP_RESULT ReadCategoryMask(SitePluginContext *pCtx, TWPUrlRatingHandle hRating, uint64_t *pMask);
+static void FreeResponse(SitePluginContext *pCtx, FwResponse *pResp);
+static TWP_RESULT GetCategoryList(SitePluginContext *pCtx, uint64_t const *pCategories,
+                                  TWPCategories **ppCategories, unsigned int *puLength);
 
 
-static SitePluginContext *LoadPlugin(void);
+/*
+ * Plug-in module shared by the library handles. It stays loaded when the
+ * last handle is closed, and is reloaded if the file has changed since.
+ */
+static pthread_mutex_t PluginLock = PTHREAD_MUTEX_INITIALIZER;
+static void *pPluginModule = NULL;
+static SitePluginContext PluginFunctions; /* Functions of pPluginModule. */
+static struct stat PluginStat; /* File of pPluginModule. */
+static unsigned int uPluginRefs = 0; /* Library handles using pPluginModule. */
 
 
 TWPLIB_HANDLE TWPInitLibrary(TWPAPIInit *pApiInit)
 {
     SitePluginContext *pCtx = NULL;
+    TWPAPIInit Init;
 
     pCtx = LoadPlugin();
     if (pCtx != NULL)
     {
+        if (pApiInit != NULL && pApiInit->memallocfunc != NULL && pApiInit->memfreefunc != NULL)
+        {
+            pCtx->pfMemAlloc = pApiInit->memallocfunc;
+            pCtx->pfMemFree = pApiInit->memfreefunc;
+        }
+
+        /* The plug-in allocates through the framework so responses can use arenas. */
+        TWPArenaSetAllocator(pCtx->pfMemAlloc, pCtx->pfMemFree);
+        Init.api_version = pApiInit != NULL ? pApiInit->api_version : TWPAPI_VERSION;
+        Init.memallocfunc = TWPArenaMemAlloc;
+        Init.memfreefunc = TWPArenaMemFree;
+
         if (pCtx->pfInitLibrary != NULL &&
-            (*pCtx->pfInitLibrary)(pApiInit) == TWP_SUCCESS)
+            (*pCtx->pfInitLibrary)(&Init) == TWP_SUCCESS)
             return (TWPLIB_HANDLE) pCtx;
 
         TWPUninitLibrary((TWPLIB_HANDLE) pCtx);
@@ -133,10 +168,26 @@ void TWPUninitLibrary(TWPLIB_HANDLE hLib)
 
     if (pCtx != NULL)
     {
+        if (pCtx->pAsync != NULL)
+            TWPAsyncDestroy(pCtx->pAsync);
+        if (pCtx->pPrefetch != NULL)
+            TWPPrefetchClose(pCtx->pPrefetch);
+        if (pCtx->pCache != NULL)
+            TWPCacheDestroy(pCtx->pCache);
+        if (pCtx->pDiskCache != NULL)
+            TWPDiskCacheClose(pCtx->pDiskCache);
+        if (pCtx->pLocalDb != NULL)
+            TWPLocalDbClose(pCtx->pLocalDb);
+        if (pCtx->pBloom != NULL)
+            TWPBloomClose(pCtx->pBloom);
+        if (pCtx->pCoalescer != NULL)
+            TWPCoalesceDestroy(pCtx->pCoalescer);
+        if (pCtx->pArenaPool != NULL)
+            TWPArenaPoolDestroy(pCtx->pArenaPool);
         if (pCtx->pfUninitLibrary != NULL)
             (*pCtx->pfUninitLibrary)();
         if (pCtx->pPlugin != NULL)
-            dlclose(pCtx->pPlugin);
+            ReleasePlugin();
         free(pCtx);
     }
 }
@@ -170,39 +221,109 @@ TWP_RESULT TWPLookupUrls(TWPLIB_HANDLE hLib, TWPConfigurationHandle hConfigure,
     if (pCtx == NULL || pCtx->pfLookupUrls == NULL)
         return TWP_NOT_IMPLEMENTED;
 
-    return (*pCtx->pfLookupUrls)(hConfigure, pRequest, iRedirUrl, ppUrls, uCount, phResponse);
+    return LookupUrls(pCtx, hConfigure, pRequest, iRedirUrl, ppUrls, uCount, pCtx->uDeadline, phResponse);
+}
+
+TWP_RESULT TWPLookupUrlsWithin(TWPLIB_HANDLE hLib, TWPConfigurationHandle hConfigure, TWPRequest *pRequest,
+                               const char **ppUrls, unsigned int uCount, unsigned int uTimeout,
+                               TWPResponseHandle *phResponse)
+{
+    SitePluginContext *pCtx = (SitePluginContext *) hLib;
+
+    if (pCtx == NULL || pCtx->pfLookupUrls == NULL)
+        return TWP_NOT_IMPLEMENTED;
+
+    return LookupUrls(pCtx, hConfigure, pRequest, 0, ppUrls, uCount, uTimeout, phResponse);
 }
 
 TWP_RESULT TWPResponseWrite(TWPLIB_HANDLE hLib, TWPResponseHandle hResponse, const void *pData, unsigned uLength)
 {
     SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    uint64_t uStart;
+    TWP_RESULT Result;
 
     if (pCtx == NULL || pCtx->pfResponseWrite == NULL)
         return TWP_NOT_IMPLEMENTED;
 
-    return (*pCtx->pfResponseWrite)(hResponse, pData, uLength);
+    if (TWP_IS_FW_HANDLE(hResponse))
+        hResponse = ((FwResponse *) TWP_FW_PTR(hResponse))->hPlugin;
+
+    uStart = TWPStatsClock();
+    Result = (*pCtx->pfResponseWrite)(hResponse, pData, uLength);
+    TWPStatsAddPhase(pCtx, TWP_PHASE_PARSE, uStart);
+    TWP_STATS_ADD(pCtx, ulBytesReceived, uLength);
+
+    return Result;
 }
 
 TWP_RESULT TWPResponseGetUrlRatingByIndex(TWPLIB_HANDLE hLib, TWPResponseHandle hResponse, unsigned int uIndex,
                                           TWPUrlRatingHandle *hRating)
 {
     SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    FwResponse *pResp;
 
     if (pCtx == NULL || pCtx->pfResponseGetUrlRatingByIndex == NULL)
         return TWP_NOT_IMPLEMENTED;
 
-    return (*pCtx->pfResponseGetUrlRatingByIndex)(hResponse, uIndex, hRating);
+    if (!TWP_IS_FW_HANDLE(hResponse))
+        return (*pCtx->pfResponseGetUrlRatingByIndex)(hResponse, uIndex, hRating);
+
+    pResp = (FwResponse *) TWP_FW_PTR(hResponse);
+    if (hRating == NULL || uIndex >= pResp->uCount)
+        return TWP_INVALID_PARAMETER;
+
+    *hRating = (TWPUrlRatingHandle) TWP_FW_HANDLE(&pResp->pRatings[uIndex]);
+
+    return TWP_SUCCESS;
 }
 
 TWP_RESULT TWPResponseGetUrlRatingByUrl(TWPLIB_HANDLE hLib, TWPResponseHandle hResponse, const char *pUrl,
                                         unsigned int uUrlLength, TWPUrlRatingHandle *hRating)
 {
     SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    FwResponse *pResp;
+    char Key[TWP_MAX_URL_LENGTH];
+    char RatingKey[TWP_MAX_URL_LENGTH];
+    unsigned int uKeyLength;
+    unsigned int uRatingKeyLength;
+    uint64_t uHash;
+    unsigned int i;
 
     if (pCtx == NULL || pCtx->pfResponseGetUrlRatingByUrl == NULL)
         return TWP_NOT_IMPLEMENTED;
 
-    return (*pCtx->pfResponseGetUrlRatingByUrl)(hResponse, pUrl, uUrlLength, hRating);
+    if (!TWP_IS_FW_HANDLE(hResponse))
+        return (*pCtx->pfResponseGetUrlRatingByUrl)(hResponse, pUrl, uUrlLength, hRating);
+
+    pResp = (FwResponse *) TWP_FW_PTR(hResponse);
+    if (pUrl == NULL || hRating == NULL)
+        return TWP_INVALID_PARAMETER;
+
+    if (TWPUrlCanonicalize(pUrl, uUrlLength, Key, sizeof(Key), &uKeyLength, &uHash) != TWP_SUCCESS)
+        return TWP_NO_DATA;
+
+    for (i = 0; i < pResp->uCount; i++)
+    {
+        FwRating *pRating = &pResp->pRatings[i];
+        char const *pszUrl = pRating->pszUrl;
+        unsigned int uLength = pRating->uUrlLength;
+
+        if (pRating->uUrlHash != uHash)
+            continue;
+        if (pszUrl == NULL &&
+            (*pCtx->pfUrlRatingGetUrl)(pRating->hPlugin, &pszUrl, &uLength) != TWP_SUCCESS)
+            continue;
+
+        if (TWPUrlCanonicalize(pszUrl, uLength, RatingKey, sizeof(RatingKey), &uRatingKeyLength,
+                               NULL) == TWP_SUCCESS &&
+            uRatingKeyLength == uKeyLength && memcmp(RatingKey, Key, uKeyLength) == 0)
+        {
+            *hRating = (TWPUrlRatingHandle) TWP_FW_HANDLE(pRating);
+            return TWP_SUCCESS;
+        }
+    }
+
+    return TWP_NO_DATA;
 }
 
 TWP_RESULT TWPResponseGetRedirUrlFor(TWPLIB_HANDLE hLib, TWPResponseHandle hResponse, TWPUrlRatingHandle hRating,
@@ -213,6 +334,17 @@ TWP_RESULT TWPResponseGetRedirUrlFor(TWPLIB_HANDLE hLib, TWPResponseHandle hResp
     if (pCtx == NULL || pCtx->pfResponseGetRedirUrlFor == NULL)
         return TWP_NOT_IMPLEMENTED;
 
+    if (TWP_IS_FW_HANDLE(hResponse))
+        hResponse = ((FwResponse *) TWP_FW_PTR(hResponse))->hPlugin;
+    if (TWP_IS_FW_HANDLE(hRating))
+        hRating = ((FwRating *) TWP_FW_PTR(hRating))->hPlugin;
+    if (TWP_IS_FW_HANDLE(hPolicy))
+        hPolicy = ((FwPolicy *) TWP_FW_PTR(hPolicy))->hPlugin;
+
+    /* Cached ratings have no landing page. */
+    if (hResponse == NULL || hRating == NULL)
+        return TWP_NO_DATA;
+
     return (*pCtx->pfResponseGetRedirUrlFor)(hResponse, hRating, hPolicy, ppUrl, puLength);
 }
 
@@ -223,7 +355,15 @@ TWP_RESULT TWPResponseGetUrlRatingsCount(TWPLIB_HANDLE hLib, TWPResponseHandle h
     if (pCtx == NULL || pCtx->pfResponseGetUrlRatingsCount == NULL)
         return TWP_NOT_IMPLEMENTED;
 
-    return (*pCtx->pfResponseGetUrlRatingsCount)(hResponse, puCount);
+    if (!TWP_IS_FW_HANDLE(hResponse))
+        return (*pCtx->pfResponseGetUrlRatingsCount)(hResponse, puCount);
+
+    if (puCount == NULL)
+        return TWP_INVALID_PARAMETER;
+
+    *puCount = ((FwResponse *) TWP_FW_PTR(hResponse))->uCount;
+
+    return TWP_SUCCESS;
 }
 
 TWP_RESULT TWPResponseDestroy(TWPLIB_HANDLE hLib, TWPResponseHandle *hResponse)
@@ -233,349 +373,1541 @@ TWP_RESULT TWPResponseDestroy(TWPLIB_HANDLE hLib, TWPResponseHandle *hResponse)
     if (pCtx == NULL || pCtx->pfResponseDestroy == NULL)
         return TWP_NOT_IMPLEMENTED;
 
-    return (*pCtx->pfResponseDestroy)(hResponse);
+    if (hResponse == NULL || !TWP_IS_FW_HANDLE(*hResponse))
+        return (*pCtx->pfResponseDestroy)(hResponse);
+
+    FreeResponse(pCtx, (FwResponse *) TWP_FW_PTR(*hResponse));
+    *hResponse = NULL;
+
+    return TWP_SUCCESS;
 }
 
 TWP_RESULT TWPPolicyCreate(TWPLIB_HANDLE hLib, TWPConfigurationHandle hCfg, TWPCategories *pCategories,
                            unsigned int uCount, TWPPolicyHandle *phPolicy)
 {
     SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    FwPolicy *pPolicy;
+    TWP_RESULT Result;
+    unsigned int i;
 
     if (pCtx == NULL || pCtx->pfPolicyCreate == NULL)
         return TWP_NOT_IMPLEMENTED;
 
-    return (*pCtx->pfPolicyCreate)(hCfg, pCategories, uCount, phPolicy);
+    if (phPolicy == NULL)
+        return (*pCtx->pfPolicyCreate)(hCfg, pCategories, uCount, phPolicy);
+
+    pPolicy = (FwPolicy *) calloc(1, sizeof(FwPolicy));
+    if (pPolicy == NULL)
+        return TWP_NOMEM;
+
+    Result = (*pCtx->pfPolicyCreate)(hCfg, pCategories, uCount, &pPolicy->hPlugin);
+    if (Result != TWP_SUCCESS)
+    {
+        free(pPolicy);
+        return Result;
+    }
+
+    /* Keep the categories to validate cached ratings locally. */
+    for (i = 0; i < uCount; i++)
+    {
+        if ((unsigned int) pCategories[i] < TWP_CATEGORY_BITS)
+            TWP_CATEGORY_SET(pPolicy->Categories, pCategories[i]);
+    }
+    *phPolicy = (TWPPolicyHandle) TWP_FW_HANDLE(pPolicy);
+
+    return TWP_SUCCESS;
 }
 
 TWP_RESULT TWPPolicyValidate(TWPLIB_HANDLE hLib, TWPPolicyHandle hPolicy, TWPUrlRatingHandle hRating, int *piViolated)
 {
     SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    FwPolicy *pPolicy = NULL;
+    FwRating *pRating;
+    TWP_RESULT Result;
 
     if (pCtx == NULL || pCtx->pfPolicyValidate == NULL)
         return TWP_NOT_IMPLEMENTED;
 
-    return (*pCtx->pfPolicyValidate)(hPolicy, hRating, piViolated);
+    if (TWP_IS_FW_HANDLE(hPolicy))
+    {
+        pPolicy = (FwPolicy *) TWP_FW_PTR(hPolicy);
+        hPolicy = pPolicy->hPlugin;
+    }
+
+    if (!TWP_IS_FW_HANDLE(hRating))
+        return (*pCtx->pfPolicyValidate)(hPolicy, hRating, piViolated);
+
+    pRating = (FwRating *) TWP_FW_PTR(hRating);
+    if (pPolicy == NULL && pRating->hPlugin != NULL)
+        return (*pCtx->pfPolicyValidate)(hPolicy, pRating->hPlugin, piViolated);
+
+    if (pPolicy == NULL || piViolated == NULL)
+        return TWP_INVALID_PARAMETER;
+
+    Result = CompileRating(pCtx, pRating);
+    if (Result != TWP_SUCCESS)
+        return Result;
+
+    *piViolated = ((pPolicy->Categories[0] & pRating->Categories[0]) |
+                   (pPolicy->Categories[1] & pRating->Categories[1]) |
+                   (pPolicy->Categories[2] & pRating->Categories[2])) != 0;
+
+    return TWP_SUCCESS;
 }
 
 TWP_RESULT TWPPolicyGetViolations(TWPLIB_HANDLE hLib, TWPPolicyHandle hPolicy, TWPUrlRatingHandle hRating,
                                   TWPCategories **ppViolated, unsigned *puLength)
 {
     SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    FwPolicy *pPolicy = NULL;
+    FwRating *pRating;
+    uint64_t Violated[TWP_CATEGORY_WORDS];
+    TWP_RESULT Result;
+    unsigned int i;
+
+    if (pCtx == NULL || pCtx->pfPolicyGetViolations == NULL)
+        return TWP_NOT_IMPLEMENTED;
+
+    if (TWP_IS_FW_HANDLE(hPolicy))
+    {
+        pPolicy = (FwPolicy *) TWP_FW_PTR(hPolicy);
+        hPolicy = pPolicy->hPlugin;
+    }
+
+    if (!TWP_IS_FW_HANDLE(hRating))
+        return (*pCtx->pfPolicyGetViolations)(hPolicy, hRating, ppViolated, puLength);
+
+    pRating = (FwRating *) TWP_FW_PTR(hRating);
+    if (pPolicy == NULL && pRating->hPlugin != NULL)
+        return (*pCtx->pfPolicyGetViolations)(hPolicy, pRating->hPlugin, ppViolated, puLength);
+
+    if (pPolicy == NULL)
+        return TWP_INVALID_PARAMETER;
+
+    Result = CompileRating(pCtx, pRating);
+    if (Result != TWP_SUCCESS)
+        return Result;
+
+    for (i = 0; i < TWP_CATEGORY_WORDS; i++)
+        Violated[i] = pPolicy->Categories[i] & pRating->Categories[i];
+
+    return GetCategoryList(pCtx, Violated, ppViolated, puLength);
+}
+
+TWP_RESULT TWPPolicyFindViolations(TWPLIB_HANDLE hLib, TWPPolicyHandle hPolicy, TWPUrlRatingHandle hRating,
+                                   TWPCategories *pViolated, unsigned int uSize, unsigned int *puLength)
+{
+    SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    FwPolicy *pPolicy;
+    FwRating *pRating;
+    TWPCategories *pList = NULL;
+    uint64_t uWord;
+    unsigned int uCount = 0;
+    TWP_RESULT Result;
+    unsigned int i;
 
     if (pCtx == NULL || pCtx->pfPolicyGetViolations == NULL)
         return TWP_NOT_IMPLEMENTED;
 
-    return (*pCtx->pfPolicyGetViolations)(hPolicy, hRating, ppViolated, puLength);
+    if (puLength == NULL || (pViolated == NULL && uSize != 0))
+        return TWP_INVALID_PARAMETER;
+
+    if (!TWP_IS_FW_HANDLE(hPolicy) || !TWP_IS_FW_HANDLE(hRating))
+    {
+        /* Ratings of the plug-in, copy its list */
+        Result = TWPPolicyGetViolations(hLib, hPolicy, hRating, &pList, &uCount);
+        if (Result != TWP_SUCCESS)
+            return Result;
+        *puLength = uCount;
+        if (pList != NULL && uSize != 0)
+            memcpy(pViolated, pList, (uCount < uSize ? uCount : uSize) * sizeof(TWPCategories));
+        if (pList != NULL)
+            (*pCtx->pfMemFree)(pList);
+
+        return uCount <= uSize ? TWP_SUCCESS : TWP_NOMEM;
+    }
+
+    pPolicy = (FwPolicy *) TWP_FW_PTR(hPolicy);
+    pRating = (FwRating *) TWP_FW_PTR(hRating);
+    Result = CompileRating(pCtx, pRating);
+    if (Result != TWP_SUCCESS)
+        return Result;
+
+    for (i = 0; i < TWP_CATEGORY_WORDS; i++)
+    {
+        for (uWord = pPolicy->Categories[i] & pRating->Categories[i]; uWord != 0; uWord &= uWord - 1)
+        {
+            if (uCount < uSize)
+                pViolated[uCount] = (TWPCategories) (i * 64 + __builtin_ctzll(uWord));
+            uCount++;
+        }
+    }
+    *puLength = uCount;
+
+    return uCount <= uSize ? TWP_SUCCESS : TWP_NOMEM;
+}
+
+TWP_RESULT TWPPolicyValidateBatch(TWPLIB_HANDLE hLib, TWPPolicyHandle const *phPolicies, unsigned int uPolicies,
+                                  TWPUrlRatingHandle const *phRatings, unsigned int uRatings,
+                                  unsigned char *pMatrix)
+{
+    SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    FwVector Local[TWP_CATEGORY_WORDS * POLICY_LOCAL_BLOCKS];
+    FwVector *pSlices = Local;
+    FwVector Words[TWP_CATEGORY_WORDS];
+    FwVector Violated;
+    unsigned int uBlocks = (uPolicies + POLICY_LANES - 1) / POLICY_LANES;
+    unsigned int uStride = TWP_POLICY_MATRIX_STRIDE(uPolicies);
+    unsigned char *pRow;
+    FwRating *pRating;
+    TWP_RESULT Result = TWP_SUCCESS;
+    int iSliced;
+    int iViolated;
+    unsigned int r, p, w, j;
+
+    if (pCtx == NULL || pCtx->pfPolicyValidate == NULL)
+        return TWP_NOT_IMPLEMENTED;
+
+    if ((uPolicies != 0 && phPolicies == NULL) || (uRatings != 0 && phRatings == NULL) ||
+        (uPolicies != 0 && uRatings != 0 && pMatrix == NULL))
+        return TWP_INVALID_PARAMETER;
+
+    if (uPolicies == 0 || uRatings == 0)
+        return TWP_SUCCESS;
+
+    if (uBlocks > POLICY_LOCAL_BLOCKS &&
+        posix_memalign((void **) &pSlices, sizeof(FwVector), uBlocks * TWP_CATEGORY_WORDS * sizeof(FwVector)) != 0)
+        return TWP_NOMEM;
+
+    /* Slice w of a block holds word w of the bitmaps of POLICY_LANES policies */
+    memset(pSlices, 0, uBlocks * TWP_CATEGORY_WORDS * sizeof(FwVector));
+    for (p = 0; p < uPolicies; p++)
+    {
+        if (!TWP_IS_FW_HANDLE(phPolicies[p]))
+            continue;
+        for (w = 0; w < TWP_CATEGORY_WORDS; w++)
+        {
+            pSlices[(p / POLICY_LANES) * TWP_CATEGORY_WORDS + w][p % POLICY_LANES] =
+                ((FwPolicy *) TWP_FW_PTR(phPolicies[p]))->Categories[w];
+        }
+    }
+
+    memset(pMatrix, 0, uRatings * uStride);
+    for (r = 0; Result == TWP_SUCCESS && r < uRatings; r++)
+    {
+        pRow = pMatrix + r * uStride;
+        pRating = TWP_IS_FW_HANDLE(phRatings[r]) ? (FwRating *) TWP_FW_PTR(phRatings[r]) : NULL;
+        iSliced = pRating != NULL && CompileRating(pCtx, pRating) == TWP_SUCCESS;
+        if (iSliced)
+        {
+            for (w = 0; w < TWP_CATEGORY_WORDS; w++)
+            {
+                for (j = 0; j < POLICY_LANES; j++)
+                    Words[w][j] = pRating->Categories[w];
+            }
+
+            for (p = 0; p < uBlocks; p++)
+            {
+                Violated = pSlices[p * TWP_CATEGORY_WORDS] & Words[0];
+                for (w = 1; w < TWP_CATEGORY_WORDS; w++)
+                    Violated |= pSlices[p * TWP_CATEGORY_WORDS + w] & Words[w];
+                for (j = 0; j < POLICY_LANES; j++)
+                {
+                    if (Violated[j] != 0)
+                        pRow[(p * POLICY_LANES + j) >> 3] |= 1 << ((p * POLICY_LANES + j) & 7);
+                }
+            }
+        }
+
+        /* Pairs without bitmaps are left to the plug-in */
+        for (p = 0; p < uPolicies; p++)
+        {
+            if (iSliced && TWP_IS_FW_HANDLE(phPolicies[p]))
+                continue;
+            Result = TWPPolicyValidate(hLib, phPolicies[p], phRatings[r], &iViolated);
+            if (Result != TWP_SUCCESS)
+                break;
+            if (iViolated)
+                pRow[p >> 3] |= 1 << (p & 7);
+        }
+    }
+
+    if (pSlices != Local)
+        free(pSlices);
+
+    return Result;
 }
 
 TWP_RESULT TWPPolicyDestroy(TWPLIB_HANDLE hLib, TWPPolicyHandle *hPolicy)
 {
     SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    FwPolicy *pPolicy;
+    TWP_RESULT Result;
 
     if (pCtx == NULL || pCtx->pfPolicyDestroy == NULL)
         return TWP_NOT_IMPLEMENTED;
 
-    return (*pCtx->pfPolicyDestroy)(hPolicy);
+    if (hPolicy == NULL || !TWP_IS_FW_HANDLE(*hPolicy))
+        return (*pCtx->pfPolicyDestroy)(hPolicy);
+
+    pPolicy = (FwPolicy *) TWP_FW_PTR(*hPolicy);
+    Result = (*pCtx->pfPolicyDestroy)(&pPolicy->hPlugin);
+    free(pPolicy);
+    *hPolicy = NULL;
+
+    return Result;
 }
 
 TWP_RESULT TWPUrlRatingGetScore(TWPLIB_HANDLE hLib, TWPUrlRatingHandle hRating, int *piScore)
 {
     SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    FwRating *pRating;
 
     if (pCtx == NULL || pCtx->pfUrlRatingGetScore == NULL)
         return TWP_NOT_IMPLEMENTED;
 
-    return (*pCtx->pfUrlRatingGetScore)(hRating, piScore);
+    if (!TWP_IS_FW_HANDLE(hRating))
+        return (*pCtx->pfUrlRatingGetScore)(hRating, piScore);
+
+    pRating = (FwRating *) TWP_FW_PTR(hRating);
+    if (pRating->hPlugin != NULL)
+        return (*pCtx->pfUrlRatingGetScore)(pRating->hPlugin, piScore);
+
+    if (piScore == NULL)
+        return TWP_INVALID_PARAMETER;
+
+    *piScore = pRating->iScore;
+
+    return TWP_SUCCESS;
 }
 
 TWP_RESULT TWPUrlRatingGetUrl(TWPLIB_HANDLE hLib, TWPUrlRatingHandle hRating, char **ppUrl,
                               unsigned int *puLength)
 {
     SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    FwRating *pRating;
 
     if (pCtx == NULL || pCtx->pfUrlRatingGetUrl == NULL)
         return TWP_NOT_IMPLEMENTED;
 
-    return (*pCtx->pfUrlRatingGetUrl)(hRating, (const char **) ppUrl, puLength);
+    if (!TWP_IS_FW_HANDLE(hRating))
+        return (*pCtx->pfUrlRatingGetUrl)(hRating, (const char **) ppUrl, puLength);
+
+    pRating = (FwRating *) TWP_FW_PTR(hRating);
+    if (pRating->pszUrl == NULL)
+        return (*pCtx->pfUrlRatingGetUrl)(pRating->hPlugin, (const char **) ppUrl, puLength);
+
+    if (ppUrl == NULL)
+        return TWP_INVALID_PARAMETER;
+
+    *ppUrl = pRating->pszUrl;
+    if (puLength != NULL)
+        *puLength = pRating->uUrlLength;
+
+    return TWP_SUCCESS;
 }
 
 TWP_RESULT TWPUrlRatingGetDLAUrl(TWPLIB_HANDLE hLib, TWPUrlRatingHandle hRating, char **ppDlaUrl,
                                  unsigned int *puLength)
 {
     SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    FwRating *pRating;
 
     if (pCtx == NULL || pCtx->pfUrlRatingGetDLAUrl == NULL)
         return TWP_NOT_IMPLEMENTED;
 
-    return (*pCtx->pfUrlRatingGetDLAUrl)(hRating, (const char **) ppDlaUrl, puLength);
+    if (!TWP_IS_FW_HANDLE(hRating))
+        return (*pCtx->pfUrlRatingGetDLAUrl)(hRating, (const char **) ppDlaUrl, puLength);
+
+    pRating = (FwRating *) TWP_FW_PTR(hRating);
+    if (pRating->hPlugin != NULL)
+        return (*pCtx->pfUrlRatingGetDLAUrl)(pRating->hPlugin, (const char **) ppDlaUrl, puLength);
+
+    if (ppDlaUrl == NULL)
+        return TWP_INVALID_PARAMETER;
+    if (pRating->pszDlaUrl == NULL)
+        return TWP_NO_DATA;
+
+    *ppDlaUrl = pRating->pszDlaUrl;
+    if (puLength != NULL)
+        *puLength = pRating->uDlaLength;
+
+    return TWP_SUCCESS;
 }
 
 TWP_RESULT TWPUrlRatingHasCategory(TWPLIB_HANDLE hLib, TWPUrlRatingHandle hRating, TWPCategories Category,
                                    int *piPresent)
 {
     SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    FwRating *pRating;
+    TWP_RESULT Result;
 
     if (pCtx == NULL || pCtx->pfUrlRatingHasCategory == NULL)
         return TWP_NOT_IMPLEMENTED;
 
-    return (*pCtx->pfUrlRatingHasCategory)(hRating, Category, piPresent);
+    if (!TWP_IS_FW_HANDLE(hRating))
+        return (*pCtx->pfUrlRatingHasCategory)(hRating, Category, piPresent);
+
+    pRating = (FwRating *) TWP_FW_PTR(hRating);
+    if (piPresent == NULL || (unsigned int) Category >= TWP_CATEGORY_BITS)
+        return TWP_INVALID_PARAMETER;
+
+    Result = CompileRating(pCtx, pRating);
+    if (Result != TWP_SUCCESS)
+        return Result;
+
+    *piPresent = (int) TWP_CATEGORY_TEST(pRating->Categories, Category);
+
+    return TWP_SUCCESS;
 }
 
 TWP_RESULT TWPUrlRatingGetCategories(TWPLIB_HANDLE hLib, TWPUrlRatingHandle hRating, TWPCategories **ppCategories,
                                      unsigned int *puLength)
 {
     SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    FwRating *pRating;
+
+    if (pCtx == NULL || pCtx->pfUrlRatingGetCategories == NULL)
+        return TWP_NOT_IMPLEMENTED;
+
+    if (!TWP_IS_FW_HANDLE(hRating))
+        return (*pCtx->pfUrlRatingGetCategories)(hRating, ppCategories, puLength);
+
+    pRating = (FwRating *) TWP_FW_PTR(hRating);
+    if (pRating->hPlugin != NULL)
+        return (*pCtx->pfUrlRatingGetCategories)(pRating->hPlugin, ppCategories, puLength);
+
+    return GetCategoryList(pCtx, pRating->Categories, ppCategories, puLength);
+}
+
+TWP_RESULT TWPUrlRatingGetCategoryMask(TWPLIB_HANDLE hLib, TWPUrlRatingHandle hRating, uint64_t *pMask)
+{
+    SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    FwRating *pRating;
+    TWP_RESULT Result;
 
     if (pCtx == NULL || pCtx->pfUrlRatingGetCategories == NULL)
         return TWP_NOT_IMPLEMENTED;
 
-    return (*pCtx->pfUrlRatingGetCategories)(hRating, ppCategories, puLength);
+    if (pMask == NULL)
+        return TWP_INVALID_PARAMETER;
+
+    if (!TWP_IS_FW_HANDLE(hRating))
+        return ReadCategoryMask(pCtx, hRating, pMask);
+
+    pRating = (FwRating *) TWP_FW_PTR(hRating);
+    Result = CompileRating(pCtx, pRating);
+    if (Result != TWP_SUCCESS)
+        return Result;
+    memcpy(pMask, pRating->Categories, sizeof(pRating->Categories));
+
+    return TWP_SUCCESS;
+}
+
+TWP_RESULT TWPUrlRatingIsProvisional(TWPLIB_HANDLE hLib, TWPUrlRatingHandle hRating, int *piProvisional)
+{
+    SitePluginContext *pCtx = (SitePluginContext *) hLib;
+
+    if (pCtx == NULL)
+        return TWP_NOT_IMPLEMENTED;
+
+    if (piProvisional == NULL)
+        return TWP_INVALID_PARAMETER;
+
+    *piProvisional = TWP_IS_FW_HANDLE(hRating) && ((FwRating *) TWP_FW_PTR(hRating))->iProvisional != 0;
+
+    return TWP_SUCCESS;
+}
+
+int TWPIsCached(SitePluginContext *pCtx, char const *pKey, unsigned int uKeyLength)
+{
+    FwRating Rating;
+
+    memset(&Rating, 0, sizeof(Rating));
+    if (GetCachedUrl(pCtx, pKey, uKeyLength, &Rating) != 0)
+        return 0;
+    free(Rating.pszDlaUrl);
+
+    /* A stale rating is refreshed by the caller. */
+    return !Rating.iRevalidate;
+}
+
+void TWPCacheResponse(SitePluginContext *pCtx, TWPResponseHandle hResponse, const char **ppUrls,
+                      unsigned int uCount)
+{
+    char Key[TWP_MAX_URL_LENGTH];
+    unsigned int uKeyLength;
+    unsigned int uRatings = 0;
+    unsigned int i;
+
+    if ((*pCtx->pfResponseGetUrlRatingsCount)(hResponse, &uRatings) != TWP_SUCCESS)
+        return;
+
+    for (i = 0; i < uRatings && i < uCount; i++)
+    {
+        FwRating Fresh;
+
+        memset(&Fresh, 0, sizeof(Fresh));
+        if ((*pCtx->pfResponseGetUrlRatingByIndex)(hResponse, i, &Fresh.hPlugin) == TWP_SUCCESS &&
+            FillRating(pCtx, &Fresh) == TWP_SUCCESS &&
+            TWPUrlCanonicalize(ppUrls[i], strlen(ppUrls[i]), Key, sizeof(Key), &uKeyLength, NULL) == TWP_SUCCESS)
+        {
+            CacheRating(pCtx, Key, uKeyLength, &Fresh);
+        }
+    }
+}
+
+
+TWP_RESULT TWPCopyRating(SitePluginContext *pCtx, TWPResponseHandle hResponse, unsigned int uIndex,
+                         const char *pszUrl, FwRating *pRating)
+{
+    char Key[TWP_MAX_URL_LENGTH];
+    unsigned int uKeyLength;
+    TWP_RESULT Result;
+
+    memset(pRating, 0, sizeof(*pRating));
+    Result = (*pCtx->pfResponseGetUrlRatingByIndex)(hResponse, uIndex, &pRating->hPlugin);
+    if (Result == TWP_SUCCESS)
+        Result = FillRating(pCtx, pRating);
+    if (Result != TWP_SUCCESS)
+    {
+        memset(pRating, 0, sizeof(*pRating));
+        return Result;
+    }
+
+    if (TWPUrlCanonicalize(pszUrl, strlen(pszUrl), Key, sizeof(Key), &uKeyLength, &pRating->uUrlHash) == TWP_SUCCESS)
+        CacheRating(pCtx, Key, uKeyLength, pRating);
+
+    /* From here on the rating is served like a cached one. */
+    pRating->hPlugin = NULL;
+    pRating->uUrlLength = strlen(pszUrl);
+    pRating->pszUrl = strdup(pszUrl);
+    if (pRating->pszDlaUrl != NULL && (pRating->pszDlaUrl = strndup(pRating->pszDlaUrl, pRating->uDlaLength)) == NULL)
+        Result = TWP_NOMEM;
+    if (pRating->pszUrl == NULL || Result != TWP_SUCCESS)
+    {
+        free(pRating->pszUrl);
+        free(pRating->pszDlaUrl);
+        memset(pRating, 0, sizeof(*pRating));
+        return TWP_NOMEM;
+    }
+
+    return TWP_SUCCESS;
 }
 
 static SitePluginContext *LoadPlugin(void)
 {
     SitePluginContext *pCtx = NULL;
-    void *pTmp = dlopen(SITE_PLUGIN_PATH, RTLD_LAZY);
+    struct stat Stat;
+
     DEBUG_LOG("%s", "load site plugin\n");
-    if (pTmp != NULL)
-    {
-        FuncUninitLibrary TmpUninitLibrary;
-        FuncInitLibrary TmpInitLibrary;
-        FuncConfigurationCreate TmpConfigurationCreate;
-        FuncConfigurationDestroy TmpConfigurationDestroy;
-        FuncLookupUrls TmpLookupUrls;
-        FuncResponseWrite TmpResponseWrite;
-        FuncResponseGetUrlRatingByIndex TmpResponseGetUrlRatingByIndex;
-        FuncResponseGetUrlRatingByUrl TmpResponseGetUrlRatingByUrl;
-        FuncResponseGetRedirUrlFor TmpResponseGetRedirUrlFor;
-        FuncResponseGetUrlRatingsCount TmpResponseGetUrlRatingsCount;
-        FuncResponseDestroy TmpResponseDestroy;
-        FuncPolicyCreate TmpPolicyCreate;
-        FuncPolicyValidate TmpPolicyValidate;
-        FuncPolicyGetViolations TmpPolicyGetViolations;
-        FuncPolicyDestroy TmpPolicyDestroy;
-        FuncUrlRatingGetScore TmpUrlRatingGetScore;
-        FuncUrlRatingGetUrl TmpUrlRatingGetUrl;
-        FuncUrlRatingGetDLAUrl TmpUrlRatingGetDLAUrl;
-        FuncUrlRatingHasCategory TmpUrlRatingHasCategory;
-        FuncUrlRatingGetCategories TmpUrlRatingGetCategories;
-        
-        do
+    pthread_mutex_lock(&PluginLock);
+    if (stat(SITE_PLUGIN_PATH, &Stat) != 0)
+    {
+        DEBUG_LOG("No plugin found.\n");
+        pthread_mutex_unlock(&PluginLock);
+        return NULL;
+    }
+
+    /* A replaced plug-in is reloaded once no library handle uses the old one. */
+    if (pPluginModule != NULL && uPluginRefs == 0 &&
+        (Stat.st_dev != PluginStat.st_dev || Stat.st_ino != PluginStat.st_ino ||
+         Stat.st_size != PluginStat.st_size || Stat.st_mtime != PluginStat.st_mtime))
+    {
+        DEBUG_LOG("%s", "site plugin changed, reload it\n");
+        dlclose(pPluginModule);
+        pPluginModule = NULL;
+    }
+
+    if (pPluginModule == NULL)
+    {
+        void *pTmp = dlopen(SITE_PLUGIN_PATH, RTLD_LAZY);
+
+        if (pTmp == NULL)
         {
-            TmpInitLibrary = dlsym(pTmp, "TWPPInitLibrary");
-            DEBUG_LOG("%s", "load api TWPPInitLibrary\n");
-            if (TmpInitLibrary == NULL)
-            {
-                DEBUG_LOG("Failed to load TWPPInitLibrary in %s\n", SITE_PLUGIN_PATH);
-                dlclose(pTmp);
-                break;
-            }
+            DEBUG_LOG("Failed to load %s\n", SITE_PLUGIN_PATH);
+        }
+        else if (ReadInterface(pTmp, &PluginFunctions) == 0 || ReadSymbols(pTmp, &PluginFunctions) == 0)
+        {
+            pPluginModule = pTmp;
+            PluginStat = Stat;
+        }
+        else
+        {
+            dlclose(pTmp);
+        }
+    }
 
-            TmpUninitLibrary = dlsym(pTmp, "TWPPUninitLibrary");
-            DEBUG_LOG("%s", "load api TWPPUninitLibrary\n");
-            if (TmpUninitLibrary == NULL)
-            {
-                DEBUG_LOG("Failed to load TWPPUninitLibrary in %s\n", SITE_PLUGIN_PATH);
-                dlclose(pTmp);
-                break;
-            }
+    if (pPluginModule != NULL)
+    {
+        pCtx = (SitePluginContext *) malloc(sizeof(SitePluginContext));
+        if (pCtx != NULL)
+        {
+            *pCtx = PluginFunctions;
+            pCtx->pPlugin = pPluginModule;
+            pCtx->pfMemAlloc = DefaultMemAlloc;
+            pCtx->pfMemFree = DefaultMemFree;
+            uPluginRefs++;
+        }
+    }
+    pthread_mutex_unlock(&PluginLock);
 
-            TmpConfigurationCreate = dlsym(pTmp, "TWPPConfigurationCreate");
-            DEBUG_LOG("%s", "load api TWPPConfigurationCreate\n");
-            if (TmpConfigurationCreate == NULL)
-            {
-                DEBUG_LOG("Failed to load TWPPConfigurationCreate in %s\n", SITE_PLUGIN_PATH);
-                dlclose(pTmp);
-                break;
-            }
+    return pCtx;
+}
 
-            TmpConfigurationDestroy = dlsym(pTmp, "TWPPConfigurationDestroy");
-            DEBUG_LOG("%s", "load api TWPPConfigurationDestroy\n");
-            if (TmpConfigurationDestroy == NULL)
-            {
-                DEBUG_LOG("Failed to load TWPPConfigurationDestroy in %s\n", SITE_PLUGIN_PATH);
-                dlclose(pTmp);
-                break;
-            }
 
-            TmpLookupUrls = dlsym(pTmp, "TWPPLookupUrls");
-            DEBUG_LOG("%s", "load api TWPPLookupUrls\n");
-            if (TmpLookupUrls == NULL)
-            {
-                DEBUG_LOG("Failed to load TWPPLookupUrls in %s\n", SITE_PLUGIN_PATH);
-                dlclose(pTmp);
-                break;
-            }
+/**
+ * Releases the plug-in of a closed library handle, it stays loaded.
+ */
+static void ReleasePlugin(void)
+{
+    pthread_mutex_lock(&PluginLock);
+    uPluginRefs--;
+    pthread_mutex_unlock(&PluginLock);
+}
 
-            TmpResponseWrite = dlsym(pTmp, "TWPPResponseWrite");
-            DEBUG_LOG("%s", "load api TWPPResponseWrite\n");
-            if (TmpResponseWrite == NULL)
-            {
-                DEBUG_LOG("Failed to load TWPPResponseWrite in %s\n", SITE_PLUGIN_PATH);
-                dlclose(pTmp);
-                break;
-            }
 
-            TmpResponseGetUrlRatingByIndex = dlsym(pTmp, "TWPPResponseGetUrlRatingByIndex");
-            DEBUG_LOG("%s", "load api TWPPResponseGetUrlRatingByIndex\n");
-            if (TmpResponseGetUrlRatingByIndex == NULL)
-            {
-                DEBUG_LOG("Failed to load TWPPResponseGetUrlRatingByIndex in %s\n", SITE_PLUGIN_PATH);
-                dlclose(pTmp);
-                break;
-            }
+/**
+ * Copies the function table of a plug-in exporting TWPPGetInterface().
+ *
+ * \return 0 on success, -1 if the plug-in has no usable table.
+ */
+static int ReadInterface(void *pPlugin, SitePluginContext *pFunctions)
+{
+    FuncGetInterface pfGetInterface;
+    TWPPInterface const *pInterface;
 
-            TmpResponseGetUrlRatingByUrl = dlsym(pTmp, "TWPPResponseGetUrlRatingByUrl");
-            DEBUG_LOG("%s", "load api TWPPResponseGetUrlRatingByUrl\n");
-            if (TmpResponseGetUrlRatingByUrl == NULL)
-            {
-                DEBUG_LOG("Failed to load TWPPResponseGetUrlRatingByUrl in %s\n", SITE_PLUGIN_PATH);
-                dlclose(pTmp);
-                break;
-            }
+    pfGetInterface = (FuncGetInterface) dlsym(pPlugin, "TWPPGetInterface");
+    if (pfGetInterface == NULL)
+        return -1;
 
-            TmpResponseGetRedirUrlFor = dlsym(pTmp, "TWPPResponseGetRedirUrlFor");
-            DEBUG_LOG("%s", "load api TWPPResponseGetRedirUrlFor\n");
-            if (TmpResponseGetRedirUrlFor == NULL)
-            {
-                DEBUG_LOG("Failed to load TWPPResponseGetRedirUrlFor in %s\n", SITE_PLUGIN_PATH);
-                dlclose(pTmp);
-                break;
-            }
+    pInterface = (*pfGetInterface)(TWPP_INTERFACE_VERSION);
+    if (pInterface == NULL || pInterface->uVersion != TWPP_INTERFACE_VERSION)
+    {
+        DEBUG_LOG("%s", "TWPPGetInterface has no table of this version\n");
+        return -1;
+    }
 
-            TmpResponseGetUrlRatingsCount = dlsym(pTmp, "TWPPResponseGetUrlRatingsCount");
-            DEBUG_LOG("%s", "load api TWPPResponseGetUrlRatingsCount\n");
-            if (TmpResponseGetUrlRatingsCount == NULL)
-            {
-                DEBUG_LOG("Failed to load TWPPResponseGetUrlRatingsCount in %s\n", SITE_PLUGIN_PATH);
-                dlclose(pTmp);
-                break;
-            }
+    memset(pFunctions, 0, sizeof(SitePluginContext));
+    pFunctions->pfUninitLibrary = pInterface->pfUninitLibrary;
+    pFunctions->pfInitLibrary = pInterface->pfInitLibrary;
+    pFunctions->pfConfigurationCreate = pInterface->pfConfigurationCreate;
+    pFunctions->pfConfigurationDestroy = pInterface->pfConfigurationDestroy;
+    pFunctions->pfLookupUrls = pInterface->pfLookupUrls;
+    pFunctions->pfResponseWrite = pInterface->pfResponseWrite;
+    pFunctions->pfResponseGetUrlRatingByIndex = pInterface->pfResponseGetUrlRatingByIndex;
+    pFunctions->pfResponseGetUrlRatingByUrl = pInterface->pfResponseGetUrlRatingByUrl;
+    pFunctions->pfResponseGetRedirUrlFor = pInterface->pfResponseGetRedirUrlFor;
+    pFunctions->pfResponseGetUrlRatingsCount = pInterface->pfResponseGetUrlRatingsCount;
+    pFunctions->pfResponseDestroy = pInterface->pfResponseDestroy;
+    pFunctions->pfPolicyCreate = pInterface->pfPolicyCreate;
+    pFunctions->pfPolicyValidate = pInterface->pfPolicyValidate;
+    pFunctions->pfPolicyGetViolations = pInterface->pfPolicyGetViolations;
+    pFunctions->pfPolicyDestroy = pInterface->pfPolicyDestroy;
+    pFunctions->pfUrlRatingGetScore = pInterface->pfUrlRatingGetScore;
+    pFunctions->pfUrlRatingGetUrl = pInterface->pfUrlRatingGetUrl;
+    pFunctions->pfUrlRatingGetDLAUrl = pInterface->pfUrlRatingGetDLAUrl;
+    pFunctions->pfUrlRatingHasCategory = pInterface->pfUrlRatingHasCategory;
+    pFunctions->pfUrlRatingGetCategories = pInterface->pfUrlRatingGetCategories;
+    if ((pInterface->uCapabilities & TWPP_CAP_RATING_SCOPE) != 0)
+        pFunctions->pfUrlRatingGetScope = pInterface->pfUrlRatingGetScope;
+    if ((pInterface->uCapabilities & TWPP_CAP_CATEGORY_MASK) != 0)
+        pFunctions->pfUrlRatingGetCategoryMask = pInterface->pfUrlRatingGetCategoryMask;
+
+    if (pFunctions->pfUninitLibrary == NULL || pFunctions->pfInitLibrary == NULL ||
+        pFunctions->pfConfigurationCreate == NULL || pFunctions->pfConfigurationDestroy == NULL ||
+        pFunctions->pfLookupUrls == NULL || pFunctions->pfResponseWrite == NULL ||
+        pFunctions->pfResponseGetUrlRatingByIndex == NULL || pFunctions->pfResponseGetUrlRatingByUrl == NULL ||
+        pFunctions->pfResponseGetRedirUrlFor == NULL || pFunctions->pfResponseGetUrlRatingsCount == NULL ||
+        pFunctions->pfResponseDestroy == NULL || pFunctions->pfPolicyCreate == NULL ||
+        pFunctions->pfPolicyValidate == NULL || pFunctions->pfPolicyGetViolations == NULL ||
+        pFunctions->pfPolicyDestroy == NULL || pFunctions->pfUrlRatingGetScore == NULL ||
+        pFunctions->pfUrlRatingGetUrl == NULL || pFunctions->pfUrlRatingGetDLAUrl == NULL ||
+        pFunctions->pfUrlRatingHasCategory == NULL || pFunctions->pfUrlRatingGetCategories == NULL)
+    {
+        DEBUG_LOG("%s", "TWPPGetInterface table misses functions\n");
+        return -1;
+    }
 
-            TmpResponseDestroy = dlsym(pTmp, "TWPPResponseDestroy");
-            DEBUG_LOG("%s", "load api TWPPResponseDestroy\n");
-            if (TmpResponseDestroy == NULL)
-            {
-                DEBUG_LOG("Failed to load TWPPResponseDestroy in %s\n", SITE_PLUGIN_PATH);
-                dlclose(pTmp);
-                break;
-            }
+    return 0;
+}
 
-            TmpPolicyCreate = dlsym(pTmp, "TWPPPolicyCreate");
-            DEBUG_LOG("%s", "load api TWPPPolicyCreate\n");
-            if (TmpPolicyCreate == NULL)
-            {
-                DEBUG_LOG("Failed to load TWPPPolicyCreate in %s\n", SITE_PLUGIN_PATH);
-                dlclose(pTmp);
-                break;
-            }
 
-            TmpPolicyValidate = dlsym(pTmp, "TWPPPolicyValidate");
-            DEBUG_LOG("%s", "load api TWPPPolicyValidate\n");
-            if (TmpPolicyValidate == NULL)
-            {
-                DEBUG_LOG("Failed to load TWPPPolicyValidate in %s\n", SITE_PLUGIN_PATH);
-                dlclose(pTmp);
-                break;
-            }
+/**
+ * Looks up the functions of a plug-in by name.
+ *
+ * \return 0 on success, -1 if a mandatory function is missing.
+ */
+static int ReadSymbols(void *pPlugin, SitePluginContext *pFunctions)
+{
+    FuncUninitLibrary TmpUninitLibrary;
+    FuncInitLibrary TmpInitLibrary;
+    FuncConfigurationCreate TmpConfigurationCreate;
+    FuncConfigurationDestroy TmpConfigurationDestroy;
+    FuncLookupUrls TmpLookupUrls;
+    FuncResponseWrite TmpResponseWrite;
+    FuncResponseGetUrlRatingByIndex TmpResponseGetUrlRatingByIndex;
+    FuncResponseGetUrlRatingByUrl TmpResponseGetUrlRatingByUrl;
+    FuncResponseGetRedirUrlFor TmpResponseGetRedirUrlFor;
+    FuncResponseGetUrlRatingsCount TmpResponseGetUrlRatingsCount;
+    FuncResponseDestroy TmpResponseDestroy;
+    FuncPolicyCreate TmpPolicyCreate;
+    FuncPolicyValidate TmpPolicyValidate;
+    FuncPolicyGetViolations TmpPolicyGetViolations;
+    FuncPolicyDestroy TmpPolicyDestroy;
+    FuncUrlRatingGetScore TmpUrlRatingGetScore;
+    FuncUrlRatingGetUrl TmpUrlRatingGetUrl;
+    FuncUrlRatingGetDLAUrl TmpUrlRatingGetDLAUrl;
+    FuncUrlRatingHasCategory TmpUrlRatingHasCategory;
+    FuncUrlRatingGetCategories TmpUrlRatingGetCategories;
+
+    TmpInitLibrary = dlsym(pPlugin, "TWPPInitLibrary");
+    DEBUG_LOG("%s", "load api TWPPInitLibrary\n");
+    if (TmpInitLibrary == NULL)
+    {
+        DEBUG_LOG("Failed to load TWPPInitLibrary in %s\n", SITE_PLUGIN_PATH);
+        return -1;
+    }
 
-            TmpPolicyGetViolations = dlsym(pTmp, "TWPPPolicyGetViolations");
-            DEBUG_LOG("%s", "load api TWPPPolicyGetViolations\n");
-            if (TmpPolicyGetViolations == NULL)
-            {
-                DEBUG_LOG("Failed to load TWPPPolicyGetViolations in %s\n", SITE_PLUGIN_PATH);
-                dlclose(pTmp);
-                break;
-            }
+    TmpUninitLibrary = dlsym(pPlugin, "TWPPUninitLibrary");
+    DEBUG_LOG("%s", "load api TWPPUninitLibrary\n");
+    if (TmpUninitLibrary == NULL)
+    {
+        DEBUG_LOG("Failed to load TWPPUninitLibrary in %s\n", SITE_PLUGIN_PATH);
+        return -1;
+    }
 
-            TmpPolicyDestroy = dlsym(pTmp, "TWPPPolicyDestroy");
-            DEBUG_LOG("%s", "load api TWPPPolicyDestroy\n");
-            if (TmpPolicyDestroy == NULL)
-            {
-                DEBUG_LOG("Failed to load TWPPPolicyDestroy in %s\n", SITE_PLUGIN_PATH);
-                dlclose(pTmp);
-                break;
-            }
+    TmpConfigurationCreate = dlsym(pPlugin, "TWPPConfigurationCreate");
+    DEBUG_LOG("%s", "load api TWPPConfigurationCreate\n");
+    if (TmpConfigurationCreate == NULL)
+    {
+        DEBUG_LOG("Failed to load TWPPConfigurationCreate in %s\n", SITE_PLUGIN_PATH);
+        return -1;
+    }
 
-            TmpUrlRatingGetScore = dlsym(pTmp, "TWPPUrlRatingGetScore");
-            DEBUG_LOG("%s", "load api TWPPUrlRatingGetScore\n");
-            if (TmpUrlRatingGetScore == NULL)
-            {
-                DEBUG_LOG("Failed to load TWPPUrlRatingGetScore in %s\n", SITE_PLUGIN_PATH);
-                dlclose(pTmp);
-                break;
-            }
+    TmpConfigurationDestroy = dlsym(pPlugin, "TWPPConfigurationDestroy");
+    DEBUG_LOG("%s", "load api TWPPConfigurationDestroy\n");
+    if (TmpConfigurationDestroy == NULL)
+    {
+        DEBUG_LOG("Failed to load TWPPConfigurationDestroy in %s\n", SITE_PLUGIN_PATH);
+        return -1;
+    }
+
+    TmpLookupUrls = dlsym(pPlugin, "TWPPLookupUrls");
+    DEBUG_LOG("%s", "load api TWPPLookupUrls\n");
+    if (TmpLookupUrls == NULL)
+    {
+        DEBUG_LOG("Failed to load TWPPLookupUrls in %s\n", SITE_PLUGIN_PATH);
+        return -1;
+    }
+
+    TmpResponseWrite = dlsym(pPlugin, "TWPPResponseWrite");
+    DEBUG_LOG("%s", "load api TWPPResponseWrite\n");
+    if (TmpResponseWrite == NULL)
+    {
+        DEBUG_LOG("Failed to load TWPPResponseWrite in %s\n", SITE_PLUGIN_PATH);
+        return -1;
+    }
+
+    TmpResponseGetUrlRatingByIndex = dlsym(pPlugin, "TWPPResponseGetUrlRatingByIndex");
+    DEBUG_LOG("%s", "load api TWPPResponseGetUrlRatingByIndex\n");
+    if (TmpResponseGetUrlRatingByIndex == NULL)
+    {
+        DEBUG_LOG("Failed to load TWPPResponseGetUrlRatingByIndex in %s\n", SITE_PLUGIN_PATH);
+        return -1;
+    }
+
+    TmpResponseGetUrlRatingByUrl = dlsym(pPlugin, "TWPPResponseGetUrlRatingByUrl");
+    DEBUG_LOG("%s", "load api TWPPResponseGetUrlRatingByUrl\n");
+    if (TmpResponseGetUrlRatingByUrl == NULL)
+    {
+        DEBUG_LOG("Failed to load TWPPResponseGetUrlRatingByUrl in %s\n", SITE_PLUGIN_PATH);
+        return -1;
+    }
+
+    TmpResponseGetRedirUrlFor = dlsym(pPlugin, "TWPPResponseGetRedirUrlFor");
+    DEBUG_LOG("%s", "load api TWPPResponseGetRedirUrlFor\n");
+    if (TmpResponseGetRedirUrlFor == NULL)
+    {
+        DEBUG_LOG("Failed to load TWPPResponseGetRedirUrlFor in %s\n", SITE_PLUGIN_PATH);
+        return -1;
+    }
+
+    TmpResponseGetUrlRatingsCount = dlsym(pPlugin, "TWPPResponseGetUrlRatingsCount");
+    DEBUG_LOG("%s", "load api TWPPResponseGetUrlRatingsCount\n");
+    if (TmpResponseGetUrlRatingsCount == NULL)
+    {
+        DEBUG_LOG("Failed to load TWPPResponseGetUrlRatingsCount in %s\n", SITE_PLUGIN_PATH);
+        return -1;
+    }
+
+    TmpResponseDestroy = dlsym(pPlugin, "TWPPResponseDestroy");
+    DEBUG_LOG("%s", "load api TWPPResponseDestroy\n");
+    if (TmpResponseDestroy == NULL)
+    {
+        DEBUG_LOG("Failed to load TWPPResponseDestroy in %s\n", SITE_PLUGIN_PATH);
+        return -1;
+    }
+
+    TmpPolicyCreate = dlsym(pPlugin, "TWPPPolicyCreate");
+    DEBUG_LOG("%s", "load api TWPPPolicyCreate\n");
+    if (TmpPolicyCreate == NULL)
+    {
+        DEBUG_LOG("Failed to load TWPPPolicyCreate in %s\n", SITE_PLUGIN_PATH);
+        return -1;
+    }
+
+    TmpPolicyValidate = dlsym(pPlugin, "TWPPPolicyValidate");
+    DEBUG_LOG("%s", "load api TWPPPolicyValidate\n");
+    if (TmpPolicyValidate == NULL)
+    {
+        DEBUG_LOG("Failed to load TWPPPolicyValidate in %s\n", SITE_PLUGIN_PATH);
+        return -1;
+    }
+
+    TmpPolicyGetViolations = dlsym(pPlugin, "TWPPPolicyGetViolations");
+    DEBUG_LOG("%s", "load api TWPPPolicyGetViolations\n");
+    if (TmpPolicyGetViolations == NULL)
+    {
+        DEBUG_LOG("Failed to load TWPPPolicyGetViolations in %s\n", SITE_PLUGIN_PATH);
+        return -1;
+    }
+
+    TmpPolicyDestroy = dlsym(pPlugin, "TWPPPolicyDestroy");
+    DEBUG_LOG("%s", "load api TWPPPolicyDestroy\n");
+    if (TmpPolicyDestroy == NULL)
+    {
+        DEBUG_LOG("Failed to load TWPPPolicyDestroy in %s\n", SITE_PLUGIN_PATH);
+        return -1;
+    }
+
+    TmpUrlRatingGetScore = dlsym(pPlugin, "TWPPUrlRatingGetScore");
+    DEBUG_LOG("%s", "load api TWPPUrlRatingGetScore\n");
+    if (TmpUrlRatingGetScore == NULL)
+    {
+        DEBUG_LOG("Failed to load TWPPUrlRatingGetScore in %s\n", SITE_PLUGIN_PATH);
+        return -1;
+    }
+
+    TmpUrlRatingGetUrl = dlsym(pPlugin, "TWPPUrlRatingGetUrl");
+    DEBUG_LOG("%s", "load api TWPPUrlRatingGetUrl\n");
+    if (TmpUrlRatingGetUrl == NULL)
+    {
+        DEBUG_LOG("Failed to load TWPPUrlRatingGetUrl in %s\n", SITE_PLUGIN_PATH);
+        return -1;
+    }
+
+    TmpUrlRatingGetDLAUrl = dlsym(pPlugin, "TWPPUrlRatingGetDLAUrl");
+    DEBUG_LOG("%s", "load api TWPPUrlRatingGetDLAUrl\n");
+    if (TmpUrlRatingGetDLAUrl == NULL)
+    {
+        DEBUG_LOG("Failed to load TWPPUrlRatingGetDLAUrl in %s\n", SITE_PLUGIN_PATH);
+        return -1;
+    }
+
+    TmpUrlRatingHasCategory = dlsym(pPlugin, "TWPPUrlRatingHasCategory");
+    DEBUG_LOG("%s", "load api TWPPUrlRatingHasCategory\n");
+    if (TmpUrlRatingHasCategory == NULL)
+    {
+        DEBUG_LOG("Failed to load TWPPUrlRatingHasCategory in %s\n", SITE_PLUGIN_PATH);
+        return -1;
+    }
+
+    TmpUrlRatingGetCategories = dlsym(pPlugin, "TWPPUrlRatingGetCategories");
+    DEBUG_LOG("%s", "load api TWPPUrlRatingGetCategories\n");
+    if (TmpUrlRatingGetCategories == NULL)
+    {
+        DEBUG_LOG("Failed to load TWPPUrlRatingGetCategories in %s\n", SITE_PLUGIN_PATH);
+        return -1;
+    }
+
+    memset(pFunctions, 0, sizeof(SitePluginContext));
+    pFunctions->pfUninitLibrary = TmpUninitLibrary;
+    pFunctions->pfInitLibrary = TmpInitLibrary;
+    pFunctions->pfConfigurationCreate = TmpConfigurationCreate;
+    pFunctions->pfConfigurationDestroy = TmpConfigurationDestroy;
+    pFunctions->pfLookupUrls = TmpLookupUrls;
+    pFunctions->pfResponseWrite = TmpResponseWrite;
+    pFunctions->pfResponseGetUrlRatingByIndex = TmpResponseGetUrlRatingByIndex;
+    pFunctions->pfResponseGetUrlRatingByUrl = TmpResponseGetUrlRatingByUrl;
+    pFunctions->pfResponseGetRedirUrlFor = TmpResponseGetRedirUrlFor;
+    pFunctions->pfResponseGetUrlRatingsCount = TmpResponseGetUrlRatingsCount;
+    pFunctions->pfResponseDestroy = TmpResponseDestroy;
+    pFunctions->pfPolicyCreate = TmpPolicyCreate;
+    pFunctions->pfPolicyValidate = TmpPolicyValidate;
+    pFunctions->pfPolicyGetViolations = TmpPolicyGetViolations;
+    pFunctions->pfPolicyDestroy = TmpPolicyDestroy;
+    pFunctions->pfUrlRatingGetScore = TmpUrlRatingGetScore;
+    pFunctions->pfUrlRatingGetUrl = TmpUrlRatingGetUrl;
+    pFunctions->pfUrlRatingGetDLAUrl = TmpUrlRatingGetDLAUrl;
+    pFunctions->pfUrlRatingHasCategory = TmpUrlRatingHasCategory;
+    pFunctions->pfUrlRatingGetCategories = TmpUrlRatingGetCategories;
+    pFunctions->pfUrlRatingGetScope = (FuncUrlRatingGetScope) dlsym(pPlugin, "TWPPUrlRatingGetScope");
+    pFunctions->pfUrlRatingGetCategoryMask = (FuncUrlRatingGetCategoryMask) dlsym(pPlugin,
+                                                                          "TWPPUrlRatingGetCategoryMask");
+
+    return 0;
+}
+
+
+static void *DefaultMemAlloc(TWPMallocSizeT Size)
+{
+    return malloc(Size);
+}
 
-            TmpUrlRatingGetUrl = dlsym(pTmp, "TWPPUrlRatingGetUrl");
-            DEBUG_LOG("%s", "load api TWPPUrlRatingGetUrl\n");
-            if (TmpUrlRatingGetUrl == NULL)
-            {
-                DEBUG_LOG("Failed to load TWPPUrlRatingGetUrl in %s\n", SITE_PLUGIN_PATH);
-                dlclose(pTmp);
-                break;
-            }
 
-            TmpUrlRatingGetDLAUrl = dlsym(pTmp, "TWPPUrlRatingGetDLAUrl");
-            DEBUG_LOG("%s", "load api TWPPUrlRatingGetDLAUrl\n");
-            if (TmpUrlRatingGetDLAUrl == NULL)
+static void DefaultMemFree(void *pAddress)
+{
+    free(pAddress);
+}
+
+
+/**
+ * Looks up URLs for TWPLookupUrls() and TWPLookupUrlsWithin(). With the event
+ * loop, the cache misses wait at most uTimeout milliseconds (0 for no limit).
+ */
+static TWP_RESULT LookupUrls(SitePluginContext *pCtx, TWPConfigurationHandle hConfigure, TWPRequest *pRequest,
+                             int iRedirUrl, const char **ppUrls, unsigned int uCount, unsigned int uTimeout,
+                             TWPResponseHandle *phResponse)
+{
+    uint64_t uStart;
+    TWP_RESULT Result;
+
+    uStart = TWPStatsClock();
+
+    /*
+     * Landing pages and asynchronous lookups need a plug-in response, they
+     * bypass the caches, the local database, coalescing and arenas.
+     * Otherwise, only batches spelling a URL twice are merged by the
+     * framework.
+     */
+    if (iRedirUrl == 0 && pRequest != NULL && pRequest->receivefunc != NULL &&
+        ppUrls != NULL && uCount != 0 && phResponse != NULL &&
+        (pCtx->pCache != NULL || pCtx->pDiskCache != NULL || pCtx->pLocalDb != NULL ||
+         pCtx->pBloom != NULL || pCtx->pCoalescer != NULL || pCtx->pArenaPool != NULL ||
+         (uTimeout != 0 && pCtx->pAsync != NULL) || HasDuplicates(ppUrls, uCount)))
+    {
+        Result = LookupCached(pCtx, hConfigure, pRequest, ppUrls, uCount, uTimeout, phResponse);
+    }
+    else
+    {
+        TWP_STATS_ADD(pCtx, ulCacheMisses, uCount);
+        Result = TWPStatsLookupUrls(pCtx, hConfigure, pRequest, iRedirUrl, ppUrls, uCount, phResponse);
+    }
+
+    TWPStatsLookup(pCtx, uCount, Result);
+    TWPStatsAddPhase(pCtx, TWP_PHASE_LOOKUP, uStart);
+
+    return Result;
+}
+
+
+/**
+ * Serves the URLs found in the cache and forwards the others to the plug-in
+ * in a single lookup, each canonical URL once. The response lists the ratings
+ * in the caller's order. Misses not answered within uTimeout get the deadline
+ * verdict.
+ */
+static TWP_RESULT LookupCached(SitePluginContext *pCtx, TWPConfigurationHandle hConfigure, TWPRequest *pRequest,
+                               const char **ppUrls, unsigned int uCount, unsigned int uTimeout,
+                               TWPResponseHandle *phResponse)
+{
+    FwResponse *pResp;
+    void *pWork;
+    uint64_t *puMissHashes;
+    const char **ppMisses;
+    unsigned int *puMisses;
+    unsigned int *puMissOf;
+    unsigned int *puTable;
+    unsigned int uTableMask = 1;
+    unsigned int uMisses = 0;
+    unsigned int uRevalidate = 0;
+    int iCopied = 0;
+    char Key[TWP_MAX_URL_LENGTH];
+    unsigned int uKeyLength;
+    FwArenaScope Saved;
+    TWP_RESULT Result = TWP_SUCCESS;
+    unsigned int i;
+
+    while (uTableMask < uCount * 2)
+        uTableMask <<= 1;
+
+    pResp = (FwResponse *) calloc(1, sizeof(FwResponse) + uCount * sizeof(FwRating));
+    pWork = calloc(1, uCount * (sizeof(uint64_t) + sizeof(const char *) + 2 * sizeof(unsigned int)) +
+                      uTableMask * sizeof(unsigned int));
+    if (pResp == NULL || pWork == NULL)
+    {
+        free(pResp);
+        free(pWork);
+        return TWP_NOMEM;
+    }
+    puMissHashes = (uint64_t *) pWork;
+    ppMisses = (const char **) (puMissHashes + uCount);
+    puMisses = (unsigned int *) (ppMisses + uCount);
+    puMissOf = puMisses + uCount;
+    puTable = puMissOf + uCount;
+    uTableMask--;
+    pResp->uCount = uCount;
+    pResp->pRatings = (FwRating *) (pResp + 1);
+
+    for (i = 0; i < uCount; i++)
+    {
+        FwRating *pRating = &pResp->pRatings[i];
+        unsigned int uLength;
+        uint64_t uHash = 0;
+        unsigned int *pSlot;
+        int iCanonical;
+        int iFound;
+
+        if (ppUrls[i] == NULL)
+        {
+            Result = TWP_INVALID_PARAMETER;
+            break;
+        }
+
+        uLength = strlen(ppUrls[i]);
+        iCanonical = TWPUrlCanonicalize(ppUrls[i], uLength, Key, sizeof(Key), &uKeyLength, &uHash) == TWP_SUCCESS;
+        pRating->uUrlHash = uHash;
+        iFound = iCanonical && GetCachedUrl(pCtx, Key, uKeyLength, pRating) == 0;
+        if (iCanonical && !iFound && pCtx->pBloom != NULL && TWPBloomMayContain(pCtx->pBloom, Key, uKeyLength) == 0)
+        {
+            /* Neither the host nor its domain is listed, no need to wait for the plug-in. */
+            SetProvisional(pRating);
+            pRating->iRevalidate = (pCtx->uBloomFlags & TWP_BLOOM_CONFIRM) != 0 &&
+                                   (pCtx->pCache != NULL || pCtx->pDiskCache != NULL);
+            iFound = 1;
+        }
+        if (iFound)
+        {
+            /* Stale cached ratings are served and refreshed in the background. */
+            uRevalidate += pRating->iRevalidate;
+            puMissOf[i] = CACHE_HIT;
+            TWP_STATS_ADD(pCtx, ulCacheHits, 1);
+            pRating->pszUrl = strdup(ppUrls[i]);
+            pRating->uUrlLength = uLength;
+            if (pRating->pszUrl == NULL)
             {
-                DEBUG_LOG("Failed to load TWPPUrlRatingGetDLAUrl in %s\n", SITE_PLUGIN_PATH);
-                dlclose(pTmp);
+                Result = TWP_NOMEM;
                 break;
             }
+            continue;
+        }
 
-            TmpUrlRatingHasCategory = dlsym(pTmp, "TWPPUrlRatingHasCategory");
-            DEBUG_LOG("%s", "load api TWPPUrlRatingHasCategory\n");
-            if (TmpUrlRatingHasCategory == NULL)
+        pSlot = iCanonical ? FindMiss(puTable, uTableMask, ppMisses, puMissHashes, Key, uKeyLength, uHash) : NULL;
+        if (pSlot != NULL && *pSlot != 0)
+        {
+            /* Same canonical URL as an earlier miss, the caller's spelling is kept. */
+            puMissOf[i] = *pSlot - 1;
+            pRating->pszUrl = strdup(ppUrls[i]);
+            pRating->uUrlLength = uLength;
+            if (pRating->pszUrl == NULL)
             {
-                DEBUG_LOG("Failed to load TWPPUrlRatingHasCategory in %s\n", SITE_PLUGIN_PATH);
-                dlclose(pTmp);
+                Result = TWP_NOMEM;
                 break;
             }
+            continue;
+        }
+
+        if (pSlot != NULL)
+            *pSlot = uMisses + 1;
+        puMissOf[i] = uMisses;
+        puMissHashes[uMisses] = uHash;
+        ppMisses[uMisses] = ppUrls[i];
+        puMisses[uMisses++] = i;
+    }
 
-            TmpUrlRatingGetCategories = dlsym(pTmp, "TWPPUrlRatingGetCategories");
-            DEBUG_LOG("%s", "load api TWPPUrlRatingGetCategories\n");
-            if (TmpUrlRatingGetCategories == NULL)
+    if (Result == TWP_SUCCESS && uMisses != 0)
+    {
+        DEBUG_LOG("cache: %u of %u urls missed\n", uMisses, uCount);
+        TWP_STATS_ADD(pCtx, ulCacheMisses, uMisses);
+        Result = TWP_NOT_IMPLEMENTED;
+        if (uTimeout != 0 && pCtx->pAsync != NULL)
+        {
+            Result = TWPDeadlineLookup(pCtx, hConfigure, ppMisses, uMisses, uTimeout, &pResp->hPlugin);
+            if (Result == TWP_NO_DATA)
             {
-                DEBUG_LOG("Failed to load TWPPUrlRatingGetCategories in %s\n", SITE_PLUGIN_PATH);
-                dlclose(pTmp);
-                break;
+                /* Verdicts have no plug-in rating, their URL must answer for them. */
+                Result = TWP_SUCCESS;
+                for (i = 0; i < uMisses; i++)
+                {
+                    FwRating *pRating = &pResp->pRatings[puMisses[i]];
+
+                    SetVerdict(pRating, pCtx->uDeadlineVerdict);
+                    pRating->uUrlLength = strlen(ppMisses[i]);
+                    pRating->pszUrl = strdup(ppMisses[i]);
+                    if (pRating->pszUrl == NULL)
+                        Result = TWP_NOMEM;
+                }
+                uMisses = 0;
             }
+        }
+        /* Without the event loop, or if it cannot reach the server, the lookup is not bounded. */
+        if (Result == TWP_NOT_IMPLEMENTED && pCtx->pCoalescer != NULL)
+        {
+            /* Merged lookups hand out copies of their ratings. */
+            Result = TWPCoalesceLookup(pCtx, hConfigure, pRequest, ppMisses, uMisses, pResp->pRatings, puMisses);
+            iCopied = Result != TWP_NOT_IMPLEMENTED;
+        }
+        if (Result == TWP_NOT_IMPLEMENTED)
+        {
+            /* Without arena, the plug-in allocates from the caller's allocator. */
+            if (pCtx->pArenaPool != NULL)
+                pResp->pArena = TWPArenaCreate(pCtx->pArenaPool);
+            TWPArenaEnter(pResp->pArena, 1, &Saved);
+            Result = TWPStatsLookupUrls(pCtx, hConfigure, pRequest, 0, ppMisses, uMisses, &pResp->hPlugin);
+            TWPArenaLeave(&Saved);
+        }
+        if (Result != TWP_SUCCESS)
+            pResp->hPlugin = NULL;
+    }
+
+    for (i = 0; Result == TWP_SUCCESS && !iCopied && i < uMisses; i++)
+    {
+        FwRating *pRating = &pResp->pRatings[puMisses[i]];
+        FwRating Fresh;
+
+        TWPArenaEnter(pResp->pArena, 1, &Saved);
+        Result = (*pCtx->pfResponseGetUrlRatingByIndex)(pResp->hPlugin, i, &pRating->hPlugin);
+        TWPArenaLeave(&Saved);
+        if (Result != TWP_SUCCESS)
+            break;
+
+        memset(&Fresh, 0, sizeof(Fresh));
+        Fresh.hPlugin = pRating->hPlugin;
+        if (FillRating(pCtx, &Fresh) == TWP_SUCCESS &&
+            TWPUrlCanonicalize(ppMisses[i], strlen(ppMisses[i]), Key, sizeof(Key), &uKeyLength, NULL) == TWP_SUCCESS)
+        {
+            memcpy(pRating->Categories, Fresh.Categories, sizeof(pRating->Categories));
+            pRating->iCompiled = 1;
+            CacheRating(pCtx, Key, uKeyLength, &Fresh);
+        }
+    }
+
+    /* Duplicates share the plug-in rating and categories of the first spelling. */
+    for (i = 0; Result == TWP_SUCCESS && i < uCount; i++)
+    {
+        FwRating *pRating = &pResp->pRatings[i];
 
-            pCtx = (SitePluginContext *) malloc(sizeof(SitePluginContext));
-            if (pCtx == NULL)
+        if (puMissOf[i] != CACHE_HIT && puMisses[puMissOf[i]] != i)
+        {
+            FwRating const *pFirst = &pResp->pRatings[puMisses[puMissOf[i]]];
+
+            pRating->hPlugin = pFirst->hPlugin;
+            pRating->iScore = pFirst->iScore;
+            memcpy(pRating->Categories, pFirst->Categories, sizeof(pRating->Categories));
+            pRating->iCompiled = pFirst->iCompiled;
+            pRating->iProvisional = pFirst->iProvisional;
+            /* Without plug-in rating, each copy owns its DLA URL. */
+            if (pFirst->hPlugin == NULL && pFirst->pszDlaUrl != NULL)
             {
-                dlclose(pTmp);
-                break;
+                pRating->pszDlaUrl = strdup(pFirst->pszDlaUrl);
+                pRating->uDlaLength = pFirst->uDlaLength;
+                if (pRating->pszDlaUrl == NULL)
+                    Result = TWP_NOMEM;
             }
-            
-            pCtx->pPlugin = pTmp;
-            pCtx->pfUninitLibrary = TmpUninitLibrary;
-            pCtx->pfInitLibrary = TmpInitLibrary;
-            pCtx->pfConfigurationCreate = TmpConfigurationCreate;
-            pCtx->pfConfigurationDestroy = TmpConfigurationDestroy;
-            pCtx->pfLookupUrls = TmpLookupUrls;
-            pCtx->pfResponseWrite = TmpResponseWrite;
-            pCtx->pfResponseGetUrlRatingByIndex = TmpResponseGetUrlRatingByIndex;
-            pCtx->pfResponseGetUrlRatingByUrl = TmpResponseGetUrlRatingByUrl;
-            pCtx->pfResponseGetRedirUrlFor = TmpResponseGetRedirUrlFor;
-            pCtx->pfResponseGetUrlRatingsCount = TmpResponseGetUrlRatingsCount;
-            pCtx->pfResponseDestroy = TmpResponseDestroy;
-            pCtx->pfPolicyCreate = TmpPolicyCreate;
-            pCtx->pfPolicyValidate = TmpPolicyValidate;
-            pCtx->pfPolicyGetViolations = TmpPolicyGetViolations;
-            pCtx->pfPolicyDestroy = TmpPolicyDestroy;
-            pCtx->pfUrlRatingGetScore = TmpUrlRatingGetScore;
-            pCtx->pfUrlRatingGetUrl = TmpUrlRatingGetUrl;
-            pCtx->pfUrlRatingGetDLAUrl = TmpUrlRatingGetDLAUrl;
-            pCtx->pfUrlRatingHasCategory = TmpUrlRatingHasCategory;
-            pCtx->pfUrlRatingGetCategories = TmpUrlRatingGetCategories;
-        } while(0);
+        }
     }
-    else
+
+    free(pWork);
+    if (Result != TWP_SUCCESS)
     {
-        DEBUG_LOG("No plugin found.\n");
+        FreeResponse(pCtx, pResp);
+        return Result;
     }
 
-    return pCtx;
+    if (uRevalidate != 0 && pCtx->pAsync != NULL)
+        Revalidate(pCtx, hConfigure, pResp, uRevalidate);
+
+    *phResponse = (TWPResponseHandle) TWP_FW_HANDLE(pResp);
+
+    return TWP_SUCCESS;
+}
+
+
+/**
+ * Returns 1 if two URLs of a batch may have the same canonical form.
+ */
+static int HasDuplicates(const char **ppUrls, unsigned int uCount)
+{
+    char Key[TWP_MAX_URL_LENGTH];
+    unsigned int uKeyLength;
+    uint64_t *puHashes;
+    int iRet = 0;
+    unsigned int i;
+
+    if (uCount < 2)
+        return 0;
+
+    puHashes = (uint64_t *) malloc(uCount * sizeof(uint64_t));
+    if (puHashes == NULL)
+        return 0;
+
+    for (i = 0; i < uCount; i++)
+    {
+        /* URLs too long for the cache keep their own lookup. */
+        if (ppUrls[i] == NULL ||
+            TWPUrlCanonicalize(ppUrls[i], strlen(ppUrls[i]), Key, sizeof(Key), &uKeyLength,
+                               &puHashes[i]) != TWP_SUCCESS)
+            puHashes[i] = i;
+    }
+
+    qsort(puHashes, uCount, sizeof(uint64_t), CompareHash);
+    for (i = 1; i < uCount && iRet == 0; i++)
+        iRet = puHashes[i] == puHashes[i - 1];
+
+    free(puHashes);
+
+    return iRet;
+}
+
+
+static int CompareHash(void const *pLeft, void const *pRight)
+{
+    uint64_t uLeft = *(uint64_t const *) pLeft;
+    uint64_t uRight = *(uint64_t const *) pRight;
+
+    return uLeft < uRight ? -1 : uLeft > uRight;
+}
+
+
+/**
+ * Finds the slot of the miss table holding an earlier miss with the same
+ * canonical URL (its index + 1), or the empty slot where it is to be added.
+ */
+static unsigned int *FindMiss(unsigned int *puTable, unsigned int uTableMask, const char **ppMisses,
+                              uint64_t const *puMissHashes, char const *pKey, unsigned int uKeyLength,
+                              uint64_t uHash)
+{
+    char Other[TWP_MAX_URL_LENGTH];
+    unsigned int uOtherLength;
+    unsigned int i;
+
+    for (i = (unsigned int) uHash & uTableMask; puTable[i] != 0; i = (i + 1) & uTableMask)
+    {
+        unsigned int uMiss = puTable[i] - 1;
+
+        if (puMissHashes[uMiss] == uHash &&
+            TWPUrlCanonicalize(ppMisses[uMiss], strlen(ppMisses[uMiss]), Other, sizeof(Other), &uOtherLength,
+                               NULL) == TWP_SUCCESS &&
+            uOtherLength == uKeyLength && memcmp(Other, pKey, uKeyLength) == 0)
+            break;
+    }
+
+    return &puTable[i];
+}
+
+
+/**
+ * Searches the local database, then the cached rating of a URL and the cached
+ * ratings covering its host and its registrable domain.
+ */
+static int GetCachedUrl(SitePluginContext *pCtx, char const *pKey, unsigned int uKeyLength, FwRating *pRating)
+{
+    char ScopeKey[TWP_MAX_URL_LENGTH];
+    unsigned int uScopeLength;
+
+    if (pCtx->pLocalDb != NULL && TWPLocalDbGet(pCtx->pLocalDb, pKey, uKeyLength, pRating) == 0)
+        return 0;
+
+    if (GetCached(pCtx, pKey, uKeyLength, pRating) == 0)
+        return 0;
+
+    if (TWPUrlScopeKey(pKey, uKeyLength, TWP_SCOPE_HOST, ScopeKey, sizeof(ScopeKey), &uScopeLength) == 0 &&
+        GetCached(pCtx, ScopeKey, uScopeLength, pRating) == 0)
+        return 0;
+
+    if (TWPUrlScopeKey(pKey, uKeyLength, TWP_SCOPE_DOMAIN, ScopeKey, sizeof(ScopeKey), &uScopeLength) == 0 &&
+        GetCached(pCtx, ScopeKey, uScopeLength, pRating) == 0)
+        return 0;
+
+    return -1;
+}
+
+
+/**
+ * Searches the in-memory cache, then the cache file. Ratings found in the
+ * file are added to the in-memory cache.
+ */
+static int GetCached(SitePluginContext *pCtx, char const *pKey, unsigned int uKeyLength, FwRating *pRating)
+{
+    uint64_t uHash = TWPUrlHash(pKey, uKeyLength);
+
+    if (pCtx->pCache != NULL && TWPCacheGet(pCtx->pCache, uHash, pKey, uKeyLength, pRating) == 0)
+        return 0;
+
+    if (pCtx->pDiskCache != NULL && TWPDiskCacheGet(pCtx->pDiskCache, uHash, pKey, uKeyLength, pRating) == 0)
+    {
+        if (pCtx->pCache != NULL)
+            TWPCachePut(pCtx->pCache, uHash, pKey, uKeyLength, pRating);
+        return 0;
+    }
+
+    return -1;
+}
+
+
+static void PutCached(SitePluginContext *pCtx, char const *pKey, unsigned int uKeyLength, FwRating const *pRating)
+{
+    uint64_t uHash = TWPUrlHash(pKey, uKeyLength);
+
+    if (pCtx->pCache != NULL)
+        TWPCachePut(pCtx->pCache, uHash, pKey, uKeyLength, pRating);
+    if (pCtx->pDiskCache != NULL)
+        TWPDiskCachePut(pCtx->pDiskCache, uHash, pKey, uKeyLength, pRating);
+}
+
+
+/**
+ * Caches a rating under its canonical URL, and under its host or domain key
+ * if the plug-in rated the whole host or domain.
+ */
+static void CacheRating(SitePluginContext *pCtx, char const *pKey, unsigned int uKeyLength, FwRating const *pRating)
+{
+    char ScopeKey[TWP_MAX_URL_LENGTH];
+    unsigned int uScopeLength;
+    int iScope = TWP_SCOPE_URL;
+
+    PutCached(pCtx, pKey, uKeyLength, pRating);
+    if (pCtx->pfUrlRatingGetScope != NULL &&
+        (*pCtx->pfUrlRatingGetScope)(pRating->hPlugin, &iScope) == TWP_SUCCESS &&
+        TWPUrlScopeKey(pKey, uKeyLength, iScope, ScopeKey, sizeof(ScopeKey), &uScopeLength) == 0)
+    {
+        PutCached(pCtx, ScopeKey, uScopeLength, pRating);
+    }
+}
+
+
+/**
+ * Rates a URL whose host missed the host filter.
+ */
+static void SetProvisional(FwRating *pRating)
+{
+    pRating->iScore = TWP_MinimalLow;
+    memset(pRating->Categories, 0, sizeof(pRating->Categories));
+    TWP_CATEGORY_SET(pRating->Categories, TWP_OverallRiskMinimal);
+    pRating->pszDlaUrl = NULL;
+    pRating->uDlaLength = 0;
+    pRating->iProvisional = PROVISIONAL_FILTER;
+}
+
+
+/**
+ * Rates a URL whose lookup missed its deadline.
+ */
+static void SetVerdict(FwRating *pRating, unsigned int uVerdict)
+{
+    pRating->iScore = uVerdict == TWP_DEADLINE_FAIL_CLOSED ? TWP_HighHigh : TWP_UnverifiedLow;
+    memset(pRating->Categories, 0, sizeof(pRating->Categories));
+    TWP_CATEGORY_SET(pRating->Categories,
+                     uVerdict == TWP_DEADLINE_FAIL_CLOSED ? TWP_OverallRiskHigh : TWP_OverallRiskUnverified);
+    pRating->iCompiled = 1;
+    pRating->pszDlaUrl = NULL;
+    pRating->uDlaLength = 0;
+    pRating->iProvisional = PROVISIONAL_DEADLINE;
+}
+
+
+/**
+ * Looks up the URLs of a response rated by the host filter or by a stale
+ * cached rating on the event loop, RevalidateDone() caches their ratings. The
+ * URLs are copied as the response may be destroyed first.
+ */
+static void Revalidate(SitePluginContext *pCtx, TWPConfigurationHandle hConfigure, FwResponse const *pResp,
+                       unsigned int uRevalidate)
+{
+    FwRevalidate *pRevalidate;
+    size_t Size = sizeof(FwRevalidate) + uRevalidate * sizeof(char *);
+    char *pNext;
+    unsigned int i;
+
+    for (i = 0; i < pResp->uCount; i++)
+    {
+        if (pResp->pRatings[i].iRevalidate)
+            Size += pResp->pRatings[i].uUrlLength + 1;
+    }
+
+    pRevalidate = (FwRevalidate *) malloc(Size);
+    if (pRevalidate == NULL)
+        return;
+    pRevalidate->pCtx = pCtx;
+    pRevalidate->uCount = 0;
+    pRevalidate->ppUrls = (const char **) (pRevalidate + 1);
+    pNext = (char *) (pRevalidate->ppUrls + uRevalidate);
+
+    for (i = 0; i < pResp->uCount; i++)
+    {
+        FwRating const *pRating = &pResp->pRatings[i];
+
+        if (!pRating->iRevalidate)
+            continue;
+        memcpy(pNext, pRating->pszUrl, pRating->uUrlLength + 1);
+        pRevalidate->ppUrls[pRevalidate->uCount++] = pNext;
+        pNext += pRating->uUrlLength + 1;
+    }
+
+    if (TWPAsyncSubmit(pCtx, hConfigure, 0, pRevalidate->ppUrls, pRevalidate->uCount, RevalidateDone,
+                       pRevalidate, TWP_SUBMIT_INTERNAL) != TWP_SUCCESS)
+    {
+        DEBUG_LOG("cache: cannot revalidate %u urls\n", pRevalidate->uCount);
+        free(pRevalidate);
+    }
+}
+
+
+static void RevalidateDone(void *pContext, TWP_RESULT Result, TWPResponseHandle hResponse)
+{
+    FwRevalidate *pRevalidate = (FwRevalidate *) pContext;
+    SitePluginContext *pCtx = pRevalidate->pCtx;
+
+    if (Result == TWP_SUCCESS)
+        TWPCacheResponse(pCtx, hResponse, pRevalidate->ppUrls, pRevalidate->uCount);
+    DEBUG_LOG("cache: revalidated %u urls (%d)\n", pRevalidate->uCount, Result);
+
+    if (hResponse != NULL)
+        (*pCtx->pfResponseDestroy)(&hResponse);
+    free(pRevalidate);
+}
+
+
+/**
+ * Reads the score, categories and DLA URL of a plug-in rating. The DLA URL is
+ * not copied and stays owned by the plug-in.
+ */
+static TWP_RESULT FillRating(SitePluginContext *pCtx, FwRating *pRating)
+{
+    unsigned int uLength = 0;
+    const char *pszDlaUrl = NULL;
+    TWP_RESULT Result;
+
+    Result = (*pCtx->pfUrlRatingGetScore)(pRating->hPlugin, &pRating->iScore);
+    if (Result != TWP_SUCCESS)
+        return Result;
+
+    Result = CompileRating(pCtx, pRating);
+    if (Result != TWP_SUCCESS)
+        return Result;
+
+    if ((*pCtx->pfUrlRatingGetDLAUrl)(pRating->hPlugin, &pszDlaUrl, &uLength) == TWP_SUCCESS &&
+        pszDlaUrl != NULL)
+    {
+        pRating->pszDlaUrl = (char *) pszDlaUrl;
+        pRating->uDlaLength = uLength;
+    }
+
+    return TWP_SUCCESS;
+}
+
+
+/**
+ * Reads the categories of a plug-in rating into its bitmap, the plug-in is
+ * only asked once per rating.
+ */
+static TWP_RESULT CompileRating(SitePluginContext *pCtx, FwRating *pRating)
+{
+    TWP_RESULT Result;
+
+    if (pRating->hPlugin == NULL || pRating->iCompiled)
+        return TWP_SUCCESS;
+
+    Result = ReadCategoryMask(pCtx, pRating->hPlugin, pRating->Categories);
+    if (Result != TWP_SUCCESS)
+        return Result;
+    pRating->iCompiled = 1;
+
+    return TWP_SUCCESS;
+}
+
+
+/**
+ * Gets the category bitmap of a plug-in rating, from the plug-in if it
+ * supports bitmaps or built from its category list.
+ */
+static TWP_RESULT ReadCategoryMask(SitePluginContext *pCtx, TWPUrlRatingHandle hRating, uint64_t *pMask)
+{
+    TWPCategories *pCategories = NULL;
+    unsigned int uLength = 0;
+    TWP_RESULT Result;
+    unsigned int i;
+
+    memset(pMask, 0, TWP_CATEGORY_WORDS * sizeof(uint64_t));
+    if (pCtx->pfUrlRatingGetCategoryMask != NULL)
+    {
+        Result = (*pCtx->pfUrlRatingGetCategoryMask)(hRating, pMask);
+        if (Result != TWP_NOT_IMPLEMENTED)
+            return Result;
+        memset(pMask, 0, TWP_CATEGORY_WORDS * sizeof(uint64_t));
+    }
+
+    Result = (*pCtx->pfUrlRatingGetCategories)(hRating, &pCategories, &uLength);
+    if (Result != TWP_SUCCESS)
+        return Result;
+    for (i = 0; i < uLength; i++)
+    {
+        if ((unsigned int) pCategories[i] < TWP_CATEGORY_BITS)
+            TWP_CATEGORY_SET(pMask, pCategories[i]);
+    }
+    if (pCategories != NULL)
+        (*pCtx->pfMemFree)(pCategories);
+
+    return TWP_SUCCESS;
+}
+
+
+static void FreeResponse(SitePluginContext *pCtx, FwResponse *pResp)
+{
+    FwArenaScope Saved;
+    unsigned int i;
+
+    for (i = 0; i < pResp->uCount; i++)
+    {
+        free(pResp->pRatings[i].pszUrl);
+        if (pResp->pRatings[i].hPlugin == NULL)
+            free(pResp->pRatings[i].pszDlaUrl);
+    }
+    if (pResp->hPlugin != NULL)
+    {
+        TWPArenaEnter(pResp->pArena, 0, &Saved);
+        (*pCtx->pfResponseDestroy)(&pResp->hPlugin);
+        TWPArenaLeave(&Saved);
+    }
+    if (pResp->pArena != NULL)
+        TWPArenaRelease(pResp->pArena);
+    free(pResp);
+}
+
+
+/**
+ * Returns the categories set in a bitmap as an array allocated with the
+ * caller's allocator, or NULL if there is none.
+ */
+static TWP_RESULT GetCategoryList(SitePluginContext *pCtx, uint64_t const *pCategories,
+                                  TWPCategories **ppCategories, unsigned int *puLength)
+{
+    TWPCategories *pList;
+    unsigned int uCount = 0;
+    unsigned int i;
+
+    if (ppCategories == NULL || puLength == NULL)
+        return TWP_INVALID_PARAMETER;
+
+    for (i = 0; i < TWP_CATEGORY_WORDS; i++)
+        uCount += __builtin_popcountll(pCategories[i]);
+
+    *ppCategories = NULL;
+    *puLength = 0;
+    if (uCount == 0)
+        return TWP_SUCCESS;
+
+    pList = (TWPCategories *) (*pCtx->pfMemAlloc)(uCount * sizeof(TWPCategories));
+    if (pList == NULL)
+        return TWP_NOMEM;
+
+    for (i = 0; i < TWP_CATEGORY_BITS; i++)
+    {
+        if (TWP_CATEGORY_TEST(pCategories, i))
+            pList[(*puLength)++] = (TWPCategories) i;
+    }
+    *ppCategories = pList;
+
+    return TWP_SUCCESS;
 }
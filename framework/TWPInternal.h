@@ -0,0 +1,527 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TWPINTERNAL_H
+#define TWPINTERNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "TWPImpl.h"
+#include "TWPPolicy.h"
+#include "TWPAsync.h"
+#include "TWPStats.h"
+#include "TWPPlugin.h"
+
+#ifdef __cplusplus 
+extern "C" {
+#endif
+
+/**
+ * \file TWPInternal.h
+ * \brief TWP Framework Internal Header File
+ *  
+ * This file is shared by the TWP framework sources and is not part of the
+ * public interface.
+ */
+
+#define TWP_CATEGORY_WORDS TWP_CATEGORY_MASK_WORDS
+
+#define TWP_CATEGORY_BITS (TWP_CATEGORY_WORDS * 64)
+
+#define TWP_CATEGORY_SET(m, c) ((m)[(unsigned int) (c) >> 6] |= (uint64_t) 1 << ((unsigned int) (c) & 63))
+
+#define TWP_CATEGORY_TEST(m, c) (((m)[(unsigned int) (c) >> 6] >> ((unsigned int) (c) & 63)) & 1)
+
+#define TWP_STATS_ADD(pCtx, Field, Value) \
+    __atomic_fetch_add(&(pCtx)->Stats.Field, (unsigned long) (Value), __ATOMIC_RELAXED)
+
+#define TWP_SUBMIT_ON_LOOP 0x1 /* TWPAsyncSubmit() callback on the event loop thread even with TWP_ASYNC_EVENTFD. */
+
+#define TWP_SUBMIT_INTERNAL 0x2 /* TWPAsyncSubmit() lookup made by the library, see TWPStats::ulInternalLookups. */
+
+#define TWP_MAX_URL_LENGTH 2048 /* Longest canonical URL kept in the cache, longer URLs bypass it. */
+
+/*
+ * Response, rating and policy handles created by the framework have the
+ * lowest bit set. Plug-in handles point to aligned objects and never do.
+ */
+#define TWP_FW_TAG ((uintptr_t) 1)
+
+#define TWP_IS_FW_HANDLE(h) ((((uintptr_t) (h)) & TWP_FW_TAG) != 0)
+
+#define TWP_FW_PTR(h) ((void *) (((uintptr_t) (h)) & ~TWP_FW_TAG))
+
+#define TWP_FW_HANDLE(p) ((void *) (((uintptr_t) (p)) | TWP_FW_TAG))
+
+
+typedef TWP_RESULT (*FuncInitLibrary)(TWPAPIInit *pApiInit);
+typedef void (*FuncUninitLibrary)(void);
+typedef TWP_RESULT (*FuncConfigurationCreate)(TWPConfiguration *pConfigure, TWPConfigurationHandle *phConfigure);
+typedef TWP_RESULT (*FuncConfigurationDestroy)(TWPConfigurationHandle *hConfigure);
+typedef TWP_RESULT (*FuncLookupUrls)(TWPConfigurationHandle hConfigure, TWPRequest *pRequest, int iRedirUrl,
+                                     const char **ppUrls, unsigned int uCount, TWPResponseHandle *phResponse);
+typedef TWP_RESULT (*FuncResponseWrite)(TWPResponseHandle hResponse, const void *pData, unsigned uLength);
+typedef TWP_RESULT (*FuncResponseGetUrlRatingByIndex)(TWPResponseHandle hResponse, unsigned int iIndex,
+                                                      TWPUrlRatingHandle *hRating);
+typedef TWP_RESULT (*FuncResponseGetUrlRatingByUrl)(TWPResponseHandle hResponse, const char *pUrl,
+                                                    unsigned int iUrlLength, TWPUrlRatingHandle *hRating);
+typedef TWP_RESULT (*FuncResponseGetRedirUrlFor)(TWPResponseHandle hResponse, TWPUrlRatingHandle hRating,
+                                                 TWPPolicyHandle hPolicy, char **ppUrl, unsigned int *puLength);
+typedef TWP_RESULT (*FuncResponseGetUrlRatingsCount)(TWPResponseHandle hResponse, unsigned int *puCount);
+typedef TWP_RESULT (*FuncResponseDestroy)(TWPResponseHandle *handle_response);
+typedef TWP_RESULT (*FuncPolicyCreate)(TWPConfigurationHandle hCfg, TWPCategories *pCategories, unsigned int uCount,
+                                       TWPPolicyHandle *phPolicy);
+typedef TWP_RESULT (*FuncPolicyValidate)(TWPPolicyHandle hPolicy, TWPUrlRatingHandle hRating, int *piViolated);
+typedef TWP_RESULT (*FuncPolicyGetViolations)(TWPPolicyHandle hPolicy, TWPUrlRatingHandle hRating,
+                                              TWPCategories **ppViolated, unsigned *puLength);
+typedef TWP_RESULT (*FuncPolicyDestroy)(TWPPolicyHandle *hPolicy);
+typedef TWP_RESULT (*FuncUrlRatingGetScore)(TWPUrlRatingHandle hRating, int *piScore);
+typedef TWP_RESULT (*FuncUrlRatingGetUrl)(TWPUrlRatingHandle hRating, const char **ppUrl,
+                                          unsigned int *puLength);
+typedef TWP_RESULT (*FuncUrlRatingGetDLAUrl)(TWPUrlRatingHandle hRating, const char **ppDlaUrl,
+                                             unsigned int *puLength);
+typedef TWP_RESULT (*FuncUrlRatingHasCategory)(TWPUrlRatingHandle hRating, TWPCategories Category,
+                                               int *piPresent);
+typedef TWP_RESULT (*FuncUrlRatingGetCategories)(TWPUrlRatingHandle hRating, TWPCategories **ppCategories,
+                                                 unsigned int *puLength);
+typedef TWP_RESULT (*FuncUrlRatingGetScope)(TWPUrlRatingHandle hRating, int *piScope);
+typedef TWP_RESULT (*FuncUrlRatingGetCategoryMask)(TWPUrlRatingHandle hRating, uint64_t *pMask);
+typedef TWPPInterface const *(*FuncGetInterface)(unsigned int uVersion);
+
+
+typedef struct TWPCache_struct TWPCache;
+typedef struct TWPDiskCache_struct TWPDiskCache;
+typedef struct TWPCoalescer_struct TWPCoalescer;
+typedef struct FwBatch_struct FwBatch;
+typedef struct TWPAsyncLoop_struct TWPAsyncLoop;
+typedef struct TWPArenaPool_struct TWPArenaPool;
+typedef struct TWPLocalDb_struct TWPLocalDb;
+typedef struct TWPBloom_struct TWPBloom;
+typedef struct TWPPrefetcher_struct TWPPrefetcher;
+typedef struct FwArena_struct FwArena;
+
+/**
+ * Arena of the plug-in calls of a thread, saved by TWPArenaEnter().
+ */
+typedef struct FwArenaScope_struct
+{
+    FwArena *pArena;
+    int iAllocate;
+} FwArenaScope;
+
+/**
+ * Rating handed out by the framework. Ratings returned by the plug-in for
+ * this lookup are forwarded to it, the other fields are only used for
+ * ratings served from the cache. The categories of plug-in ratings are read
+ * into the bitmap on first use, policies are then checked without the
+ * plug-in.
+ */
+typedef struct FwRating_struct
+{
+    TWPUrlRatingHandle hPlugin; /* Plug-in rating, NULL if served from the cache. */
+    int iScore;
+    uint64_t Categories[TWP_CATEGORY_WORDS];
+    int iCompiled; /* Categories holds the categories of hPlugin. */
+    char *pszUrl; /* URL as given by the caller, NULL if hPlugin rates this spelling. */
+    unsigned int uUrlLength;
+    uint64_t uUrlHash; /* Hash of the canonical URL, 0 if the URL is too long. */
+    char *pszDlaUrl; /* NULL if the URL has no DLA URL. */
+    unsigned int uDlaLength;
+    int iProvisional; /* Rated without lookup, by the host filter or the deadline verdict. */
+    int iRevalidate; /* Looked up again in the background, the rating is stale or provisional. */
+    unsigned int uLifetime; /* Seconds left before a rating read from the cache file expires, 0 otherwise. */
+} FwRating;
+
+/**
+ * Response handed out by the framework, the ratings are in the order of the
+ * caller's URLs.
+ */
+typedef struct FwResponse_struct
+{
+    TWPResponseHandle hPlugin; /* Plug-in response for the cache misses, NULL if none. */
+    unsigned int uCount;
+    FwRating *pRatings;
+    FwArena *pArena; /* Arena of the plug-in allocations for hPlugin, NULL if none. */
+} FwResponse;
+
+/**
+ * Policy handed out by the framework, keeps the policy categories so cached
+ * ratings can be validated without the plug-in.
+ */
+typedef struct FwPolicy_struct
+{
+    TWPPolicyHandle hPlugin;
+    uint64_t Categories[TWP_CATEGORY_WORDS];
+} FwPolicy;
+
+
+typedef struct SitePluginContext_struct
+{
+    void *pPlugin;
+    FuncUninitLibrary pfUninitLibrary;
+    FuncInitLibrary pfInitLibrary;
+    FuncConfigurationCreate pfConfigurationCreate;
+    FuncConfigurationDestroy pfConfigurationDestroy;
+    FuncLookupUrls pfLookupUrls;
+    FuncResponseWrite pfResponseWrite;
+    FuncResponseGetUrlRatingByIndex pfResponseGetUrlRatingByIndex;
+    FuncResponseGetUrlRatingByUrl pfResponseGetUrlRatingByUrl;
+    FuncResponseGetRedirUrlFor pfResponseGetRedirUrlFor;
+    FuncResponseGetUrlRatingsCount pfResponseGetUrlRatingsCount;
+    FuncResponseDestroy pfResponseDestroy;
+    FuncPolicyCreate pfPolicyCreate;
+    FuncPolicyValidate pfPolicyValidate;
+    FuncPolicyGetViolations pfPolicyGetViolations;
+    FuncPolicyDestroy pfPolicyDestroy;
+    FuncUrlRatingGetScore pfUrlRatingGetScore;
+    FuncUrlRatingGetUrl pfUrlRatingGetUrl;
+    FuncUrlRatingGetDLAUrl pfUrlRatingGetDLAUrl;
+    FuncUrlRatingHasCategory pfUrlRatingHasCategory;
+    FuncUrlRatingGetCategories pfUrlRatingGetCategories;
+    FuncUrlRatingGetScope pfUrlRatingGetScope; /* Optional, NULL if not exported by the plug-in. */
+    FuncUrlRatingGetCategoryMask pfUrlRatingGetCategoryMask; /* Optional. */
+    TWPFnMemAlloc pfMemAlloc; /* Allocator given to TWPInitLibrary(), never NULL. */
+    TWPFnMemFree pfMemFree;
+    TWPCache *pCache; /* Rating cache, NULL if disabled. */
+    TWPDiskCache *pDiskCache; /* Rating cache file, NULL if disabled. */
+    TWPCoalescer *pCoalescer; /* Lookup coalescing, NULL if disabled. */
+    TWPAsyncLoop *pAsync; /* Event loop of the asynchronous lookups, NULL if stopped. */
+    TWPArenaPool *pArenaPool; /* Response arenas, NULL if disabled. */
+    TWPLocalDb *pLocalDb; /* Local reputation database, NULL if closed. */
+    TWPBloom *pBloom; /* Host filter, NULL if closed. */
+    unsigned int uBloomFlags; /* TWP_BLOOM_ flags of pBloom. */
+    TWPPrefetcher *pPrefetch; /* Prefetch queue, NULL if disabled. */
+    unsigned int uDeadline; /* Time limit (in milliseconds) of TWPLookupUrls(), 0 for none. */
+    unsigned int uDeadlineVerdict; /* TWP_DEADLINE_ verdict of late URLs. */
+    TWPStats Stats; /* Lookup counters, updated with relaxed atomics. */
+} SitePluginContext;
+
+
+/**
+ * \brief Finds the host of a canonical URL, without user information, port
+ * and trailing dot.
+ *
+ * \return Return Type (int) \n
+ * 0 - on success. \n
+ * -1 - if the URL has no host. \n
+ */
+int TWPUrlGetHost(char const *pKey, unsigned int uLength, unsigned int *puStart, unsigned int *puLength);
+
+/**
+ * \brief Finds the registrable domain (eTLD+1) of a lowercase host name.
+ *
+ * \param[out] puStart Offset of the registrable domain in pHost.
+ *
+ * \return Return Type (int) \n
+ * 0 - on success. \n
+ * -1 - if the host is an address or a public suffix. \n
+ */
+int TWPUrlGetDomain(char const *pHost, unsigned int uLength, unsigned int *puStart);
+
+/**
+ * \brief Builds the cache key of the host (TWP_SCOPE_HOST) or registrable
+ * domain (TWP_SCOPE_DOMAIN) of a canonical URL.
+ *
+ * \return Return Type (int) \n
+ * 0 - on success. \n
+ * -1 - if the URL has no such key or it does not fit in pBuffer. \n
+ */
+int TWPUrlScopeKey(char const *pKey, unsigned int uLength, int iScope, char *pBuffer, unsigned int uSize,
+                   unsigned int *puLength);
+
+/**
+ * \brief Returns the 64-bit FNV-1a hash of a cache key.
+ */
+uint64_t TWPUrlHash(char const *pData, unsigned int uLength);
+
+/**
+ * \brief Releases a rating cache.
+ */
+void TWPCacheDestroy(TWPCache *pCache);
+
+/**
+ * \brief Looks up a cached rating.
+ *
+ * \param[out] pRating Score, categories and DLA URL of the rating. The DLA URL
+ * is allocated with malloc(). iRevalidate is set if the rating is stale and
+ * the caller is the one to refresh it.
+ *
+ * \return Return Type (int) \n
+ * 0 - on success. \n
+ * -1 - if the key is not cached, has expired or on memory shortage. \n
+ */
+int TWPCacheGet(TWPCache *pCache, uint64_t uHash, char const *pKey, unsigned int uKeyLength,
+                FwRating *pRating);
+
+/**
+ * \brief Adds or replaces a cached rating, evicting the least recently used
+ * rating if the cache is full. A rating with a uLifetime shorter than the
+ * lifetime of the cache expires with it.
+ */
+void TWPCachePut(TWPCache *pCache, uint64_t uHash, char const *pKey, unsigned int uKeyLength,
+                 FwRating const *pRating);
+
+/**
+ * \brief Unmaps and closes a rating cache file.
+ */
+void TWPDiskCacheClose(TWPDiskCache *pCache);
+
+/**
+ * \brief Empties a rating cache file.
+ */
+void TWPDiskCacheFlush(TWPDiskCache *pCache);
+
+/**
+ * \brief Looks up a rating in the cache file, same as TWPCacheGet(). The
+ * rest of its lifetime is in pRating->uLifetime.
+ */
+int TWPDiskCacheGet(TWPDiskCache *pCache, uint64_t uHash, char const *pKey, unsigned int uKeyLength,
+                    FwRating *pRating);
+
+/**
+ * \brief Writes a rating to the cache file, replacing the rating expiring
+ * first among the slots the key may use.
+ */
+void TWPDiskCachePut(TWPDiskCache *pCache, uint64_t uHash, char const *pKey, unsigned int uKeyLength,
+                     FwRating const *pRating);
+
+/**
+ * \brief Unmaps and releases a reputation database.
+ */
+void TWPLocalDbClose(TWPLocalDb *pDb);
+
+/**
+ * \brief Looks up the canonical URL, its prefixes, host and domain in a
+ * reputation database.
+ *
+ * \param[out] pRating Score and categories of the most specific entry found.
+ *
+ * \return Return Type (int) \n
+ * 0 - on success. \n
+ * -1 - if the URL is not in the database. \n
+ */
+int TWPLocalDbGet(TWPLocalDb *pDb, char const *pKey, unsigned int uKeyLength, FwRating *pRating);
+
+/**
+ * \brief Writes a file under a temporary name and renames it to pszPath, so
+ * readers see the old or the new file.
+ *
+ * \return Return Type (int) \n
+ * 0 - on success. \n
+ * -1 - on failure, the old file is kept. \n
+ */
+int TWPFileReplace(char const *pszPath, void const *pData, size_t Size);
+
+/**
+ * \brief Unmaps and releases a host filter.
+ */
+void TWPBloomClose(TWPBloom *pBloom);
+
+/**
+ * \brief Tests the host and the registrable domain of a canonical URL in a
+ * host filter.
+ *
+ * \return Return Type (int) \n
+ * 1 - if the host or the domain may be in the filter, or the URL has no host. \n
+ * 0 - if neither is in the filter. \n
+ */
+int TWPBloomMayContain(TWPBloom *pBloom, char const *pKey, unsigned int uKeyLength);
+
+/**
+ * \brief Tells whether a canonical URL is rated by the local database or the
+ * rating cache.
+ *
+ * \return Return Type (int) \n
+ * 1 - if the URL is rated by a rating that is not stale. \n
+ * 0 - otherwise, the caller refreshes the stale rating. \n
+ */
+int TWPIsCached(SitePluginContext *pCtx, char const *pKey, unsigned int uKeyLength);
+
+/**
+ * \brief Adds the ratings of a plug-in response to the rating cache, ppUrls
+ * are the URLs of the lookup in order.
+ */
+void TWPCacheResponse(SitePluginContext *pCtx, TWPResponseHandle hResponse, const char **ppUrls,
+                      unsigned int uCount);
+
+/**
+ * \brief Copies rating uIndex of a plug-in response for the URL pszUrl into a
+ * rating that does not refer to the plug-in response, like a cached one, and
+ * caches it.
+ *
+ * \return TWP_RESULT, pRating is zeroed on failure.
+ */
+TWP_RESULT TWPCopyRating(SitePluginContext *pCtx, TWPResponseHandle hResponse, unsigned int uIndex,
+                         const char *pszUrl, FwRating *pRating);
+
+/**
+ * \brief Drops the queued prefetches, the prefetcher is released when the
+ * lookups in flight complete.
+ */
+void TWPPrefetchClose(TWPPrefetcher *pPrefetch);
+
+/**
+ * \brief Returns the monotonic time in nanoseconds.
+ */
+uint64_t TWPStatsClock(void);
+
+/**
+ * \brief Adds the time since uStart to the histogram of a phase.
+ *
+ * \return The current time, the start of the next phase.
+ */
+uint64_t TWPStatsAddPhase(SitePluginContext *pCtx, TWPStatsPhase Phase, uint64_t uStart);
+
+/**
+ * \brief Counts a lookup of uUrls URLs which ended with Result.
+ */
+void TWPStatsLookup(SitePluginContext *pCtx, unsigned int uUrls, TWP_RESULT Result);
+
+/**
+ * \brief Calls the plug-in lookup, timing the transport callbacks of a
+ * synchronous request.
+ */
+TWP_RESULT TWPStatsLookupUrls(SitePluginContext *pCtx, TWPConfigurationHandle hConfigure, TWPRequest *pRequest,
+                              int iRedirUrl, const char **ppUrls, unsigned int uCount,
+                              TWPResponseHandle *phResponse);
+
+/**
+ * \brief Releases the coalescing state of a library handle.
+ */
+void TWPCoalesceDestroy(TWPCoalescer *pCoalescer);
+
+/**
+ * \brief Looks up URLs in a plug-in lookup shared with other threads.
+ *
+ * The thread sending the lookup copies every rating out with TWPCopyRating()
+ * before the others are woken up, so the plug-in response is only read by
+ * one thread.
+ *
+ * \param[out] pRatings Ratings of the caller, the rating of ppUrls[i] is
+ * stored in pRatings[puSlots[i]].
+ *
+ * \return TWP_RESULT, TWP_NOT_IMPLEMENTED if the lookup cannot be merged and
+ * the caller looks the URLs up itself.
+ */
+TWP_RESULT TWPCoalesceLookup(SitePluginContext *pCtx, TWPConfigurationHandle hConfigure, TWPRequest *pRequest,
+                             const char **ppUrls, unsigned int uCount, FwRating *pRatings,
+                             unsigned int const *puSlots);
+
+/**
+ * \brief Stops an event loop, ending its lookups with TWP_ERROR, and releases
+ * it.
+ */
+void TWPAsyncDestroy(TWPAsyncLoop *pLoop);
+
+/**
+ * \brief Hands a lookup to the event loop, see TWPLookupUrlsAsync().
+ *
+ * \param[in] uFlags TWP_SUBMIT_ON_LOOP to run pfDone on the event loop
+ * thread, for callers waiting for it. TWP_SUBMIT_INTERNAL for lookups the
+ * library makes itself, they are not counted as TWPLookupUrlsAsync() calls.
+ *
+ * \return TWP_RESULT, TWP_NOT_IMPLEMENTED if the event loop cannot reach the
+ * plug-in server (HTTPS).
+ */
+TWP_RESULT TWPAsyncSubmit(SitePluginContext *pCtx, TWPConfigurationHandle hConfigure, int iRedirUrl,
+                          const char **ppUrls, unsigned int uCount, TWPFnLookupDone pfDone, void *pContext,
+                          unsigned int uFlags);
+
+/**
+ * \brief Looks up URLs on the event loop, waiting for the reply at most
+ * uTimeout milliseconds.
+ *
+ * \return TWP_RESULT \n
+ * TWP_NO_DATA - if the reply is late, it is added to the rating cache when
+ * it arrives. \n
+ */
+TWP_RESULT TWPDeadlineLookup(SitePluginContext *pCtx, TWPConfigurationHandle hConfigure, const char **ppUrls,
+                             unsigned int uCount, unsigned int uTimeout, TWPResponseHandle *phResponse);
+
+/**
+ * \brief Sets the allocator the plug-in allocations are forwarded to outside
+ * arenas. The plug-in is shared by the library handles, the allocator of the
+ * last TWPInitLibrary() call is used.
+ */
+void TWPArenaSetAllocator(TWPFnMemAlloc pfMemAlloc, TWPFnMemFree pfMemFree);
+
+/**
+ * \brief Allocator given to the plug-in, serves the arena of the calling
+ * thread if any.
+ */
+void *TWPArenaMemAlloc(TWPMallocSizeT Size);
+
+/**
+ * \brief Deallocator given to the plug-in, ignores the memory of the arena of
+ * the calling thread.
+ */
+void TWPArenaMemFree(void *pAddress);
+
+/**
+ * \brief Creates the arena of a response.
+ *
+ * \return The arena, NULL on memory shortage.
+ */
+FwArena *TWPArenaCreate(TWPArenaPool *pPool);
+
+/**
+ * \brief Releases an arena and all its allocations.
+ */
+void TWPArenaRelease(FwArena *pArena);
+
+/**
+ * \brief Makes the plug-in calls of this thread use an arena until
+ * TWPArenaLeave().
+ *
+ * \param[in] pArena Arena, NULL for none.
+ * \param[in] iAllocate 1 to serve allocations from the arena, 0 to only
+ * ignore frees of its memory.
+ * \param[out] pSaved Arena used before, to be restored.
+ */
+void TWPArenaEnter(FwArena *pArena, int iAllocate, FwArenaScope *pSaved);
+
+/**
+ * \brief Restores the arena used before TWPArenaEnter().
+ */
+void TWPArenaLeave(FwArenaScope const *pSaved);
+
+/**
+ * \brief Releases the arena pool of a library handle, its arenas must have
+ * been released.
+ */
+void TWPArenaPoolDestroy(TWPArenaPool *pPool);
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif  /* TWPINTERNAL_H */
@@ -0,0 +1,625 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "TWPCache.h"
+#include "TWPUrl.h"
+#include "TWPLocalDb.h"
+#include "TWPInternal.h"
+
+#if defined(DEBUG)
+#define DEBUG_LOG(_fmt_, _param_...)    { \
+                                            printf("[TWP] %s,%d: " _fmt_, __FILE__, __LINE__, ##_param_); \
+                                        }
+#else
+#define DEBUG_LOG(_fmt_, _param_...)
+#endif
+
+
+#define LOCALDB_MAGIC 0x31444C5057545754ULL /* "TWTWPLD1" */
+
+#define LOCALDB_VERSION 1
+
+#define LOCALDB_BUCKET_ENTRIES 4 /* Average number of fingerprints of a bucket. */
+
+#define LOCALDB_MAX_BUCKET_BITS 24
+
+#define LOCALDB_MAX_PREFIXES 16 /* URL prefixes searched, from the longest. */
+
+#define LOCALDB_PREFIX_TAG 0x03 /* Hashed after a prefix so it differs from the same URL. */
+
+#define LOCALDB_ALIGN(n) (((n) + 7) & ~(size_t) 7)
+
+
+/**
+ * File header. The bucket directory, the sorted fingerprints, their records
+ * and the category bitmaps follow, each aligned on 8 bytes.
+ */
+typedef struct LocalHeader_struct
+{
+    uint64_t uMagic;
+    uint32_t uVersion;
+    uint32_t uCount;
+    uint32_t uBucketBits; /* Fingerprints are bucketed by their top bits. */
+    uint32_t uMasks;
+} LocalHeader;
+
+/**
+ * Rating of a fingerprint.
+ */
+typedef struct LocalRecord_struct
+{
+    int32_t iScore;
+    uint32_t uMask; /* Index of the category bitmap. */
+} LocalRecord;
+
+/**
+ * Offsets of the parts of a file.
+ */
+typedef struct LocalLayout_struct
+{
+    size_t Buckets; /* (1 << uBucketBits) + 1 start indexes of the buckets. */
+    size_t Keys;
+    size_t Records;
+    size_t Masks; /* TWP_CATEGORY_WORDS words per bitmap. */
+    size_t Size;
+} LocalLayout;
+
+typedef struct LocalMap_struct
+{
+    void *pMap;
+    size_t Size;
+    uint32_t uCount;
+    uint32_t uBucketBits;
+    uint32_t uMasks;
+    uint32_t const *puBuckets;
+    uint64_t const *puKeys;
+    LocalRecord const *pRecords;
+    uint64_t const *puMasks;
+} LocalMap;
+
+struct TWPLocalDb_struct
+{
+    char *pszPath;
+    pthread_rwlock_t Lock; /* Held for reading while searching, for writing to switch files. */
+    LocalMap Map;
+    struct stat Stat; /* File of Map. */
+    time_t Checked; /* Last time the file was checked for a new version. */
+};
+
+/**
+ * Entry being written by TWPLocalDbBuild().
+ */
+typedef struct BuildEntry_struct
+{
+    uint64_t uKey;
+    unsigned int uOrder;
+    int iScore;
+    uint64_t Mask[TWP_CATEGORY_WORDS];
+} BuildEntry;
+
+
+static void GetLayout(uint32_t uCount, uint32_t uBucketBits, uint32_t uMasks, LocalLayout *pLayout);
+static int MapOpen(char const *pszPath, LocalMap *pMap, struct stat *pStat);
+static void MapClose(LocalMap *pMap);
+static void Refresh(TWPLocalDb *pDb);
+static int Search(LocalMap const *pMap, uint64_t uKey, FwRating *pRating);
+static uint64_t Fingerprint(char const *pKey, unsigned int uLength, int iScope);
+static int EntryKey(TWPLocalDbEntry const *pEntry, uint64_t *puKey);
+static int CompareEntry(void const *pLeft, void const *pRight);
+static int CompareMask(void const *pLeft, void const *pRight);
+
+
+TWP_RESULT TWPLocalDbConfigure(TWPLIB_HANDLE hLib, TWPLocalDbParam const *pParam)
+{
+    SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    TWPLocalDb *pDb = NULL;
+
+    if (pCtx == NULL)
+        return TWP_INVALID_HANDLE;
+
+    if (pParam != NULL)
+    {
+        if (pParam->pszPath == NULL)
+            return TWP_INVALID_PARAMETER;
+        pDb = (TWPLocalDb *) calloc(1, sizeof(TWPLocalDb));
+        if (pDb == NULL)
+            return TWP_NOMEM;
+        pDb->pszPath = strdup(pParam->pszPath);
+        if (pDb->pszPath == NULL)
+        {
+            free(pDb);
+            return TWP_NOMEM;
+        }
+        if (MapOpen(pDb->pszPath, &pDb->Map, &pDb->Stat) != 0)
+        {
+            free(pDb->pszPath);
+            free(pDb);
+            return TWP_ERROR;
+        }
+        pthread_rwlock_init(&pDb->Lock, NULL);
+        pDb->Checked = time(NULL);
+    }
+
+    if (pCtx->pLocalDb != NULL)
+        TWPLocalDbClose(pCtx->pLocalDb);
+    pCtx->pLocalDb = pDb;
+
+    return TWP_SUCCESS;
+}
+
+
+TWP_RESULT TWPLocalDbBuild(char const *pszPath, TWPLocalDbEntry const *pEntries, unsigned int uCount)
+{
+    BuildEntry *pBuild;
+    uint64_t *puMasks;
+    unsigned char *pData;
+    LocalLayout Layout;
+    LocalHeader *pHeader;
+    uint32_t *puBuckets;
+    uint64_t *puKeys;
+    LocalRecord *pRecords;
+    uint32_t uBucketBits = 0;
+    unsigned int uKept = 0;
+    unsigned int uMasks = 0;
+    unsigned int i;
+    unsigned int j;
+    int iRet;
+
+    if (pszPath == NULL || (pEntries == NULL && uCount != 0))
+        return TWP_INVALID_PARAMETER;
+
+    pBuild = (BuildEntry *) calloc(uCount + 1, sizeof(BuildEntry));
+    puMasks = (uint64_t *) calloc(uCount + 1, TWP_CATEGORY_WORDS * sizeof(uint64_t));
+    if (pBuild == NULL || puMasks == NULL)
+    {
+        free(pBuild);
+        free(puMasks);
+        return TWP_NOMEM;
+    }
+
+    for (i = 0; i < uCount; i++)
+    {
+        if (EntryKey(&pEntries[i], &pBuild[i].uKey) != 0 ||
+            (pEntries[i].pCategories == NULL && pEntries[i].uCategories != 0))
+        {
+            free(pBuild);
+            free(puMasks);
+            return TWP_INVALID_PARAMETER;
+        }
+        pBuild[i].uOrder = i;
+        pBuild[i].iScore = pEntries[i].iScore;
+        for (j = 0; j < pEntries[i].uCategories; j++)
+        {
+            if ((unsigned int) pEntries[i].pCategories[j] < TWP_CATEGORY_BITS)
+                TWP_CATEGORY_SET(pBuild[i].Mask, pEntries[i].pCategories[j]);
+        }
+    }
+
+    /* The last entry of a key is kept. */
+    qsort(pBuild, uCount, sizeof(BuildEntry), CompareEntry);
+    for (i = 0; i < uCount; i++)
+    {
+        if (i + 1 < uCount && pBuild[i + 1].uKey == pBuild[i].uKey)
+            continue;
+        pBuild[uKept++] = pBuild[i];
+    }
+
+    /* Entries share the bitmaps of their categories. */
+    for (i = 0; i < uKept; i++)
+        memcpy(&puMasks[i * TWP_CATEGORY_WORDS], pBuild[i].Mask, sizeof(pBuild[i].Mask));
+    qsort(puMasks, uKept, TWP_CATEGORY_WORDS * sizeof(uint64_t), CompareMask);
+    for (i = 0; i < uKept; i++)
+    {
+        if (uMasks != 0 && CompareMask(&puMasks[(uMasks - 1) * TWP_CATEGORY_WORDS],
+                                       &puMasks[i * TWP_CATEGORY_WORDS]) == 0)
+            continue;
+        memmove(&puMasks[uMasks * TWP_CATEGORY_WORDS], &puMasks[i * TWP_CATEGORY_WORDS],
+                TWP_CATEGORY_WORDS * sizeof(uint64_t));
+        uMasks++;
+    }
+
+    while (uBucketBits < LOCALDB_MAX_BUCKET_BITS && ((size_t) LOCALDB_BUCKET_ENTRIES << uBucketBits) < uKept)
+        uBucketBits++;
+
+    GetLayout(uKept, uBucketBits, uMasks, &Layout);
+    pData = (unsigned char *) calloc(1, Layout.Size);
+    if (pData == NULL)
+    {
+        free(pBuild);
+        free(puMasks);
+        return TWP_NOMEM;
+    }
+
+    pHeader = (LocalHeader *) pData;
+    pHeader->uMagic = LOCALDB_MAGIC;
+    pHeader->uVersion = LOCALDB_VERSION;
+    pHeader->uCount = uKept;
+    pHeader->uBucketBits = uBucketBits;
+    pHeader->uMasks = uMasks;
+    puBuckets = (uint32_t *) (pData + Layout.Buckets);
+    puKeys = (uint64_t *) (pData + Layout.Keys);
+    pRecords = (LocalRecord *) (pData + Layout.Records);
+    memcpy(pData + Layout.Masks, puMasks, uMasks * TWP_CATEGORY_WORDS * sizeof(uint64_t));
+
+    for (i = 0, j = 0; i < ((uint32_t) 1 << uBucketBits); i++)
+    {
+        puBuckets[i] = j;
+        while (j < uKept && (uBucketBits == 0 ? 0 : pBuild[j].uKey >> (64 - uBucketBits)) == i)
+            j++;
+    }
+    puBuckets[i] = uKept;
+
+    for (i = 0; i < uKept; i++)
+    {
+        uint64_t const *puFound = (uint64_t const *) bsearch(pBuild[i].Mask, puMasks, uMasks,
+                                                             TWP_CATEGORY_WORDS * sizeof(uint64_t), CompareMask);
+
+        puKeys[i] = pBuild[i].uKey;
+        pRecords[i].iScore = pBuild[i].iScore;
+        pRecords[i].uMask = (uint32_t) ((puFound - puMasks) / TWP_CATEGORY_WORDS);
+    }
+
+    iRet = TWPFileReplace(pszPath, pData, Layout.Size);
+    DEBUG_LOG("localdb: %u entries, %u bitmaps, %lu bytes\n", uKept, uMasks, (unsigned long) Layout.Size);
+
+    free(pData);
+    free(pBuild);
+    free(puMasks);
+
+    return iRet == 0 ? TWP_SUCCESS : TWP_ERROR;
+}
+
+
+void TWPLocalDbClose(TWPLocalDb *pDb)
+{
+    MapClose(&pDb->Map);
+    pthread_rwlock_destroy(&pDb->Lock);
+    free(pDb->pszPath);
+    free(pDb);
+}
+
+
+int TWPLocalDbGet(TWPLocalDb *pDb, char const *pKey, unsigned int uKeyLength, FwRating *pRating)
+{
+    uint64_t Keys[LOCALDB_MAX_PREFIXES + 3];
+    char ScopeKey[TWP_MAX_URL_LENGTH];
+    unsigned int uScopeLength;
+    unsigned int uKeys = 0;
+    unsigned int uPath;
+    unsigned int uEnd;
+    unsigned int i;
+    time_t Now = time(NULL);
+    time_t Checked = __atomic_load_n(&pDb->Checked, __ATOMIC_RELAXED);
+    int iRet = -1;
+
+    /* One thread a second looks for a new file. */
+    if (Now != Checked &&
+        __atomic_compare_exchange_n(&pDb->Checked, &Checked, Now, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        Refresh(pDb);
+
+    Keys[uKeys++] = Fingerprint(pKey, uKeyLength, TWP_SCOPE_URL);
+
+    /* Prefixes end with a slash of the path, the query is not searched. */
+    for (uPath = 0; uPath + 2 < uKeyLength && memcmp(pKey + uPath, "://", 3) != 0; uPath++)
+        ;
+    for (uPath += 3; uPath < uKeyLength && pKey[uPath] != '/' && pKey[uPath] != '?'; uPath++)
+        ;
+    for (uEnd = uPath; uEnd < uKeyLength && pKey[uEnd] != '?'; uEnd++)
+        ;
+    for (i = uEnd; i > uPath && uKeys <= LOCALDB_MAX_PREFIXES; i--)
+    {
+        if (pKey[i - 1] == '/')
+            Keys[uKeys++] = Fingerprint(pKey, i, TWP_LOCALDB_PREFIX);
+    }
+
+    if (TWPUrlScopeKey(pKey, uKeyLength, TWP_SCOPE_HOST, ScopeKey, sizeof(ScopeKey), &uScopeLength) == 0)
+        Keys[uKeys++] = Fingerprint(ScopeKey, uScopeLength, TWP_SCOPE_HOST);
+    if (TWPUrlScopeKey(pKey, uKeyLength, TWP_SCOPE_DOMAIN, ScopeKey, sizeof(ScopeKey), &uScopeLength) == 0)
+        Keys[uKeys++] = Fingerprint(ScopeKey, uScopeLength, TWP_SCOPE_DOMAIN);
+
+    pthread_rwlock_rdlock(&pDb->Lock);
+    for (i = 0; i < uKeys && iRet != 0; i++)
+        iRet = Search(&pDb->Map, Keys[i], pRating);
+    pthread_rwlock_unlock(&pDb->Lock);
+
+    return iRet;
+}
+
+
+int TWPFileReplace(char const *pszPath, void const *pData, size_t Size)
+{
+    char *pszTemp;
+    size_t Done = 0;
+    int iFd;
+    int iRet;
+
+    pszTemp = (char *) malloc(strlen(pszPath) + sizeof(".XXXXXX"));
+    if (pszTemp == NULL)
+        return -1;
+    strcpy(pszTemp, pszPath);
+    strcat(pszTemp, ".XXXXXX");
+
+    iFd = mkstemp(pszTemp);
+    if (iFd < 0)
+    {
+        free(pszTemp);
+        return -1;
+    }
+
+    while (Done < Size)
+    {
+        ssize_t Written = write(iFd, (char const *) pData + Done, Size - Done);
+
+        if (Written < 0 && errno == EINTR)
+            continue;
+        if (Written <= 0)
+            break;
+        Done += (size_t) Written;
+    }
+
+    iRet = Done == Size && fchmod(iFd, 0644) == 0 && fsync(iFd) == 0 ? 0 : -1;
+    if (close(iFd) != 0 || (iRet == 0 && rename(pszTemp, pszPath) != 0))
+        iRet = -1;
+    if (iRet != 0)
+    {
+        DEBUG_LOG("cannot write %s, errno %d\n", pszPath, errno);
+        unlink(pszTemp);
+    }
+    free(pszTemp);
+
+    return iRet;
+}
+
+
+static void GetLayout(uint32_t uCount, uint32_t uBucketBits, uint32_t uMasks, LocalLayout *pLayout)
+{
+    pLayout->Buckets = LOCALDB_ALIGN(sizeof(LocalHeader));
+    pLayout->Keys = LOCALDB_ALIGN(pLayout->Buckets + (((size_t) 1 << uBucketBits) + 1) * sizeof(uint32_t));
+    pLayout->Records = pLayout->Keys + (size_t) uCount * sizeof(uint64_t);
+    pLayout->Masks = LOCALDB_ALIGN(pLayout->Records + (size_t) uCount * sizeof(LocalRecord));
+    pLayout->Size = pLayout->Masks + (size_t) uMasks * TWP_CATEGORY_WORDS * sizeof(uint64_t);
+}
+
+
+/**
+ * Maps a database file and checks its header. Records and buckets are checked
+ * when searched, so opening does not read the whole file.
+ */
+static int MapOpen(char const *pszPath, LocalMap *pMap, struct stat *pStat)
+{
+    LocalHeader const *pHeader;
+    LocalLayout Layout;
+    int iFd;
+
+    iFd = open(pszPath, O_RDONLY | O_CLOEXEC);
+    if (iFd < 0)
+    {
+        DEBUG_LOG("localdb: cannot open %s, errno %d\n", pszPath, errno);
+        return -1;
+    }
+
+    if (fstat(iFd, pStat) != 0 || pStat->st_size < (off_t) sizeof(LocalHeader))
+    {
+        close(iFd);
+        return -1;
+    }
+
+    pMap->Size = (size_t) pStat->st_size;
+    pMap->pMap = mmap(NULL, pMap->Size, PROT_READ, MAP_SHARED, iFd, 0);
+    close(iFd);
+    if (pMap->pMap == MAP_FAILED)
+        return -1;
+
+    pHeader = (LocalHeader const *) pMap->pMap;
+    if (pHeader->uMagic == LOCALDB_MAGIC && pHeader->uVersion == LOCALDB_VERSION &&
+        pHeader->uBucketBits <= LOCALDB_MAX_BUCKET_BITS)
+    {
+        GetLayout(pHeader->uCount, pHeader->uBucketBits, pHeader->uMasks, &Layout);
+        if (Layout.Size == pMap->Size)
+        {
+            pMap->uCount = pHeader->uCount;
+            pMap->uBucketBits = pHeader->uBucketBits;
+            pMap->uMasks = pHeader->uMasks;
+            pMap->puBuckets = (uint32_t const *) ((char const *) pMap->pMap + Layout.Buckets);
+            pMap->puKeys = (uint64_t const *) ((char const *) pMap->pMap + Layout.Keys);
+            pMap->pRecords = (LocalRecord const *) ((char const *) pMap->pMap + Layout.Records);
+            pMap->puMasks = (uint64_t const *) ((char const *) pMap->pMap + Layout.Masks);
+            return 0;
+        }
+    }
+
+    DEBUG_LOG("localdb: %s is not a database\n", pszPath);
+    munmap(pMap->pMap, pMap->Size);
+
+    return -1;
+}
+
+
+static void MapClose(LocalMap *pMap)
+{
+    munmap(pMap->pMap, pMap->Size);
+}
+
+
+/**
+ * Switches to the database file if it was replaced. The old file stays in
+ * use if the new one cannot be opened.
+ */
+static void Refresh(TWPLocalDb *pDb)
+{
+    LocalMap Map;
+    LocalMap Old;
+    struct stat Stat;
+
+    if (stat(pDb->pszPath, &Stat) != 0 ||
+        (Stat.st_dev == pDb->Stat.st_dev && Stat.st_ino == pDb->Stat.st_ino &&
+         Stat.st_size == pDb->Stat.st_size && Stat.st_mtime == pDb->Stat.st_mtime))
+        return;
+
+    if (MapOpen(pDb->pszPath, &Map, &Stat) != 0)
+        return;
+
+    pthread_rwlock_wrlock(&pDb->Lock);
+    Old = pDb->Map;
+    pDb->Map = Map;
+    pDb->Stat = Stat;
+    pthread_rwlock_unlock(&pDb->Lock);
+    MapClose(&Old);
+    DEBUG_LOG("localdb: switched to the new %s\n", pDb->pszPath);
+}
+
+
+static int Search(LocalMap const *pMap, uint64_t uKey, FwRating *pRating)
+{
+    uint32_t uBucket = pMap->uBucketBits == 0 ? 0 : (uint32_t) (uKey >> (64 - pMap->uBucketBits));
+    uint32_t uLow = pMap->puBuckets[uBucket];
+    uint32_t uHigh = pMap->puBuckets[uBucket + 1];
+    LocalRecord const *pRecord;
+
+    if (uHigh > pMap->uCount)
+        return -1;
+
+    while (uLow < uHigh)
+    {
+        uint32_t uMiddle = uLow + (uHigh - uLow) / 2;
+
+        if (pMap->puKeys[uMiddle] < uKey)
+            uLow = uMiddle + 1;
+        else
+            uHigh = uMiddle;
+    }
+    if (uLow >= pMap->uCount || pMap->puKeys[uLow] != uKey)
+        return -1;
+
+    pRecord = &pMap->pRecords[uLow];
+    if (pRecord->uMask >= pMap->uMasks)
+        return -1;
+
+    pRating->iScore = pRecord->iScore;
+    memcpy(pRating->Categories, &pMap->puMasks[(size_t) pRecord->uMask * TWP_CATEGORY_WORDS],
+           sizeof(pRating->Categories));
+    pRating->pszDlaUrl = NULL;
+    pRating->uDlaLength = 0;
+
+    return 0;
+}
+
+
+static uint64_t Fingerprint(char const *pKey, unsigned int uLength, int iScope)
+{
+    uint64_t uHash = TWPUrlHash(pKey, uLength);
+
+    /* Same as hashing one more byte, a prefix differs from the URL it spells. */
+    if (iScope == TWP_LOCALDB_PREFIX)
+        uHash = (uHash ^ LOCALDB_PREFIX_TAG) * 0x100000001B3ULL;
+
+    return uHash;
+}
+
+
+/**
+ * Computes the fingerprint of the key of an entry, the canonical URL, host
+ * or domain key as used by the rating cache.
+ */
+static int EntryKey(TWPLocalDbEntry const *pEntry, uint64_t *puKey)
+{
+    char Key[TWP_MAX_URL_LENGTH];
+    char ScopeKey[TWP_MAX_URL_LENGTH];
+    unsigned int uKeyLength;
+    unsigned int uScopeLength;
+
+    if (pEntry->pszUrl == NULL ||
+        TWPUrlCanonicalize(pEntry->pszUrl, strlen(pEntry->pszUrl), Key, sizeof(Key), &uKeyLength,
+                           NULL) != TWP_SUCCESS)
+        return -1;
+
+    switch (pEntry->iScope)
+    {
+        case TWP_SCOPE_URL:
+            *puKey = Fingerprint(Key, uKeyLength, TWP_SCOPE_URL);
+            return 0;
+
+        case TWP_LOCALDB_PREFIX:
+            if (Key[uKeyLength - 1] != '/' || memchr(Key, '?', uKeyLength) != NULL)
+                return -1;
+            *puKey = Fingerprint(Key, uKeyLength, TWP_LOCALDB_PREFIX);
+            return 0;
+
+        case TWP_SCOPE_HOST:
+        case TWP_SCOPE_DOMAIN:
+            if (TWPUrlScopeKey(Key, uKeyLength, pEntry->iScope, ScopeKey, sizeof(ScopeKey), &uScopeLength) != 0)
+                return -1;
+            *puKey = Fingerprint(ScopeKey, uScopeLength, pEntry->iScope);
+            return 0;
+
+        default:
+            return -1;
+    }
+}
+
+
+static int CompareEntry(void const *pLeft, void const *pRight)
+{
+    BuildEntry const *pA = (BuildEntry const *) pLeft;
+    BuildEntry const *pB = (BuildEntry const *) pRight;
+
+    if (pA->uKey != pB->uKey)
+        return pA->uKey < pB->uKey ? -1 : 1;
+
+    return pA->uOrder < pB->uOrder ? -1 : (pA->uOrder > pB->uOrder);
+}
+
+
+static int CompareMask(void const *pLeft, void const *pRight)
+{
+    uint64_t const *pA = (uint64_t const *) pLeft;
+    uint64_t const *pB = (uint64_t const *) pRight;
+    unsigned int i;
+
+    for (i = 0; i < TWP_CATEGORY_WORDS; i++)
+    {
+        if (pA[i] != pB[i])
+            return pA[i] < pB[i] ? -1 : 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TWPLOCALDB_H
+#define TWPLOCALDB_H
+
+#include "TWPImpl.h"
+
+#ifdef __cplusplus 
+extern "C" {
+#endif
+
+/**
+ * \file TWPLocalDb.h
+ * \brief TWP Local Reputation Database Header File
+ *  
+ * This file provides functions to rate URLs from a reputation database file,
+ * e.g. a list of high-risk hosts shipped with the product, so they are
+ * answered without network.
+ *
+ * When a database is opened, synchronous TWPLookupUrls() calls without
+ * landing page (iRedirUrl is 0) first search it for the canonical URL, then
+ * for the URL prefixes ending with a slash from the longest, then for the
+ * host and the registrable domain of the URL. URLs found are rated from the
+ * database, the others go to the rating cache and the plug-in. Ratings served
+ * from the database have no landing page and no DLA URL.
+ *
+ * The file is memory mapped and holds 64-bit fingerprints of the keys rather
+ * than the keys. A URL missing from the database matches an entry with a
+ * probability of about the number of entries divided by 2^64. A search costs
+ * one bucket lookup and a binary search over a few fingerprints per key.
+ *
+ * TWPLocalDbBuild() writes a new file and renames it over the old one. Opened
+ * databases notice the new file within a second and switch to it.
+ */
+
+#define TWP_LOCALDB_PREFIX 3 /* The entry applies to the URLs starting with its URL, which ends with a slash. */
+
+/**
+ * Database entry.
+ */
+typedef struct TWPLocalDbEntry_struct
+{
+    char const *pszUrl; /* URL, or any URL of the host or domain. */
+    int iScope; /* TWP_SCOPE_URL, TWP_SCOPE_HOST, TWP_SCOPE_DOMAIN (see TWPCache.h) or TWP_LOCALDB_PREFIX. */
+    int iScore;
+    TWPCategories const *pCategories;
+    unsigned int uCategories;
+} TWPLocalDbEntry;
+
+/**
+ * Database settings.
+ */
+typedef struct TWPLocalDbParam_struct
+{
+    char const *pszPath; /* Database file written by TWPLocalDbBuild(). */
+} TWPLocalDbParam;
+
+/**
+ * \brief Writes a database file.
+ *
+ * The file is written next to pszPath and renamed to it once complete, so
+ * processes using the previous file never see a partial one. When several
+ * entries have the same key, the last one is kept.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] pszPath Database file.
+ * \param[in] pEntries Entries of the database.
+ * \param[in] uCount Number of entries.
+ *
+ * \return TWP_RESULT \n
+ * TWP_INVALID_PARAMETER - if an entry has an invalid URL or scope, or a
+ * prefix not ending with a slash. \n
+ * TWP_ERROR - if the file could not be written. \n
+ */
+TWP_RESULT TWPLocalDbBuild(char const *pszPath, TWPLocalDbEntry const *pEntries, unsigned int uCount);
+
+/**
+ * \brief Opens, replaces or closes the reputation database of a library
+ * handle.
+ *
+ * The database is disabled by default. This must not be called while other
+ * threads use the library handle.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] hLib Library handle returned by TWPInitLibrary().
+ * \param[in] pParam Database settings, NULL to close the database.
+ *
+ * \return TWP_RESULT \n
+ * TWP_ERROR - if the file is missing or is not a database. \n
+ */
+TWP_RESULT TWPLocalDbConfigure(TWPLIB_HANDLE hLib, TWPLocalDbParam const *pParam);
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif  /* TWPLOCALDB_H */
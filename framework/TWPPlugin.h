@@ -0,0 +1,111 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TWPPLUGIN_H
+#define TWPPLUGIN_H
+
+#include <stdint.h>
+
+#include "TWPImpl.h"
+
+#ifdef __cplusplus 
+extern "C" {
+#endif
+
+/**
+ * \file TWPPlugin.h
+ * \brief TWP Plug-in Interface Header File
+ *  
+ * This file provides the function table a plug-in may export instead of its
+ * functions one by one:
+ *
+ *     TWPPInterface const *TWPPGetInterface(unsigned int uVersion);
+ *
+ * The framework asks for TWPP_INTERFACE_VERSION and uses the table if the
+ * plug-in returns one of that version with all the mandatory functions set.
+ * Otherwise, or if the plug-in does not export TWPPGetInterface(), the
+ * functions are looked up by name (TWPPInitLibrary(), TWPPLookupUrls()...).
+ *
+ * The plug-in is loaded once per process and kept loaded after
+ * TWPUninitLibrary(). It is loaded again by the next TWPInitLibrary() if the
+ * plug-in file was replaced while no library handle was open.
+ */
+
+#define TWPP_INTERFACE_VERSION 1 /* Version of TWPPInterface */
+
+#define TWPP_CAP_RATING_SCOPE 0x1 /* pfUrlRatingGetScope is set, see TWPCache.h. */
+
+#define TWPP_CAP_CATEGORY_MASK 0x2 /* pfUrlRatingGetCategoryMask is set, see TWPPolicy.h. */
+
+/**
+ * Functions of a plug-in, same as the exported TWPP functions. The optional
+ * functions are only used when their capability bit is set.
+ */
+typedef struct TWPPInterface_struct
+{
+    unsigned int uVersion; /* TWPP_INTERFACE_VERSION */
+    unsigned int uCapabilities; /* TWPP_CAP_ bits */
+    TWP_RESULT (*pfInitLibrary)(TWPAPIInit *pApiInit);
+    void (*pfUninitLibrary)(void);
+    TWP_RESULT (*pfConfigurationCreate)(TWPConfiguration *pConfigure, TWPConfigurationHandle *phConfigure);
+    TWP_RESULT (*pfConfigurationDestroy)(TWPConfigurationHandle *hConfigure);
+    TWP_RESULT (*pfLookupUrls)(TWPConfigurationHandle hConfigure, TWPRequest *pRequest, int iRedirUrl,
+                               const char **ppUrls, unsigned int uCount, TWPResponseHandle *phResponse);
+    TWP_RESULT (*pfResponseWrite)(TWPResponseHandle hResponse, const void *pData, unsigned uLength);
+    TWP_RESULT (*pfResponseGetUrlRatingByIndex)(TWPResponseHandle hResponse, unsigned int iIndex,
+                                                TWPUrlRatingHandle *hRating);
+    TWP_RESULT (*pfResponseGetUrlRatingByUrl)(TWPResponseHandle hResponse, const char *pUrl,
+                                              unsigned int iUrlLength, TWPUrlRatingHandle *hRating);
+    TWP_RESULT (*pfResponseGetRedirUrlFor)(TWPResponseHandle hResponse, TWPUrlRatingHandle hRating,
+                                           TWPPolicyHandle hPolicy, char **ppUrl, unsigned int *puLength);
+    TWP_RESULT (*pfResponseGetUrlRatingsCount)(TWPResponseHandle hResponse, unsigned int *puCount);
+    TWP_RESULT (*pfResponseDestroy)(TWPResponseHandle *handle_response);
+    TWP_RESULT (*pfPolicyCreate)(TWPConfigurationHandle hCfg, TWPCategories *pCategories, unsigned int uCount,
+                                 TWPPolicyHandle *phPolicy);
+    TWP_RESULT (*pfPolicyValidate)(TWPPolicyHandle hPolicy, TWPUrlRatingHandle hRating, int *piViolated);
+    TWP_RESULT (*pfPolicyGetViolations)(TWPPolicyHandle hPolicy, TWPUrlRatingHandle hRating,
+                                        TWPCategories **ppViolated, unsigned *puLength);
+    TWP_RESULT (*pfPolicyDestroy)(TWPPolicyHandle *hPolicy);
+    TWP_RESULT (*pfUrlRatingGetScore)(TWPUrlRatingHandle hRating, int *piScore);
+    TWP_RESULT (*pfUrlRatingGetUrl)(TWPUrlRatingHandle hRating, const char **ppUrl, unsigned int *puLength);
+    TWP_RESULT (*pfUrlRatingGetDLAUrl)(TWPUrlRatingHandle hRating, const char **ppDlaUrl, unsigned int *puLength);
+    TWP_RESULT (*pfUrlRatingHasCategory)(TWPUrlRatingHandle hRating, TWPCategories Category, int *piPresent);
+    TWP_RESULT (*pfUrlRatingGetCategories)(TWPUrlRatingHandle hRating, TWPCategories **ppCategories,
+                                           unsigned int *puLength);
+    TWP_RESULT (*pfUrlRatingGetScope)(TWPUrlRatingHandle hRating, int *piScope);
+    TWP_RESULT (*pfUrlRatingGetCategoryMask)(TWPUrlRatingHandle hRating, uint64_t *pMask);
+} TWPPInterface;
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif  /* TWPPLUGIN_H */
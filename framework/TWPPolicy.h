@@ -0,0 +1,148 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TWPPOLICY_H
+#define TWPPOLICY_H
+
+#include <stdint.h>
+
+#include "TWPImpl.h"
+
+#ifdef __cplusplus 
+extern "C" {
+#endif
+
+/**
+ * \file TWPPolicy.h
+ * \brief TWP Policy Evaluation Header File
+ *  
+ * This file provides policy and category functions that do not allocate
+ * memory.
+ *
+ * TWPPolicyCreate() compiles the categories of a policy into a bitmap. The
+ * ratings handed out by the framework (with the rating cache, coalescing or
+ * a batch spelling a URL twice) read their categories into a bitmap once,
+ * validating them against a policy is then done without the plug-in. Other
+ * ratings are checked by the plug-in.
+ *
+ * Category bitmaps hold category c in bit (c % 64) of word (c / 64). Plug-ins
+ * may fill them directly with the optional function
+ *
+ *     TWP_RESULT TWPPUrlRatingGetCategoryMask(TWPUrlRatingHandle hRating, uint64_t *pMask);
+ *
+ * otherwise the framework builds them from TWPPUrlRatingGetCategories().
+ */
+
+#define TWP_CATEGORY_MASK_WORDS 3 /* Words of a category bitmap, covers all TWPCategories values. */
+
+/**
+ * Tests a category in a bitmap filled by TWPUrlRatingGetCategoryMask().
+ */
+#define TWP_CATEGORY_MASK_TEST(pMask, Category) \
+    (((pMask)[(unsigned int) (Category) >> 6] >> ((unsigned int) (Category) & 63)) & 1)
+
+/**
+ * \brief Gets the categories of a rating violating a policy into a caller
+ * buffer.
+ *
+ * The categories are in ascending order.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] hLib Library handle returned by TWPInitLibrary().
+ * \param[in] hPolicy Policy handle.
+ * \param[in] hRating Rating handle.
+ * \param[out] pViolated Buffer for the violated categories.
+ * \param[in] uSize Number of categories pViolated holds.
+ * \param[out] puLength Number of violated categories, also set when pViolated
+ * is too small.
+ *
+ * \return TWP_RESULT, TWP_NOMEM if pViolated is too small.
+ */
+TWP_RESULT TWPPolicyFindViolations(TWPLIB_HANDLE hLib, TWPPolicyHandle hPolicy, TWPUrlRatingHandle hRating,
+                                   TWPCategories *pViolated, unsigned int uSize, unsigned int *puLength);
+
+/**
+ * \brief Gets the categories of a rating as a bitmap.
+ *
+ * Ratings handed out by the framework keep their bitmap, later calls are
+ * answered without the plug-in.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] hLib Library handle returned by TWPInitLibrary().
+ * \param[in] hRating Rating handle.
+ * \param[out] pMask Bitmap of TWP_CATEGORY_MASK_WORDS words.
+ *
+ * \return TWP_RESULT
+ */
+TWP_RESULT TWPUrlRatingGetCategoryMask(TWPLIB_HANDLE hLib, TWPUrlRatingHandle hRating, uint64_t *pMask);
+
+/**
+ * Bytes of a row of the violation matrix of TWPPolicyValidateBatch().
+ */
+#define TWP_POLICY_MATRIX_STRIDE(uPolicies) (((uPolicies) + 7) / 8)
+
+/**
+ * Tests whether a rating violates a policy in a violation matrix.
+ */
+#define TWP_POLICY_MATRIX_TEST(pMatrix, uPolicies, uRating, uPolicy) \
+    (((pMatrix)[(uRating) * TWP_POLICY_MATRIX_STRIDE(uPolicies) + ((uPolicy) >> 3)] >> ((uPolicy) & 7)) & 1)
+
+/**
+ * \brief Validates every rating against every policy.
+ *
+ * The violation matrix has a row of TWP_POLICY_MATRIX_STRIDE(uPolicies)
+ * bytes per rating, bit uPolicy of a row is set if the rating violates the
+ * policy. Ratings handed out by the framework are checked against several
+ * policies at once with vector instructions.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] hLib Library handle returned by TWPInitLibrary().
+ * \param[in] phPolicies Policy handles.
+ * \param[in] uPolicies Number of policies.
+ * \param[in] phRatings Rating handles.
+ * \param[in] uRatings Number of ratings.
+ * \param[out] pMatrix Violation matrix of uRatings * TWP_POLICY_MATRIX_STRIDE(uPolicies)
+ * bytes.
+ *
+ * \return TWP_RESULT
+ */
+TWP_RESULT TWPPolicyValidateBatch(TWPLIB_HANDLE hLib, TWPPolicyHandle const *phPolicies, unsigned int uPolicies,
+                                  TWPUrlRatingHandle const *phRatings, unsigned int uRatings,
+                                  unsigned char *pMatrix);
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif  /* TWPPOLICY_H */
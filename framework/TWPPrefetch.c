@@ -0,0 +1,335 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "TWPUrl.h"
+#include "TWPAsync.h"
+#include "TWPPrefetch.h"
+#include "TWPInternal.h"
+
+#if defined(DEBUG)
+#define DEBUG_LOG(_fmt_, _param_...)    { \
+                                            printf("[TWP] %s,%d: " _fmt_, __FILE__, __LINE__, ##_param_); \
+                                        }
+#else
+#define DEBUG_LOG(_fmt_, _param_...)
+#endif
+
+
+/**
+ * Queued URL.
+ */
+typedef struct PrefetchUrl_struct
+{
+    TWPConfigurationHandle hConfigure;
+    uint64_t uHash; /* Hash of the canonical URL. */
+    char *pszUrl;
+    unsigned int uLength;
+} PrefetchUrl;
+
+/**
+ * Lookup in flight, the URLs follow.
+ */
+typedef struct PrefetchBatch_struct
+{
+    TWPPrefetcher *pPrefetch;
+    unsigned int uCount;
+    unsigned long ulBytes;
+    const char **ppUrls;
+} PrefetchBatch;
+
+struct TWPPrefetcher_struct
+{
+    SitePluginContext *pCtx;
+    pthread_mutex_t Lock;
+    TWPPrefetchParam Param;
+    PrefetchUrl *pQueue; /* Ring of Param.uMaxQueued URLs. */
+    unsigned int uFirst;
+    unsigned int uQueued;
+    unsigned int uRequests; /* Lookups in flight. */
+    unsigned long ulBytes; /* Bytes of the URLs in flight. */
+    int iClosed; /* Released by the last lookup in flight. */
+};
+
+
+static void Pump(TWPPrefetcher *pPrefetch);
+static void PrefetchDone(void *pContext, TWP_RESULT Result, TWPResponseHandle hResponse);
+static void FreeBatch(PrefetchBatch *pBatch);
+static void FreePrefetcher(TWPPrefetcher *pPrefetch);
+
+
+TWP_RESULT TWPPrefetchConfigure(TWPLIB_HANDLE hLib, TWPPrefetchParam const *pParam)
+{
+    SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    TWPPrefetcher *pPrefetch = NULL;
+
+    if (pCtx == NULL)
+        return TWP_INVALID_HANDLE;
+
+    if (pParam != NULL)
+    {
+        pPrefetch = (TWPPrefetcher *) calloc(1, sizeof(TWPPrefetcher));
+        if (pPrefetch == NULL)
+            return TWP_NOMEM;
+        pPrefetch->pCtx = pCtx;
+        pPrefetch->Param.uMaxRequests = pParam->uMaxRequests != 0 ? pParam->uMaxRequests : TWP_PREFETCH_DEF_REQUESTS;
+        pPrefetch->Param.uMaxBytes = pParam->uMaxBytes != 0 ? pParam->uMaxBytes : TWP_PREFETCH_DEF_BYTES;
+        pPrefetch->Param.uBatch = pParam->uBatch != 0 ? pParam->uBatch : TWP_PREFETCH_DEF_BATCH;
+        pPrefetch->Param.uMaxQueued = pParam->uMaxQueued != 0 ? pParam->uMaxQueued : TWP_PREFETCH_DEF_QUEUED;
+        pPrefetch->pQueue = (PrefetchUrl *) calloc(pPrefetch->Param.uMaxQueued, sizeof(PrefetchUrl));
+        if (pPrefetch->pQueue == NULL)
+        {
+            free(pPrefetch);
+            return TWP_NOMEM;
+        }
+        pthread_mutex_init(&pPrefetch->Lock, NULL);
+    }
+
+    if (pCtx->pPrefetch != NULL)
+        TWPPrefetchClose(pCtx->pPrefetch);
+    pCtx->pPrefetch = pPrefetch;
+
+    return TWP_SUCCESS;
+}
+
+
+TWP_RESULT TWPPrefetchUrls(TWPLIB_HANDLE hLib, TWPConfigurationHandle hConfigure, const char **ppUrls,
+                           unsigned int uCount)
+{
+    SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    TWPPrefetcher *pPrefetch;
+    char Key[TWP_MAX_URL_LENGTH];
+    unsigned int uKeyLength;
+    unsigned int uAdded = 0;
+    unsigned int i;
+    unsigned int j;
+
+    if (pCtx == NULL)
+        return TWP_INVALID_HANDLE;
+
+    if (ppUrls == NULL && uCount != 0)
+        return TWP_INVALID_PARAMETER;
+    for (i = 0; i < uCount; i++)
+    {
+        if (ppUrls[i] == NULL)
+            return TWP_INVALID_PARAMETER;
+    }
+
+    pPrefetch = pCtx->pPrefetch;
+    if (pPrefetch == NULL || pCtx->pAsync == NULL || (pCtx->pCache == NULL && pCtx->pDiskCache == NULL))
+        return TWP_ERROR;
+
+    for (i = 0; i < uCount; i++)
+    {
+        PrefetchUrl Url;
+        int iQueued = 0;
+
+        /* URLs too long for the cache would be looked up again anyway. */
+        if (TWPUrlCanonicalize(ppUrls[i], strlen(ppUrls[i]), Key, sizeof(Key), &uKeyLength,
+                               &Url.uHash) != TWP_SUCCESS ||
+            TWPIsCached(pCtx, Key, uKeyLength))
+            continue;
+
+        Url.hConfigure = hConfigure;
+        Url.uLength = strlen(ppUrls[i]);
+        Url.pszUrl = strdup(ppUrls[i]);
+        if (Url.pszUrl == NULL)
+            return TWP_NOMEM;
+
+        pthread_mutex_lock(&pPrefetch->Lock);
+        for (j = 0; j < pPrefetch->uQueued && !iQueued; j++)
+            iQueued = pPrefetch->pQueue[(pPrefetch->uFirst + j) % pPrefetch->Param.uMaxQueued].uHash == Url.uHash;
+        if (!iQueued)
+        {
+            if (pPrefetch->uQueued == pPrefetch->Param.uMaxQueued)
+            {
+                /* The oldest URL is the least likely to be opened. */
+                free(pPrefetch->pQueue[pPrefetch->uFirst].pszUrl);
+                pPrefetch->uFirst = (pPrefetch->uFirst + 1) % pPrefetch->Param.uMaxQueued;
+                pPrefetch->uQueued--;
+            }
+            pPrefetch->pQueue[(pPrefetch->uFirst + pPrefetch->uQueued) % pPrefetch->Param.uMaxQueued] = Url;
+            pPrefetch->uQueued++;
+            uAdded++;
+        }
+        pthread_mutex_unlock(&pPrefetch->Lock);
+
+        if (iQueued)
+            free(Url.pszUrl);
+    }
+    DEBUG_LOG("prefetch: %u of %u urls queued\n", uAdded, uCount);
+
+    Pump(pPrefetch);
+
+    return TWP_SUCCESS;
+}
+
+
+void TWPPrefetchClose(TWPPrefetcher *pPrefetch)
+{
+    int iFree;
+
+    pthread_mutex_lock(&pPrefetch->Lock);
+    pPrefetch->iClosed = 1;
+    while (pPrefetch->uQueued != 0)
+    {
+        free(pPrefetch->pQueue[pPrefetch->uFirst].pszUrl);
+        pPrefetch->uFirst = (pPrefetch->uFirst + 1) % pPrefetch->Param.uMaxQueued;
+        pPrefetch->uQueued--;
+    }
+    iFree = pPrefetch->uRequests == 0;
+    pthread_mutex_unlock(&pPrefetch->Lock);
+
+    if (iFree)
+        FreePrefetcher(pPrefetch);
+}
+
+
+/**
+ * Starts lookups of the queued URLs while the budget allows. A batch only
+ * holds URLs of the same configuration. This may run on the event loop
+ * thread, TWPAsyncSubmit() only builds the request and queues it.
+ */
+static void Pump(TWPPrefetcher *pPrefetch)
+{
+    PrefetchBatch *pBatch;
+    TWPConfigurationHandle hConfigure;
+    unsigned long ulBytes;
+    unsigned int uCount;
+    unsigned int i;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&pPrefetch->Lock);
+        if (pPrefetch->iClosed || pPrefetch->uQueued == 0 ||
+            pPrefetch->uRequests >= pPrefetch->Param.uMaxRequests)
+        {
+            pthread_mutex_unlock(&pPrefetch->Lock);
+            return;
+        }
+
+        hConfigure = pPrefetch->pQueue[pPrefetch->uFirst].hConfigure;
+        ulBytes = 0;
+        for (uCount = 0; uCount < pPrefetch->uQueued && uCount < pPrefetch->Param.uBatch; uCount++)
+        {
+            PrefetchUrl const *pUrl = &pPrefetch->pQueue[(pPrefetch->uFirst + uCount) % pPrefetch->Param.uMaxQueued];
+
+            if (pUrl->hConfigure != hConfigure)
+                break;
+            /* A URL over the budget goes alone once nothing else is in flight. */
+            if (pPrefetch->ulBytes + ulBytes + pUrl->uLength > pPrefetch->Param.uMaxBytes &&
+                (uCount != 0 || pPrefetch->ulBytes != 0))
+                break;
+            ulBytes += pUrl->uLength;
+        }
+
+        pBatch = uCount != 0 ? (PrefetchBatch *) malloc(sizeof(PrefetchBatch) + uCount * sizeof(char *)) : NULL;
+        if (pBatch == NULL)
+        {
+            pthread_mutex_unlock(&pPrefetch->Lock);
+            return;
+        }
+        pBatch->pPrefetch = pPrefetch;
+        pBatch->uCount = uCount;
+        pBatch->ulBytes = ulBytes;
+        pBatch->ppUrls = (const char **) (pBatch + 1);
+        for (i = 0; i < uCount; i++)
+        {
+            pBatch->ppUrls[i] = pPrefetch->pQueue[pPrefetch->uFirst].pszUrl;
+            pPrefetch->uFirst = (pPrefetch->uFirst + 1) % pPrefetch->Param.uMaxQueued;
+        }
+        pPrefetch->uQueued -= uCount;
+        pPrefetch->uRequests++;
+        pPrefetch->ulBytes += ulBytes;
+        pthread_mutex_unlock(&pPrefetch->Lock);
+
+        if (TWPAsyncSubmit(pPrefetch->pCtx, hConfigure, 0, pBatch->ppUrls, uCount, PrefetchDone, pBatch,
+                           TWP_SUBMIT_INTERNAL) != TWP_SUCCESS)
+        {
+            DEBUG_LOG("prefetch: cannot look up %u urls\n", uCount);
+            pthread_mutex_lock(&pPrefetch->Lock);
+            pPrefetch->uRequests--;
+            pPrefetch->ulBytes -= ulBytes;
+            pthread_mutex_unlock(&pPrefetch->Lock);
+            FreeBatch(pBatch);
+            return;
+        }
+    }
+}
+
+
+static void PrefetchDone(void *pContext, TWP_RESULT Result, TWPResponseHandle hResponse)
+{
+    PrefetchBatch *pBatch = (PrefetchBatch *) pContext;
+    TWPPrefetcher *pPrefetch = pBatch->pPrefetch;
+    SitePluginContext *pCtx = pPrefetch->pCtx;
+    int iFree;
+
+    if (Result == TWP_SUCCESS)
+        TWPCacheResponse(pCtx, hResponse, pBatch->ppUrls, pBatch->uCount);
+    if (hResponse != NULL)
+        (*pCtx->pfResponseDestroy)(&hResponse);
+    DEBUG_LOG("prefetch: %u urls done (%d)\n", pBatch->uCount, Result);
+
+    pthread_mutex_lock(&pPrefetch->Lock);
+    pPrefetch->uRequests--;
+    pPrefetch->ulBytes -= pBatch->ulBytes;
+    iFree = pPrefetch->iClosed && pPrefetch->uRequests == 0;
+    pthread_mutex_unlock(&pPrefetch->Lock);
+    FreeBatch(pBatch);
+
+    if (iFree)
+        FreePrefetcher(pPrefetch);
+    else
+        Pump(pPrefetch);
+}
+
+
+static void FreeBatch(PrefetchBatch *pBatch)
+{
+    unsigned int i;
+
+    for (i = 0; i < pBatch->uCount; i++)
+        free((char *) pBatch->ppUrls[i]);
+    free(pBatch);
+}
+
+
+static void FreePrefetcher(TWPPrefetcher *pPrefetch)
+{
+    pthread_mutex_destroy(&pPrefetch->Lock);
+    free(pPrefetch->pQueue);
+    free(pPrefetch);
+}
@@ -0,0 +1,122 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TWPPREFETCH_H
+#define TWPPREFETCH_H
+
+#include "TWPImpl.h"
+
+#ifdef __cplusplus 
+extern "C" {
+#endif
+
+/**
+ * \file TWPPrefetch.h
+ * \brief TWP Prefetch Header File
+ *  
+ * This file provides functions to rate URLs ahead of use, e.g. the links of
+ * the page being shown, so the lookup made when one is opened is answered by
+ * the rating cache.
+ *
+ * TWPPrefetchUrls() queues the URLs and returns at once. The queued URLs are
+ * looked up in batches on the event loop (see TWPAsync.h) and their ratings
+ * are added to the rating cache. Prefetching yields to the caller's own
+ * lookups: it never has more than uMaxRequests lookups nor more than
+ * uMaxBytes bytes of URLs in flight, and the queue keeps the uMaxQueued most
+ * recent URLs. URLs already rated by the local database or the rating cache,
+ * or already queued, are skipped.
+ *
+ * The next batches are started from the completion callbacks, which may run
+ * on the event loop thread. Neither they nor TWPPrefetchUrls() wait for the
+ * network, the plug-in server is resolved by the resolver thread of the event
+ * loop.
+ */
+
+#define TWP_PREFETCH_DEF_REQUESTS 2 /* Default number of prefetch lookups in flight. */
+
+#define TWP_PREFETCH_DEF_BYTES 16384 /* Default size of the URLs in flight. */
+
+#define TWP_PREFETCH_DEF_BATCH 32 /* Default number of URLs per lookup. */
+
+#define TWP_PREFETCH_DEF_QUEUED 1024 /* Default number of queued URLs. */
+
+/**
+ * Prefetch settings, 0 selects the default.
+ */
+typedef struct TWPPrefetchParam_struct
+{
+    unsigned int uMaxRequests; /* Prefetch lookups in flight. */
+    unsigned int uMaxBytes; /* Bytes of the URLs in flight, a longer URL is sent alone. */
+    unsigned int uBatch; /* URLs per lookup. */
+    unsigned int uMaxQueued; /* URLs waiting, the oldest are dropped first. */
+} TWPPrefetchParam;
+
+/**
+ * \brief Enables, changes or disables prefetching on a library handle.
+ *
+ * Prefetching is disabled by default. Disabling it drops the queued URLs,
+ * the lookups in flight complete normally. This must not be called while
+ * other threads use the library handle.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] hLib Library handle returned by TWPInitLibrary().
+ * \param[in] pParam Prefetch settings, NULL to disable prefetching.
+ *
+ * \return TWP_RESULT
+ */
+TWP_RESULT TWPPrefetchConfigure(TWPLIB_HANDLE hLib, TWPPrefetchParam const *pParam);
+
+/**
+ * \brief Queues URLs to be rated in the background.
+ *
+ * Requires the event loop and the rating cache. The configuration handle
+ * must stay valid until the event loop is stopped.
+ *
+ * This is an asynchronous API.
+ *
+ * \param[in] hLib Library handle returned by TWPInitLibrary().
+ * \param[in] hConfigure Configuration handle.
+ * \param[in] ppUrls URLs to rate.
+ * \param[in] uCount Number of URLs.
+ *
+ * \return TWP_RESULT \n
+ * TWP_ERROR - if prefetching is disabled, the event loop is stopped or the
+ * rating cache is disabled. \n
+ */
+TWP_RESULT TWPPrefetchUrls(TWPLIB_HANDLE hLib, TWPConfigurationHandle hConfigure, const char **ppUrls,
+                           unsigned int uCount);
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif  /* TWPPREFETCH_H */
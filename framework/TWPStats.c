@@ -0,0 +1,239 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "TWPStats.h"
+#include "TWPInternal.h"
+
+#if defined(DEBUG)
+#define DEBUG_LOG(_fmt_, _param_...)    { \
+                                            printf("[TWP] %s,%d: " _fmt_, __FILE__, __LINE__, ##_param_); \
+                                        }
+#else
+#define DEBUG_LOG(_fmt_, _param_...)
+#endif
+
+
+#define STATS_WORDS (sizeof(TWPStats) / sizeof(unsigned long))
+
+
+/**
+ * Synchronous request given to the plug-in in place of the caller's one. The
+ * caller's callbacks get the caller's request.
+ */
+typedef struct StatsRequest_struct
+{
+    TWPRequest Request; /* Must be first. */
+    TWPRequest *pCaller;
+    SitePluginContext *pCtx;
+    uint64_t uTransport; /* Nanoseconds spent in the caller's callbacks. */
+} StatsRequest;
+
+
+static void AddValue(TWPHistogram *pHistogram, unsigned long ulValue);
+static TWP_RESULT StatsSetUrl(TWPRequest *pRequest, const char *pszUrl, unsigned int uLength);
+static TWP_RESULT StatsSetMethod(TWPRequest *pRequest, TWPSubmitMethod Method);
+static TWP_RESULT StatsSend(TWPRequest *pRequest, TWPResponseHandle hResponse, const void *pData,
+                            unsigned int uLength);
+static TWP_RESULT StatsReceive(TWPRequest *pRequest, void *pBuffer, unsigned int uBufferLength,
+                               unsigned int *puLength);
+
+
+TWP_RESULT TWPGetStats(TWPLIB_HANDLE hLib, TWPStats *pStats)
+{
+    SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    unsigned long const *pulFrom;
+    unsigned long *pulTo;
+    unsigned int i;
+
+    if (pCtx == NULL)
+        return TWP_INVALID_HANDLE;
+
+    if (pStats == NULL)
+        return TWP_INVALID_PARAMETER;
+
+    pulFrom = (unsigned long const *) &pCtx->Stats;
+    pulTo = (unsigned long *) pStats;
+    for (i = 0; i < STATS_WORDS; i++)
+        pulTo[i] = __atomic_load_n(&pulFrom[i], __ATOMIC_RELAXED);
+
+    return TWP_SUCCESS;
+}
+
+
+TWP_RESULT TWPResetStats(TWPLIB_HANDLE hLib)
+{
+    SitePluginContext *pCtx = (SitePluginContext *) hLib;
+    unsigned long *pulStats;
+    unsigned int i;
+
+    if (pCtx == NULL)
+        return TWP_INVALID_HANDLE;
+
+    pulStats = (unsigned long *) &pCtx->Stats;
+    for (i = 0; i < STATS_WORDS; i++)
+        __atomic_store_n(&pulStats[i], 0, __ATOMIC_RELAXED);
+
+    return TWP_SUCCESS;
+}
+
+
+uint64_t TWPStatsClock(void)
+{
+    struct timespec Now;
+
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+
+    return (uint64_t) Now.tv_sec * 1000000000 + (uint64_t) Now.tv_nsec;
+}
+
+
+uint64_t TWPStatsAddPhase(SitePluginContext *pCtx, TWPStatsPhase Phase, uint64_t uStart)
+{
+    uint64_t uNow = TWPStatsClock();
+
+    AddValue(&pCtx->Stats.Phases[Phase], (unsigned long) ((uNow - uStart) / 1000));
+
+    return uNow;
+}
+
+
+void TWPStatsLookup(SitePluginContext *pCtx, unsigned int uUrls, TWP_RESULT Result)
+{
+    unsigned int uResult = (unsigned int) Result < TWP_STATS_RESULTS ? (unsigned int) Result : TWP_STATS_RESULTS - 1;
+
+    TWP_STATS_ADD(pCtx, ulLookups, 1);
+    TWP_STATS_ADD(pCtx, ulUrls, uUrls);
+    TWP_STATS_ADD(pCtx, ulResults[uResult], 1);
+    AddValue(&pCtx->Stats.BatchSizes, uUrls);
+}
+
+
+TWP_RESULT TWPStatsLookupUrls(SitePluginContext *pCtx, TWPConfigurationHandle hConfigure, TWPRequest *pRequest,
+                              int iRedirUrl, const char **ppUrls, unsigned int uCount,
+                              TWPResponseHandle *phResponse)
+{
+    StatsRequest Wrapper;
+    uint64_t uStart;
+    uint64_t uElapsed;
+    TWP_RESULT Result;
+
+    /* Asynchronous callers may use their request after the lookup, it is not wrapped. */
+    if (pRequest == NULL || pRequest->receivefunc == NULL)
+    {
+        uStart = TWPStatsClock();
+        Result = (*pCtx->pfLookupUrls)(hConfigure, pRequest, iRedirUrl, ppUrls, uCount, phResponse);
+        TWPStatsAddPhase(pCtx, TWP_PHASE_PARSE, uStart);
+        return Result;
+    }
+
+    Wrapper.Request = *pRequest;
+    Wrapper.Request.seturlfunc = pRequest->seturlfunc != NULL ? StatsSetUrl : NULL;
+    Wrapper.Request.setmethodfunc = pRequest->setmethodfunc != NULL ? StatsSetMethod : NULL;
+    Wrapper.Request.sendfunc = pRequest->sendfunc != NULL ? StatsSend : NULL;
+    Wrapper.Request.receivefunc = StatsReceive;
+    Wrapper.pCaller = pRequest;
+    Wrapper.pCtx = pCtx;
+    Wrapper.uTransport = 0;
+
+    uStart = TWPStatsClock();
+    Result = (*pCtx->pfLookupUrls)(hConfigure, &Wrapper.Request, iRedirUrl, ppUrls, uCount, phResponse);
+    uElapsed = TWPStatsClock() - uStart;
+    AddValue(&pCtx->Stats.Phases[TWP_PHASE_PARSE],
+             (unsigned long) ((uElapsed > Wrapper.uTransport ? uElapsed - Wrapper.uTransport : 0) / 1000));
+
+    return Result;
+}
+
+
+static void AddValue(TWPHistogram *pHistogram, unsigned long ulValue)
+{
+    unsigned int uBucket = 0;
+
+    while (ulValue >> uBucket != 0 && uBucket < TWP_STATS_BUCKETS - 1)
+        uBucket++;
+
+    __atomic_fetch_add(&pHistogram->ulCount, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&pHistogram->ulTotal, ulValue, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&pHistogram->ulBuckets[uBucket], 1, __ATOMIC_RELAXED);
+}
+
+
+static TWP_RESULT StatsSetUrl(TWPRequest *pRequest, const char *pszUrl, unsigned int uLength)
+{
+    TWPRequest *pCaller = ((StatsRequest *) pRequest)->pCaller;
+
+    return (*pCaller->seturlfunc)(pCaller, pszUrl, uLength);
+}
+
+
+static TWP_RESULT StatsSetMethod(TWPRequest *pRequest, TWPSubmitMethod Method)
+{
+    TWPRequest *pCaller = ((StatsRequest *) pRequest)->pCaller;
+
+    return (*pCaller->setmethodfunc)(pCaller, Method);
+}
+
+
+static TWP_RESULT StatsSend(TWPRequest *pRequest, TWPResponseHandle hResponse, const void *pData,
+                            unsigned int uLength)
+{
+    StatsRequest *pWrapper = (StatsRequest *) pRequest;
+    uint64_t uStart = TWPStatsClock();
+    TWP_RESULT Result;
+
+    Result = (*pWrapper->pCaller->sendfunc)(pWrapper->pCaller, hResponse, pData, uLength);
+    pWrapper->uTransport += TWPStatsAddPhase(pWrapper->pCtx, TWP_PHASE_SEND, uStart) - uStart;
+    TWP_STATS_ADD(pWrapper->pCtx, ulRequests, 1);
+    if (Result == TWP_SUCCESS)
+        TWP_STATS_ADD(pWrapper->pCtx, ulBytesSent, uLength);
+
+    return Result;
+}
+
+
+static TWP_RESULT StatsReceive(TWPRequest *pRequest, void *pBuffer, unsigned int uBufferLength,
+                               unsigned int *puLength)
+{
+    StatsRequest *pWrapper = (StatsRequest *) pRequest;
+    uint64_t uStart = TWPStatsClock();
+    TWP_RESULT Result;
+
+    Result = (*pWrapper->pCaller->receivefunc)(pWrapper->pCaller, pBuffer, uBufferLength, puLength);
+    pWrapper->uTransport += TWPStatsAddPhase(pWrapper->pCtx, TWP_PHASE_RECEIVE, uStart) - uStart;
+    if (Result == TWP_SUCCESS && puLength != NULL)
+        TWP_STATS_ADD(pWrapper->pCtx, ulBytesReceived, *puLength);
+
+    return Result;
+}
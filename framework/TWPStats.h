@@ -0,0 +1,149 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TWPSTATS_H
+#define TWPSTATS_H
+
+#include "TWPImpl.h"
+
+#ifdef __cplusplus 
+extern "C" {
+#endif
+
+/**
+ * \file TWPStats.h
+ * \brief TWP Lookup Statistics Header File
+ *  
+ * This file provides the counters of the lookups made through a library
+ * handle. The counters are always on, they are updated with relaxed atomic
+ * additions and the phases are timed with the monotonic clock.
+ *
+ * A lookup is split in phases:
+ * - TWP_PHASE_LOOKUP: the whole TWPLookupUrls() call, or the time from
+ *   TWPLookupUrlsAsync() to its callback.
+ * - TWP_PHASE_QUEUE: the wait before the plug-in lookup, in the coalescing
+ *   window (see TWPCoalesce.h) or in the event loop queue.
+ * - TWP_PHASE_SEND: TWPRequest::sendfunc calls of synchronous lookups, or
+ *   connecting and writing the request on the event loop.
+ * - TWP_PHASE_RECEIVE: TWPRequest::receivefunc calls of synchronous lookups,
+ *   or the wait for the complete reply on the event loop.
+ * - TWP_PHASE_PARSE: the plug-in lookup less the transport callbacks of
+ *   synchronous lookups (building the request and parsing the reply), and
+ *   TWPResponseWrite() calls.
+ *
+ * Lookups of asynchronous callers (TWPRequest::receivefunc is NULL) only
+ * have TWP_PHASE_LOOKUP and TWP_PHASE_PARSE, their transport is not seen by
+ * the framework.
+ *
+ * The lookups the library makes itself on the event loop (revalidations of
+ * stale ratings, prefetches and the lookups of a TWPLookupUrls() call with a
+ * deadline) are only counted in ulInternalLookups, their phases other than
+ * TWP_PHASE_LOOKUP are timed with the others.
+ */
+
+#define TWP_STATS_BUCKETS 24 /* Buckets of a histogram. */
+
+#define TWP_STATS_RESULTS 9 /* TWP_SUCCESS to TWP_NO_DATA, then the other results. */
+
+/**
+ * Timed phases of a lookup.
+ */
+typedef enum
+{
+    TWP_PHASE_LOOKUP = 0,
+    TWP_PHASE_QUEUE = 1,
+    TWP_PHASE_SEND = 2,
+    TWP_PHASE_RECEIVE = 3,
+    TWP_PHASE_PARSE = 4,
+    TWP_PHASES = 5
+} TWPStatsPhase;
+
+/**
+ * Log-scale histogram. Bucket 0 counts the values under 1, bucket i (i > 0)
+ * the values from 2^(i-1) to 2^i - 1, the last bucket also the larger values.
+ */
+typedef struct TWPHistogram_struct
+{
+    unsigned long ulCount;
+    unsigned long ulTotal; /* Sum of the values. */
+    unsigned long ulBuckets[TWP_STATS_BUCKETS];
+} TWPHistogram;
+
+/**
+ * Lookup counters since the library was initialized or the counters reset.
+ */
+typedef struct TWPStats_struct
+{
+    unsigned long ulLookups; /* TWPLookupUrls() and TWPLookupUrlsAsync() calls. */
+    unsigned long ulUrls; /* URLs of these lookups. */
+    unsigned long ulCacheHits; /* URLs rated by the local database, the rating cache or the host filter. */
+    unsigned long ulCacheMisses; /* URLs of the TWPLookupUrls() calls sent to the plug-in. */
+    unsigned long ulRequests; /* HTTP requests sent. */
+    unsigned long ulBytesSent; /* Bytes of these requests. */
+    unsigned long ulBytesReceived; /* Bytes of the replies, received or given to TWPResponseWrite(). */
+    unsigned long ulDeadlines; /* Lookups answered with the deadline verdict, see TWPDeadline.h. */
+    unsigned long ulInternalLookups; /* Lookups the library made itself on the event loop. */
+    unsigned long ulResults[TWP_STATS_RESULTS]; /* Lookups by TWP_RESULT, the last entry counts the others. */
+    TWPHistogram BatchSizes; /* URLs per lookup. */
+    TWPHistogram Phases[TWP_PHASES]; /* Duration (in microseconds) of each phase. */
+} TWPStats;
+
+/**
+ * \brief Gets the lookup counters of a library handle.
+ *
+ * The counters are read one by one while lookups may go on, they are not a
+ * snapshot of a single instant.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] hLib Library handle returned by TWPInitLibrary().
+ * \param[out] pStats Lookup counters.
+ *
+ * \return TWP_RESULT
+ */
+TWP_RESULT TWPGetStats(TWPLIB_HANDLE hLib, TWPStats *pStats);
+
+/**
+ * \brief Resets the lookup counters of a library handle.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] hLib Library handle returned by TWPInitLibrary().
+ *
+ * \return TWP_RESULT
+ */
+TWP_RESULT TWPResetStats(TWPLIB_HANDLE hLib);
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif  /* TWPSTATS_H */
@@ -0,0 +1,421 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file TWPSuffixGen.c
+ * \brief Build time generator of the public suffix table used by TWPUrl.c.
+ *
+ * Usage: TWPSuffixGen public_suffix_list.dat > TWPSuffixTable.h
+ *
+ * Every rule of the list is kept, from both the ICANN and the private
+ * sections. "*.name" rules set SUFFIX_WILDCARD on name, "!name" rules set
+ * SUFFIX_EXCEPTION and the other rules SUFFIX_RULE. Rules with non ASCII
+ * labels are emitted both in UTF-8 and in their "xn--" form, as hosts may
+ * come in either. The output is sorted by name for bsearch().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define SUFFIX_RULE 0x1
+
+#define SUFFIX_WILDCARD 0x2
+
+#define SUFFIX_EXCEPTION 0x4
+
+#define SUFFIX_LINE_MAX 1024
+
+#define SUFFIX_NAME_MAX 255 /* The length is stored in an unsigned char. */
+
+/* Punycode parameters from RFC 3492. */
+#define PUNY_BASE 36
+#define PUNY_TMIN 1
+#define PUNY_TMAX 26
+#define PUNY_SKEW 38
+#define PUNY_DAMP 700
+#define PUNY_INITIAL_BIAS 72
+#define PUNY_INITIAL_N 128
+
+
+typedef struct SuffixEntry_struct
+{
+    char *pszName;
+    unsigned int uFlags;
+} SuffixEntry;
+
+typedef struct SuffixList_struct
+{
+    SuffixEntry *pEntries;
+    unsigned int uCount;
+    unsigned int uSize;
+} SuffixList;
+
+
+static int AddName(SuffixList *pList, char const *pszName, unsigned int uFlags);
+static int ToAscii(char const *pszName, char *pszOut, unsigned int uSize);
+static int PutLabel(char const *pLabel, unsigned int uLength, char *pszOut, unsigned int uSize,
+                    unsigned int *puOut);
+static unsigned int Adapt(unsigned int uDelta, unsigned int uPoints, int iFirst);
+static int CompareEntry(void const *pLeft, void const *pRight);
+static void PrintName(char const *pszName);
+
+
+int main(int argc, char **argv)
+{
+    FILE *pFile;
+    SuffixList List;
+    char szLine[SUFFIX_LINE_MAX];
+    char szAscii[SUFFIX_LINE_MAX];
+    unsigned int uOffset;
+    unsigned int uCount;
+    unsigned int i;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s public_suffix_list.dat\n", argv[0]);
+        return 1;
+    }
+
+    pFile = fopen(argv[1], "r");
+    if (pFile == NULL)
+    {
+        fprintf(stderr, "%s: cannot open %s\n", argv[0], argv[1]);
+        return 1;
+    }
+
+    memset(&List, 0, sizeof(List));
+    while (fgets(szLine, sizeof(szLine), pFile) != NULL)
+    {
+        char *pszName = szLine;
+        unsigned int uFlags = SUFFIX_RULE;
+        unsigned int uLength;
+
+        /* A rule is the first word of its line. */
+        uLength = strcspn(szLine, " \t\r\n");
+        szLine[uLength] = '\0';
+        if (uLength == 0 || strncmp(szLine, "//", 2) == 0)
+            continue;
+
+        if (pszName[0] == '!')
+        {
+            uFlags = SUFFIX_EXCEPTION;
+            pszName++;
+        }
+        else if (strncmp(pszName, "*.", 2) == 0)
+        {
+            uFlags = SUFFIX_WILDCARD;
+            pszName += 2;
+        }
+        for (i = 0; pszName[i] != '\0'; i++)
+        {
+            if (pszName[i] >= 'A' && pszName[i] <= 'Z')
+                pszName[i] += 'a' - 'A';
+        }
+
+        if (strchr(pszName, '*') != NULL)
+        {
+            fprintf(stderr, "%s: unsupported rule %s\n", argv[0], szLine);
+            fclose(pFile);
+            return 1;
+        }
+
+        if (AddName(&List, pszName, uFlags) != 0)
+        {
+            fclose(pFile);
+            return 1;
+        }
+        if (ToAscii(pszName, szAscii, sizeof(szAscii)) != 0)
+        {
+            fprintf(stderr, "%s: cannot convert %s\n", argv[0], szLine);
+            fclose(pFile);
+            return 1;
+        }
+        if (strcmp(szAscii, pszName) != 0 && AddName(&List, szAscii, uFlags) != 0)
+        {
+            fclose(pFile);
+            return 1;
+        }
+    }
+    fclose(pFile);
+
+    if (List.uCount == 0)
+    {
+        fprintf(stderr, "%s: no rules in %s\n", argv[0], argv[1]);
+        return 1;
+    }
+
+    /* A name may have a wildcard, an exception and a plain rule, merged in one entry. */
+    qsort(List.pEntries, List.uCount, sizeof(SuffixEntry), CompareEntry);
+    uCount = 0;
+    for (i = 0; i < List.uCount; i++)
+    {
+        if (uCount != 0 && strcmp(List.pEntries[uCount - 1].pszName, List.pEntries[i].pszName) == 0)
+        {
+            List.pEntries[uCount - 1].uFlags |= List.pEntries[i].uFlags;
+            free(List.pEntries[i].pszName);
+            continue;
+        }
+        List.pEntries[uCount++] = List.pEntries[i];
+    }
+
+    printf("/* Generated by TWPSuffixGen from the public suffix list, do not edit. */\n\n");
+    printf("#define SUFFIX_RULE_COUNT %u\n\n", uCount);
+
+    printf("static char const SuffixNames[] =\n");
+    for (i = 0; i < uCount; i++)
+    {
+        printf("    \"");
+        PrintName(List.pEntries[i].pszName);
+        printf("\"%s\n", i + 1 == uCount ? ";" : "");
+    }
+
+    printf("\nstatic SuffixRule const SuffixRules[SUFFIX_RULE_COUNT] =\n{\n");
+    uOffset = 0;
+    for (i = 0; i < uCount; i++)
+    {
+        unsigned int uLength = strlen(List.pEntries[i].pszName);
+
+        printf("    {%u, %u, %u}%s\n", uOffset, uLength, List.pEntries[i].uFlags, i + 1 == uCount ? "" : ",");
+        uOffset += uLength;
+        free(List.pEntries[i].pszName);
+    }
+    printf("};\n");
+    free(List.pEntries);
+
+    return 0;
+}
+
+
+static int AddName(SuffixList *pList, char const *pszName, unsigned int uFlags)
+{
+    if (strlen(pszName) > SUFFIX_NAME_MAX)
+    {
+        fprintf(stderr, "TWPSuffixGen: rule too long %s\n", pszName);
+        return -1;
+    }
+
+    if (pList->uCount == pList->uSize)
+    {
+        unsigned int uSize = pList->uSize == 0 ? 1024 : pList->uSize * 2;
+        SuffixEntry *pEntries = realloc(pList->pEntries, uSize * sizeof(SuffixEntry));
+
+        if (pEntries == NULL)
+            return -1;
+        pList->pEntries = pEntries;
+        pList->uSize = uSize;
+    }
+
+    pList->pEntries[pList->uCount].pszName = strdup(pszName);
+    if (pList->pEntries[pList->uCount].pszName == NULL)
+        return -1;
+    pList->pEntries[pList->uCount].uFlags = uFlags;
+    pList->uCount++;
+
+    return 0;
+}
+
+
+/**
+ * Converts each label of a UTF-8 name to its "xn--" form when it is not ASCII.
+ */
+static int ToAscii(char const *pszName, char *pszOut, unsigned int uSize)
+{
+    unsigned int uOut = 0;
+
+    for (;;)
+    {
+        unsigned int uLength = strcspn(pszName, ".");
+
+        if (PutLabel(pszName, uLength, pszOut, uSize, &uOut) != 0)
+            return -1;
+        if (pszName[uLength] == '\0')
+            break;
+        if (uOut + 1 >= uSize)
+            return -1;
+        pszOut[uOut++] = '.';
+        pszName += uLength + 1;
+    }
+    pszOut[uOut] = '\0';
+
+    return 0;
+}
+
+
+/**
+ * Punycode encoder of RFC 3492 for one label.
+ */
+static int PutLabel(char const *pLabel, unsigned int uLength, char *pszOut, unsigned int uSize,
+                    unsigned int *puOut)
+{
+    unsigned long Points[SUFFIX_LINE_MAX];
+    unsigned int uPoints = 0;
+    unsigned int uBasic = 0;
+    unsigned int uHandled;
+    unsigned long ulN = PUNY_INITIAL_N;
+    unsigned long ulDelta = 0;
+    unsigned int uBias = PUNY_INITIAL_BIAS;
+    unsigned int uOut = *puOut;
+    unsigned int i;
+
+#define PUNY_PUT(c) do { if (uOut + 1 >= uSize) return -1; pszOut[uOut++] = (c); } while (0)
+
+    /* UTF-8 decoding, the list is valid UTF-8. */
+    for (i = 0; i < uLength;)
+    {
+        unsigned char c = (unsigned char) pLabel[i];
+        unsigned int uMore = c < 0x80 ? 0 : c < 0xe0 ? 1 : c < 0xf0 ? 2 : 3;
+        unsigned long ulPoint = uMore == 0 ? c : c & (0x3f >> uMore);
+
+        if (i + uMore >= uLength)
+            return -1;
+        for (i++; uMore != 0; uMore--, i++)
+            ulPoint = (ulPoint << 6) | ((unsigned char) pLabel[i] & 0x3f);
+        Points[uPoints++] = ulPoint;
+    }
+
+    for (i = 0; i < uPoints; i++)
+    {
+        if (Points[i] < 0x80)
+            uBasic++;
+    }
+    if (uBasic == uPoints)
+    {
+        for (i = 0; i < uLength; i++)
+            PUNY_PUT(pLabel[i]);
+        *puOut = uOut;
+        return 0;
+    }
+
+    PUNY_PUT('x');
+    PUNY_PUT('n');
+    PUNY_PUT('-');
+    PUNY_PUT('-');
+    for (i = 0; i < uPoints; i++)
+    {
+        if (Points[i] < 0x80)
+            PUNY_PUT((char) Points[i]);
+    }
+    if (uBasic != 0)
+        PUNY_PUT('-');
+
+    for (uHandled = uBasic; uHandled < uPoints;)
+    {
+        unsigned long ulNext = (unsigned long) -1;
+
+        for (i = 0; i < uPoints; i++)
+        {
+            if (Points[i] >= ulN && Points[i] < ulNext)
+                ulNext = Points[i];
+        }
+        ulDelta += (ulNext - ulN) * (uHandled + 1);
+        ulN = ulNext;
+
+        for (i = 0; i < uPoints; i++)
+        {
+            if (Points[i] < ulN)
+                ulDelta++;
+            if (Points[i] == ulN)
+            {
+                unsigned long ulQ = ulDelta;
+                unsigned int k;
+
+                for (k = PUNY_BASE;; k += PUNY_BASE)
+                {
+                    unsigned int t = k <= uBias ? PUNY_TMIN : k >= uBias + PUNY_TMAX ? PUNY_TMAX : k - uBias;
+                    unsigned int uDigit;
+
+                    if (ulQ < t)
+                        break;
+                    uDigit = t + (ulQ - t) % (PUNY_BASE - t);
+                    PUNY_PUT(uDigit < 26 ? 'a' + uDigit : '0' + uDigit - 26);
+                    ulQ = (ulQ - t) / (PUNY_BASE - t);
+                }
+                PUNY_PUT(ulQ < 26 ? 'a' + ulQ : '0' + ulQ - 26);
+                uBias = Adapt(ulDelta, uHandled + 1, uHandled == uBasic);
+                ulDelta = 0;
+                uHandled++;
+            }
+        }
+        ulDelta++;
+        ulN++;
+    }
+
+#undef PUNY_PUT
+
+    *puOut = uOut;
+
+    return 0;
+}
+
+
+static unsigned int Adapt(unsigned int uDelta, unsigned int uPoints, int iFirst)
+{
+    unsigned int k = 0;
+
+    uDelta = iFirst ? uDelta / PUNY_DAMP : uDelta / 2;
+    uDelta += uDelta / uPoints;
+    while (uDelta > ((PUNY_BASE - PUNY_TMIN) * PUNY_TMAX) / 2)
+    {
+        uDelta /= PUNY_BASE - PUNY_TMIN;
+        k += PUNY_BASE;
+    }
+
+    return k + (PUNY_BASE - PUNY_TMIN + 1) * uDelta / (uDelta + PUNY_SKEW);
+}
+
+
+/**
+ * Byte order, as compared by TWPUrl.c.
+ */
+static int CompareEntry(void const *pLeft, void const *pRight)
+{
+    return strcmp(((SuffixEntry const *) pLeft)->pszName, ((SuffixEntry const *) pRight)->pszName);
+}
+
+
+/**
+ * Names are printed in octal escapes when not ASCII, three digits each so the
+ * next character is never read as part of the escape.
+ */
+static void PrintName(char const *pszName)
+{
+    for (; *pszName != '\0'; pszName++)
+    {
+        unsigned char c = (unsigned char) *pszName;
+
+        if (c < 0x20 || c >= 0x7f || c == '"' || c == '\\' || c == '?')
+            printf("\\%03o", c);
+        else
+            putchar(c);
+    }
+}
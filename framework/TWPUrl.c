@@ -0,0 +1,621 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "TWPCache.h"
+#include "TWPUrl.h"
+#include "TWPInternal.h"
+
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+
+#define FNV_PRIME 0x100000001b3ULL
+
+#define URL_LOWER(c) (((c) >= 'A' && (c) <= 'Z') ? (char) ((c) + ('a' - 'A')) : (c))
+
+#define URL_IS_ALPHA(c) (((c) >= 'a' && (c) <= 'z') || ((c) >= 'A' && (c) <= 'Z'))
+
+#define URL_IS_ALNUM(c) (URL_IS_ALPHA(c) || ((c) >= '0' && (c) <= '9'))
+
+#define URL_IS_SLASH(c) ((c) == '/' || (c) == '\\')
+
+/* Tabs and line breaks are dropped from URLs, as browsers do. */
+#define URL_IS_IGNORED(c) ((c) == '\t' || (c) == '\r' || (c) == '\n')
+
+#define SCOPE_KEY_HOST '\001' /* First byte of host keys, never found in a URL. */
+
+#define SCOPE_KEY_DOMAIN '\002' /* First byte of registrable domain keys. */
+
+
+#define SUFFIX_RULE 0x1 /* The name is a public suffix. */
+
+#define SUFFIX_WILDCARD 0x2 /* Each label below the name is a public suffix, "*.name". */
+
+#define SUFFIX_EXCEPTION 0x4 /* The name is not a public suffix though a wildcard covers it, "!name". */
+
+
+/**
+ * Public suffix list rule, the name is uLength bytes at uName in SuffixNames.
+ */
+typedef struct SuffixRule_struct
+{
+    unsigned int uName;
+    unsigned char uLength;
+    unsigned char uFlags;
+} SuffixRule;
+
+/*
+ * SuffixNames and SuffixRules, sorted for bsearch(), are generated from the
+ * whole public suffix list at build time by TWPSuffixGen.c.
+ */
+#include "TWPSuffixTable.h"
+
+/**
+ * Host name part being searched in SuffixRules.
+ */
+typedef struct SuffixKey_struct
+{
+    char const *pName;
+    unsigned int uLength;
+} SuffixKey;
+
+
+/**
+ * Output of the canonicalizer, writes past the buffer are counted but dropped.
+ */
+typedef struct UrlWriter_struct
+{
+    char *pBuffer;
+    unsigned int uSize;
+    unsigned int uLength;
+    int iOverflow;
+} UrlWriter;
+
+
+static void UrlPut(UrlWriter *pOut, char c);
+static void PutHost(UrlWriter *pOut, char const *pHost, unsigned int uLength);
+static void PutPath(UrlWriter *pOut, char const *pPath, unsigned int uLength);
+static void PutEscaped(UrlWriter *pOut, char const *pData, unsigned int uLeft, unsigned int *puIndex);
+static int HexValue(char c);
+static unsigned int DefaultPort(char const *pScheme, unsigned int uLength);
+static unsigned int SuffixFlags(char const *pName, unsigned int uLength);
+static int CompareSuffix(void const *pKey, void const *pEntry);
+static int IsAddress(char const *pHost, unsigned int uLength);
+
+
+TWP_RESULT TWPUrlCanonicalize(const char *pUrl, unsigned int uLength, char *pBuffer, unsigned int uSize,
+                              unsigned int *puLength, uint64_t *puHash)
+{
+    UrlWriter Out;
+    unsigned int uStart = 0;
+    unsigned int uEnd = uLength;
+    unsigned int uAuthEnd;
+    unsigned int uHostStart;
+    unsigned int uHostEnd;
+    unsigned int uPort;
+    unsigned int uDefaultPort = 0;
+    unsigned int i;
+
+    if (pUrl == NULL || pBuffer == NULL || uSize == 0 || puLength == NULL)
+        return TWP_INVALID_PARAMETER;
+
+    Out.pBuffer = pBuffer;
+    Out.uSize = uSize;
+    Out.uLength = 0;
+    Out.iOverflow = 0;
+
+    while (uStart < uEnd && (unsigned char) pUrl[uStart] <= ' ')
+        uStart++;
+    while (uEnd > uStart && (unsigned char) pUrl[uEnd - 1] <= ' ')
+        uEnd--;
+
+    /* The fragment is never sent to the server. */
+    for (i = uStart; i < uEnd && pUrl[i] != '#'; i++)
+        ;
+    uEnd = i;
+
+    /* Scheme, URLs without one are taken as http. */
+    for (i = uStart; i < uEnd && (URL_IS_ALNUM(pUrl[i]) || pUrl[i] == '+' || pUrl[i] == '-' || pUrl[i] == '.'); i++)
+        ;
+    if (i > uStart && i + 2 < uEnd && pUrl[i] == ':' && URL_IS_SLASH(pUrl[i + 1]) && URL_IS_SLASH(pUrl[i + 2]))
+    {
+        unsigned int uScheme;
+
+        for (uScheme = uStart; uScheme < i; uScheme++)
+            UrlPut(&Out, URL_LOWER(pUrl[uScheme]));
+        uDefaultPort = Out.iOverflow ? 0 : DefaultPort(pBuffer, i - uStart);
+        uStart = i + 3;
+    }
+    else
+    {
+        UrlPut(&Out, 'h');
+        UrlPut(&Out, 't');
+        UrlPut(&Out, 't');
+        UrlPut(&Out, 'p');
+        uDefaultPort = 80;
+    }
+    UrlPut(&Out, ':');
+    UrlPut(&Out, '/');
+    UrlPut(&Out, '/');
+
+    /* Authority, user information keeps its spelling. */
+    for (uAuthEnd = uStart; uAuthEnd < uEnd && !URL_IS_SLASH(pUrl[uAuthEnd]) && pUrl[uAuthEnd] != '?'; uAuthEnd++)
+        ;
+    uHostStart = uStart;
+    for (i = uStart; i < uAuthEnd; i++)
+    {
+        if (pUrl[i] == '@')
+            uHostStart = i + 1;
+    }
+    for (i = uStart; i < uHostStart; i++)
+        UrlPut(&Out, pUrl[i]);
+
+    /* Port, the colons of an IPv6 address are inside brackets. */
+    uHostEnd = uAuthEnd;
+    uPort = uAuthEnd;
+    for (i = uAuthEnd; i > uHostStart && pUrl[i - 1] != ':' && pUrl[i - 1] != ']'; i--)
+        ;
+    if (i > uHostStart && pUrl[i - 1] == ':')
+    {
+        uHostEnd = i - 1;
+        uPort = i;
+    }
+
+    PutHost(&Out, pUrl + uHostStart, uHostEnd - uHostStart);
+
+    if (uPort < uAuthEnd)
+    {
+        unsigned int uValue = 0;
+        unsigned int uDigits = 0;
+
+        for (i = uPort; i < uAuthEnd && pUrl[i] == '0'; i++)
+            ;
+        uPort = i;
+        for (; i < uAuthEnd && pUrl[i] >= '0' && pUrl[i] <= '9' && uDigits < 6; i++, uDigits++)
+            uValue = uValue * 10 + (pUrl[i] - '0');
+        if (i < uAuthEnd)
+        {
+            /* Not a port number, kept as is. */
+            UrlPut(&Out, ':');
+            for (i = uPort; i < uAuthEnd; i++)
+                UrlPut(&Out, pUrl[i]);
+        }
+        else if (uValue != 0 && uValue != uDefaultPort)
+        {
+            UrlPut(&Out, ':');
+            for (i = uPort; i < uAuthEnd; i++)
+                UrlPut(&Out, pUrl[i]);
+        }
+    }
+
+    for (i = uAuthEnd; i < uEnd && pUrl[i] != '?'; i++)
+        ;
+    PutPath(&Out, pUrl + uAuthEnd, i - uAuthEnd);
+
+    /* An empty query is dropped. */
+    if (i + 1 < uEnd)
+    {
+        UrlPut(&Out, '?');
+        for (i++; i < uEnd; i++)
+            PutEscaped(&Out, pUrl + i, uEnd - i, &i);
+    }
+
+    if (Out.iOverflow)
+        return TWP_NOMEM;
+
+    pBuffer[Out.uLength] = '\0';
+    *puLength = Out.uLength;
+    if (puHash != NULL)
+        *puHash = TWPUrlHash(pBuffer, Out.uLength);
+
+    return TWP_SUCCESS;
+}
+
+
+int TWPUrlGetHost(char const *pKey, unsigned int uLength, unsigned int *puStart, unsigned int *puLength)
+{
+    unsigned int uStart = 0;
+    unsigned int uEnd;
+    unsigned int i;
+
+    for (i = 0; i < uLength && pKey[i] != ':' && pKey[i] != '/' && pKey[i] != '?'; i++)
+        ;
+    if (i + 2 < uLength && pKey[i] == ':' && pKey[i + 1] == '/' && pKey[i + 2] == '/')
+        uStart = i + 3;
+
+    for (uEnd = uStart; uEnd < uLength && pKey[uEnd] != '/' && pKey[uEnd] != '?'; uEnd++)
+    {
+        if (pKey[uEnd] == '@')
+            uStart = uEnd + 1;
+    }
+
+    /* Drop the port, the colons of an IPv6 address are inside brackets. */
+    for (i = uEnd; i > uStart && pKey[i - 1] >= '0' && pKey[i - 1] <= '9'; i--)
+        ;
+    if (i > uStart && pKey[i - 1] == ':')
+        uEnd = i - 1;
+    if (uEnd > uStart && pKey[uEnd - 1] == '.')
+        uEnd--;
+
+    if (uEnd == uStart)
+        return -1;
+
+    *puStart = uStart;
+    *puLength = uEnd - uStart;
+
+    return 0;
+}
+
+
+int TWPUrlGetDomain(char const *pHost, unsigned int uLength, unsigned int *puStart)
+{
+    unsigned int uSuffix = uLength;
+    unsigned int uException = uLength;
+    unsigned int uPrevious = uLength;
+    unsigned int uNext;
+    unsigned int i;
+
+    if (IsAddress(pHost, uLength))
+        return -1;
+
+    /*
+     * Labels are tried from the left, so the first rule found is the longest.
+     * An exception rule prevails over any other, its suffix starts at the
+     * next label.
+     */
+    for (i = 0; i < uLength; uPrevious = i, i = uNext)
+    {
+        unsigned int uFlags = SuffixFlags(pHost + i, uLength - i);
+
+        for (uNext = i; uNext < uLength && pHost[uNext] != '.'; uNext++)
+            ;
+        if (uNext < uLength)
+            uNext++;
+
+        if ((uFlags & SUFFIX_EXCEPTION) != 0 && uException == uLength)
+            uException = uNext;
+        if ((uFlags & SUFFIX_WILDCARD) != 0 && uPrevious != uLength && uSuffix == uLength)
+            uSuffix = uPrevious;
+        if ((uFlags & SUFFIX_RULE) != 0 && uSuffix == uLength)
+            uSuffix = i;
+    }
+
+    if (uException != uLength)
+        uSuffix = uException;
+    else if (uSuffix == uLength)
+    {
+        for (uSuffix = uLength; uSuffix > 0 && pHost[uSuffix - 1] != '.'; uSuffix--)
+            ;
+    }
+
+    /* A public suffix has no registrable domain. */
+    if (uSuffix < 2)
+        return -1;
+
+    for (i = uSuffix - 1; i > 0 && pHost[i - 1] != '.'; i--)
+        ;
+    if (i == uSuffix - 1)
+        return -1;
+    *puStart = i;
+
+    return 0;
+}
+
+
+int TWPUrlScopeKey(char const *pKey, unsigned int uLength, int iScope, char *pBuffer, unsigned int uSize,
+                   unsigned int *puLength)
+{
+    unsigned int uStart;
+    unsigned int uHostLength;
+    unsigned int uDomain;
+
+    if (TWPUrlGetHost(pKey, uLength, &uStart, &uHostLength) != 0)
+        return -1;
+
+    if (iScope == TWP_SCOPE_DOMAIN)
+    {
+        if (TWPUrlGetDomain(pKey + uStart, uHostLength, &uDomain) != 0)
+            return -1;
+        uStart += uDomain;
+        uHostLength -= uDomain;
+        pBuffer[0] = SCOPE_KEY_DOMAIN;
+    }
+    else if (iScope == TWP_SCOPE_HOST)
+    {
+        pBuffer[0] = SCOPE_KEY_HOST;
+    }
+    else
+    {
+        return -1;
+    }
+
+    if (uHostLength + 2 > uSize)
+        return -1;
+    memcpy(pBuffer + 1, pKey + uStart, uHostLength);
+    pBuffer[uHostLength + 1] = '\0';
+    *puLength = uHostLength + 1;
+
+    return 0;
+}
+
+
+uint64_t TWPUrlHash(char const *pData, unsigned int uLength)
+{
+    uint64_t uHash = FNV_OFFSET_BASIS;
+    unsigned int i;
+
+    for (i = 0; i < uLength; i++)
+    {
+        uHash ^= (unsigned char) pData[i];
+        uHash *= FNV_PRIME;
+    }
+
+    return uHash;
+}
+
+
+static void UrlPut(UrlWriter *pOut, char c)
+{
+    /* One byte is kept for the terminating null. */
+    if (pOut->uLength + 1 < pOut->uSize)
+        pOut->pBuffer[pOut->uLength++] = c;
+    else
+        pOut->iOverflow = 1;
+}
+
+
+/**
+ * Writes the host lowercased, with %-escapes decoded and without empty labels
+ * or trailing dot.
+ */
+static void PutHost(UrlWriter *pOut, char const *pHost, unsigned int uLength)
+{
+    int iDot = 1;
+    unsigned int i;
+
+    for (i = 0; i < uLength; i++)
+    {
+        char c = pHost[i];
+
+        if (URL_IS_IGNORED(c))
+            continue;
+        if (c == '%' && i + 2 < uLength && HexValue(pHost[i + 1]) >= 0 && HexValue(pHost[i + 2]) >= 0)
+        {
+            int iValue = HexValue(pHost[i + 1]) << 4 | HexValue(pHost[i + 2]);
+
+            if (iValue > ' ' && iValue < 0x7f)
+            {
+                c = (char) iValue;
+                i += 2;
+            }
+        }
+        if (c == '.')
+        {
+            if (!iDot)
+                UrlPut(pOut, c);
+            iDot = 1;
+            continue;
+        }
+        UrlPut(pOut, URL_LOWER(c));
+        iDot = 0;
+    }
+
+    if (iDot && pOut->uLength > 0 && pOut->pBuffer[pOut->uLength - 1] == '.' && !pOut->iOverflow)
+        pOut->uLength--;
+}
+
+
+/**
+ * Writes the path with its "." and ".." segments resolved. Backslashes are
+ * taken as slashes and an empty path becomes "/".
+ */
+static void PutPath(UrlWriter *pOut, char const *pPath, unsigned int uLength)
+{
+    unsigned int uRoot = pOut->uLength;
+    unsigned int uSegment;
+    unsigned int i = 0;
+
+    UrlPut(pOut, '/');
+    if (uLength != 0 && URL_IS_SLASH(pPath[0]))
+        i = 1;
+
+    uSegment = pOut->uLength;
+    for (;; i++)
+    {
+        if (i < uLength && !URL_IS_SLASH(pPath[i]))
+        {
+            if (!URL_IS_IGNORED(pPath[i]))
+                PutEscaped(pOut, pPath + i, uLength - i, &i);
+            continue;
+        }
+
+        if (!pOut->iOverflow)
+        {
+            char const *pSegment = pOut->pBuffer + uSegment;
+            unsigned int uSegmentLength = pOut->uLength - uSegment;
+
+            if (uSegmentLength == 1 && pSegment[0] == '.')
+            {
+                pOut->uLength = uSegment;
+                if (i < uLength)
+                    continue;
+                break;
+            }
+            if (uSegmentLength == 2 && pSegment[0] == '.' && pSegment[1] == '.')
+            {
+                pOut->uLength = uSegment - 1;
+                while (pOut->uLength > uRoot && pOut->pBuffer[pOut->uLength - 1] != '/')
+                    pOut->uLength--;
+                if (pOut->uLength <= uRoot)
+                    pOut->uLength = uRoot + 1;
+                uSegment = pOut->uLength;
+                if (i < uLength)
+                    continue;
+                break;
+            }
+        }
+
+        if (i >= uLength)
+            break;
+        UrlPut(pOut, '/');
+        uSegment = pOut->uLength;
+    }
+}
+
+
+/**
+ * Writes the character at pData[0] of a path or query. %-escapes of unreserved
+ * characters are decoded, the others are uppercased, and control, space,
+ * non-ASCII and unsafe characters are escaped. *puIndex is advanced past the
+ * escape read.
+ */
+static void PutEscaped(UrlWriter *pOut, char const *pData, unsigned int uLeft, unsigned int *puIndex)
+{
+    static char const Hex[] = "0123456789ABCDEF";
+    unsigned char c = (unsigned char) pData[0];
+
+    if (URL_IS_IGNORED(c))
+        return;
+
+    if (c == '%')
+    {
+        if (uLeft >= 3 && HexValue(pData[1]) >= 0 && HexValue(pData[2]) >= 0)
+        {
+            c = (unsigned char) (HexValue(pData[1]) << 4 | HexValue(pData[2]));
+            *puIndex += 2;
+            if (URL_IS_ALNUM(c) || c == '-' || c == '.' || c == '_' || c == '~')
+            {
+                UrlPut(pOut, (char) c);
+                return;
+            }
+        }
+        else
+        {
+            /* A lone % stands for itself. */
+            c = '%';
+        }
+        UrlPut(pOut, '%');
+        UrlPut(pOut, Hex[c >> 4]);
+        UrlPut(pOut, Hex[c & 15]);
+        return;
+    }
+
+    if (c <= ' ' || c >= 0x7f || c == '"' || c == '<' || c == '>' || c == '`' || c == '{' || c == '}')
+    {
+        UrlPut(pOut, '%');
+        UrlPut(pOut, Hex[c >> 4]);
+        UrlPut(pOut, Hex[c & 15]);
+        return;
+    }
+
+    UrlPut(pOut, (char) c);
+}
+
+
+static int HexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+
+    return -1;
+}
+
+
+/**
+ * Returns the port dropped from URLs of a lowercase scheme, 0 if none.
+ */
+static unsigned int DefaultPort(char const *pScheme, unsigned int uLength)
+{
+    if ((uLength == 4 && memcmp(pScheme, "http", 4) == 0) || (uLength == 2 && memcmp(pScheme, "ws", 2) == 0))
+        return 80;
+    if ((uLength == 5 && memcmp(pScheme, "https", 5) == 0) || (uLength == 3 && memcmp(pScheme, "wss", 3) == 0))
+        return 443;
+    if (uLength == 3 && memcmp(pScheme, "ftp", 3) == 0)
+        return 21;
+
+    return 0;
+}
+
+
+/**
+ * Returns the SUFFIX_* flags of a host name part, 0 if it has no rule.
+ */
+static unsigned int SuffixFlags(char const *pName, unsigned int uLength)
+{
+    SuffixKey Key;
+    SuffixRule const *pRule;
+
+    Key.pName = pName;
+    Key.uLength = uLength;
+    pRule = bsearch(&Key, SuffixRules, SUFFIX_RULE_COUNT, sizeof(SuffixRules[0]), CompareSuffix);
+
+    return pRule != NULL ? pRule->uFlags : 0;
+}
+
+
+static int CompareSuffix(void const *pKey, void const *pEntry)
+{
+    SuffixKey const *pSuffix = (SuffixKey const *) pKey;
+    SuffixRule const *pRule = (SuffixRule const *) pEntry;
+    unsigned int uLength = pSuffix->uLength < pRule->uLength ? pSuffix->uLength : pRule->uLength;
+    int iRet = memcmp(pSuffix->pName, SuffixNames + pRule->uName, uLength);
+
+    if (iRet == 0 && pSuffix->uLength != pRule->uLength)
+        iRet = pSuffix->uLength < pRule->uLength ? -1 : 1;
+
+    return iRet;
+}
+
+
+/**
+ * Returns 1 for IPv4 and IPv6 addresses, they have no registrable domain.
+ */
+static int IsAddress(char const *pHost, unsigned int uLength)
+{
+    unsigned int i;
+
+    if (pHost[0] == '[')
+        return 1;
+
+    for (i = 0; i < uLength; i++)
+    {
+        if ((pHost[i] < '0' || pHost[i] > '9') && pHost[i] != '.')
+            return 0;
+    }
+
+    return 1;
+}
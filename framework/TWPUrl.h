@@ -0,0 +1,89 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TWPURL_H
+#define TWPURL_H
+
+#include <stdint.h>
+
+#include "TWPImpl.h"
+
+#ifdef __cplusplus 
+extern "C" {
+#endif
+
+/**
+ * \file TWPUrl.h
+ * \brief TWP URL Canonicalization Header File
+ *  
+ * This file provides the function giving the canonical form of a URL, used
+ * by the framework to match the spellings of a URL in the rating cache, in
+ * lookup batches and in TWPResponseGetUrlRatingByUrl().
+ */
+
+/**
+ * \brief Writes the canonical form of a URL and its hash.
+ *
+ * The canonical form is built as follows:
+ * - Leading and trailing spaces and control characters, tabs and line breaks
+ *   and the fragment are removed.
+ * - The scheme is lowercased, http is used if the URL has none.
+ * - The host is lowercased, its %-escapes decoded, and empty labels and the
+ *   trailing dot removed.
+ * - The default port of http, https, ws, wss and ftp is removed.
+ * - "." and ".." path segments are resolved, backslashes in the path are
+ *   taken as slashes and an empty path becomes "/".
+ * - In the path and query, %-escapes of unreserved characters are decoded,
+ *   the others are uppercased, and spaces, control, non-ASCII and unsafe
+ *   characters are escaped. An empty query is removed.
+ *
+ * No memory is allocated.
+ *
+ * This is a synchronous API.
+ *
+ * \param[in] pUrl URL to be canonicalized.
+ * \param[in] uLength Length of pUrl.
+ * \param[out] pBuffer Buffer receiving the null terminated canonical URL.
+ * \param[in] uSize Size of pBuffer.
+ * \param[out] puLength Length of the canonical URL.
+ * \param[out] puHash 64-bit FNV-1a hash of the canonical URL, may be NULL.
+ *
+ * \return TWP_RESULT \n
+ * TWP_NOMEM - if pBuffer is too small. \n
+ */
+TWP_RESULT TWPUrlCanonicalize(const char *pUrl, unsigned int uLength, char *pBuffer, unsigned int uSize,
+                              unsigned int *puLength, uint64_t *puHash);
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif  /* TWPURL_H */
@@ -9,6 +9,8 @@ License: BSD
 Group: System/Libraries
 URL: http://tizen.org
 
+BuildRequires: publicsuffix-list
+
 %description
 
 
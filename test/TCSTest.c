@@ -37,6 +37,11 @@
 #include <assert.h>
 #include "TCSImpl.h"
 #include "TCSErrorCodes.h"
+#include "TCSResultCodec.h"
+#include "TCSParallelScan.h"
+#include "TCSIndicator.h"
+#include "TCSInternal.h"
+#include "SecFwScan.h"
 
 #include "TCSTest.h"
 
@@ -138,10 +143,35 @@ static void TCSScanFile_0031(void);
 static void TCSScanFile_0032(void);
 static void TCSScanFile_0033(void);
 static void TCSScanFile_0034(void);
+static void TCSScanResultEncode_0001(void);
+static void TCSScanResultEncode_0002(void);
+static void TCSScanResultDecode_0001(void);
+static void TCSScanResultViewInit_0001(void);
+static void TCSScanFileParallel_0001(void);
+static void TCSScanFileParallel_0002(void);
+static void TCSScanFileParallel_0003(void);
+static void TCSScanFileParallel_0004(void);
+static void TCSExtractIndicators_0001(void);
+static void TCSExtractIndicators_0002(void);
+static void TCSExtractIndicators_0003(void);
+static void TCSExtractIndicators_0004(void);
+static void SecFwScanData_0001(void);
+static void SecFwScanData_0002(void);
 
 static void TestCases(void);
 
 
+typedef int (*PFExtractIndicators)(void const *pBuffer, unsigned int uSize, int iTypes,
+                                   TCSIndicator *pIndicators, unsigned int uMax);
+
+/* The indicator cases run through the block search of the build and the byte by byte one. */
+static PFExtractIndicators const Extractors[] =
+{
+    TCSExtractIndicators,
+    TCSExtractIndicatorsScalar
+};
+
+
 extern int TestCasesCount;
 extern int Success;
 extern int Failures;
@@ -256,6 +286,24 @@ static void TestCases(void)
     TCSScanFile_0032();
     TCSScanFile_0033();
     TCSScanFile_0034();
+
+    TCSScanResultEncode_0001();
+    TCSScanResultEncode_0002();
+    TCSScanResultDecode_0001();
+    TCSScanResultViewInit_0001();
+
+    TCSScanFileParallel_0001();
+    TCSScanFileParallel_0002();
+    TCSScanFileParallel_0003();
+    TCSScanFileParallel_0004();
+
+    TCSExtractIndicators_0001();
+    TCSExtractIndicators_0002();
+    TCSExtractIndicators_0003();
+    TCSExtractIndicators_0004();
+
+    SecFwScanData_0001();
+    SecFwScanData_0002();
 }
 
 
@@ -1089,3 +1137,366 @@ static void TCSLibraryOpen_0004(void)
     TESTCASEDTOR(&TestCtx);
 }
 
+
+static void TCSScanResultEncode_0001(void)
+{
+    TestCase TestCtx;
+    TCSDetected Detected[2] =
+    {
+        {&Detected[1], "Name0", "", TCS_VTYPE_MALWARE, TCS_SC_USER | (TCS_BC_LEVEL1 << 8), NULL},
+        {NULL, "Name1", "Variant1", TCS_VTYPE_MALWARE, TCS_SC_TERMINAL, "/tmp/file|entry"}
+    };
+    TCSScanResult SR = {2, &Detected[0], NULL};
+    TCSScanResult DR = {0};
+    unsigned char Buffer[256];
+    unsigned int uLength = 0;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__, 0, 0, 0, NULL);
+    TEST_ASSERT(TCSScanResultEncode(&SR, Buffer, sizeof(Buffer), &uLength) == 0);
+    TEST_ASSERT(TCSScanResultDecode(Buffer, uLength, &DR) == 0);
+    TEST_ASSERT(DR.iNumDetected == 2 && DR.pfFreeResult != NULL);
+    TEST_ASSERT(strcmp(DR.pDList->pszName, "Name0") == 0);
+    TEST_ASSERT(strcmp(DR.pDList->pszVariant, "") == 0);
+    TEST_ASSERT(DR.pDList->pszFileName == NULL);
+    TEST_ASSERT(DR.pDList->uAction == Detected[0].uAction);
+    TEST_ASSERT(DR.pDList->pNext != NULL && DR.pDList->pNext->pNext == NULL);
+    TEST_ASSERT(strcmp(DR.pDList->pNext->pszVariant, "Variant1") == 0);
+    TEST_ASSERT(strcmp(DR.pDList->pNext->pszFileName, "/tmp/file|entry") == 0);
+    DR.pfFreeResult(&DR);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TCSScanResultEncode_0002(void)
+{
+    TestCase TestCtx;
+    TCSDetected Detected = {NULL, "Name0", "", TCS_VTYPE_MALWARE, TCS_SC_USER, NULL};
+    TCSScanResult SR = {1, &Detected, NULL};
+    unsigned char Buffer[8];
+    unsigned int uLength = 0;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__, 0, 0, 0, NULL);
+    TEST_ASSERT(TCSScanResultEncode(&SR, NULL, 0, &uLength) == -1);
+    TEST_ASSERT(uLength > TCS_CODEC_HEADER_SIZE);
+    TEST_ASSERT(TCSScanResultEncode(&SR, Buffer, sizeof(Buffer), &uLength) == -1);
+    TEST_ASSERT(TCSScanResultEncode(NULL, Buffer, sizeof(Buffer), &uLength) == -1);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TCSScanResultDecode_0001(void)
+{
+    TestCase TestCtx;
+    TCSDetected Detected = {NULL, "Name0", "", TCS_VTYPE_MALWARE, TCS_SC_USER, NULL};
+    TCSScanResult SR = {1, &Detected, NULL};
+    TCSScanResult DR = {0};
+    unsigned char Buffer[256];
+    unsigned int uLength = 0;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__, 0, 0, 0, NULL);
+    TEST_ASSERT(TCSScanResultEncode(&SR, Buffer, sizeof(Buffer), &uLength) == 0);
+    TEST_ASSERT(TCSScanResultDecode(Buffer, uLength - 1, &DR) == -1);
+    Buffer[0] = 'X';
+    TEST_ASSERT(TCSScanResultDecode(Buffer, uLength, &DR) == -1);
+    TEST_ASSERT(TCSScanResultDecode(NULL, 0, &DR) == -1);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TCSScanResultViewInit_0001(void)
+{
+    TestCase TestCtx;
+    TCSDetected Detected[2] =
+    {
+        {&Detected[1], "Name0", "", TCS_VTYPE_MALWARE, TCS_SC_USER, NULL},
+        {NULL, "Name1", "", TCS_VTYPE_MALWARE, TCS_SC_TERMINAL, NULL}
+    };
+    TCSScanResult SR = {2, &Detected[0], NULL};
+    TCSScanResultView View;
+    TCSDetected Record;
+    unsigned char Buffer[256];
+    unsigned int uLength = 0;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__, 0, 0, 0, NULL);
+    TEST_ASSERT(TCSScanResultEncode(&SR, Buffer, sizeof(Buffer), &uLength) == 0);
+    TEST_ASSERT(TCSScanResultViewInit(&View, Buffer, uLength) == 2);
+    TEST_ASSERT(TCSScanResultViewNext(&View, &Record) == 1);
+    TEST_ASSERT(Record.pszName >= (char const *) Buffer &&
+                Record.pszName < (char const *) Buffer + uLength);
+    TEST_ASSERT(strcmp(Record.pszName, "Name0") == 0);
+    TEST_ASSERT(TCSScanResultViewNext(&View, &Record) == 1);
+    TEST_ASSERT(Record.uAction == TCS_SC_TERMINAL);
+    TEST_ASSERT(TCSScanResultViewNext(&View, &Record) == 0);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TCSScanFileParallel_0001(void)
+{
+    TestCase TestCtx;
+    TCSScanResult SR = {0};
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__, 0, 0, 0, NULL);
+    TEST_ASSERT(TCSScanFileParallel(INVALID_TCSLIB_HANDLE, "file", TCS_DTYPE_UNKNOWN,
+                                    TCS_SA_SCANONLY, 1, NULL, &SR) == -1);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TCSScanFileParallel_0002(void)
+{
+    TestCase TestCtx;
+    TCSLIB_HANDLE hLib;
+    TCSScanResult SR = {0};
+    TCSParallelParam Param = {0};
+
+    Param.WindowSize = 4096;
+    Param.Overlap = 4096;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__, 0, 0, 0, NULL);
+    TEST_ASSERT((hLib = TCSLibraryOpen()) != INVALID_TCSLIB_HANDLE);
+    TEST_ASSERT(TCSScanFileParallel(hLib, "file", TCS_DTYPE_UNKNOWN,
+                                    TCS_SA_SCANONLY, 1, &Param, &SR) == -1);
+    TCSLibraryClose(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TCSScanFileParallel_0003(void)
+{
+    TestCase TestCtx;
+    TCSLIB_HANDLE hLib;
+    TCSScanResult SR = {0};
+    TCSParallelParam Param = {0};
+    TCSDetected *pDetected;
+    /* Windows start every 56K: the first copy lies in the overlap of
+       windows 0 and 1, the second one in window 3 only. */
+    int Offsets[2] = {57 * 1024, 200 * 1024};
+    int iSampleLen = 0, iCount = 0;
+    char *pszPath;
+    size_t Len;
+
+    Param.uThreads = 4;
+    Param.WindowSize = 64 * 1024;
+    Param.Overlap = 8 * 1024;
+    Param.MinFileSize = 128 * 1024;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__, MALWARE_TTYPE_BUFFER, INFECTED_DATA, TCS_SA_SCANONLY, NULL);
+    TEST_ASSERT((pszPath = CreateSpreadSample(MALWARE_TTYPE_BUFFER, 300 * 1024, Offsets,
+                                              ELEMENT_NUM(Offsets), &iSampleLen)) != NULL);
+    TEST_ASSERT(iSampleLen > 0 && Offsets[0] + iSampleLen <= (int) Param.WindowSize);
+    TEST_ASSERT((hLib = TCSLibraryOpen()) != INVALID_TCSLIB_HANDLE);
+    TEST_ASSERT(TCSScanFileParallel(hLib, pszPath, TCS_DTYPE_UNKNOWN,
+                                    TCS_SA_SCANONLY, 1, &Param, &SR) == 0);
+    /* three windows detect the sample, it is reported once */
+    TEST_ASSERT(SR.iNumDetected == SampleGetCount(MALWARE_TTYPE_BUFFER));
+    Len = strlen(pszPath);
+    for (pDetected = SR.pDList; pDetected != NULL; pDetected = pDetected->pNext, iCount++)
+    {
+        TEST_ASSERT(strcmp(pDetected->pszName, SampleGetMalName(MALWARE_TTYPE_BUFFER, iCount)) == 0);
+        /* the scanned file is the first component of the name */
+        TEST_ASSERT(strncmp(pDetected->pszFileName, pszPath, Len) == 0 &&
+                    (pDetected->pszFileName[Len] == '\0' || pDetected->pszFileName[Len] == '|'));
+    }
+    TEST_ASSERT(iCount == SR.iNumDetected);
+    (*SR.pfFreeResult)(&SR);
+    TCSLibraryClose(hLib);
+    DestroySpreadSample(pszPath);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TCSScanFileParallel_0004(void)
+{
+    TestCase TestCtx;
+    TCSLIB_HANDLE hLib;
+    TCSScanResult SR = {0};
+    TCSParallelParam Param = {0};
+    int Offsets[1] = {0};
+    int iSampleLen = 0;
+    char *pszPath;
+
+    Param.WindowSize = 64 * 1024;
+    Param.Overlap = 1;
+    Param.MinFileSize = 128 * 1024;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__, MALWARE_TTYPE_BUFFER, INFECTED_DATA, TCS_SA_SCANONLY, NULL);
+    TEST_ASSERT((pszPath = CreateSpreadSample(MALWARE_TTYPE_BUFFER, 1, Offsets, 0, &iSampleLen)) != NULL);
+    DestroySpreadSample(pszPath);
+    TEST_ASSERT(iSampleLen > 2);
+    /* The first window ends in the middle of the sample and the second one
+       starts a byte earlier, each window holds about half of it. Below
+       MinFileSize the whole file is given to TCSScanFile(), which finds it. */
+    Offsets[0] = (int) Param.WindowSize - iSampleLen / 2;
+    TEST_ASSERT((pszPath = CreateSpreadSample(MALWARE_TTYPE_BUFFER, 100 * 1024, Offsets,
+                                              ELEMENT_NUM(Offsets), &iSampleLen)) != NULL);
+    TEST_ASSERT((hLib = TCSLibraryOpen()) != INVALID_TCSLIB_HANDLE);
+    TEST_ASSERT(TCSScanFileParallel(hLib, pszPath, TCS_DTYPE_UNKNOWN,
+                                    TCS_SA_SCANONLY, 1, &Param, &SR) == 0);
+    TEST_ASSERT(SR.iNumDetected == SampleGetCount(MALWARE_TTYPE_BUFFER));
+    TEST_ASSERT(SR.pDList != NULL &&
+                strcmp(SR.pDList->pszName, SampleGetMalName(MALWARE_TTYPE_BUFFER, 0)) == 0);
+    (*SR.pfFreeResult)(&SR);
+    TCSLibraryClose(hLib);
+    DestroySpreadSample(pszPath);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TCSExtractIndicators_0001(void)
+{
+    TestCase TestCtx;
+    char const *pszText = "Visit http://evil.example.com/a?b=1, mail john.doe@example.com "
+                          "or call 5551234567 (see www.example.org).";
+    TCSIndicator Ind[4];
+    unsigned int i;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__, 0, 0, 0, NULL);
+    for (i = 0; i < ELEMENT_NUM(Extractors); i++)
+    {
+        TEST_ASSERT((*Extractors[i])(pszText, strlen(pszText), TCS_IND_ALL, Ind, 4) == 4);
+        TEST_ASSERT(Ind[0].iDataType == TCS_DTYPE_URL && Ind[0].pData == pszText + Ind[0].uOffset);
+        TEST_ASSERT(strncmp(Ind[0].pData, "http://evil.example.com/a?b=1", Ind[0].uLength) == 0 &&
+                    Ind[0].uLength == 29);
+        TEST_ASSERT(Ind[1].iDataType == TCS_DTYPE_EMAIL && Ind[1].uLength == 20 &&
+                    strncmp(Ind[1].pData, "john.doe@example.com", 20) == 0);
+        TEST_ASSERT(Ind[2].iDataType == TCS_DTYPE_PHONE && Ind[2].uLength == 10 &&
+                    strncmp(Ind[2].pData, "5551234567", 10) == 0);
+        TEST_ASSERT(Ind[3].iDataType == TCS_DTYPE_URL && Ind[3].uLength == 15 &&
+                    strncmp(Ind[3].pData, "www.example.org", 15) == 0);
+    }
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TCSExtractIndicators_0002(void)
+{
+    TestCase TestCtx;
+    char const *pszText = "http://user@host.example.com/5551234567 abc1234567 x@y 12345";
+    TCSIndicator Ind[4];
+    unsigned int i;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__, 0, 0, 0, NULL);
+    for (i = 0; i < ELEMENT_NUM(Extractors); i++)
+    {
+        TEST_ASSERT((*Extractors[i])(pszText, strlen(pszText), TCS_IND_ALL, Ind, 4) == 1);
+        TEST_ASSERT(Ind[0].iDataType == TCS_DTYPE_URL && Ind[0].uOffset == 0 && Ind[0].uLength == 39);
+        TEST_ASSERT((*Extractors[i])(pszText, strlen(pszText), TCS_IND_EMAIL | TCS_IND_PHONE,
+                                     Ind, 4) == 2);
+        TEST_ASSERT(Ind[0].iDataType == TCS_DTYPE_EMAIL && Ind[1].iDataType == TCS_DTYPE_PHONE);
+        TEST_ASSERT((*Extractors[i])(pszText, strlen(pszText), TCS_IND_ALL, NULL, 0) == 1);
+        TEST_ASSERT((*Extractors[i])(pszText, strlen(pszText), 0, Ind, 4) == -1);
+        TEST_ASSERT((*Extractors[i])(NULL, 1, TCS_IND_ALL, Ind, 4) == -1);
+    }
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TCSExtractIndicators_0003(void)
+{
+    TestCase TestCtx;
+    TCSLIB_HANDLE hLib;
+    char const *pszText = "<a href=\"http://www.example.com/\">home</a>";
+    TCSIndicator Ind[1];
+    TCSScanParam SP;
+    TCSScanResult SR;
+    char Buffer[64];
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__, 0, 0, 0, NULL);
+    TEST_ASSERT(TCSExtractIndicators(pszText, strlen(pszText), TCS_IND_URL, Ind, 1) == 1);
+    TCSIndicatorScanParam(&Ind[0], &SP);
+    TEST_ASSERT(SP.iDataType == TCS_DTYPE_URL && SP.iAction == TCS_SA_SCANONLY);
+    TEST_ASSERT((*SP.pfGetSize)(SP.pPrivate) == 23);
+    TEST_ASSERT((*SP.pfRead)(SP.pPrivate, 7, Buffer, sizeof(Buffer)) == 16);
+    TEST_ASSERT(strncmp(Buffer, "www.example.com/", 16) == 0);
+    TEST_ASSERT((hLib = TCSLibraryOpen()) != INVALID_TCSLIB_HANDLE);
+    memset(&SR, 0, sizeof(SR));
+    TEST_ASSERT(TCSScanData(hLib, &SP, &SR) == 0);
+    if (SR.pfFreeResult != NULL)
+        (*SR.pfFreeResult)(&SR);
+    TCSLibraryClose(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TCSExtractIndicators_0004(void)
+{
+    TestCase TestCtx;
+    char const *pszText = "http://a.example.com/p a@b.example.org 5551234567 www.c.org";
+    char const *ppExpected[4] =
+    {
+        "http://a.example.com/p",
+        "a@b.example.org",
+        "5551234567",
+        "www.c.org"
+    };
+    int const Types[4] = {TCS_DTYPE_URL, TCS_DTYPE_EMAIL, TCS_DTYPE_PHONE, TCS_DTYPE_URL};
+    char Buffer[160];
+    TCSIndicator Ind[4];
+    unsigned int uLead, uTail, uSize, i, j;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__, 0, 0, 0, NULL);
+    /* Each anchor is moved across the 16 and 32 byte block boundaries and
+       into the last bytes of the buffer, which are searched one at a time. */
+    for (uLead = 0; uLead <= 64; uLead++)
+    {
+        for (uTail = 0; uTail <= 35; uTail++)
+        {
+            memset(Buffer, ' ', sizeof(Buffer));
+            memcpy(Buffer + uLead, pszText, strlen(pszText));
+            uSize = uLead + strlen(pszText) + uTail;
+            for (i = 0; i < ELEMENT_NUM(Extractors); i++)
+            {
+                TEST_ASSERT((*Extractors[i])(Buffer, uSize, TCS_IND_ALL, Ind, 4) == 4);
+                for (j = 0; j < ELEMENT_NUM(Ind); j++)
+                {
+                    TEST_ASSERT(Ind[j].iDataType == Types[j]);
+                    TEST_ASSERT(Ind[j].uOffset == uLead + (strstr(pszText, ppExpected[j]) - pszText));
+                    TEST_ASSERT(Ind[j].uLength == strlen(ppExpected[j]));
+                }
+            }
+        }
+    }
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void SecFwScanData_0001(void)
+{
+    TestCase TestCtx;
+    char const *pszText = "Hello, see http://www.example.com/ for details.";
+    SecFwScanParam Param = {0};
+    SecFwScanResult Result;
+
+    Param.iDataType = TCS_DTYPE_TEXT;
+    Param.hTwpLib = INVALID_TWPLIB_HANDLE;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__, 0, 0, 0, NULL);
+    TEST_ASSERT(SecFwScanData(INVALID_TCSLIB_HANDLE, pszText, strlen(pszText), &Param, &Result) == -1);
+    TEST_ASSERT(SecFwScanData((TCSLIB_HANDLE) 1, NULL, 1, &Param, &Result) == -1);
+    TEST_ASSERT(SecFwScanData((TCSLIB_HANDLE) 1, pszText, strlen(pszText), NULL, &Result) == -1);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void SecFwScanData_0002(void)
+{
+    TestCase TestCtx;
+    TCSLIB_HANDLE hLib;
+    char const *pszText = "Hello, see http://www.example.com/ for details.";
+    SecFwScanParam Param = {0};
+    SecFwScanResult Result;
+
+    Param.iDataType = TCS_DTYPE_TEXT;
+    Param.hTwpLib = INVALID_TWPLIB_HANDLE;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__, 0, 0, 0, NULL);
+    TEST_ASSERT((hLib = TCSLibraryOpen()) != INVALID_TCSLIB_HANDLE);
+    TEST_ASSERT(SecFwScanData(hLib, pszText, strlen(pszText), &Param, &Result) == 0);
+    TEST_ASSERT(Result.iVerdict == SECFW_VERDICT_CLEAN);
+    TEST_ASSERT(Result.ContentResult.iNumDetected == 0);
+    TEST_ASSERT(Result.UrlResult == TWP_NO_DATA && Result.hResponse == NULL && Result.uUrlCount == 0);
+    SecFwScanResultFree(INVALID_TWPLIB_HANDLE, &Result);
+    TCSLibraryClose(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
@@ -150,6 +150,9 @@ extern void TestScanFileEx(const char *pszFunc, int iTType, int iPolarity,
                            int iAction, int iCompressFlag);
 extern void TestScanDataEx(const char *pszFunc, int iTType, int iPolarity,
                            int iAction, int iCompressFlag, PFScan pfCallback);
+extern char *CreateSpreadSample(int iTType, int iSize, int const *pOffsets, int iCount,
+                                int *piSampleLen);
+extern void DestroySpreadSample(char *pszPath);
 extern void ConScanFile(TestCase *pCtx, int iAction);
 extern void ConScanData(TestCase *pCtx, int iAction);
 extern int DetectRepairFunc(void);
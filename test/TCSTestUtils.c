@@ -1065,6 +1065,67 @@ void TestScanFileEx(const char *pszFunc, int iTType, int iPolarity,
 }
 
 
+/**
+ * Test framework helper function: writes a file of iSize zero bytes with the
+ * infected sample of iTType copied at each of the iCount offsets, next to the
+ * sample. Returns the absolute path of the file, NULL on failure. The sample
+ * length is returned in *piSampleLen.
+ */
+char *CreateSpreadSample(int iTType, int iSize, int const *pOffsets, int iCount, int *piSampleLen)
+{
+    TestCase Ctx;
+    FILE *pFile = NULL;
+    char *pszSample, *pszPath = NULL, *pSample, *pData;
+    int iSampleLen = 0, iWritten = 0, i;
+
+    memset(&Ctx, 0, sizeof(Ctx));
+    Ctx.iTestType = iTType;
+    Ctx.iPolarity = INFECTED_DATA;
+    if ((pszSample = GetSamplePath(&Ctx)) == NULL)
+        return NULL;
+
+    pSample = LoadFile(pszSample, &iSampleLen);
+    pData = (char *) calloc(iSize, sizeof(char));
+    if (pSample != NULL && pData != NULL &&
+        asprintf(&pszPath, "%s.spread", pszSample) > 0)
+    {
+        for (i = 0; i < iCount && pOffsets[i] + iSampleLen <= iSize; i++)
+            memcpy(pData + pOffsets[i], pSample, iSampleLen);
+
+        if (i == iCount && (pFile = fopen(pszPath, "wb")) != NULL)
+        {
+            iWritten = (int) fwrite(pData, 1, (size_t) iSize, pFile);
+            if (fclose(pFile) != 0)
+                iWritten = 0;
+        }
+        if (iWritten != iSize)
+        {
+            unlink(pszPath);
+            free(pszPath);
+            pszPath = NULL;
+        }
+        *piSampleLen = iSampleLen;
+    }
+
+    free(pData);
+    PutLoadedFile(pSample);
+    PutSamplePath(pszSample);
+
+    return pszPath;
+}
+
+
+void DestroySpreadSample(char *pszPath)
+{
+
+    if (pszPath != NULL)
+    {
+        unlink(pszPath);
+        free(pszPath);
+    }
+}
+
+
 static int BufferCompare(const char *pBuffer1, const char *pBuffer2, int iLen)
 {
 
@@ -0,0 +1,127 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file TWPScopePlugin.c
+ * \brief Test plug-in rating whole registrable domains.
+ *
+ * Installed as the site plug-in by the scope cache tests. It forwards every
+ * call to the engine named by TWP_SCOPE_ENGINE (the backed up engine) and
+ * adds TWPPUrlRatingGetScope(), which gives TWP_SCOPE_DOMAIN to all ratings.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include "TWPImpl.h"
+#include "TWPCache.h"
+#include "TWPPlugin.h"
+
+
+#define SCOPE_SYMBOL(Field, Name) (*(void **) &ScopeInterface.Field = dlsym(pEngine, Name))
+
+
+static TWP_RESULT ScopeUrlRatingGetScope(TWPUrlRatingHandle hRating, int *piScope);
+static void ScopeUnload(void) __attribute__((destructor));
+
+
+static void *pEngine = NULL;
+
+static TWPPInterface ScopeInterface;
+
+
+TWPPInterface const *TWPPGetInterface(unsigned int uVersion)
+{
+    typedef TWPPInterface const *(*FuncGetInterface)(unsigned int uVersion);
+    FuncGetInterface pfGetInterface;
+    TWPPInterface const *pInterface;
+    char const *pszEngine = getenv("TWP_SCOPE_ENGINE");
+
+    if (uVersion != TWPP_INTERFACE_VERSION || pszEngine == NULL)
+        return NULL;
+
+    if (pEngine == NULL && (pEngine = dlopen(pszEngine, RTLD_NOW | RTLD_LOCAL)) == NULL)
+        return NULL;
+
+    *(void **) &pfGetInterface = dlsym(pEngine, "TWPPGetInterface");
+    if (pfGetInterface != NULL && (pInterface = (*pfGetInterface)(uVersion)) != NULL)
+    {
+        ScopeInterface = *pInterface;
+    }
+    else
+    {
+        memset(&ScopeInterface, 0, sizeof(ScopeInterface));
+        SCOPE_SYMBOL(pfInitLibrary, "TWPPInitLibrary");
+        SCOPE_SYMBOL(pfUninitLibrary, "TWPPUninitLibrary");
+        SCOPE_SYMBOL(pfConfigurationCreate, "TWPPConfigurationCreate");
+        SCOPE_SYMBOL(pfConfigurationDestroy, "TWPPConfigurationDestroy");
+        SCOPE_SYMBOL(pfLookupUrls, "TWPPLookupUrls");
+        SCOPE_SYMBOL(pfResponseWrite, "TWPPResponseWrite");
+        SCOPE_SYMBOL(pfResponseGetUrlRatingByIndex, "TWPPResponseGetUrlRatingByIndex");
+        SCOPE_SYMBOL(pfResponseGetUrlRatingByUrl, "TWPPResponseGetUrlRatingByUrl");
+        SCOPE_SYMBOL(pfResponseGetRedirUrlFor, "TWPPResponseGetRedirUrlFor");
+        SCOPE_SYMBOL(pfResponseGetUrlRatingsCount, "TWPPResponseGetUrlRatingsCount");
+        SCOPE_SYMBOL(pfResponseDestroy, "TWPPResponseDestroy");
+        SCOPE_SYMBOL(pfPolicyCreate, "TWPPPolicyCreate");
+        SCOPE_SYMBOL(pfPolicyValidate, "TWPPPolicyValidate");
+        SCOPE_SYMBOL(pfPolicyGetViolations, "TWPPPolicyGetViolations");
+        SCOPE_SYMBOL(pfPolicyDestroy, "TWPPPolicyDestroy");
+        SCOPE_SYMBOL(pfUrlRatingGetScore, "TWPPUrlRatingGetScore");
+        SCOPE_SYMBOL(pfUrlRatingGetUrl, "TWPPUrlRatingGetUrl");
+        SCOPE_SYMBOL(pfUrlRatingGetDLAUrl, "TWPPUrlRatingGetDLAUrl");
+        SCOPE_SYMBOL(pfUrlRatingHasCategory, "TWPPUrlRatingHasCategory");
+        SCOPE_SYMBOL(pfUrlRatingGetCategories, "TWPPUrlRatingGetCategories");
+    }
+
+    ScopeInterface.uVersion = TWPP_INTERFACE_VERSION;
+    ScopeInterface.uCapabilities |= TWPP_CAP_RATING_SCOPE;
+    ScopeInterface.pfUrlRatingGetScope = ScopeUrlRatingGetScope;
+
+    return &ScopeInterface;
+}
+
+
+static TWP_RESULT ScopeUrlRatingGetScope(TWPUrlRatingHandle hRating, int *piScope)
+{
+    if (hRating == NULL || piScope == NULL)
+        return TWP_INVALID_PARAMETER;
+
+    *piScope = TWP_SCOPE_DOMAIN;
+
+    return TWP_SUCCESS;
+}
+
+
+static void ScopeUnload(void)
+{
+    if (pEngine != NULL)
+        dlclose(pEngine);
+}
@@ -36,9 +36,30 @@
 #include <string.h>
 #include <assert.h>
 #include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include "TWPImpl.h"
+#include "TWPCache.h"
+#include "TWPUrl.h"
+#include "TWPCoalesce.h"
+#include "TWPAsync.h"
+#include "TWPPolicy.h"
+#include "TWPArena.h"
+#include "TWPLocalDb.h"
+#include "TWPBloom.h"
+#include "TWPPrefetch.h"
+#include "TWPStats.h"
+#include "TWPDeadline.h"
+#include "TWPInternal.h"
 
 #include "XMHttp.h"
+#include "XMHttpMulti.h"
+#include "XMPHttp.h"
+#include "XMDns.h"
 #include "TWPTest.h"
 #include "UrlInfo.h"
 
@@ -88,6 +109,59 @@ static void TWPRatingHasCategory_0003(void);
 static void TWPRatingGetCategories_0001(void);
 static void TWPRatingGetCategories_0002(void);
 static void TWPRatingGetCategories_0003(void);
+static void TWPCacheConfigure_0001(void);
+static void TWPCacheConfigure_0002(void);
+static void TWPDiskCacheConfigure_0001(void);
+static void TWPDiskCacheConfigure_0002(void);
+static void TWPCacheConfigure_0003(void);
+static void TWPUrlCanonicalize_0001(void);
+static void TWPUrlCanonicalize_0002(void);
+static void TWPUrlGetDomain_0001(void);
+static void TWPUrlScopeKey_0001(void);
+static void TWPLookupUrls_0006(void);
+static void TWPCoalesceConfigure_0001(void);
+static void TWPCoalesceConfigure_0002(void);
+static void TWPLookupUrlsAsync_0001(void);
+static void TWPLookupUrlsAsync_0002(void);
+static void TWPPolicyFindViolations_0001(void);
+static void TWPPolicyFindViolations_0002(void);
+static void TWPPolicyValidateBatch_0001(void);
+static void TWPPolicyValidateBatch_0002(void);
+static void TWPUrlRatingGetCategoryMask_0001(void);
+static void TWPUrlRatingGetCategoryMask_0002(void);
+static void TWPArenaConfigure_0001(void);
+static void TWPArenaConfigure_0002(void);
+static void TWPInitLibrary_0005(void);
+static void TWPLocalDbBuild_0001(void);
+static void TWPLocalDbBuild_0002(void);
+static void TWPBloomBuild_0001(void);
+static void TWPBloomBuild_0002(void);
+static void TWPPrefetchUrls_0001(void);
+static void TWPPrefetchUrls_0002(void);
+static void TWPGetStats_0001(void);
+static void TWPGetStats_0002(void);
+static void TWPLookupUrlsWithin_0001(void);
+static void TWPLookupUrlsWithin_0002(void);
+static void TWPCacheConfigure_0004(void);
+static void TWPLookupUrlsWithin_0003(void);
+static void TWPGetStats_0003(void);
+static void TWPDiskCacheConfigure_0003(void);
+static void TWPPrefetchUrls_0003(void);
+static void XmDnsResolve_0001(void);
+static void XmDnsResolve_0002(void);
+static void XmDnsResolve_0003(void);
+static void XmHttpExec_0001(void);
+static void XmHttpExec_0002(void);
+static void XmHttpExec_0003(void);
+static void XmHttpExec_0004(void);
+static void XmHttpExec_0005(void);
+static void XmHttpExec_0006(void);
+static void XmHttpExec_0007(void);
+static void XmHttpExec_0008(void);
+static void XmHttpMulti_0001(void);
+static void XmHttpMulti_0002(void);
+static void XmHttpMulti_0003(void);
+static void TWPCoalesceConfigure_0003(void);
 
 static void TestCases(void);
 
@@ -157,6 +231,59 @@ static void TestCases(void)
     TWPRatingGetCategories_0001();
     TWPRatingGetCategories_0002();
     TWPRatingGetCategories_0003();
+    TWPCacheConfigure_0001();
+    TWPCacheConfigure_0002();
+    TWPDiskCacheConfigure_0001();
+    TWPDiskCacheConfigure_0002();
+    TWPCacheConfigure_0003();
+    TWPUrlCanonicalize_0001();
+    TWPUrlCanonicalize_0002();
+    TWPUrlGetDomain_0001();
+    TWPUrlScopeKey_0001();
+    TWPLookupUrls_0006();
+    TWPCoalesceConfigure_0001();
+    TWPCoalesceConfigure_0002();
+    TWPLookupUrlsAsync_0001();
+    TWPLookupUrlsAsync_0002();
+    TWPPolicyFindViolations_0001();
+    TWPPolicyFindViolations_0002();
+    TWPPolicyValidateBatch_0001();
+    TWPPolicyValidateBatch_0002();
+    TWPUrlRatingGetCategoryMask_0001();
+    TWPUrlRatingGetCategoryMask_0002();
+    TWPArenaConfigure_0001();
+    TWPArenaConfigure_0002();
+    TWPInitLibrary_0005();
+    TWPLocalDbBuild_0001();
+    TWPLocalDbBuild_0002();
+    TWPBloomBuild_0001();
+    TWPBloomBuild_0002();
+    TWPPrefetchUrls_0001();
+    TWPPrefetchUrls_0002();
+    TWPGetStats_0001();
+    TWPGetStats_0002();
+    TWPLookupUrlsWithin_0001();
+    TWPLookupUrlsWithin_0002();
+    TWPCacheConfigure_0004();
+    TWPLookupUrlsWithin_0003();
+    TWPGetStats_0003();
+    TWPDiskCacheConfigure_0003();
+    TWPPrefetchUrls_0003();
+    XmDnsResolve_0001();
+    XmDnsResolve_0002();
+    XmDnsResolve_0003();
+    XmHttpExec_0001();
+    XmHttpExec_0002();
+    XmHttpExec_0003();
+    XmHttpExec_0004();
+    XmHttpExec_0005();
+    XmHttpExec_0006();
+    XmHttpExec_0007();
+    XmHttpExec_0008();
+    XmHttpMulti_0001();
+    XmHttpMulti_0002();
+    XmHttpMulti_0003();
+    TWPCoalesceConfigure_0003();
 }
 
 
@@ -1129,6 +1256,2163 @@ static void TWPRatingGetCategories_0003(void)
 }
 
 
+static void TWPCacheConfigure_0001(void)
+{
+    TestCase TestCtx;
+    TWPCacheParam Param = {0, 0, 0};
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT(TWPCacheConfigure(INVALID_TWPLIB_HANDLE, &Param) == TWP_INVALID_HANDLE);
+    TEST_ASSERT(TWPCacheFlush(INVALID_TWPLIB_HANDLE) == TWP_INVALID_HANDLE);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPCacheConfigure_0002(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPResponseHandle hResponse;
+    TWPUrlRatingHandle hRating;
+    const char *ppUrls[1] =
+    {
+        URL_0_0
+    };
+    TWPCacheParam Param = {0, 0, 0};
+    TWPPolicyHandle hPolicy;
+    int iScore = 0;
+    int iViolated = 0;
+    char *pUrl = NULL;
+    unsigned int uLength = 0;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPCacheConfigure(hLib, &Param) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                              ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    /* the second lookup is answered from the cache */
+    TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                              ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(hResponse != NULL);
+    TEST_ASSERT(TWPResponseGetUrlRatingByUrl(hLib, hResponse, ppUrls[0], strlen(ppUrls[0]), &hRating) == TWP_SUCCESS);
+    TEST_ASSERT(TWPUrlRatingGetScore(hLib, hRating, &iScore) == TWP_SUCCESS);
+    TEST_ASSERT(iScore == SCORE_0_0);
+    TEST_ASSERT(TWPPolicyCreate(hLib, hCfg, CATEGORIES_0_0_1, ELEMENT_NUM(CATEGORIES_0_0_1), &hPolicy) == TWP_SUCCESS);
+    TEST_ASSERT(TWPPolicyValidate(hLib, hPolicy, hRating, &iViolated) == TWP_SUCCESS);
+    TEST_ASSERT(iViolated == 1);
+    TEST_ASSERT(TWPResponseGetRedirUrlFor(hLib, hResponse, hRating, hPolicy, &pUrl, &uLength) == TWP_NO_DATA);
+    TEST_ASSERT(TWPPolicyDestroy(hLib, &hPolicy) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPCacheFlush(hLib) == TWP_SUCCESS);
+    TEST_ASSERT(TWPCacheConfigure(hLib, NULL) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPDiskCacheConfigure_0001(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPDiskCacheParam Param = {NULL, 0, 0};
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT(TWPDiskCacheConfigure(INVALID_TWPLIB_HANDLE, &Param) == TWP_INVALID_HANDLE);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPDiskCacheConfigure(hLib, &Param) == TWP_INVALID_PARAMETER);
+    Param.pszPath = "/nonexistent/twp.cache";
+    TEST_ASSERT(TWPDiskCacheConfigure(hLib, &Param) == TWP_ERROR);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPDiskCacheConfigure_0002(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPResponseHandle hResponse;
+    TWPUrlRatingHandle hRating;
+    const char *ppUrls[1] =
+    {
+        URL_0_0
+    };
+    TWPDiskCacheParam Param = {"/tmp/twptest.cache", 0, 0};
+    TWPPolicyHandle hPolicy;
+    int iScore = 0;
+    char *pUrl = NULL;
+    unsigned int uLength = 0;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    unlink(Param.pszPath);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPDiskCacheConfigure(hLib, &Param) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                              ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+
+    /* a new library handle finds the rating in the file */
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPDiskCacheConfigure(hLib, &Param) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                              ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseGetUrlRatingByIndex(hLib, hResponse, 0, &hRating) == TWP_SUCCESS);
+    TEST_ASSERT(TWPUrlRatingGetScore(hLib, hRating, &iScore) == TWP_SUCCESS);
+    TEST_ASSERT(iScore == SCORE_0_0);
+    TEST_ASSERT(TWPPolicyCreate(hLib, hCfg, CATEGORIES_0_0_1, ELEMENT_NUM(CATEGORIES_0_0_1), &hPolicy) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseGetRedirUrlFor(hLib, hResponse, hRating, hPolicy, &pUrl, &uLength) == TWP_NO_DATA);
+    TEST_ASSERT(TWPPolicyDestroy(hLib, &hPolicy) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+
+    /* flushing empties the file */
+    TEST_ASSERT(TWPCacheFlush(hLib) == TWP_SUCCESS);
+    TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                              ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseGetUrlRatingByIndex(hLib, hResponse, 0, &hRating) == TWP_SUCCESS);
+    TEST_ASSERT(TWPPolicyCreate(hLib, hCfg, CATEGORIES_0_0_1, ELEMENT_NUM(CATEGORIES_0_0_1), &hPolicy) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseGetRedirUrlFor(hLib, hResponse, hRating, hPolicy, &pUrl, &uLength) != TWP_NO_DATA);
+    free(pUrl);
+    TEST_ASSERT(TWPPolicyDestroy(hLib, &hPolicy) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPDiskCacheConfigure(hLib, NULL) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    unlink(Param.pszPath);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPCacheConfigure_0003(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPResponseHandle hResponse;
+    TWPUrlRatingHandle hRating;
+    const char *ppUrls[3] =
+    {
+        URL_0_0,
+        "http://images.screensavers.com/index.html",
+        "http://screensavers.com/"
+    };
+    TWPCacheParam Param = {0, 0, 0};
+    TWPStats Stats;
+    unsigned long ulRequests = 0;
+    int iScore = 0;
+    unsigned int i;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    /* the test plug-in forwards to the engine and rates all of screensavers.com */
+    TEST_ASSERT(InstallScopeEngine() == 0);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPCacheConfigure(hLib, &Param) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    for (i = 0; i < ELEMENT_NUM(ppUrls); i++)
+    {
+        TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                                  &ppUrls[i], 1, &hResponse) == TWP_SUCCESS);
+        TEST_ASSERT(TWPResponseGetUrlRatingByUrl(hLib, hResponse, ppUrls[i], strlen(ppUrls[i]), &hRating) == TWP_SUCCESS);
+        TEST_ASSERT(TWPUrlRatingGetScore(hLib, hRating, &iScore) == TWP_SUCCESS);
+        TEST_ASSERT(iScore == SCORE_0_0);
+        TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+        TEST_ASSERT(TWPGetStats(hLib, &Stats) == TWP_SUCCESS);
+        if (i == 0)
+        {
+            TEST_ASSERT(Stats.ulRequests > 0);
+            ulRequests = Stats.ulRequests;
+        }
+        /* the other hosts of the domain reach neither the plug-in nor the server */
+        TEST_ASSERT(Stats.ulCacheMisses == 1 && Stats.ulCacheHits == i);
+        TEST_ASSERT(Stats.ulRequests == ulRequests);
+    }
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    RemoveScopeEngine();
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPUrlCanonicalize_0001(void)
+{
+    TestCase TestCtx;
+    const char *ppUrls[] =
+    {
+        "http://www.example.com/a/b?q=1",
+        "HTTP://WWW.Example.COM:80/a/./b?q=1#top",
+        "www.example.com./a/c/../b?q=%31",
+        " http://www.example.com/%61/b?q=1 "
+    };
+    char Canonical[256];
+    char Expected[256];
+    unsigned int uLength = 0;
+    unsigned int uExpectedLength = 0;
+    uint64_t uHash = 0;
+    uint64_t uExpectedHash = 0;
+    unsigned int i;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT(TWPUrlCanonicalize(ppUrls[0], strlen(ppUrls[0]), Expected, sizeof(Expected),
+                                   &uExpectedLength, &uExpectedHash) == TWP_SUCCESS);
+    TEST_ASSERT(strcmp(Expected, ppUrls[0]) == 0);
+    TEST_ASSERT(uExpectedLength == strlen(ppUrls[0]));
+    for (i = 1; i < ELEMENT_NUM(ppUrls); i++)
+    {
+        TEST_ASSERT(TWPUrlCanonicalize(ppUrls[i], strlen(ppUrls[i]), Canonical, sizeof(Canonical),
+                                       &uLength, &uHash) == TWP_SUCCESS);
+        TEST_ASSERT(uLength == uExpectedLength && strcmp(Canonical, Expected) == 0);
+        TEST_ASSERT(uHash == uExpectedHash);
+    }
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPUrlCanonicalize_0002(void)
+{
+    TestCase TestCtx;
+    char Canonical[8];
+    unsigned int uLength = 0;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT(TWPUrlCanonicalize(NULL, 0, Canonical, sizeof(Canonical), &uLength, NULL) == TWP_INVALID_PARAMETER);
+    TEST_ASSERT(TWPUrlCanonicalize(URL_1_0, strlen(URL_1_0), NULL, 0, &uLength, NULL) == TWP_INVALID_PARAMETER);
+    TEST_ASSERT(TWPUrlCanonicalize(URL_1_0, strlen(URL_1_0), Canonical, sizeof(Canonical), &uLength, NULL) == TWP_NOMEM);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPUrlGetDomain_0001(void)
+{
+    TestCase TestCtx;
+    const char *ppHosts[][2] =
+    {
+        {"www.example.com", "example.com"},
+        {"a.b.co.uk", "b.co.uk"},
+        {"www.foo.co.at", "foo.co.at"},
+        {"shop.example.com.pl", "example.com.pl"},
+        {"x.blogspot.com", "x.blogspot.com"},
+        {"school.k12.ak.us", "school.k12.ak.us"},
+        /* *.ck is a wildcard rule with the !www.ck exception */
+        {"b.a.ck", "b.a.ck"},
+        {"www.ck", "www.ck"},
+        {"www.city.kawasaki.jp", "city.kawasaki.jp"},
+        {"www.example.xn--fiqs8s", "example.xn--fiqs8s"}
+    };
+    const char *ppNone[] =
+    {
+        "1.2.3.4",
+        "[::1]",
+        "com",
+        "co.uk",
+        "blogspot.com",
+        "a.ck"
+    };
+    unsigned int uStart = 0;
+    unsigned int i;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    for (i = 0; i < ELEMENT_NUM(ppHosts); i++)
+    {
+        TEST_ASSERT(TWPUrlGetDomain(ppHosts[i][0], strlen(ppHosts[i][0]), &uStart) == 0);
+        TEST_ASSERT(strcmp(ppHosts[i][0] + uStart, ppHosts[i][1]) == 0);
+    }
+    /* addresses and public suffixes have no registrable domain */
+    for (i = 0; i < ELEMENT_NUM(ppNone); i++)
+        TEST_ASSERT(TWPUrlGetDomain(ppNone[i], strlen(ppNone[i]), &uStart) == -1);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPUrlScopeKey_0001(void)
+{
+    TestCase TestCtx;
+    const char *pszUrl = "http://a.b.co.uk/index.html";
+    char Key[64];
+    unsigned int uLength = 0;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT(TWPUrlScopeKey(pszUrl, strlen(pszUrl), TWP_SCOPE_HOST, Key, sizeof(Key), &uLength) == 0);
+    TEST_ASSERT(uLength == 10 && Key[0] == '\001' && strcmp(Key + 1, "a.b.co.uk") == 0);
+    TEST_ASSERT(TWPUrlScopeKey(pszUrl, strlen(pszUrl), TWP_SCOPE_DOMAIN, Key, sizeof(Key), &uLength) == 0);
+    TEST_ASSERT(uLength == 8 && Key[0] == '\002' && strcmp(Key + 1, "b.co.uk") == 0);
+    /* blogspot.com is a suffix of the private section, each blog is a domain */
+    pszUrl = "http://x.blogspot.com/";
+    TEST_ASSERT(TWPUrlScopeKey(pszUrl, strlen(pszUrl), TWP_SCOPE_DOMAIN, Key, sizeof(Key), &uLength) == 0);
+    TEST_ASSERT(strcmp(Key + 1, "x.blogspot.com") == 0);
+    /* addresses only have a host key */
+    pszUrl = "http://1.2.3.4/";
+    TEST_ASSERT(TWPUrlScopeKey(pszUrl, strlen(pszUrl), TWP_SCOPE_HOST, Key, sizeof(Key), &uLength) == 0);
+    TEST_ASSERT(strcmp(Key + 1, "1.2.3.4") == 0);
+    TEST_ASSERT(TWPUrlScopeKey(pszUrl, strlen(pszUrl), TWP_SCOPE_DOMAIN, Key, sizeof(Key), &uLength) == -1);
+    pszUrl = "http://[::1]/";
+    TEST_ASSERT(TWPUrlScopeKey(pszUrl, strlen(pszUrl), TWP_SCOPE_HOST, Key, sizeof(Key), &uLength) == 0);
+    TEST_ASSERT(strcmp(Key + 1, "[::1]") == 0);
+    TEST_ASSERT(TWPUrlScopeKey(pszUrl, strlen(pszUrl), TWP_SCOPE_DOMAIN, Key, sizeof(Key), &uLength) == -1);
+    /* a public suffix neither */
+    pszUrl = "http://co.uk/";
+    TEST_ASSERT(TWPUrlScopeKey(pszUrl, strlen(pszUrl), TWP_SCOPE_DOMAIN, Key, sizeof(Key), &uLength) == -1);
+    TEST_ASSERT(TWPUrlScopeKey(pszUrl, strlen(pszUrl), TWP_SCOPE_URL, Key, sizeof(Key), &uLength) == -1);
+    /* the key does not fit */
+    pszUrl = "http://a.b.co.uk/index.html";
+    TEST_ASSERT(TWPUrlScopeKey(pszUrl, strlen(pszUrl), TWP_SCOPE_HOST, Key, 10, &uLength) == -1);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPLookupUrls_0006(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPResponseHandle hResponse;
+    TWPUrlRatingHandle hRating;
+    const char *ppUrls[3] =
+    {
+        URL_0_0,
+        URL_1_0,
+        "HTTP://WWW.SCREENSAVERS.COM:80/"
+    };
+    unsigned int uCount = 0;
+    char *pUrl = NULL;
+    unsigned int uLength = 0;
+    int iScore = 0;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    /* the third URL is the first one spelled differently */
+    TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                              ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseGetUrlRatingsCount(hLib, hResponse, &uCount) == TWP_SUCCESS);
+    TEST_ASSERT(uCount == ELEMENT_NUM(ppUrls));
+    TEST_ASSERT(TWPResponseGetUrlRatingByIndex(hLib, hResponse, 2, &hRating) == TWP_SUCCESS);
+    TEST_ASSERT(TWPUrlRatingGetUrl(hLib, hRating, &pUrl, &uLength) == TWP_SUCCESS);
+    TEST_ASSERT(uLength == strlen(ppUrls[2]) && memcmp(pUrl, ppUrls[2], uLength) == 0);
+    TEST_ASSERT(TWPUrlRatingGetScore(hLib, hRating, &iScore) == TWP_SUCCESS);
+    TEST_ASSERT(iScore == SCORE_0_0);
+    TEST_ASSERT(TWPResponseGetUrlRatingByUrl(hLib, hResponse, "http://www.Screensavers.com/", 28, &hRating) == TWP_SUCCESS);
+    TEST_ASSERT(TWPUrlRatingGetScore(hLib, hRating, &iScore) == TWP_SUCCESS);
+    TEST_ASSERT(iScore == SCORE_0_0);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPCoalesceConfigure_0001(void)
+{
+    TestCase TestCtx;
+    TWPCoalesceParam Param = {0, 0};
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT(TWPCoalesceConfigure(INVALID_TWPLIB_HANDLE, &Param) == TWP_INVALID_HANDLE);
+    TEST_ASSERT(TWPCoalesceConfigure(INVALID_TWPLIB_HANDLE, NULL) == TWP_INVALID_HANDLE);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPCoalesceConfigure_0002(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPResponseHandle hResponse;
+    TWPUrlRatingHandle hRating;
+    const char *ppUrls[2] =
+    {
+        URL_0_0,
+        URL_1_0
+    };
+    TWPCoalesceParam Param = {1000, 0};
+    unsigned int uCount = 0;
+    int iScore = 0;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPCoalesceConfigure(hLib, &Param) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    /* a lone lookup is sent when the window ends */
+    TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                              ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseGetUrlRatingsCount(hLib, hResponse, &uCount) == TWP_SUCCESS);
+    TEST_ASSERT(uCount == ELEMENT_NUM(ppUrls));
+    TEST_ASSERT(TWPResponseGetUrlRatingByUrl(hLib, hResponse, ppUrls[0], strlen(ppUrls[0]), &hRating) == TWP_SUCCESS);
+    TEST_ASSERT(TWPUrlRatingGetScore(hLib, hRating, &iScore) == TWP_SUCCESS);
+    TEST_ASSERT(iScore == SCORE_0_0);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPCoalesceConfigure(hLib, NULL) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+/**
+ * Completion of an asynchronous lookup, checked by the test cases.
+ */
+typedef struct AsyncResult_struct
+{
+    int iDone;
+    TWP_RESULT Result;
+    TWPResponseHandle hResponse;
+} AsyncResult;
+
+
+static void AsyncDone(void *pContext, TWP_RESULT Result, TWPResponseHandle hResponse)
+{
+    AsyncResult *pResult = (AsyncResult *) pContext;
+
+    pResult->Result = Result;
+    pResult->hResponse = hResponse;
+    pResult->iDone = 1;
+}
+
+
+static void TWPLookupUrlsAsync_0001(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    AsyncResult Result = {0, TWP_SUCCESS, NULL};
+    TWPAsyncParam Param = {0, 0};
+    const char *ppUrls[1] =
+    {
+        URL_0_0
+    };
+    int iEventFd = 0;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    /* the event loop is stopped by default */
+    TEST_ASSERT(TWPLookupUrlsAsync(hLib, hCfg, 0, ppUrls, ELEMENT_NUM(ppUrls), AsyncDone, &Result) == TWP_ERROR);
+    TEST_ASSERT(TWPAsyncConfigure(hLib, &Param, &iEventFd) == TWP_SUCCESS);
+    TEST_ASSERT(iEventFd == -1);
+    TEST_ASSERT(TWPLookupUrlsAsync(hLib, hCfg, 0, ppUrls, ELEMENT_NUM(ppUrls), NULL, &Result) ==
+                TWP_INVALID_PARAMETER);
+    TEST_ASSERT(TWPAsyncDispatch(hLib) == TWP_ERROR);
+    TEST_ASSERT(TWPAsyncConfigure(hLib, NULL, NULL) == TWP_SUCCESS);
+    TEST_ASSERT(Result.iDone == 0);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPLookupUrlsAsync_0002(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPUrlRatingHandle hRating;
+    AsyncResult Results[4];
+    TWPAsyncParam Param = {TWP_ASYNC_EVENTFD, 0};
+    const char *ppUrls[1] =
+    {
+        URL_0_0
+    };
+    struct pollfd Poll;
+    int iEventFd = -1;
+    int iScore = 0;
+    unsigned int uDone = 0;
+    unsigned int i;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    memset(Results, 0, sizeof(Results));
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    TEST_ASSERT(TWPAsyncConfigure(hLib, &Param, &iEventFd) == TWP_SUCCESS);
+    TEST_ASSERT(iEventFd >= 0);
+    for (i = 0; i < ELEMENT_NUM(Results); i++)
+    {
+        TEST_ASSERT(TWPLookupUrlsAsync(hLib, hCfg, 0, ppUrls, ELEMENT_NUM(ppUrls), AsyncDone, &Results[i]) ==
+                    TWP_SUCCESS);
+    }
+    /* all lookups are in flight at once, the callbacks run here */
+    while (uDone < ELEMENT_NUM(Results))
+    {
+        Poll.fd = iEventFd;
+        Poll.events = POLLIN;
+        if (poll(&Poll, 1, 10000) <= 0)
+            break;
+        TEST_ASSERT(TWPAsyncDispatch(hLib) == TWP_SUCCESS);
+        for (i = 0, uDone = 0; i < ELEMENT_NUM(Results); i++)
+            uDone += Results[i].iDone;
+    }
+    TEST_ASSERT(uDone == ELEMENT_NUM(Results));
+    for (i = 0; i < ELEMENT_NUM(Results); i++)
+    {
+        TEST_ASSERT(Results[i].Result == TWP_SUCCESS);
+        TEST_ASSERT(TWPResponseGetUrlRatingByIndex(hLib, Results[i].hResponse, 0, &hRating) == TWP_SUCCESS);
+        TEST_ASSERT(TWPUrlRatingGetScore(hLib, hRating, &iScore) == TWP_SUCCESS);
+        TEST_ASSERT(iScore == SCORE_0_0);
+        TEST_ASSERT(TWPResponseDestroy(hLib, &Results[i].hResponse) == TWP_SUCCESS);
+    }
+    TEST_ASSERT(TWPAsyncConfigure(hLib, NULL, NULL) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPPolicyFindViolations_0001(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPResponseHandle hResponse;
+    TWPUrlRatingHandle hRating;
+    TWPCacheParam Param = {0, 0, 0};
+    const char *ppUrls[1] =
+    {
+        URL_0_0
+    };
+    TWPPolicyHandle hPolicy;
+    TWPPolicyHandle hOther;
+    TWPCategories Violated[4];
+    unsigned int uLength = 0;
+    int iViolated = 1;
+    int i;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    /* ratings handed out by the framework are checked on their bitmap */
+    TEST_ASSERT(TWPCacheConfigure(hLib, &Param) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                              ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseGetUrlRatingByIndex(hLib, hResponse, 0, &hRating) == TWP_SUCCESS);
+    TEST_ASSERT(TWPPolicyCreate(hLib, hCfg, CATEGORIES_0_0_2, ELEMENT_NUM(CATEGORIES_0_0_2), &hPolicy) == TWP_SUCCESS);
+    TEST_ASSERT(TWPPolicyCreate(hLib, hCfg, CATEGORIES_0_0_0, ELEMENT_NUM(CATEGORIES_0_0_0), &hOther) == TWP_SUCCESS);
+    TEST_ASSERT(TWPPolicyFindViolations(hLib, hPolicy, hRating, Violated, ELEMENT_NUM(Violated),
+                                        &uLength) == TWP_SUCCESS);
+    TEST_ASSERT(uLength == ELEMENT_NUM(VIOLATIONS_0_0_2));
+    for (i = 0; i < uLength; i++)
+    {
+        TEST_ASSERT(Violated[i] == VIOLATIONS_0_0_2[i]);
+    }
+    TEST_ASSERT(TWPPolicyFindViolations(hLib, hPolicy, hRating, Violated, 1, &uLength) == TWP_NOMEM);
+    TEST_ASSERT(uLength == ELEMENT_NUM(VIOLATIONS_0_0_2));
+    TEST_ASSERT(TWPPolicyFindViolations(hLib, hOther, hRating, Violated, ELEMENT_NUM(Violated),
+                                        &uLength) == TWP_SUCCESS);
+    TEST_ASSERT(uLength == 0);
+    TEST_ASSERT(TWPPolicyValidate(hLib, hPolicy, hRating, &iViolated) == TWP_SUCCESS);
+    TEST_ASSERT(iViolated == 1);
+    TEST_ASSERT(TWPPolicyValidate(hLib, hOther, hRating, &iViolated) == TWP_SUCCESS);
+    TEST_ASSERT(iViolated == 0);
+    TEST_ASSERT(TWPUrlRatingHasCategory(hLib, hRating, CATEGORY_0_0_1, &iViolated) == TWP_SUCCESS);
+    TEST_ASSERT(iViolated == 1);
+    TEST_ASSERT(TWPPolicyDestroy(hLib, &hOther) == TWP_SUCCESS);
+    TEST_ASSERT(TWPPolicyDestroy(hLib, &hPolicy) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPPolicyFindViolations_0002(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPResponseHandle hResponse;
+    TWPUrlRatingHandle hRating;
+    const char *ppUrls[1] =
+    {
+        URL_0_0
+    };
+    TWPPolicyHandle hPolicy;
+    TWPCategories Violated[4];
+    unsigned int uLength = 0;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT(TWPPolicyFindViolations(INVALID_TWPLIB_HANDLE, NULL, NULL, Violated, ELEMENT_NUM(Violated),
+                                        &uLength) == TWP_NOT_IMPLEMENTED);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    /* plug-in ratings are checked by the plug-in */
+    TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                              ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseGetUrlRatingByIndex(hLib, hResponse, 0, &hRating) == TWP_SUCCESS);
+    TEST_ASSERT(TWPPolicyCreate(hLib, hCfg, CATEGORIES_0_0_2, ELEMENT_NUM(CATEGORIES_0_0_2), &hPolicy) == TWP_SUCCESS);
+    TEST_ASSERT(TWPPolicyFindViolations(hLib, hPolicy, hRating, NULL, 1, &uLength) == TWP_INVALID_PARAMETER);
+    TEST_ASSERT(TWPPolicyFindViolations(hLib, hPolicy, hRating, Violated, ELEMENT_NUM(Violated),
+                                        &uLength) == TWP_SUCCESS);
+    TEST_ASSERT(uLength == ELEMENT_NUM(VIOLATIONS_0_0_2));
+    TEST_ASSERT(Violated[0] == VIOLATIONS_0_0_2[0]);
+    TEST_ASSERT(TWPPolicyDestroy(hLib, &hPolicy) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPPolicyValidateBatch_0001(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPResponseHandle hResponse;
+    TWPUrlRatingHandle phRatings[2];
+    TWPPolicyHandle phPolicies[2];
+    TWPCacheParam Param = {0, 0, 0};
+    const char *ppUrls[2] =
+    {
+        URL_0_0,
+        URL_1_0
+    };
+    unsigned char Matrix[2 * TWP_POLICY_MATRIX_STRIDE(2)];
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPCacheConfigure(hLib, &Param) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                              ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseGetUrlRatingByIndex(hLib, hResponse, 0, &phRatings[0]) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseGetUrlRatingByIndex(hLib, hResponse, 1, &phRatings[1]) == TWP_SUCCESS);
+    TEST_ASSERT(TWPPolicyCreate(hLib, hCfg, CATEGORIES_0_0_0, ELEMENT_NUM(CATEGORIES_0_0_0),
+                                &phPolicies[0]) == TWP_SUCCESS);
+    TEST_ASSERT(TWPPolicyCreate(hLib, hCfg, CATEGORIES_0_0_2, ELEMENT_NUM(CATEGORIES_0_0_2),
+                                &phPolicies[1]) == TWP_SUCCESS);
+    TEST_ASSERT(TWPPolicyValidateBatch(hLib, phPolicies, 2, phRatings, 2, Matrix) == TWP_SUCCESS);
+    /* only the first URL violates the second policy */
+    TEST_ASSERT(TWP_POLICY_MATRIX_TEST(Matrix, 2, 0, 0) == 0);
+    TEST_ASSERT(TWP_POLICY_MATRIX_TEST(Matrix, 2, 0, 1) == 1);
+    TEST_ASSERT(TWP_POLICY_MATRIX_TEST(Matrix, 2, 1, 0) == 0);
+    TEST_ASSERT(TWP_POLICY_MATRIX_TEST(Matrix, 2, 1, 1) == 0);
+    TEST_ASSERT(TWPPolicyDestroy(hLib, &phPolicies[0]) == TWP_SUCCESS);
+    TEST_ASSERT(TWPPolicyDestroy(hLib, &phPolicies[1]) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPPolicyValidateBatch_0002(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPResponseHandle hResponse;
+    TWPUrlRatingHandle hRating;
+    TWPPolicyHandle hPolicy;
+    const char *ppUrls[1] =
+    {
+        URL_0_0
+    };
+    unsigned char Matrix[1];
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT(TWPPolicyValidateBatch(INVALID_TWPLIB_HANDLE, NULL, 0, NULL, 0, NULL) == TWP_NOT_IMPLEMENTED);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                              ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseGetUrlRatingByIndex(hLib, hResponse, 0, &hRating) == TWP_SUCCESS);
+    TEST_ASSERT(TWPPolicyCreate(hLib, hCfg, CATEGORIES_0_0_2, ELEMENT_NUM(CATEGORIES_0_0_2), &hPolicy) == TWP_SUCCESS);
+    TEST_ASSERT(TWPPolicyValidateBatch(hLib, &hPolicy, 1, &hRating, 1, NULL) == TWP_INVALID_PARAMETER);
+    TEST_ASSERT(TWPPolicyValidateBatch(hLib, NULL, 1, &hRating, 1, Matrix) == TWP_INVALID_PARAMETER);
+    /* plug-in ratings are checked by the plug-in */
+    TEST_ASSERT(TWPPolicyValidateBatch(hLib, &hPolicy, 1, &hRating, 1, Matrix) == TWP_SUCCESS);
+    TEST_ASSERT(TWP_POLICY_MATRIX_TEST(Matrix, 1, 0, 0) == 1);
+    TEST_ASSERT(TWPPolicyDestroy(hLib, &hPolicy) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPUrlRatingGetCategoryMask_0001(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPResponseHandle hResponse;
+    TWPUrlRatingHandle hRating;
+    TWPCacheParam Param = {0, 0, 0};
+    const char *ppUrls[1] =
+    {
+        URL_0_0
+    };
+    uint64_t Mask[TWP_CATEGORY_MASK_WORDS];
+    int iPass;
+    int i;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    /* plug-in ratings first, then ratings handed out by the framework */
+    for (iPass = 0; iPass < 2; iPass++)
+    {
+        if (iPass == 1)
+        {
+            TEST_ASSERT(TWPCacheConfigure(hLib, &Param) == TWP_SUCCESS);
+        }
+        TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                                  ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+        TEST_ASSERT(TWPResponseGetUrlRatingByIndex(hLib, hResponse, 0, &hRating) == TWP_SUCCESS);
+        memset(Mask, 0xff, sizeof(Mask));
+        TEST_ASSERT(TWPUrlRatingGetCategoryMask(hLib, hRating, Mask) == TWP_SUCCESS);
+        for (i = 0; i < ELEMENT_NUM(CATEGORIES_0_0_1); i++)
+        {
+            TEST_ASSERT(TWP_CATEGORY_MASK_TEST(Mask, CATEGORIES_0_0_1[i]) == 1);
+        }
+        TEST_ASSERT(TWP_CATEGORY_MASK_TEST(Mask, CATEGORY_0_0_0) == 0);
+        TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    }
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPUrlRatingGetCategoryMask_0002(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPResponseHandle hResponse;
+    TWPUrlRatingHandle hRating;
+    const char *ppUrls[1] =
+    {
+        URL_0_0
+    };
+    uint64_t Mask[TWP_CATEGORY_MASK_WORDS];
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT(TWPUrlRatingGetCategoryMask(INVALID_TWPLIB_HANDLE, NULL, Mask) == TWP_NOT_IMPLEMENTED);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                              ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseGetUrlRatingByIndex(hLib, hResponse, 0, &hRating) == TWP_SUCCESS);
+    TEST_ASSERT(TWPUrlRatingGetCategoryMask(hLib, hRating, NULL) == TWP_INVALID_PARAMETER);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPArenaConfigure_0001(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPResponseHandle hResponse;
+    TWPUrlRatingHandle hRating;
+    TWPArenaParam Param = {0, 0};
+    TWPArenaStats Stats;
+    const char *ppUrls[2] =
+    {
+        URL_0_0,
+        URL_1_0
+    };
+    char *pUrl;
+    unsigned int uLength;
+    int iScore;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    TEST_ASSERT(TWPArenaConfigure(hLib, &Param) == TWP_SUCCESS);
+    TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                              ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPArenaGetStats(hLib, &Stats) == TWP_SUCCESS);
+    TEST_ASSERT(Stats.ulLiveArenas == 1);
+    TEST_ASSERT(TWPResponseGetUrlRatingByIndex(hLib, hResponse, 0, &hRating) == TWP_SUCCESS);
+    TEST_ASSERT(TWPUrlRatingGetScore(hLib, hRating, &iScore) == TWP_SUCCESS);
+    TEST_ASSERT(iScore == SCORE_0_0);
+    TEST_ASSERT(TWPUrlRatingGetUrl(hLib, hRating, &pUrl, &uLength) == TWP_SUCCESS);
+    TEST_ASSERT(uLength == strlen(URL_0_0) && memcmp(pUrl, URL_0_0, uLength) == 0);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPArenaGetStats(hLib, &Stats) == TWP_SUCCESS);
+    TEST_ASSERT(Stats.ulResponses == 1);
+    TEST_ASSERT(Stats.ulLiveArenas == 0);
+    TEST_ASSERT(Stats.ulUsedBytes >= Stats.ulRequestedBytes);
+    TEST_ASSERT(Stats.ulPooledBlocks == Stats.ulReservedBlocks);
+    /* disabling arenas resets the counters */
+    TEST_ASSERT(TWPArenaConfigure(hLib, NULL) == TWP_SUCCESS);
+    TEST_ASSERT(TWPArenaGetStats(hLib, &Stats) == TWP_SUCCESS);
+    TEST_ASSERT(Stats.ulResponses == 0 && Stats.ulReservedBlocks == 0);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPArenaConfigure_0002(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPArenaParam Param = {0, 0};
+    TWPArenaStats Stats;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT(TWPArenaConfigure(INVALID_TWPLIB_HANDLE, &Param) == TWP_INVALID_HANDLE);
+    TEST_ASSERT(TWPArenaGetStats(INVALID_TWPLIB_HANDLE, &Stats) == TWP_INVALID_HANDLE);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPArenaGetStats(hLib, NULL) == TWP_INVALID_PARAMETER);
+    TEST_ASSERT(TWPArenaGetStats(hLib, &Stats) == TWP_SUCCESS);
+    TEST_ASSERT(Stats.ulResponses == 0 && Stats.ulLiveArenas == 0);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPInitLibrary_0005(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib[4];
+    TWPConfigurationHandle hCfg;
+    int i;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    /* the plug-in is shared by the handles and stays loaded between them */
+    for (i = 0; i < ELEMENT_NUM(hLib); i++)
+    {
+        TEST_ASSERT((hLib[i] = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    }
+    for (i = 0; i < ELEMENT_NUM(hLib); i++)
+    {
+        TEST_ASSERT(TWPConfigurationCreate(hLib[i], &Cfg, &hCfg) == TWP_SUCCESS);
+        TEST_ASSERT(TWPConfigurationDestroy(hLib[i], &hCfg) == TWP_SUCCESS);
+        TWPUninitLibrary(hLib[i]);
+    }
+    for (i = 0; i < 100; i++)
+    {
+        TEST_ASSERT((hLib[0] = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+        TWPUninitLibrary(hLib[0]);
+    }
+    TEST_ASSERT((hLib[0] = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPConfigurationCreate(hLib[0], &Cfg, &hCfg) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib[0], &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib[0]);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPLocalDbBuild_0001(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPResponseHandle hResponse;
+    TWPUrlRatingHandle hRating;
+    TWPLocalDbParam Param = {"/tmp/twptest.localdb"};
+    TWPCategories Categories[] = {TWP_Gambling};
+    TWPLocalDbEntry Entries[] =
+    {
+        {"http://www.example.com/", TWP_SCOPE_DOMAIN, 90, Categories, ELEMENT_NUM(Categories)},
+        {"http://www.google.com/phish/", TWP_LOCALDB_PREFIX, 80, NULL, 0}
+    };
+    const char *ppUrls[3] =
+    {
+        "http://login.example.com/account",
+        "http://www.google.com/phish/page.html",
+        URL_0_0
+    };
+    int iScores[3] = {90, 80, SCORE_0_0};
+    int iPresent;
+    int iScore;
+    int i;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT(TWPLocalDbBuild(Param.pszPath, Entries, ELEMENT_NUM(Entries)) == TWP_SUCCESS);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    TEST_ASSERT(TWPLocalDbConfigure(hLib, &Param) == TWP_SUCCESS);
+    /* the last URL is not in the database and goes to the plug-in */
+    TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                              ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+    for (i = 0; i < ELEMENT_NUM(ppUrls); i++)
+    {
+        TEST_ASSERT(TWPResponseGetUrlRatingByIndex(hLib, hResponse, i, &hRating) == TWP_SUCCESS);
+        TEST_ASSERT(TWPUrlRatingGetScore(hLib, hRating, &iScore) == TWP_SUCCESS);
+        TEST_ASSERT(iScore == iScores[i]);
+    }
+    TEST_ASSERT(TWPResponseGetUrlRatingByIndex(hLib, hResponse, 0, &hRating) == TWP_SUCCESS);
+    TEST_ASSERT(TWPUrlRatingHasCategory(hLib, hRating, TWP_Gambling, &iPresent) == TWP_SUCCESS);
+    TEST_ASSERT(iPresent == 1);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPLocalDbConfigure(hLib, NULL) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    unlink(Param.pszPath);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPLocalDbBuild_0002(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPLocalDbParam Param = {"/tmp/twptest.localdb"};
+    TWPLocalDbEntry Entry = {"http://www.example.com/path", TWP_LOCALDB_PREFIX, 90, NULL, 0};
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    /* prefixes end with a slash */
+    TEST_ASSERT(TWPLocalDbBuild(Param.pszPath, &Entry, 1) == TWP_INVALID_PARAMETER);
+    TEST_ASSERT(TWPLocalDbBuild(NULL, &Entry, 1) == TWP_INVALID_PARAMETER);
+    TEST_ASSERT(TWPLocalDbConfigure(INVALID_TWPLIB_HANDLE, &Param) == TWP_INVALID_HANDLE);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    unlink(Param.pszPath);
+    TEST_ASSERT(TWPLocalDbConfigure(hLib, &Param) == TWP_ERROR);
+    Param.pszPath = NULL;
+    TEST_ASSERT(TWPLocalDbConfigure(hLib, &Param) == TWP_INVALID_PARAMETER);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPBloomBuild_0001(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPResponseHandle hResponse;
+    TWPUrlRatingHandle hRating;
+    TWPBloomParam Param = {"/tmp/twptest.bloom", 0};
+    const char *ppHosts[] = {"www.screensavers.com"};
+    const char *ppUrls[2] = {URL_0_0, URL_1_0};
+    int iProvisional;
+    int iPresent;
+    int iScore;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT(TWPBloomBuild(Param.pszPath, ppHosts, ELEMENT_NUM(ppHosts), 0) == TWP_SUCCESS);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    TEST_ASSERT(TWPBloomConfigure(hLib, &Param) == TWP_SUCCESS);
+    TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                              ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+    /* the listed host is looked up */
+    TEST_ASSERT(TWPResponseGetUrlRatingByIndex(hLib, hResponse, 0, &hRating) == TWP_SUCCESS);
+    TEST_ASSERT(TWPUrlRatingGetScore(hLib, hRating, &iScore) == TWP_SUCCESS);
+    TEST_ASSERT(iScore == SCORE_0_0);
+    TEST_ASSERT(TWPUrlRatingIsProvisional(hLib, hRating, &iProvisional) == TWP_SUCCESS);
+    TEST_ASSERT(iProvisional == 0);
+    /* the other one is rated at once */
+    TEST_ASSERT(TWPResponseGetUrlRatingByIndex(hLib, hResponse, 1, &hRating) == TWP_SUCCESS);
+    TEST_ASSERT(TWPUrlRatingGetScore(hLib, hRating, &iScore) == TWP_SUCCESS);
+    TEST_ASSERT(iScore == TWP_MinimalLow);
+    TEST_ASSERT(TWPUrlRatingIsProvisional(hLib, hRating, &iProvisional) == TWP_SUCCESS);
+    TEST_ASSERT(iProvisional == 1);
+    TEST_ASSERT(TWPUrlRatingHasCategory(hLib, hRating, TWP_OverallRiskMinimal, &iPresent) == TWP_SUCCESS);
+    TEST_ASSERT(iPresent == 1);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPBloomConfigure(hLib, NULL) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    unlink(Param.pszPath);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPBloomBuild_0002(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPBloomParam Param = {"/tmp/twptest.bloom", 0};
+    const char *ppHosts[] = {"http:///path"};
+    int iProvisional;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    /* entries need a host */
+    TEST_ASSERT(TWPBloomBuild(Param.pszPath, ppHosts, ELEMENT_NUM(ppHosts), 0) == TWP_INVALID_PARAMETER);
+    TEST_ASSERT(TWPBloomBuild(NULL, ppHosts, ELEMENT_NUM(ppHosts), 0) == TWP_INVALID_PARAMETER);
+    TEST_ASSERT(TWPBloomConfigure(INVALID_TWPLIB_HANDLE, &Param) == TWP_INVALID_HANDLE);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    unlink(Param.pszPath);
+    TEST_ASSERT(TWPBloomConfigure(hLib, &Param) == TWP_ERROR);
+    TEST_ASSERT(TWPUrlRatingIsProvisional(hLib, NULL, NULL) == TWP_INVALID_PARAMETER);
+    TEST_ASSERT(TWPUrlRatingIsProvisional(INVALID_TWPLIB_HANDLE, NULL, &iProvisional) == TWP_NOT_IMPLEMENTED);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPPrefetchUrls_0001(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPResponseHandle hResponse;
+    TWPUrlRatingHandle hRating;
+    TWPCacheParam CacheParam = {0, 0, 0};
+    TWPAsyncParam AsyncParam = {TWP_ASYNC_EVENTFD, 0};
+    TWPPrefetchParam Param = {1, 0, 0, 0};
+    const char *ppUrls[1] =
+    {
+        URL_0_0
+    };
+    struct pollfd Poll;
+    int iEventFd = -1;
+    int iScore = 0;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    TEST_ASSERT(TWPCacheConfigure(hLib, &CacheParam) == TWP_SUCCESS);
+    TEST_ASSERT(TWPAsyncConfigure(hLib, &AsyncParam, &iEventFd) == TWP_SUCCESS);
+    TEST_ASSERT(TWPPrefetchConfigure(hLib, &Param) == TWP_SUCCESS);
+    TEST_ASSERT(TWPPrefetchUrls(hLib, hCfg, ppUrls, ELEMENT_NUM(ppUrls)) == TWP_SUCCESS);
+    /* the rating is cached when the callback runs */
+    Poll.fd = iEventFd;
+    Poll.events = POLLIN;
+    TEST_ASSERT(poll(&Poll, 1, 10000) == 1);
+    TEST_ASSERT(TWPAsyncDispatch(hLib) == TWP_SUCCESS);
+    TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                              ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseGetUrlRatingByIndex(hLib, hResponse, 0, &hRating) == TWP_SUCCESS);
+    TEST_ASSERT(TWPUrlRatingGetScore(hLib, hRating, &iScore) == TWP_SUCCESS);
+    TEST_ASSERT(iScore == SCORE_0_0);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPPrefetchConfigure(hLib, NULL) == TWP_SUCCESS);
+    TEST_ASSERT(TWPAsyncConfigure(hLib, NULL, NULL) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPPrefetchUrls_0002(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPCacheParam CacheParam = {0, 0, 0};
+    TWPAsyncParam AsyncParam = {0, 0};
+    TWPPrefetchParam Param = {0, 0, 0, 0};
+    const char *ppUrls[2] =
+    {
+        URL_0_0,
+        NULL
+    };
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT(TWPPrefetchConfigure(INVALID_TWPLIB_HANDLE, &Param) == TWP_INVALID_HANDLE);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    /* prefetching needs to be enabled, the event loop and the rating cache */
+    TEST_ASSERT(TWPPrefetchUrls(hLib, hCfg, ppUrls, 1) == TWP_ERROR);
+    TEST_ASSERT(TWPPrefetchConfigure(hLib, &Param) == TWP_SUCCESS);
+    TEST_ASSERT(TWPPrefetchUrls(hLib, hCfg, ppUrls, 1) == TWP_ERROR);
+    TEST_ASSERT(TWPAsyncConfigure(hLib, &AsyncParam, NULL) == TWP_SUCCESS);
+    TEST_ASSERT(TWPPrefetchUrls(hLib, hCfg, ppUrls, 1) == TWP_ERROR);
+    TEST_ASSERT(TWPCacheConfigure(hLib, &CacheParam) == TWP_SUCCESS);
+    TEST_ASSERT(TWPPrefetchUrls(hLib, hCfg, ppUrls, 2) == TWP_INVALID_PARAMETER);
+    TEST_ASSERT(TWPAsyncConfigure(hLib, NULL, NULL) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPGetStats_0001(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPResponseHandle hResponse;
+    TWPCacheParam CacheParam = {0, 0, 0};
+    TWPStats Stats;
+    const char *ppUrls[2] = {URL_0_0, URL_1_0};
+    int i;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    TEST_ASSERT(TWPCacheConfigure(hLib, &CacheParam) == TWP_SUCCESS);
+    /* the second lookup is served from the cache */
+    for (i = 0; i < 2; i++)
+    {
+        TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                                  ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+        TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    }
+    TEST_ASSERT(TWPGetStats(hLib, &Stats) == TWP_SUCCESS);
+    TEST_ASSERT(Stats.ulLookups == 2);
+    TEST_ASSERT(Stats.ulUrls == 2 * ELEMENT_NUM(ppUrls));
+    TEST_ASSERT(Stats.ulCacheMisses == ELEMENT_NUM(ppUrls));
+    TEST_ASSERT(Stats.ulCacheHits == ELEMENT_NUM(ppUrls));
+    TEST_ASSERT(Stats.ulResults[TWP_SUCCESS] == 2);
+    TEST_ASSERT(Stats.ulRequests > 0 && Stats.ulBytesSent > 0 && Stats.ulBytesReceived > 0);
+    TEST_ASSERT(Stats.BatchSizes.ulCount == 2);
+    TEST_ASSERT(Stats.Phases[TWP_PHASE_LOOKUP].ulCount == 2);
+    TEST_ASSERT(Stats.Phases[TWP_PHASE_SEND].ulCount > 0);
+    TEST_ASSERT(Stats.Phases[TWP_PHASE_RECEIVE].ulCount > 0);
+    TEST_ASSERT(TWPResetStats(hLib) == TWP_SUCCESS);
+    TEST_ASSERT(TWPGetStats(hLib, &Stats) == TWP_SUCCESS);
+    TEST_ASSERT(Stats.ulLookups == 0 && Stats.Phases[TWP_PHASE_LOOKUP].ulCount == 0);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPGetStats_0002(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPStats Stats;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT(TWPGetStats(INVALID_TWPLIB_HANDLE, &Stats) == TWP_INVALID_HANDLE);
+    TEST_ASSERT(TWPResetStats(INVALID_TWPLIB_HANDLE) == TWP_INVALID_HANDLE);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPGetStats(hLib, NULL) == TWP_INVALID_PARAMETER);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPLookupUrlsWithin_0001(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPResponseHandle hResponse;
+    TWPUrlRatingHandle hRating;
+    TWPAsyncParam AsyncParam = {TWP_ASYNC_EVENTFD, 0};
+    TWPDeadlineParam Param = {30000, TWP_DEADLINE_FAIL_CLOSED};
+    TWPStats Stats;
+    const char *ppUrls[2] = {URL_0_0, URL_1_0};
+    int iEventFd = -1;
+    int iProvisional = 1;
+    int iScore = 0;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    /* the waiting caller does not need to dispatch the completions */
+    TEST_ASSERT(TWPAsyncConfigure(hLib, &AsyncParam, &iEventFd) == TWP_SUCCESS);
+    TEST_ASSERT(TWPDeadlineConfigure(hLib, &Param) == TWP_SUCCESS);
+    TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                              ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseGetUrlRatingByIndex(hLib, hResponse, 0, &hRating) == TWP_SUCCESS);
+    TEST_ASSERT(TWPUrlRatingGetScore(hLib, hRating, &iScore) == TWP_SUCCESS);
+    TEST_ASSERT(iScore == SCORE_0_0);
+    TEST_ASSERT(TWPUrlRatingIsProvisional(hLib, hRating, &iProvisional) == TWP_SUCCESS);
+    TEST_ASSERT(iProvisional == 0);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPLookupUrlsWithin(hLib, hCfg, (TWPRequest *) &Request,
+                                    ppUrls, ELEMENT_NUM(ppUrls), 30000, &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseGetUrlRatingByIndex(hLib, hResponse, 0, &hRating) == TWP_SUCCESS);
+    TEST_ASSERT(TWPUrlRatingGetScore(hLib, hRating, &iScore) == TWP_SUCCESS);
+    TEST_ASSERT(iScore == SCORE_0_0);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPGetStats(hLib, &Stats) == TWP_SUCCESS);
+    TEST_ASSERT(Stats.ulDeadlines == 0);
+    TEST_ASSERT(Stats.ulLookups == 2 && Stats.ulInternalLookups == 2);
+    TEST_ASSERT(Stats.ulResults[TWP_SUCCESS] == 2 && Stats.BatchSizes.ulCount == 2);
+    TEST_ASSERT(Stats.Phases[TWP_PHASE_LOOKUP].ulCount == 2);
+    TEST_ASSERT(TWPDeadlineConfigure(hLib, NULL) == TWP_SUCCESS);
+    TEST_ASSERT(TWPAsyncConfigure(hLib, NULL, NULL) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPLookupUrlsWithin_0002(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPResponseHandle hResponse;
+    TWPDeadlineParam Param = {100, 2};
+    const char *ppUrls[1] = {URL_0_0};
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT(TWPDeadlineConfigure(INVALID_TWPLIB_HANDLE, &Param) == TWP_INVALID_HANDLE);
+    TEST_ASSERT(TWPLookupUrlsWithin(INVALID_TWPLIB_HANDLE, NULL, (TWPRequest *) &Request,
+                                    ppUrls, ELEMENT_NUM(ppUrls), 100, &hResponse) == TWP_NOT_IMPLEMENTED);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPDeadlineConfigure(hLib, &Param) == TWP_INVALID_PARAMETER);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPCacheConfigure_0004(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPResponseHandle hResponse;
+    TWPUrlRatingHandle hRating;
+    TWPCacheParam Param = {0, 60, 1};
+    TWPAsyncParam AsyncParam = {TWP_ASYNC_EVENTFD, 0};
+    TWPStats Stats;
+    const char *ppUrls[1] =
+    {
+        URL_0_0
+    };
+    struct pollfd Poll;
+    int iEventFd = -1;
+    int iScore = 0;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    TEST_ASSERT(TWPCacheConfigure(hLib, &Param) == TWP_SUCCESS);
+    TEST_ASSERT(TWPAsyncConfigure(hLib, &AsyncParam, &iEventFd) == TWP_SUCCESS);
+    TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                              ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    /* the stale rating is served at once and refreshed in the background */
+    sleep(2);
+    TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                              ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseGetUrlRatingByIndex(hLib, hResponse, 0, &hRating) == TWP_SUCCESS);
+    TEST_ASSERT(TWPUrlRatingGetScore(hLib, hRating, &iScore) == TWP_SUCCESS);
+    TEST_ASSERT(iScore == SCORE_0_0);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    Poll.fd = iEventFd;
+    Poll.events = POLLIN;
+    TEST_ASSERT(poll(&Poll, 1, 10000) == 1);
+    TEST_ASSERT(TWPAsyncDispatch(hLib) == TWP_SUCCESS);
+    TEST_ASSERT(TWPGetStats(hLib, &Stats) == TWP_SUCCESS);
+    TEST_ASSERT(Stats.ulCacheHits == 1 && Stats.ulCacheMisses == 1);
+    /* the refresh is not one of the caller's lookups */
+    TEST_ASSERT(Stats.ulLookups == 2 && Stats.ulInternalLookups == 1);
+    TEST_ASSERT(Stats.Phases[TWP_PHASE_LOOKUP].ulCount == 2);
+    TEST_ASSERT(TWPAsyncConfigure(hLib, NULL, NULL) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPLookupUrlsWithin_0003(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPResponseHandle hResponse;
+    TWPUrlRatingHandle hRating;
+    TWPUrlRatingHandle hByUrl;
+    TWPAsyncParam AsyncParam = {TWP_ASYNC_EVENTFD, 0};
+    TWPDeadlineParam Param = {1, TWP_DEADLINE_FAIL_CLOSED};
+    TWPStats Stats;
+    const char *ppUrls[1] = {URL_0_0};
+    char *pszUrl = NULL;
+    unsigned int uLength = 0;
+    int iEventFd = -1;
+    int iProvisional = 0;
+    int iScore = 0;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    TEST_ASSERT(TWPAsyncConfigure(hLib, &AsyncParam, &iEventFd) == TWP_SUCCESS);
+    TEST_ASSERT(TWPDeadlineConfigure(hLib, &Param) == TWP_SUCCESS);
+    /* the server cannot answer within a millisecond, the verdict is given */
+    TEST_ASSERT(TWPLookupUrlsWithin(hLib, hCfg, (TWPRequest *) &Request,
+                                    ppUrls, ELEMENT_NUM(ppUrls), 1, &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseGetUrlRatingByIndex(hLib, hResponse, 0, &hRating) == TWP_SUCCESS);
+    TEST_ASSERT(TWPUrlRatingGetScore(hLib, hRating, &iScore) == TWP_SUCCESS);
+    TEST_ASSERT(iScore == TWP_HighHigh);
+    TEST_ASSERT(TWPUrlRatingIsProvisional(hLib, hRating, &iProvisional) == TWP_SUCCESS);
+    TEST_ASSERT(iProvisional == 1);
+    TEST_ASSERT(TWPUrlRatingGetUrl(hLib, hRating, &pszUrl, &uLength) == TWP_SUCCESS);
+    TEST_ASSERT(pszUrl != NULL && uLength == strlen(URL_0_0) && memcmp(pszUrl, URL_0_0, uLength) == 0);
+    TEST_ASSERT(TWPResponseGetUrlRatingByUrl(hLib, hResponse, URL_0_0, strlen(URL_0_0), &hByUrl) == TWP_SUCCESS);
+    TEST_ASSERT(hByUrl == hRating);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPGetStats(hLib, &Stats) == TWP_SUCCESS);
+    TEST_ASSERT(Stats.ulDeadlines == 1);
+    TEST_ASSERT(TWPDeadlineConfigure(hLib, NULL) == TWP_SUCCESS);
+    TEST_ASSERT(TWPAsyncConfigure(hLib, NULL, NULL) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPGetStats_0003(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    AsyncResult Result = {0, TWP_SUCCESS, NULL};
+    TWPAsyncParam Param = {TWP_ASYNC_EVENTFD, 0};
+    TWPStats Stats;
+    const char *ppUrls[2] = {URL_0_0, URL_1_0};
+    struct pollfd Poll;
+    int iEventFd = -1;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    TEST_ASSERT(TWPAsyncConfigure(hLib, &Param, &iEventFd) == TWP_SUCCESS);
+    TEST_ASSERT(TWPLookupUrlsAsync(hLib, hCfg, 0, ppUrls, ELEMENT_NUM(ppUrls), AsyncDone, &Result) == TWP_SUCCESS);
+    Poll.fd = iEventFd;
+    Poll.events = POLLIN;
+    TEST_ASSERT(poll(&Poll, 1, 10000) == 1);
+    TEST_ASSERT(TWPAsyncDispatch(hLib) == TWP_SUCCESS);
+    TEST_ASSERT(Result.iDone && Result.Result == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &Result.hResponse) == TWP_SUCCESS);
+    /* counted once, and the cache was not consulted */
+    TEST_ASSERT(TWPGetStats(hLib, &Stats) == TWP_SUCCESS);
+    TEST_ASSERT(Stats.ulLookups == 1 && Stats.ulUrls == ELEMENT_NUM(ppUrls));
+    TEST_ASSERT(Stats.ulCacheHits == 0 && Stats.ulCacheMisses == 0);
+    TEST_ASSERT(Stats.ulInternalLookups == 0);
+    TEST_ASSERT(Stats.ulResults[TWP_SUCCESS] == 1 && Stats.BatchSizes.ulCount == 1);
+    TEST_ASSERT(Stats.Phases[TWP_PHASE_LOOKUP].ulCount == 1);
+    TEST_ASSERT(TWPAsyncConfigure(hLib, NULL, NULL) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPDiskCacheConfigure_0003(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPResponseHandle hResponse;
+    TWPDiskCacheParam Param = {"/tmp/twptest.cache", 0, 2};
+    TWPCacheParam CacheParam = {0, 60, 0};
+    TWPStats Stats;
+    const char *ppUrls[1] =
+    {
+        URL_0_0
+    };
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    unlink(Param.pszPath);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPDiskCacheConfigure(hLib, &Param) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                              ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+
+    /* the rating read from the file expires in memory when it does in the file */
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPCacheConfigure(hLib, &CacheParam) == TWP_SUCCESS);
+    TEST_ASSERT(TWPDiskCacheConfigure(hLib, &Param) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                              ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    sleep(3);
+    TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                              ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPGetStats(hLib, &Stats) == TWP_SUCCESS);
+    TEST_ASSERT(Stats.ulCacheHits == 1 && Stats.ulCacheMisses == 1);
+    TEST_ASSERT(TWPDiskCacheConfigure(hLib, NULL) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    unlink(Param.pszPath);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void TWPPrefetchUrls_0003(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPResponseHandle hResponse;
+    TWPCacheParam CacheParam = {0, 0, 0};
+    TWPAsyncParam AsyncParam = {0, 0};
+    TWPPrefetchParam Param = {1, 0, 1, 0};
+    TWPStats Stats;
+    const char *ppUrls[2] = {URL_0_0, URL_1_0};
+    int i;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    TEST_ASSERT(TWPCacheConfigure(hLib, &CacheParam) == TWP_SUCCESS);
+    TEST_ASSERT(TWPAsyncConfigure(hLib, &AsyncParam, NULL) == TWP_SUCCESS);
+    TEST_ASSERT(TWPPrefetchConfigure(hLib, &Param) == TWP_SUCCESS);
+    /* one lookup at a time, the second one is started by the callback of the first on the event loop */
+    TEST_ASSERT(TWPPrefetchUrls(hLib, hCfg, ppUrls, ELEMENT_NUM(ppUrls)) == TWP_SUCCESS);
+    for (i = 0; i < 1000; i++)
+    {
+        TEST_ASSERT(TWPGetStats(hLib, &Stats) == TWP_SUCCESS);
+        if (Stats.ulInternalLookups == 2 && Stats.Phases[TWP_PHASE_RECEIVE].ulCount == 2)
+            break;
+        usleep(10000);
+    }
+    TEST_ASSERT(Stats.ulInternalLookups == 2 && Stats.ulLookups == 0);
+    usleep(100000);
+    TEST_ASSERT(TWPLookupUrls(hLib, hCfg, (TWPRequest *) &Request, 0,
+                              ppUrls, ELEMENT_NUM(ppUrls), &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPGetStats(hLib, &Stats) == TWP_SUCCESS);
+    TEST_ASSERT(Stats.ulCacheHits == ELEMENT_NUM(ppUrls) && Stats.ulCacheMisses == 0);
+    TEST_ASSERT(TWPPrefetchConfigure(hLib, NULL) == TWP_SUCCESS);
+    TEST_ASSERT(TWPAsyncConfigure(hLib, NULL, NULL) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+/**
+ * Resolver the XMDns tests plug in, counting the lookups it gets.
+ */
+static int iDnsCalls = 0;
+static int iDnsDelay = 0;
+
+
+static int DnsFakeResolve(char const *pszNode, char const *pszService,
+                          struct addrinfo const *pHints, struct addrinfo **ppRes)
+{
+    int iError;
+    struct addrinfo Hints, *pV4;
+
+    __atomic_fetch_add(&iDnsCalls, 1, __ATOMIC_RELAXED);
+    usleep(iDnsDelay * 1000);
+
+    memset(&Hints, 0, sizeof(Hints));
+    Hints.ai_socktype = SOCK_STREAM;
+    Hints.ai_flags = AI_NUMERICHOST;
+    if (strcmp(pszNode, "v4.test") == 0)
+        return getaddrinfo("127.0.0.1", pszService, &Hints, ppRes);
+    if (strcmp(pszNode, "dual.test") != 0)
+        return EAI_NONAME;
+
+    /* ::1 first, then 127.0.0.1: glibc frees the chained lists node by node. */
+    if ((iError = getaddrinfo("::1", pszService, &Hints, ppRes)) != 0)
+        return iError;
+    if ((iError = getaddrinfo("127.0.0.1", pszService, &Hints, &pV4)) != 0)
+    {
+        freeaddrinfo(*ppRes);
+        return iError;
+    }
+    (*ppRes)->ai_next = pV4;
+
+    return 0;
+}
+
+
+static void *DnsResolveThread(void *pArg)
+{
+    XmDnsAddr Addrs[XM_DNS_MAX_ADDRS];
+
+    *(int *) pArg = XmDnsResolve("v4.test", 80, Addrs, XM_DNS_MAX_ADDRS);
+
+    return NULL;
+}
+
+
+/**
+ * Request body and reply of the XmHttpExec() and XmHttpMulti tests.
+ */
+typedef struct HttpBody_struct
+{
+    char const *pData;      /* NULL to send from iFd at lOffset instead */
+    long lSize;
+    long lRead;
+    char szReply[64];
+    int iReply;
+    int iFd;
+    long lOffset;
+    int iResult;            /* XmHttpMultiDone result and status */
+    int iStatus;
+} HttpBody;
+
+
+static int HttpBodyWrite(void *pPrivate, void const *pData, int iSize)
+{
+    HttpBody *pBody = (HttpBody *) pPrivate;
+    int iCopy = iSize < (int) sizeof(pBody->szReply) - 1 - pBody->iReply ?
+                iSize: (int) sizeof(pBody->szReply) - 1 - pBody->iReply;
+
+    memcpy(pBody->szReply + pBody->iReply, pData, iCopy);
+    pBody->iReply += iCopy;
+    pBody->szReply[pBody->iReply] = '\0';
+
+    return iSize;
+}
+
+
+static int HttpBodyRead(void *pPrivate, void *pData, int iSize)
+{
+    HttpBody *pBody = (HttpBody *) pPrivate;
+    int iCopy = iSize < pBody->lSize - pBody->lRead ? iSize: (int) (pBody->lSize - pBody->lRead);
+
+    memcpy(pData, pBody->pData + pBody->lRead, iCopy);
+    pBody->lRead += iCopy;
+
+    return iCopy;
+}
+
+
+static long HttpBodyGetSize(void *pPrivate)
+{
+
+    return ((HttpBody *) pPrivate)->lSize - ((HttpBody *) pPrivate)->lRead;
+}
+
+
+static int HttpBodyGetFd(void *pPrivate, long *plOffset)
+{
+    HttpBody *pBody = (HttpBody *) pPrivate;
+
+    *plOffset = pBody->lOffset;
+
+    return pBody->iFd;
+}
+
+
+static void HttpBodyInit(HttpBody *pBody, char const *pData, long lSize)
+{
+
+    memset(pBody, 0, sizeof(*pBody));
+    pBody->pData = pData;
+    pBody->lSize = lSize;
+    pBody->iFd = -1;
+}
+
+
+static void HttpBodyCallbacks(HttpBody *pBody, XmHttpCallbacks *pHttpCb)
+{
+
+    memset(pHttpCb, 0, sizeof(*pHttpCb));
+    pHttpCb->pfWrite = HttpBodyWrite;
+    pHttpCb->pfRead = HttpBodyRead;
+    pHttpCb->pfGetSize = HttpBodyGetSize;
+    if (pBody->pData == NULL)
+        pHttpCb->pfGetFd = HttpBodyGetFd;
+    pBody->lRead = 0;
+    pBody->iReply = 0;
+    pBody->szReply[0] = '\0';
+}
+
+
+static int HttpBodyExec(XM_HTTP_HANDLE hHttp, char const *pszUrl, HttpBody *pBody)
+{
+    XmHttpCallbacks HttpCb;
+
+    HttpBodyCallbacks(pBody, &HttpCb);
+
+    return XmHttpExec(hHttp, "POST", pszUrl, &HttpCb, pBody);
+}
+
+
+static int HttpBodyAdd(XM_HTTP_MULTI_HANDLE hMulti, char const *pszUrl, int iTimeout,
+                       HttpBody *pBody)
+{
+    XmHttpCallbacks HttpCb;
+
+    HttpBodyCallbacks(pBody, &HttpCb);
+    pBody->iResult = 1;
+    pBody->iStatus = 0;
+
+    return XmHttpMultiAdd(hMulti, "POST", pszUrl, iTimeout, &HttpCb, pBody);
+}
+
+
+/**
+ * Runs one perform loop until every request finished, returns their number.
+ */
+static int HttpMultiDrive(XM_HTTP_MULTI_HANDLE hMulti)
+{
+    int iRunning, iDone = 0;
+    XmHttpMultiDone Done;
+
+    do
+    {
+        if (XmHttpMultiPerform(hMulti, 1000, &iRunning) != 0)
+            return -1;
+        while (XmHttpMultiInfoRead(hMulti, &Done))
+        {
+            ((HttpBody *) Done.pPrivate)->iResult = Done.iResult;
+            ((HttpBody *) Done.pPrivate)->iStatus = Done.iStatus;
+            iDone++;
+        }
+    } while (iRunning > 0);
+
+    return iDone;
+}
+
+
+static long long HttpMultiNow(void)
+{
+    struct timespec TS;
+
+    clock_gettime(CLOCK_MONOTONIC, &TS);
+
+    return (long long) TS.tv_sec * 1000 + TS.tv_nsec / 1000000;
+}
+
+
+static void XmDnsResolve_0001(void)
+{
+    TestCase TestCtx;
+    XmDnsAddr Addrs[XM_DNS_MAX_ADDRS];
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    XmDnsFlush();
+    XmDnsSetup(-1, -1, DnsFakeResolve);
+    iDnsCalls = 0;
+    /* every address is returned, in order, with the port set */
+    TEST_ASSERT(XmDnsResolve("dual.test", 8080, Addrs, XM_DNS_MAX_ADDRS) == 2);
+    TEST_ASSERT(Addrs[0].Addr.ss_family == AF_INET6 && Addrs[1].Addr.ss_family == AF_INET);
+    TEST_ASSERT(ntohs(((struct sockaddr_in6 *) &Addrs[0].Addr)->sin6_port) == 8080);
+    TEST_ASSERT(ntohs(((struct sockaddr_in *) &Addrs[1].Addr)->sin_port) == 8080);
+    /* the second lookup is a hit, even with another port or case */
+    TEST_ASSERT(XmDnsResolve("DUAL.test", 443, Addrs, 1) == 1);
+    TEST_ASSERT(Addrs[0].Addr.ss_family == AF_INET6);
+    TEST_ASSERT(ntohs(((struct sockaddr_in6 *) &Addrs[0].Addr)->sin6_port) == 443);
+    TEST_ASSERT(iDnsCalls == 1);
+    XmDnsFlush();
+    TEST_ASSERT(XmDnsResolve("dual.test", 8080, Addrs, XM_DNS_MAX_ADDRS) == 2);
+    TEST_ASSERT(iDnsCalls == 2);
+    XmDnsFlush();
+    XmDnsSetup(-1, -1, NULL);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void XmDnsResolve_0002(void)
+{
+    TestCase TestCtx;
+    XmDnsAddr Addrs[XM_DNS_MAX_ADDRS];
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    XmDnsFlush();
+    XmDnsSetup(-1, 1, DnsFakeResolve);
+    iDnsCalls = 0;
+    /* failures are cached for the negative TTL */
+    TEST_ASSERT(XmDnsResolve("unknown.test", 80, Addrs, XM_DNS_MAX_ADDRS) < 0);
+    TEST_ASSERT(XmDnsResolve("unknown.test", 80, Addrs, XM_DNS_MAX_ADDRS) < 0);
+    TEST_ASSERT(iDnsCalls == 1);
+    sleep(2);
+    TEST_ASSERT(XmDnsResolve("unknown.test", 80, Addrs, XM_DNS_MAX_ADDRS) < 0);
+    TEST_ASSERT(iDnsCalls == 2);
+    XmDnsFlush();
+    XmDnsSetup(-1, -1, NULL);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void XmDnsResolve_0003(void)
+{
+    TestCase TestCtx;
+    pthread_t Threads[4];
+    int i, piAddrs[ELEMENT_NUM(Threads)];
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    XmDnsFlush();
+    XmDnsSetup(-1, -1, DnsFakeResolve);
+    iDnsCalls = 0;
+    iDnsDelay = 200;
+    /* concurrent lookups of a name wait for the one in flight */
+    for (i = 0; i < (int) ELEMENT_NUM(Threads); i++)
+        TEST_ASSERT(pthread_create(&Threads[i], NULL, DnsResolveThread, &piAddrs[i]) == 0);
+    for (i = 0; i < (int) ELEMENT_NUM(Threads); i++)
+        pthread_join(Threads[i], NULL);
+    iDnsDelay = 0;
+    for (i = 0; i < (int) ELEMENT_NUM(Threads); i++)
+        TEST_ASSERT(piAddrs[i] == 1);
+    TEST_ASSERT(iDnsCalls == 1);
+    XmDnsFlush();
+    XmDnsSetup(-1, -1, NULL);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void XmHttpExec_0001(void)
+{
+    TestCase TestCtx;
+    TestServer Server;
+    XM_HTTP_HANDLE hHttp;
+    HttpBody Body;
+    char szUrl[64];
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    HttpBodyInit(&Body, "ping", 4);
+    XmDnsFlush();
+    XmDnsSetup(-1, -1, DnsFakeResolve);
+    /* nothing listens on ::1, the connection falls back to 127.0.0.1 */
+    TEST_ASSERT(TestServerStart(&Server, AF_INET) == 0);
+    TEST_ASSERT((hHttp = XmHttpOpen()) != INVALID_XM_HTTP_HANDLE);
+    snprintf(szUrl, sizeof(szUrl), "http://dual.test:%d/", Server.iPort);
+    TEST_ASSERT(HttpBodyExec(hHttp, szUrl, &Body) == 0);
+    TEST_ASSERT(strcmp(Body.szReply, "OK") == 0);
+    TEST_ASSERT(Server.iRequests == 1 && Server.lBodyBytes == 4);
+    TEST_ASSERT(strstr(Server.szHead, "\r\nHost: dual.test\r\n") != NULL);
+    XmHttpClose(hHttp);
+    TestServerStop(&Server);
+    XmDnsFlush();
+    XmDnsSetup(-1, -1, NULL);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void XmHttpExec_0002(void)
+{
+    TestCase TestCtx;
+    TestServer Server;
+    XM_HTTP_HANDLE hHttp;
+    HttpBody Body;
+    char szUrl[64];
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    HttpBodyInit(&Body, "ping", 4);
+    /* IPv6 literals keep their brackets in the Host header */
+    TEST_ASSERT(TestServerStart(&Server, AF_INET6) == 0);
+    TEST_ASSERT((hHttp = XmHttpOpen()) != INVALID_XM_HTTP_HANDLE);
+    snprintf(szUrl, sizeof(szUrl), "http://[::1]:%d/", Server.iPort);
+    TEST_ASSERT(HttpBodyExec(hHttp, szUrl, &Body) == 0);
+    TEST_ASSERT(strcmp(Body.szReply, "OK") == 0);
+    TEST_ASSERT(strstr(Server.szHead, "\r\nHost: [::1]\r\n") != NULL);
+    XmHttpClose(hHttp);
+    TestServerStop(&Server);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void XmHttpExec_0003(void)
+{
+    TestCase TestCtx;
+    TestServer Server;
+    XM_HTTP_HANDLE hHttp;
+    HttpBody Body;
+    char szUrl[64];
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    HttpBodyInit(&Body, "ping", 4);
+    /* the second request goes over the pooled connection */
+    TEST_ASSERT(TestServerStart(&Server, AF_INET) == 0);
+    TEST_ASSERT((hHttp = XmHttpOpen()) != INVALID_XM_HTTP_HANDLE);
+    snprintf(szUrl, sizeof(szUrl), "http://127.0.0.1:%d/", Server.iPort);
+    TEST_ASSERT(HttpBodyExec(hHttp, szUrl, &Body) == 0);
+    TEST_ASSERT(strstr(Server.szHead, "\r\nConnection: keep-alive\r\n") != NULL);
+    TEST_ASSERT(HttpBodyExec(hHttp, szUrl, &Body) == 0);
+    TEST_ASSERT(strcmp(Body.szReply, "OK") == 0);
+    TEST_ASSERT(Server.iAccepts == 1 && Server.iRequests == 2);
+    XmHttpClose(hHttp);
+    TestServerStop(&Server);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void XmHttpExec_0004(void)
+{
+    TestCase TestCtx;
+    TestServer Server;
+    XM_HTTP_HANDLE hHttp;
+    HttpBody Body;
+    char szUrl[64];
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    HttpBodyInit(&Body, "ping", 4);
+    TEST_ASSERT(TestServerStart(&Server, AF_INET) == 0);
+    TEST_ASSERT((hHttp = XmHttpOpen()) != INVALID_XM_HTTP_HANDLE);
+    snprintf(szUrl, sizeof(szUrl), "http://127.0.0.1:%d/", Server.iPort);
+    TEST_ASSERT(HttpBodyExec(hHttp, szUrl, &Body) == 0);
+    /* the server drops the pooled connection: the request is replayed on a new one */
+    Server.iDrop = 1;
+    TEST_ASSERT(HttpBodyExec(hHttp, szUrl, &Body) == 0);
+    TEST_ASSERT(strcmp(Body.szReply, "OK") == 0);
+    TEST_ASSERT(Server.iAccepts == 2 && Server.iRequests == 3);
+    TEST_ASSERT(Server.lBodyBytes == 12);
+    /* but only once */
+    Server.iDrop = 2;
+    TEST_ASSERT(HttpBodyExec(hHttp, szUrl, &Body) != 0);
+    TEST_ASSERT(Server.iAccepts == 3 && Server.iRequests == 5);
+    /* and a new connection the server drops is not retried */
+    Server.iDrop = 1;
+    TEST_ASSERT(HttpBodyExec(hHttp, szUrl, &Body) != 0);
+    TEST_ASSERT(Server.iAccepts == 4 && Server.iRequests == 6);
+    TEST_ASSERT(HttpBodyExec(hHttp, szUrl, &Body) == 0);
+    TEST_ASSERT(Server.iAccepts == 5 && Server.iRequests == 7);
+    XmHttpClose(hHttp);
+    TestServerStop(&Server);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void XmHttpExec_0005(void)
+{
+    TestCase TestCtx;
+    TestServer Server;
+    XM_HTTP_HANDLE hHttp;
+    HttpBody Body;
+    char szUrl[64];
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    HttpBodyInit(&Body, "ping", 4);
+    TEST_ASSERT(TestServerStart(&Server, AF_INET) == 0);
+    snprintf(szUrl, sizeof(szUrl), "http://127.0.0.1:%d/", Server.iPort);
+    /* a pool size of zero closes every connection */
+    setenv("XM_HTTP_POOL_SIZE", "0", 1);
+    hHttp = XmHttpOpen();
+    unsetenv("XM_HTTP_POOL_SIZE");
+    TEST_ASSERT(hHttp != INVALID_XM_HTTP_HANDLE);
+    TEST_ASSERT(HttpBodyExec(hHttp, szUrl, &Body) == 0);
+    TEST_ASSERT(strstr(Server.szHead, "\r\nConnection: close\r\n") != NULL);
+    TEST_ASSERT(HttpBodyExec(hHttp, szUrl, &Body) == 0);
+    TEST_ASSERT(Server.iAccepts == 2 && Server.iRequests == 2);
+    XmHttpClose(hHttp);
+    /* idle connections expire */
+    setenv("XM_HTTP_IDLE_TIMEO", "1", 1);
+    hHttp = XmHttpOpen();
+    unsetenv("XM_HTTP_IDLE_TIMEO");
+    TEST_ASSERT(hHttp != INVALID_XM_HTTP_HANDLE);
+    TEST_ASSERT(HttpBodyExec(hHttp, szUrl, &Body) == 0);
+    TEST_ASSERT(HttpBodyExec(hHttp, szUrl, &Body) == 0);
+    TEST_ASSERT(Server.iAccepts == 3 && Server.iRequests == 4);
+    sleep(2);
+    TEST_ASSERT(HttpBodyExec(hHttp, szUrl, &Body) == 0);
+    TEST_ASSERT(Server.iAccepts == 4 && Server.iRequests == 5);
+    XmHttpClose(hHttp);
+    TestServerStop(&Server);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void XmHttpExec_0006(void)
+{
+    TestCase TestCtx;
+    TestServer Server;
+    XM_HTTP_HANDLE hHttp;
+    HttpBody Body;
+    char szUrl[64];
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    HttpBodyInit(&Body, "ping", 4);
+    /* head and body leave in a single send, so the first read gets all of them */
+    TEST_ASSERT(TestServerStart(&Server, AF_INET) == 0);
+    TEST_ASSERT((hHttp = XmHttpOpen()) != INVALID_XM_HTTP_HANDLE);
+    snprintf(szUrl, sizeof(szUrl), "http://127.0.0.1:%d/", Server.iPort);
+    TEST_ASSERT(HttpBodyExec(hHttp, szUrl, &Body) == 0);
+    TEST_ASSERT(strncmp(Server.szHead, "POST / HTTP/1.1\r\nHost: 127.0.0.1\r\n", 34) == 0);
+    TEST_ASSERT(strstr(Server.szHead, "\r\nContent-Length: 4\r\n\r\n") != NULL);
+    TEST_ASSERT(Server.iFirstRead == (int) strlen(Server.szHead) + 4);
+    TEST_ASSERT(Server.ulBodySum == TestServerSum(0, "ping", 4));
+    /* the same with the cached head over the pooled connection */
+    TEST_ASSERT(HttpBodyExec(hHttp, szUrl, &Body) == 0);
+    TEST_ASSERT(Server.iFirstRead == (int) strlen(Server.szHead) + 4);
+    TEST_ASSERT(Server.iAccepts == 1 && Server.iRequests == 2);
+    XmHttpClose(hHttp);
+    TestServerStop(&Server);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void XmHttpExec_0007(void)
+{
+    TestCase TestCtx;
+    TestServer Server;
+    XM_HTTP_HANDLE hHttp;
+    HttpBody Body;
+    char szUrl[64], *pData;
+    long i;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    HttpBodyInit(&Body, NULL, 16 * 1024 * 1024);
+    TEST_ASSERT((pData = (char *) malloc(Body.lSize)) != NULL);
+    for (i = 0; i < Body.lSize; i++)
+        pData[i] = (char) (i % 251);
+    Body.pData = pData;
+    /*
+     * The server stalls past the 1s send timeout, so the body goes out in
+     * several short writes that must pick up where the last one stopped.
+     */
+    TEST_ASSERT(TestServerStart(&Server, AF_INET) == 0);
+    Server.iReadDelay = 1500;
+    TEST_ASSERT((hHttp = XmHttpOpen()) != INVALID_XM_HTTP_HANDLE);
+    snprintf(szUrl, sizeof(szUrl), "http://127.0.0.1:%d/", Server.iPort);
+    setenv("XM_NET_SENDTIMEO", "1", 1);
+    i = HttpBodyExec(hHttp, szUrl, &Body);
+    unsetenv("XM_NET_SENDTIMEO");
+    TEST_ASSERT(i == 0);
+    TEST_ASSERT(strcmp(Body.szReply, "OK") == 0);
+    TEST_ASSERT(Server.lBodyBytes == Body.lSize);
+    TEST_ASSERT(Server.ulBodySum == TestServerSum(0, pData, (int) Body.lSize));
+    XmHttpClose(hHttp);
+    TestServerStop(&Server);
+    free(pData);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void XmHttpExec_0008(void)
+{
+    TestCase TestCtx;
+    TestServer Server;
+    XM_HTTP_HANDLE hHttp;
+    HttpBody Body;
+    char szUrl[64], szPath[] = "/tmp/twpbodyXXXXXX", Data[100 + 65536];
+    int i, iFd;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    HttpBodyInit(&Body, NULL, 65536);
+    for (i = 0; i < (int) sizeof(Data); i++)
+        Data[i] = (char) (i % 251);
+    TEST_ASSERT((iFd = mkstemp(szPath)) >= 0);
+    unlink(szPath);
+    TEST_ASSERT(write(iFd, Data, sizeof(Data)) == sizeof(Data));
+    /* the body is sent from the file, starting at the offset pfGetFd returns */
+    Body.iFd = iFd;
+    Body.lOffset = 100;
+    TEST_ASSERT(TestServerStart(&Server, AF_INET) == 0);
+    TEST_ASSERT((hHttp = XmHttpOpen()) != INVALID_XM_HTTP_HANDLE);
+    snprintf(szUrl, sizeof(szUrl), "http://127.0.0.1:%d/", Server.iPort);
+    TEST_ASSERT(HttpBodyExec(hHttp, szUrl, &Body) == 0);
+    TEST_ASSERT(strcmp(Body.szReply, "OK") == 0);
+    TEST_ASSERT(strstr(Server.szHead, "\r\nContent-Length: 65536\r\n\r\n") != NULL);
+    TEST_ASSERT(Server.lBodyBytes == 65536);
+    TEST_ASSERT(Server.ulBodySum == TestServerSum(0, Data + 100, 65536));
+    /* and sent again from the same offset when a dead pooled connection is retried */
+    Server.iDrop = 1;
+    TEST_ASSERT(HttpBodyExec(hHttp, szUrl, &Body) == 0);
+    TEST_ASSERT(Server.iRequests == 3 && Server.lBodyBytes == 3 * 65536);
+    TEST_ASSERT(Server.ulBodySum == TestServerSum(0, Data + 100, 65536));
+    XmHttpClose(hHttp);
+    TestServerStop(&Server);
+    close(iFd);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void XmHttpMulti_0001(void)
+{
+    TestCase TestCtx;
+    TestServer Server;
+    XM_HTTP_MULTI_HANDLE hMulti;
+    HttpBody Bodies[64];
+    char szUrl[64], szDualUrl[64];
+    long long llStart;
+    int i, iOk = 0;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    XmDnsFlush();
+    XmDnsSetup(-1, -1, DnsFakeResolve);
+    TEST_ASSERT(TestServerStart(&Server, AF_INET) == 0);
+    /* every request stalls 200ms, run one after the other they would take 12.8s */
+    Server.iReadDelay = 200;
+    TEST_ASSERT((hMulti = XmHttpMultiOpen()) != INVALID_XM_HTTP_MULTI_HANDLE);
+    snprintf(szUrl, sizeof(szUrl), "http://v4.test:%d/", Server.iPort);
+    snprintf(szDualUrl, sizeof(szDualUrl), "http://dual.test:%d/", Server.iPort);
+    llStart = HttpMultiNow();
+    for (i = 0; i < (int) ELEMENT_NUM(Bodies); i++)
+    {
+        HttpBodyInit(&Bodies[i], "ping", 4);
+        /* nothing listens on ::1, half of the requests fall back to 127.0.0.1 */
+        TEST_ASSERT(HttpBodyAdd(hMulti, i % 2 ? szDualUrl: szUrl, 10000, &Bodies[i]) == 0);
+    }
+    TEST_ASSERT(HttpMultiDrive(hMulti) == ELEMENT_NUM(Bodies));
+    TEST_ASSERT(HttpMultiNow() - llStart < 5000);
+    /* the replies came back through the pfWrite callback of each request */
+    for (i = 0; i < (int) ELEMENT_NUM(Bodies); i++)
+        iOk += Bodies[i].iResult == 0 && Bodies[i].iStatus == 200 &&
+               strcmp(Bodies[i].szReply, "OK") == 0 && Bodies[i].lRead == 4;
+    TEST_ASSERT(iOk == ELEMENT_NUM(Bodies));
+    TEST_ASSERT(Server.iRequests == ELEMENT_NUM(Bodies));
+    TEST_ASSERT(Server.lBodyBytes == 4 * ELEMENT_NUM(Bodies));
+    TEST_ASSERT(Server.iPeakConns > 1);
+    TEST_ASSERT(strstr(Server.szHead, "\r\nConnection: close\r\n") != NULL);
+    XmHttpMultiClose(hMulti);
+    TestServerStop(&Server);
+    XmDnsFlush();
+    XmDnsSetup(-1, -1, NULL);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void XmHttpMulti_0002(void)
+{
+    TestCase TestCtx;
+    TestServer Server, SlowServer;
+    XM_HTTP_MULTI_HANDLE hMulti;
+    HttpBody Bodies[8], SlowBody;
+    char szUrl[64];
+    long long llStart, llTime;
+    int i, iOk = 0;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT(TestServerStart(&Server, AF_INET) == 0);
+    TEST_ASSERT(TestServerStart(&SlowServer, AF_INET) == 0);
+    SlowServer.iReadDelay = 1000;
+    TEST_ASSERT((hMulti = XmHttpMultiOpen()) != INVALID_XM_HTTP_MULTI_HANDLE);
+    llStart = HttpMultiNow();
+    /* the request to the slow server passes its own 200ms deadline */
+    HttpBodyInit(&SlowBody, "ping", 4);
+    snprintf(szUrl, sizeof(szUrl), "http://127.0.0.1:%d/", SlowServer.iPort);
+    TEST_ASSERT(HttpBodyAdd(hMulti, szUrl, 200, &SlowBody) == 0);
+    snprintf(szUrl, sizeof(szUrl), "http://127.0.0.1:%d/", Server.iPort);
+    for (i = 0; i < (int) ELEMENT_NUM(Bodies); i++)
+    {
+        HttpBodyInit(&Bodies[i], "ping", 4);
+        TEST_ASSERT(HttpBodyAdd(hMulti, szUrl, 10000, &Bodies[i]) == 0);
+    }
+    TEST_ASSERT(HttpMultiDrive(hMulti) == ELEMENT_NUM(Bodies) + 1);
+    llTime = HttpMultiNow() - llStart;
+    TEST_ASSERT(llTime >= 190 && llTime < 1000);
+    TEST_ASSERT(SlowBody.iResult == -XME_HTTP_TIMEOUT && SlowBody.iStatus == 0);
+    TEST_ASSERT(SlowBody.szReply[0] == '\0');
+    /* and does not hold the others back */
+    for (i = 0; i < (int) ELEMENT_NUM(Bodies); i++)
+        iOk += Bodies[i].iResult == 0 && strcmp(Bodies[i].szReply, "OK") == 0;
+    TEST_ASSERT(iOk == ELEMENT_NUM(Bodies));
+    TEST_ASSERT(Server.iRequests == ELEMENT_NUM(Bodies));
+    XmHttpMultiClose(hMulti);
+    TestServerStop(&Server);
+    TestServerStop(&SlowServer);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
+static void XmHttpMulti_0003(void)
+{
+    TestCase TestCtx;
+    TestServer Server;
+    XM_HTTP_MULTI_HANDLE hMulti;
+    HttpBody Body, ExpiredBody, UnknownBody;
+    char szUrl[64];
+    long long llStart;
+    int iRunning;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    XmDnsFlush();
+    XmDnsSetup(-1, -1, DnsFakeResolve);
+    iDnsCalls = 0;
+    iDnsDelay = 300;
+    TEST_ASSERT(TestServerStart(&Server, AF_INET) == 0);
+    TEST_ASSERT((hMulti = XmHttpMultiOpen()) != INVALID_XM_HTTP_MULTI_HANDLE);
+    HttpBodyInit(&Body, "ping", 4);
+    HttpBodyInit(&ExpiredBody, "ping", 4);
+    HttpBodyInit(&UnknownBody, "ping", 4);
+    /* names are resolved on the resolver thread: neither adding nor performing waits for them */
+    llStart = HttpMultiNow();
+    snprintf(szUrl, sizeof(szUrl), "http://v4.test:%d/", Server.iPort);
+    TEST_ASSERT(HttpBodyAdd(hMulti, szUrl, 10000, &Body) == 0);
+    snprintf(szUrl, sizeof(szUrl), "http://expired.test:%d/", Server.iPort);
+    TEST_ASSERT(HttpBodyAdd(hMulti, szUrl, 100, &ExpiredBody) == 0);
+    snprintf(szUrl, sizeof(szUrl), "http://unknown.test:%d/", Server.iPort);
+    TEST_ASSERT(HttpBodyAdd(hMulti, szUrl, 10000, &UnknownBody) == 0);
+    TEST_ASSERT(XmHttpMultiPerform(hMulti, 0, &iRunning) == 0 && iRunning == 3);
+    TEST_ASSERT(HttpMultiNow() - llStart < 100);
+    TEST_ASSERT(HttpMultiDrive(hMulti) == 3);
+    iDnsDelay = 0;
+    TEST_ASSERT(Body.iResult == 0 && strcmp(Body.szReply, "OK") == 0);
+    TEST_ASSERT(UnknownBody.iResult == -XME_HTTP_UNKNOWN_HOST);
+    /* a request that expired while waiting for the resolver is never looked up */
+    TEST_ASSERT(ExpiredBody.iResult == -XME_HTTP_TIMEOUT);
+    TEST_ASSERT(iDnsCalls == 2);
+    TEST_ASSERT(Server.iRequests == 1);
+    /* closing the handle while a lookup is in flight waits for it */
+    iDnsDelay = 200;
+    snprintf(szUrl, sizeof(szUrl), "http://closed.test:%d/", Server.iPort);
+    TEST_ASSERT(HttpBodyAdd(hMulti, szUrl, 10000, &Body) == 0);
+    TEST_ASSERT(XmHttpMultiPerform(hMulti, 50, &iRunning) == 0 && iRunning == 1);
+    XmHttpMultiClose(hMulti);
+    iDnsDelay = 0;
+    TestServerStop(&Server);
+    XmDnsFlush();
+    XmDnsSetup(-1, -1, NULL);
+    TESTCASEDTOR(&TestCtx);
+}
+
+/**
+ * Lookup of one URL made by a coalescing test thread.
+ */
+typedef struct CoalesceCall_struct
+{
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TRequest Request;
+    const char *pszUrl;
+    TWP_RESULT Result;
+    TWPResponseHandle hResponse;
+} CoalesceCall;
+
+
+static void *CoalesceThread(void *pArg)
+{
+    CoalesceCall *pCall = (CoalesceCall *) pArg;
+
+    pCall->Result = TWPLookupUrls(pCall->hLib, pCall->hCfg, (TWPRequest *) &pCall->Request, 0,
+                                  &pCall->pszUrl, 1, &pCall->hResponse);
+
+    return NULL;
+}
+
+
+static void TWPCoalesceConfigure_0003(void)
+{
+    TestCase TestCtx;
+    TWPLIB_HANDLE hLib;
+    TWPConfigurationHandle hCfg;
+    TWPUrlRatingHandle hRating;
+    TWPCoalesceParam Param = {2000000, 2};
+    TWPStats Stats;
+    CoalesceCall Calls[2];
+    pthread_t Threads[2];
+    char *pszUrl = NULL;
+    unsigned int uLength = 0;
+    int iScore = 0;
+    int i;
+
+    TESTCASECTOR(&TestCtx, __FUNCTION__);
+    TEST_ASSERT((hLib = TWPInitLibrary(&Init)) != INVALID_TWPLIB_HANDLE);
+    TEST_ASSERT(TWPCoalesceConfigure(hLib, &Param) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationCreate(hLib, &Cfg, &hCfg) == TWP_SUCCESS);
+    /* two threads share one plug-in lookup, the batch is sent once full */
+    for (i = 0; i < 2; i++)
+    {
+        memset(&Calls[i], 0, sizeof(Calls[i]));
+        Calls[i].hLib = hLib;
+        Calls[i].hCfg = hCfg;
+        Calls[i].Request.Request = Request.Request;
+        Calls[i].pszUrl = i == 0 ? URL_0_0 : URL_1_0;
+        TEST_ASSERT(pthread_create(&Threads[i], NULL, CoalesceThread, &Calls[i]) == 0);
+    }
+    for (i = 0; i < 2; i++)
+        pthread_join(Threads[i], NULL);
+    TEST_ASSERT(Calls[0].Result == TWP_SUCCESS && Calls[1].Result == TWP_SUCCESS);
+    TEST_ASSERT(TWPGetStats(hLib, &Stats) == TWP_SUCCESS);
+    TEST_ASSERT(Stats.ulLookups == 2 && Stats.ulRequests == 1);
+    /* every caller has its own copies, which outlive the other responses */
+    TEST_ASSERT(TWPResponseDestroy(hLib, &Calls[1].hResponse) == TWP_SUCCESS);
+    TEST_ASSERT(TWPResponseGetUrlRatingByIndex(hLib, Calls[0].hResponse, 0, &hRating) == TWP_SUCCESS);
+    TEST_ASSERT(TWPUrlRatingGetScore(hLib, hRating, &iScore) == TWP_SUCCESS);
+    TEST_ASSERT(iScore == SCORE_0_0);
+    TEST_ASSERT(TWPUrlRatingGetUrl(hLib, hRating, &pszUrl, &uLength) == TWP_SUCCESS);
+    TEST_ASSERT(uLength == strlen(URL_0_0) && strncmp(pszUrl, URL_0_0, uLength) == 0);
+    TEST_ASSERT(TWPResponseDestroy(hLib, &Calls[0].hResponse) == TWP_SUCCESS);
+    for (i = 0; i < 2; i++)
+    {
+        if (Calls[i].Request.hHttp != INVALID_XM_HTTP_HANDLE)
+            XmHttpClose(Calls[i].Request.hHttp);
+        free((void *) Calls[i].Request.pszUrl);
+        free(Calls[i].Request.ResponseBody);
+    }
+    TEST_ASSERT(TWPCoalesceConfigure(hLib, NULL) == TWP_SUCCESS);
+    TEST_ASSERT(TWPConfigurationDestroy(hLib, &hCfg) == TWP_SUCCESS);
+    TWPUninitLibrary(hLib);
+    TESTCASEDTOR(&TestCtx);
+}
+
+
 static void TWPStartup(void)
 {
     extern int TestCasesCount;
@@ -34,6 +34,7 @@
 
 
 #include <setjmp.h>
+#include <pthread.h>
 
 
 #ifdef __cplusplus 
@@ -104,6 +105,28 @@ typedef struct TRequest
     size_t ResponseBytesRead;
 } TRequest;
 
+/**
+ * Local HTTP server for the transport tests
+ */
+typedef struct TestServer_struct
+{
+    int iListenFd;
+    int iPort;
+    int iDrop;              /* Requests to read and then close the connection on */
+    int iReadDelay;         /* Milliseconds to stall each request after its first read */
+    int iAccepts;
+    int iRequests;
+    long lBodyBytes;
+    int iFirstRead;         /* Bytes the first read of the last request returned */
+    unsigned long ulBodySum; /* Hash of the body of the last request */
+    char szHead[4096];      /* Head of the last request */
+    int iConns;             /* Connections being served */
+    int iPeakConns;         /* Most connections served at once */
+    pthread_t Thread;
+    pthread_mutex_t Lock;
+    pthread_cond_t Idle;
+} TestServer;
+
 
 /*
  * Very simple/thin porting layer
@@ -115,6 +138,8 @@ extern void TestCaseDtor(TestCase *pCtx);
 extern void RestoreEngine();
 extern void RemoveEngine();
 extern void BackupEngine();
+extern int InstallScopeEngine();
+extern void RemoveScopeEngine();
 
 extern TWP_RESULT CbSend(struct TWPRequest *pRequest, TWPResponseHandle hResponse,
                          const void *pData, unsigned int uLength);
@@ -125,6 +150,9 @@ extern TWP_RESULT CbSetMethod(struct TWPRequest *pRequest, TWPSubmitMethod Metho
 extern long GenerateRandomNumber();
 extern void DestoryTestDirs(void);
 extern int CreateTestDirs(void);
+extern int TestServerStart(TestServer *pServer, int iFamily);
+extern void TestServerStop(TestServer *pServer);
+extern unsigned long TestServerSum(unsigned long ulSum, char const *pData, int iSize);
 
 extern jmp_buf WPJmpBuf;
 
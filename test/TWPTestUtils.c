@@ -37,7 +37,11 @@
 #include <pthread.h>
 #include <sys/time.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include <errno.h>
+#include <limits.h>
 #include "TWPImpl.h"
 #include "XMHttp.h"
 #include "TWPTest.h"
@@ -168,6 +172,55 @@ void RemoveEngine()
 }
 
 
+/**
+ * Test framework helper function: replaces the engine with libwpscope.so from
+ * the directory of the test program, which forwards to the backed up engine
+ * and rates whole domains. Returns 0 if the plug-in was installed.
+ */
+int InstallScopeEngine()
+{
+    char *pszRoot = GetTestRoot(), *pszCommand, *pszEngine;
+    char szDir[PATH_MAX];
+    ssize_t iLen;
+    int iRet = -1;
+
+    iLen = readlink("/proc/self/exe", szDir, sizeof(szDir) - 1);
+    if (pszRoot != NULL && iLen > 0)
+    {
+        szDir[iLen] = '\0';
+        *strrchr(szDir, '/') = '\0';
+        RemoveEngine();
+
+        asprintf(&pszEngine, "%s/backup/libwpengine.so", pszRoot);
+        setenv("TWP_SCOPE_ENGINE", pszEngine, 1);
+        free(pszEngine);
+
+        asprintf(&pszCommand, "cp -f %s/libwpscope.so /opt/usr/share/sec_plugin/libwpengine.so", szDir);
+        CallSys(pszCommand);
+        free(pszCommand);
+
+        if (access("/opt/usr/share/sec_plugin/libwpengine.so", R_OK) == 0)
+            iRet = 0;
+    }
+    PutTestRoot(pszRoot);
+
+    return iRet;
+}
+
+
+/**
+ * Test framework helper function: puts back the engine replaced by
+ * InstallScopeEngine(). The plug-in file is removed first so the loaded one
+ * is never overwritten in place.
+ */
+void RemoveScopeEngine()
+{
+    CallSys("rm -f /opt/usr/share/sec_plugin/libwpengine.so");
+    RestoreEngine();
+    unsetenv("TWP_SCOPE_ENGINE");
+}
+
+
 long GenerateRandomNumber()
 {
 
@@ -251,6 +304,7 @@ static TWP_RESULT HttpSend(TRequest *pCtx, const void *pData, unsigned int uLeng
             return TWP_NOMEM;
     }
 
+    memset(&HttpCb, 0, sizeof(HttpCb));
     HttpCb.pfWrite = CbHttpWrite;
     HttpCb.pfRead = CbHttpRead;
     HttpCb.pfGetSize = CbHttpGetSize;
@@ -453,3 +507,217 @@ static void PutBackupDir(char *pszBackupDir)
         free(pszBackupDir);
 }
 
+
+static int TestServerRecv(int iFd, char *pBuffer, int iSize)
+{
+    int iRead;
+
+    while ((iRead = recv(iFd, pBuffer, iSize, 0)) < 0 && errno == EINTR)
+        ;
+
+    return iRead;
+}
+
+
+/**
+ * Test server helper function: hash of the request bodies the server got.
+ */
+unsigned long TestServerSum(unsigned long ulSum, char const *pData, int iSize)
+{
+    int i;
+
+    for (i = 0; i < iSize; i++)
+        ulSum = ulSum * 31 + (unsigned char) pData[i];
+
+    return ulSum;
+}
+
+
+/**
+ * Test server helper function: read one request, returns 0 on EOF.
+ */
+static int TestServerRequest(TestServer *pServer, int iFd)
+{
+    int iRead, iFirstRead = 0, iHead = 0;
+    long lContLen = 0, lBody;
+    unsigned long ulSum;
+    char szHead[sizeof(pServer->szHead)], szBuffer[16384], *pszEnd = NULL, *pszLen;
+
+    while (pszEnd == NULL)
+    {
+        if (iHead == sizeof(szHead) - 1 ||
+            (iRead = TestServerRecv(iFd, szHead + iHead, sizeof(szHead) - 1 - iHead)) <= 0)
+            return 0;
+        if (iHead == 0)
+        {
+            iFirstRead = iRead;
+            usleep(pServer->iReadDelay * 1000);
+        }
+        iHead += iRead;
+        szHead[iHead] = '\0';
+        pszEnd = strstr(szHead, "\r\n\r\n");
+    }
+    if ((pszLen = strstr(szHead, "\r\nContent-Length:")) != NULL && pszLen < pszEnd)
+        lContLen = atol(pszLen + 17);
+    lBody = iHead - (pszEnd + 4 - szHead);
+    ulSum = TestServerSum(0, pszEnd + 4, (int) lBody);
+    for (; lBody < lContLen; lBody += iRead)
+    {
+        if ((iRead = TestServerRecv(iFd, szBuffer, (int) MIN(sizeof(szBuffer),
+                                                             lContLen - lBody))) <= 0)
+            return 0;
+        ulSum = TestServerSum(ulSum, szBuffer, iRead);
+    }
+    pszEnd[4] = '\0';
+
+    /* connections are served concurrently, the last request wins */
+    pthread_mutex_lock(&pServer->Lock);
+    memcpy(pServer->szHead, szHead, pszEnd + 5 - szHead);
+    pServer->iFirstRead = iFirstRead;
+    pServer->ulBodySum = ulSum;
+    pServer->lBodyBytes += lBody;
+    pServer->iRequests++;
+    pthread_mutex_unlock(&pServer->Lock);
+
+    return 1;
+}
+
+
+/**
+ * Test server helper function: serve the requests of one connection.
+ */
+static void TestServerServe(TestServer *pServer, int iFd)
+{
+    int iDrop;
+    static const char szResponse[] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n"
+                                     "Connection: keep-alive\r\n\r\nOK";
+
+    while (TestServerRequest(pServer, iFd))
+    {
+        /* a dropped request looks like a pooled connection the server timed out */
+        iDrop = __atomic_load_n(&pServer->iDrop, __ATOMIC_RELAXED);
+        if (iDrop > 0)
+        {
+            __atomic_fetch_sub(&pServer->iDrop, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        if (send(iFd, szResponse, sizeof(szResponse) - 1, MSG_NOSIGNAL) < 0)
+            break;
+    }
+    close(iFd);
+}
+
+
+typedef struct TestServerConn_struct
+{
+    TestServer *pServer;
+    int iFd;
+} TestServerConn;
+
+
+static void *TestServerConnRun(void *pArg)
+{
+    TestServerConn *pConn = (TestServerConn *) pArg;
+    TestServer *pServer = pConn->pServer;
+
+    TestServerServe(pServer, pConn->iFd);
+    free(pConn);
+    pthread_mutex_lock(&pServer->Lock);
+    if (--pServer->iConns == 0)
+        pthread_cond_signal(&pServer->Idle);
+    pthread_mutex_unlock(&pServer->Lock);
+
+    return NULL;
+}
+
+
+static void *TestServerRun(void *pArg)
+{
+    TestServer *pServer = (TestServer *) pArg;
+    TestServerConn *pConn;
+    pthread_t Thread;
+    pthread_attr_t Attr;
+    int iFd;
+
+    pthread_attr_init(&Attr);
+    pthread_attr_setdetachstate(&Attr, PTHREAD_CREATE_DETACHED);
+    while ((iFd = accept(pServer->iListenFd, NULL, NULL)) >= 0)
+    {
+        __atomic_fetch_add(&pServer->iAccepts, 1, __ATOMIC_RELAXED);
+        /* each connection gets its own thread, so clients can hold several at once */
+        if ((pConn = (TestServerConn *) malloc(sizeof(TestServerConn))) == NULL)
+        {
+            TestServerServe(pServer, iFd);
+            continue;
+        }
+        pConn->pServer = pServer;
+        pConn->iFd = iFd;
+        pthread_mutex_lock(&pServer->Lock);
+        if (++pServer->iConns > pServer->iPeakConns)
+            pServer->iPeakConns = pServer->iConns;
+        pthread_mutex_unlock(&pServer->Lock);
+        if (pthread_create(&Thread, &Attr, TestServerConnRun, pConn) != 0)
+            TestServerConnRun(pConn);
+    }
+    pthread_attr_destroy(&Attr);
+
+    return NULL;
+}
+
+
+/**
+ * Test server helper function: start a keep-alive HTTP server on the loopback
+ * address of the given family. The port is returned in pServer->iPort.
+ */
+int TestServerStart(TestServer *pServer, int iFamily)
+{
+    struct sockaddr_storage Addr;
+    socklen_t AddrLen = sizeof(Addr);
+
+    memset(pServer, 0, sizeof(*pServer));
+    memset(&Addr, 0, sizeof(Addr));
+    Addr.ss_family = iFamily;
+    if (iFamily == AF_INET6)
+        ((struct sockaddr_in6 *) &Addr)->sin6_addr = in6addr_loopback;
+    else
+        ((struct sockaddr_in *) &Addr)->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if ((pServer->iListenFd = socket(iFamily, SOCK_STREAM, 0)) < 0)
+        return -1;
+    pthread_mutex_init(&pServer->Lock, NULL);
+    pthread_cond_init(&pServer->Idle, NULL);
+    if (bind(pServer->iListenFd, (struct sockaddr *) &Addr, iFamily == AF_INET6 ?
+             sizeof(struct sockaddr_in6): sizeof(struct sockaddr_in)) != 0 ||
+        listen(pServer->iListenFd, SOMAXCONN) != 0 ||
+        getsockname(pServer->iListenFd, (struct sockaddr *) &Addr, &AddrLen) != 0 ||
+        pthread_create(&pServer->Thread, NULL, TestServerRun, pServer) != 0)
+    {
+        close(pServer->iListenFd);
+        pthread_cond_destroy(&pServer->Idle);
+        pthread_mutex_destroy(&pServer->Lock);
+        return -1;
+    }
+    pServer->iPort = ntohs(iFamily == AF_INET6 ? ((struct sockaddr_in6 *) &Addr)->sin6_port:
+                           ((struct sockaddr_in *) &Addr)->sin_port);
+
+    return 0;
+}
+
+
+/**
+ * Test server helper function: stop the server. The clients must have closed
+ * their connections first; this waits for the connection threads to end.
+ */
+void TestServerStop(TestServer *pServer)
+{
+
+    shutdown(pServer->iListenFd, SHUT_RDWR);
+    pthread_join(pServer->Thread, NULL);
+    close(pServer->iListenFd);
+    pthread_mutex_lock(&pServer->Lock);
+    while (pServer->iConns > 0)
+        pthread_cond_wait(&pServer->Idle, &pServer->Lock);
+    pthread_mutex_unlock(&pServer->Lock);
+    pthread_cond_destroy(&pServer->Idle);
+    pthread_mutex_destroy(&pServer->Lock);
+}
@@ -0,0 +1,210 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+
+#include "XMDns.h"
+
+#define XM_DNS_TTL "XM_DNS_TTL"
+#define XM_DNS_NEGTTL "XM_DNS_NEGTTL"
+
+#define DNS_STD_TTL 60
+#define DNS_STD_NEGTTL 5
+
+
+typedef struct XmDnsEntry_struct XmDnsEntry;
+
+struct XmDnsEntry_struct
+{
+    XmDnsEntry *pNext;
+    int iResolving;
+    int iWaiters;
+    int iError;
+    time_t Expires;
+    int iAddrs;
+    XmDnsAddr Addrs[XM_DNS_MAX_ADDRS];
+    char szHost[1];
+};
+
+
+static pthread_mutex_t DnsLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t DnsCond = PTHREAD_COND_INITIALIZER;
+static pthread_once_t DnsOnce = PTHREAD_ONCE_INIT;
+static XmDnsEntry *pDnsCache = NULL;
+static int iDnsTtl, iDnsNegTtl;
+static XmDnsGetAddrInfo pfDnsGetAddrInfo = getaddrinfo;
+
+
+static int XmDnsGetIntEnv(char const *pszVar, int iDefault)
+{
+    char const *pszValue;
+
+    return (pszValue = getenv(pszVar)) != NULL ? atoi(pszValue): iDefault;
+}
+
+static void XmDnsInit()
+{
+    iDnsTtl = XmDnsGetIntEnv(XM_DNS_TTL, DNS_STD_TTL);
+    iDnsNegTtl = XmDnsGetIntEnv(XM_DNS_NEGTTL, DNS_STD_NEGTTL);
+}
+
+static void XmDnsPrune(time_t Now, int iAll)
+{
+    XmDnsEntry *pEntry, **ppPrev;
+
+    for (ppPrev = &pDnsCache; (pEntry = *ppPrev) != NULL;)
+        if (!pEntry->iResolving && pEntry->iWaiters == 0 && (iAll || pEntry->Expires <= Now))
+        {
+            *ppPrev = pEntry->pNext;
+            free(pEntry);
+        }
+        else
+            ppPrev = &pEntry->pNext;
+}
+
+static void XmDnsLookup(XmDnsEntry *pEntry, XmDnsGetAddrInfo pfGetAddrInfo)
+{
+    struct addrinfo Hints, *pAI, *pCur;
+
+    memset(&Hints, 0, sizeof(Hints));
+    Hints.ai_family = AF_UNSPEC;
+    Hints.ai_socktype = SOCK_STREAM;
+    /* AI_ADDRCONFIG would reject IPv6 literals such as ::1 on IPv4-only hosts. */
+    Hints.ai_flags = strchr(pEntry->szHost, ':') != NULL ? AI_NUMERICHOST: AI_ADDRCONFIG;
+
+    pEntry->iAddrs = 0;
+    if ((pEntry->iError = (*pfGetAddrInfo)(pEntry->szHost, NULL, &Hints, &pAI)) != 0)
+        return;
+    /* getaddrinfo() already sorts the answers by preference. */
+    for (pCur = pAI; pCur != NULL && pEntry->iAddrs < XM_DNS_MAX_ADDRS; pCur = pCur->ai_next)
+    {
+        if (pCur->ai_addrlen > sizeof(pEntry->Addrs[0].Addr))
+            continue;
+        memcpy(&pEntry->Addrs[pEntry->iAddrs].Addr, pCur->ai_addr, pCur->ai_addrlen);
+        pEntry->Addrs[pEntry->iAddrs++].AddrLen = pCur->ai_addrlen;
+    }
+    freeaddrinfo(pAI);
+    if (pEntry->iAddrs == 0)
+        pEntry->iError = EAI_NONAME;
+}
+
+int XmDnsResolve(char const *pszHost, int iPort, XmDnsAddr *pAddrs, int iMaxAddrs)
+{
+    int i, iError, iAddrs = 0;
+    time_t Now = time(NULL);
+    XmDnsEntry *pEntry;
+    XmDnsGetAddrInfo pfGetAddrInfo;
+
+    pthread_once(&DnsOnce, XmDnsInit);
+
+    pthread_mutex_lock(&DnsLock);
+    XmDnsPrune(Now, 0);
+    for (pEntry = pDnsCache; pEntry != NULL; pEntry = pEntry->pNext)
+        if (strcasecmp(pEntry->szHost, pszHost) == 0)
+            break;
+
+    if (pEntry == NULL)
+    {
+        if ((pEntry = (XmDnsEntry *) malloc(sizeof(XmDnsEntry) + strlen(pszHost))) == NULL)
+        {
+            pthread_mutex_unlock(&DnsLock);
+            return -1;
+        }
+        strcpy(pEntry->szHost, pszHost);
+        pEntry->iResolving = 1;
+        pEntry->iWaiters = 0;
+        pEntry->pNext = pDnsCache;
+        pDnsCache = pEntry;
+        pfGetAddrInfo = pfDnsGetAddrInfo;
+
+        pthread_mutex_unlock(&DnsLock);
+        XmDnsLookup(pEntry, pfGetAddrInfo);
+        pthread_mutex_lock(&DnsLock);
+
+        pEntry->Expires = time(NULL) + (pEntry->iError == 0 ? iDnsTtl: iDnsNegTtl);
+        pEntry->iResolving = 0;
+        pthread_cond_broadcast(&DnsCond);
+    }
+    else if (pEntry->iResolving)
+    {
+        /* Someone is already asking for this name: share their answer. */
+        pEntry->iWaiters++;
+        while (pEntry->iResolving)
+            pthread_cond_wait(&DnsCond, &DnsLock);
+        pEntry->iWaiters--;
+    }
+
+    if ((iError = pEntry->iError) == 0)
+    {
+        iAddrs = pEntry->iAddrs < iMaxAddrs ? pEntry->iAddrs: iMaxAddrs;
+        memcpy(pAddrs, pEntry->Addrs, iAddrs * sizeof(XmDnsAddr));
+    }
+    pthread_mutex_unlock(&DnsLock);
+
+    if (iError != 0 || iAddrs == 0)
+        return -1;
+    for (i = 0; i < iAddrs; i++)
+        if (pAddrs[i].Addr.ss_family == AF_INET6)
+            ((struct sockaddr_in6 *) &pAddrs[i].Addr)->sin6_port = htons((unsigned short) iPort);
+        else
+            ((struct sockaddr_in *) &pAddrs[i].Addr)->sin_port = htons((unsigned short) iPort);
+
+    return iAddrs;
+}
+
+void XmDnsFlush()
+{
+    pthread_mutex_lock(&DnsLock);
+    XmDnsPrune(0, 1);
+    pthread_mutex_unlock(&DnsLock);
+}
+
+/*
+ * Overrides the TTLs (a negative value restores the default one) and the
+ * resolver function (NULL for getaddrinfo()). Meant for tests.
+ */
+void XmDnsSetup(int iTtl, int iNegTtl, XmDnsGetAddrInfo pfGetAddrInfo)
+{
+    pthread_once(&DnsOnce, XmDnsInit);
+
+    pthread_mutex_lock(&DnsLock);
+    iDnsTtl = iTtl >= 0 ? iTtl: XmDnsGetIntEnv(XM_DNS_TTL, DNS_STD_TTL);
+    iDnsNegTtl = iNegTtl >= 0 ? iNegTtl: XmDnsGetIntEnv(XM_DNS_NEGTTL, DNS_STD_NEGTTL);
+    pfDnsGetAddrInfo = pfGetAddrInfo != NULL ? pfGetAddrInfo: getaddrinfo;
+    pthread_mutex_unlock(&DnsLock);
+}
@@ -0,0 +1,71 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if !defined(_XMDNS_H)
+#define _XMDNS_H
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "XMHttp.h"
+
+/*
+ * Process-wide caching resolver built on getaddrinfo().
+ *
+ * Successful answers are kept for XM_DNS_TTL seconds (default 60) and
+ * failures for XM_DNS_NEGTTL seconds (default 5). Concurrent requests for
+ * a name that is already being resolved wait for that lookup instead of
+ * issuing their own. Both IPv4 and IPv6 addresses are returned, up to
+ * XM_DNS_MAX_ADDRS of them in the order of getaddrinfo(): callers try each
+ * one in turn.
+ */
+
+#define XM_DNS_MAX_ADDRS 8
+
+struct addrinfo;
+
+typedef struct XmDnsAddr_struct
+{
+    struct sockaddr_storage Addr;
+    socklen_t AddrLen;
+} XmDnsAddr;
+
+typedef int (*XmDnsGetAddrInfo)(char const *pszNode, char const *pszService,
+                                struct addrinfo const *pHints, struct addrinfo **ppRes);
+
+EXTERNC_BEGIN;
+
+int XmDnsResolve(char const *pszHost, int iPort, XmDnsAddr *pAddrs, int iMaxAddrs);
+void XmDnsFlush();
+void XmDnsSetup(int iTtl, int iNegTtl, XmDnsGetAddrInfo pfGetAddrInfo);
+
+EXTERNC_END;
+
+#endif
@@ -48,11 +48,17 @@ XMHANDLE(XM_HTTP_HANDLE);
 
 #define INVALID_XM_HTTP_HANDLE ((XM_HTTP_HANDLE) 0)
 
+/*
+ * pfGetFd is optional. When set and it returns a descriptor, XmHttpExec()
+ * sends the pfGetSize() bytes found at *plOffset in that file with
+ * sendfile() instead of pulling them through pfRead.
+ */
 typedef struct XmHttpCallbacks_struct
 {
     int (*pfWrite)(void *pPrivate, void const *pData, int iSize);
     int (*pfRead)(void *pPrivate, void *pData, int iSize);
     long (*pfGetSize)(void *pPrivate);
+    int (*pfGetFd)(void *pPrivate, long *plOffset);
 } XmHttpCallbacks;
 
 
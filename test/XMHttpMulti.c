@@ -0,0 +1,756 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+
+#include "XMHttpMulti.h"
+#include "XMPHttp.h"
+
+#define MULTI_EVENTS 64
+#define MULTI_HDR_SIZE 8192
+#define MULTI_LINE_SIZE 128
+#define MULTI_RECV_SIZE 4096
+#define MULTI_STD_TIMEOUT 60000
+
+#define XFER_RESOLVING 0
+#define XFER_CONNECTING 1
+#define XFER_SENDING 2
+#define XFER_HEADERS 3
+#define XFER_BODY 4
+
+#define CHUNK_SIZE 0
+#define CHUNK_DATA 1
+#define CHUNK_DATA_END 2
+#define CHUNK_TRAILER 3
+
+#define MULTI_MIN(a, b) ((a) < (b) ? (a): (b))
+
+#if defined(MSG_NOSIGNAL)
+#define MULTI_SENDFLAGS MSG_NOSIGNAL
+#else
+#define MULTI_SENDFLAGS 0
+#endif
+
+
+typedef struct XmHttpXfer_struct XmHttpXfer;
+typedef struct XmHttpLookup_struct XmHttpLookup;
+
+/*
+ * Name lookup handed to the resolver thread. When the request finishes
+ * before the answer is picked up, pXfer is cleared under the context lock
+ * and whichever side holds the lookup next frees it.
+ */
+struct XmHttpLookup_struct
+{
+    XmHttpLookup *pNext;
+    XmHttpXfer *pXfer;
+    char *pszHost;
+    int iPort;
+    int iAddrs;
+    XmDnsAddr Addrs[XM_DNS_MAX_ADDRS];
+};
+
+struct XmHttpXfer_struct
+{
+    XmHttpXfer *pPrev, *pNext;
+    int SockFd;
+    int iState;
+    long long llDeadline;
+    XmHttpCallbacks HCB;
+    void *pPrivate;
+    XmHttpLookup *pLookup;
+    int iAddr;
+    char *pTx;
+    int iTxSize, iTxSent;
+    int iStatus, iValid;
+    int iResult;
+    long lContLen, lBody;
+    int iChunked, iChunkState;
+    long lChunkLeft;
+    int iHdrLen, iLineLen;
+    char Hdr[MULTI_HDR_SIZE];
+    char Line[MULTI_LINE_SIZE];
+};
+
+/*
+ * The resolver thread takes lookups from pLookups and moves them to
+ * pAnswers, then signals EventFd, which sits in the epoll set with a NULL
+ * data pointer. Both lists and iQuit are protected by Lock.
+ */
+typedef struct XmHttpMultiCtx_struct
+{
+    XmPHttpCtx PCtx;
+    int EpollFd;
+    int EventFd;
+    int iRunning;
+    XmHttpXfer *pActive;
+    XmHttpXfer *pDone, *pDoneTail;
+    pthread_t Resolver;
+    pthread_mutex_t Lock;
+    pthread_cond_t Queued;
+    int iQuit;
+    XmHttpLookup *pLookups, *pLookupsTail;
+    XmHttpLookup *pAnswers;
+} XmHttpMultiCtx;
+
+
+static void XmHttpMultiConnect(XmHttpMultiCtx *pCtx, XmHttpXfer *pXfer);
+
+
+static long long XmHttpMultiNow()
+{
+    struct timespec TS;
+
+    clock_gettime(CLOCK_MONOTONIC, &TS);
+
+    return (long long) TS.tv_sec * 1000 + TS.tv_nsec / 1000000;
+}
+
+static void XmHttpMultiLookupFree(XmHttpLookup *pLookup)
+{
+    free(pLookup->pszHost);
+    free(pLookup);
+}
+
+static void *XmHttpMultiResolver(void *pArg)
+{
+    XmHttpMultiCtx *pCtx = (XmHttpMultiCtx *) pArg;
+    XmHttpLookup *pLookup;
+    uint64_t ullValue = 1;
+
+    pthread_mutex_lock(&pCtx->Lock);
+    while (!pCtx->iQuit)
+    {
+        if ((pLookup = pCtx->pLookups) == NULL)
+        {
+            pthread_cond_wait(&pCtx->Queued, &pCtx->Lock);
+            continue;
+        }
+        if ((pCtx->pLookups = pLookup->pNext) == NULL)
+            pCtx->pLookupsTail = NULL;
+
+        /* A request that expired while queued is not resolved at all. */
+        if (pLookup->pXfer != NULL)
+        {
+            pthread_mutex_unlock(&pCtx->Lock);
+            pLookup->iAddrs = XmPHttpResolve(&pCtx->PCtx, pLookup->pszHost, pLookup->iPort,
+                                             pLookup->Addrs, XM_DNS_MAX_ADDRS);
+            pthread_mutex_lock(&pCtx->Lock);
+        }
+        if (pLookup->pXfer == NULL)
+        {
+            XmHttpMultiLookupFree(pLookup);
+            continue;
+        }
+        pLookup->pNext = pCtx->pAnswers;
+        pCtx->pAnswers = pLookup;
+        while (write(pCtx->EventFd, &ullValue, sizeof(ullValue)) < 0 && errno == EINTR)
+            ;
+    }
+    pthread_mutex_unlock(&pCtx->Lock);
+
+    return NULL;
+}
+
+static char *XmHttpMultiRequest(XmHttpMultiCtx *pCtx, char const *pszMethod, char const *pszURL,
+                                struct PHttpUrl *pPU, XmHttpCallbacks *pHCB, void *pPrivate,
+                                int *piSize)
+{
+    int iHeadSize, iSize;
+    long lReqSize;
+    char *pszHead, *pTx;
+    char szContLen[64];
+
+    if ((lReqSize = pHCB->pfGetSize(pPrivate)) < 0 ||
+        (pszHead = XmPHttpTemplate(&pCtx->PCtx, pszMethod, pszURL, pPU, &iHeadSize)) == NULL)
+        return NULL;
+    iSize = snprintf(szContLen, sizeof(szContLen), "Content-Length: %ld\r\n\r\n", lReqSize);
+
+    /* Head and body go out together, so they share one buffer. */
+    if ((pTx = (char *) realloc(pszHead, iHeadSize + iSize + lReqSize + 1)) == NULL)
+    {
+        free(pszHead);
+        return NULL;
+    }
+    memcpy(pTx + iHeadSize, szContLen, iSize);
+    if (lReqSize > 0 &&
+        pHCB->pfRead(pPrivate, pTx + iHeadSize + iSize, (int) lReqSize) != lReqSize)
+    {
+        free(pTx);
+        return NULL;
+    }
+    *piSize = iHeadSize + iSize + (int) lReqSize;
+
+    return pTx;
+}
+
+static void XmHttpMultiDisconnect(XmHttpMultiCtx *pCtx, XmHttpXfer *pXfer)
+{
+    if (pXfer->SockFd < 0)
+        return;
+    epoll_ctl(pCtx->EpollFd, EPOLL_CTL_DEL, pXfer->SockFd, NULL);
+    close(pXfer->SockFd);
+    pXfer->SockFd = -1;
+}
+
+static void XmHttpMultiFinish(XmHttpMultiCtx *pCtx, XmHttpXfer *pXfer, int iResult)
+{
+    XmHttpMultiDisconnect(pCtx, pXfer);
+    free(pXfer->pTx);
+    pXfer->pTx = NULL;
+    pXfer->iResult = iResult;
+
+    /* A lookup still on the resolver side is orphaned and freed there. */
+    if (pXfer->pLookup != NULL)
+    {
+        pthread_mutex_lock(&pCtx->Lock);
+        if (pXfer->iState == XFER_RESOLVING)
+            pXfer->pLookup->pXfer = NULL;
+        else
+            XmHttpMultiLookupFree(pXfer->pLookup);
+        pthread_mutex_unlock(&pCtx->Lock);
+        pXfer->pLookup = NULL;
+    }
+
+    if (pXfer->pPrev != NULL)
+        pXfer->pPrev->pNext = pXfer->pNext;
+    else
+        pCtx->pActive = pXfer->pNext;
+    if (pXfer->pNext != NULL)
+        pXfer->pNext->pPrev = pXfer->pPrev;
+    pCtx->iRunning--;
+
+    pXfer->pPrev = pXfer->pNext = NULL;
+    if (pCtx->pDoneTail != NULL)
+        pCtx->pDoneTail->pNext = pXfer;
+    else
+        pCtx->pDone = pXfer;
+    pCtx->pDoneTail = pXfer;
+}
+
+static void XmHttpMultiConnect(XmHttpMultiCtx *pCtx, XmHttpXfer *pXfer)
+{
+    XmHttpLookup *pLookup = pXfer->pLookup;
+    XmDnsAddr *pAddr;
+    struct epoll_event Event;
+
+    /* Try the addresses in order, so that e.g. an unreachable IPv6 one falls back to IPv4. */
+    for (; pXfer->iAddr < pLookup->iAddrs; pXfer->iAddr++)
+    {
+        pAddr = &pLookup->Addrs[pXfer->iAddr];
+        if ((pXfer->SockFd = socket(pAddr->Addr.ss_family,
+                                    SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+            continue;
+        if (connect(pXfer->SockFd, (struct sockaddr *) &pAddr->Addr, pAddr->AddrLen) == 0)
+            pXfer->iState = XFER_SENDING;
+        else if (errno == EINPROGRESS)
+            pXfer->iState = XFER_CONNECTING;
+        else
+        {
+            close(pXfer->SockFd);
+            pXfer->SockFd = -1;
+            continue;
+        }
+
+        Event.events = EPOLLOUT;
+        Event.data.ptr = pXfer;
+        if (epoll_ctl(pCtx->EpollFd, EPOLL_CTL_ADD, pXfer->SockFd, &Event) != 0)
+            XmHttpMultiFinish(pCtx, pXfer, -XME_HTTP_SELECT);
+        return;
+    }
+
+    XmHttpMultiFinish(pCtx, pXfer, -XME_HTTP_CONNECT);
+}
+
+static void XmHttpMultiAnswers(XmHttpMultiCtx *pCtx)
+{
+    XmHttpLookup *pLookup, *pNext;
+    XmHttpXfer *pXfer, *pXferNext;
+    uint64_t ullValue;
+
+    while (read(pCtx->EventFd, &ullValue, sizeof(ullValue)) < 0 && errno == EINTR)
+        ;
+    pthread_mutex_lock(&pCtx->Lock);
+    pLookup = pCtx->pAnswers;
+    pCtx->pAnswers = NULL;
+    for (; pLookup != NULL; pLookup = pNext)
+    {
+        pNext = pLookup->pNext;
+        if ((pXfer = pLookup->pXfer) == NULL)
+            XmHttpMultiLookupFree(pLookup);
+        else
+            pXfer->iState = XFER_CONNECTING;
+    }
+    pthread_mutex_unlock(&pCtx->Lock);
+
+    /* The requests own their answers now, connect them outside the lock. */
+    for (pXfer = pCtx->pActive; pXfer != NULL; pXfer = pXferNext)
+    {
+        pXferNext = pXfer->pNext;
+        if (pXfer->iState != XFER_CONNECTING || pXfer->SockFd >= 0)
+            continue;
+        if (pXfer->pLookup->iAddrs < 0)
+            XmHttpMultiFinish(pCtx, pXfer, -XME_HTTP_UNKNOWN_HOST);
+        else
+            XmHttpMultiConnect(pCtx, pXfer);
+    }
+}
+
+static int XmHttpMultiDeliver(XmHttpXfer *pXfer, char const *pData, int iSize)
+{
+    pXfer->lBody += iSize;
+    if (pXfer->iValid && pXfer->HCB.pfWrite &&
+        pXfer->HCB.pfWrite(pXfer->pPrivate, pData, iSize) != iSize)
+        return -XME_HTTP_CALLBACK;
+
+    return 0;
+}
+
+static int XmHttpMultiLine(XmHttpXfer *pXfer, char const **ppData, int *piSize)
+{
+    char const *pszNL;
+    int iTxSize;
+
+    pszNL = (char const *) memchr(*ppData, '\n', *piSize);
+    iTxSize = pszNL != NULL ? (int) (pszNL - *ppData) + 1: *piSize;
+    if (pXfer->iLineLen + iTxSize >= MULTI_LINE_SIZE)
+        return -XME_HTTP_PROTOCOL;
+    memcpy(pXfer->Line + pXfer->iLineLen, *ppData, iTxSize);
+    pXfer->iLineLen += iTxSize;
+    *ppData += iTxSize;
+    *piSize -= iTxSize;
+    if (pszNL == NULL)
+        return 0;
+
+    for (; pXfer->iLineLen > 0 && (pXfer->Line[pXfer->iLineLen - 1] == '\r' ||
+                                   pXfer->Line[pXfer->iLineLen - 1] == '\n'); pXfer->iLineLen--);
+    pXfer->Line[pXfer->iLineLen] = '\0';
+    pXfer->iLineLen = 0;
+
+    return 1;
+}
+
+static int XmHttpMultiChunked(XmHttpXfer *pXfer, char const *pData, int iSize)
+{
+    int iError, iCurr;
+
+    while (iSize > 0)
+    {
+        if (pXfer->iChunkState == CHUNK_DATA)
+        {
+            iCurr = (int) MULTI_MIN(pXfer->lChunkLeft, iSize);
+            if ((iError = XmHttpMultiDeliver(pXfer, pData, iCurr)) < 0)
+                return iError;
+            pXfer->lChunkLeft -= iCurr;
+            pData += iCurr;
+            iSize -= iCurr;
+            if (pXfer->lChunkLeft == 0)
+                pXfer->iChunkState = CHUNK_DATA_END;
+            continue;
+        }
+
+        if ((iError = XmHttpMultiLine(pXfer, &pData, &iSize)) <= 0)
+            return iError;
+        if (pXfer->iChunkState == CHUNK_SIZE)
+        {
+            if (sscanf(pXfer->Line, "%lx", &pXfer->lChunkLeft) != 1 || pXfer->lChunkLeft < 0)
+                return -XME_HTTP_PROTOCOL;
+            pXfer->iChunkState = pXfer->lChunkLeft != 0 ? CHUNK_DATA: CHUNK_TRAILER;
+        }
+        else if (pXfer->iChunkState == CHUNK_DATA_END)
+        {
+            if (pXfer->Line[0] != '\0')
+                return -XME_HTTP_PROTOCOL;
+            pXfer->iChunkState = CHUNK_SIZE;
+        }
+        else if (pXfer->Line[0] == '\0')
+            return 1;
+    }
+
+    return 0;
+}
+
+static int XmHttpMultiHeaders(XmHttpXfer *pXfer)
+{
+    char *pszLine, *pszValue, *pszSave;
+
+    if ((pszLine = strtok_r(pXfer->Hdr, "\r\n", &pszSave)) == NULL ||
+        sscanf(pszLine, "HTTP/%*d.%*d %d", &pXfer->iStatus) != 1)
+        return -XME_HTTP_PROTOCOL;
+
+    pXfer->iValid = pXfer->iStatus == 200 || pXfer->iStatus == 204;
+    while ((pszLine = strtok_r(NULL, "\r\n", &pszSave)) != NULL)
+    {
+        if ((pszValue = strchr(pszLine, ':')) == NULL)
+            continue;
+        for (pszValue++; *pszValue == ' ' || *pszValue == '\t'; pszValue++);
+        if (!strncasecmp(pszLine, "Content-Length:", 15))
+            pXfer->lContLen = atol(pszValue);
+        else if (!strncasecmp(pszLine, "Transfer-Encoding:", 18))
+            pXfer->iChunked = strcasecmp(pszValue, "chunked") == 0;
+    }
+    if (pXfer->iChunked)
+        pXfer->lContLen = -1;
+    if ((pXfer->iStatus >= 100 && pXfer->iStatus < 200) || pXfer->iStatus == 204 ||
+        pXfer->iStatus == 304)
+        pXfer->lContLen = 0, pXfer->iChunked = 0;
+
+    return 0;
+}
+
+static int XmHttpMultiFeed(XmHttpXfer *pXfer, char const *pData, int iSize)
+{
+    int iError, iCurr;
+    char *pszEnd;
+
+    if (pXfer->iState == XFER_HEADERS)
+    {
+        iCurr = MULTI_MIN(iSize, MULTI_HDR_SIZE - 1 - pXfer->iHdrLen);
+        memcpy(pXfer->Hdr + pXfer->iHdrLen, pData, iCurr);
+        pXfer->Hdr[pXfer->iHdrLen + iCurr] = '\0';
+        if ((pszEnd = strstr(pXfer->Hdr, "\r\n\r\n")) == NULL)
+        {
+            pXfer->iHdrLen += iCurr;
+            return pXfer->iHdrLen < MULTI_HDR_SIZE - 1 ? 0: -XME_HTTP_PROTOCOL;
+        }
+
+        iCurr = (int) (pszEnd + 4 - pXfer->Hdr) - pXfer->iHdrLen;
+        pData += iCurr;
+        iSize -= iCurr;
+        *pszEnd = '\0';
+        if ((iError = XmHttpMultiHeaders(pXfer)) < 0)
+            return iError;
+        pXfer->iState = XFER_BODY;
+    }
+
+    if (pXfer->iChunked)
+        return XmHttpMultiChunked(pXfer, pData, iSize);
+    if (pXfer->lContLen >= 0)
+    {
+        iCurr = (int) MULTI_MIN(pXfer->lContLen - pXfer->lBody, iSize);
+        if ((iError = XmHttpMultiDeliver(pXfer, pData, iCurr)) < 0)
+            return iError;
+
+        return pXfer->lBody == pXfer->lContLen;
+    }
+
+    /* No framing: the body runs until the server closes the connection. */
+    return XmHttpMultiDeliver(pXfer, pData, iSize);
+}
+
+static void XmHttpMultiEvent(XmHttpMultiCtx *pCtx, XmHttpXfer *pXfer)
+{
+    int iError, iRead;
+    socklen_t ErrSize = sizeof(iError);
+    struct epoll_event Event;
+    char RxBuff[MULTI_RECV_SIZE];
+
+    if (pXfer->iState == XFER_CONNECTING)
+    {
+        if (getsockopt(pXfer->SockFd, SOL_SOCKET, SO_ERROR, &iError, &ErrSize) != 0 ||
+            iError != 0)
+        {
+            XmHttpMultiDisconnect(pCtx, pXfer);
+            pXfer->iAddr++;
+            XmHttpMultiConnect(pCtx, pXfer);
+            return;
+        }
+        pXfer->iState = XFER_SENDING;
+    }
+
+    if (pXfer->iState == XFER_SENDING)
+    {
+        while (pXfer->iTxSent < pXfer->iTxSize)
+        {
+            if ((iError = send(pXfer->SockFd, pXfer->pTx + pXfer->iTxSent,
+                               pXfer->iTxSize - pXfer->iTxSent, MULTI_SENDFLAGS)) < 0)
+            {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                    XmHttpMultiFinish(pCtx, pXfer, -XME_HTTP_SKWRITE);
+                return;
+            }
+            pXfer->iTxSent += iError;
+        }
+
+        Event.events = EPOLLIN;
+        Event.data.ptr = pXfer;
+        if (epoll_ctl(pCtx->EpollFd, EPOLL_CTL_MOD, pXfer->SockFd, &Event) != 0)
+            XmHttpMultiFinish(pCtx, pXfer, -XME_HTTP_SELECT);
+        else
+            pXfer->iState = XFER_HEADERS;
+        return;
+    }
+
+    if ((iRead = recv(pXfer->SockFd, RxBuff, sizeof(RxBuff), 0)) < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            XmHttpMultiFinish(pCtx, pXfer, -XME_HTTP_SKREAD);
+        return;
+    }
+    if (iRead == 0)
+    {
+        if (pXfer->iState == XFER_BODY && !pXfer->iChunked && pXfer->lContLen < 0)
+            XmHttpMultiFinish(pCtx, pXfer, pXfer->iValid ? 0: -1);
+        else
+            XmHttpMultiFinish(pCtx, pXfer, -XME_HTTP_DISCONNECT);
+        return;
+    }
+    if ((iError = XmHttpMultiFeed(pXfer, RxBuff, iRead)) < 0)
+        XmHttpMultiFinish(pCtx, pXfer, iError);
+    else if (iError > 0)
+        XmHttpMultiFinish(pCtx, pXfer, pXfer->iValid ? 0: -1);
+}
+
+XM_HTTP_MULTI_HANDLE XmHttpMultiOpen()
+{
+    XmHttpMultiCtx *pCtx;
+    struct epoll_event Event;
+
+    if ((pCtx = (XmHttpMultiCtx *) malloc(sizeof(XmHttpMultiCtx))) == NULL)
+        return INVALID_XM_HTTP_MULTI_HANDLE;
+    memset(pCtx, 0, sizeof(*pCtx));
+    if (XmPHttpInit(&pCtx->PCtx) < 0)
+    {
+        free(pCtx);
+        return INVALID_XM_HTTP_MULTI_HANDLE;
+    }
+    /* Every multi request owns its connection, so ask the server to close it. */
+    pCtx->PCtx.iPHttpPoolSize = 0;
+    pthread_mutex_init(&pCtx->Lock, NULL);
+    pthread_cond_init(&pCtx->Queued, NULL);
+    pCtx->EpollFd = epoll_create1(EPOLL_CLOEXEC);
+    pCtx->EventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    Event.events = EPOLLIN;
+    Event.data.ptr = NULL;
+    if (pCtx->EpollFd < 0 || pCtx->EventFd < 0 ||
+        epoll_ctl(pCtx->EpollFd, EPOLL_CTL_ADD, pCtx->EventFd, &Event) != 0 ||
+        pthread_create(&pCtx->Resolver, NULL, XmHttpMultiResolver, pCtx) != 0)
+    {
+        if (pCtx->EventFd >= 0)
+            close(pCtx->EventFd);
+        if (pCtx->EpollFd >= 0)
+            close(pCtx->EpollFd);
+        pthread_cond_destroy(&pCtx->Queued);
+        pthread_mutex_destroy(&pCtx->Lock);
+        XmPHttpCleanup(&pCtx->PCtx);
+        free(pCtx);
+        return INVALID_XM_HTTP_MULTI_HANDLE;
+    }
+
+    return (XM_HTTP_MULTI_HANDLE) pCtx;
+}
+
+
+void XmHttpMultiClose(XM_HTTP_MULTI_HANDLE hMulti)
+{
+    XmHttpMultiCtx *pCtx = (XmHttpMultiCtx *) hMulti;
+    XmHttpXfer *pXfer;
+    XmHttpLookup *pLookup;
+
+    while (pCtx->pActive != NULL)
+        XmHttpMultiFinish(pCtx, pCtx->pActive, -XME_HTTP_DISCONNECT);
+    while ((pXfer = pCtx->pDone) != NULL)
+    {
+        pCtx->pDone = pXfer->pNext;
+        free(pXfer);
+    }
+
+    /* A resolution in progress is not cut short, the thread ends after it. */
+    pthread_mutex_lock(&pCtx->Lock);
+    pCtx->iQuit = 1;
+    pthread_cond_signal(&pCtx->Queued);
+    pthread_mutex_unlock(&pCtx->Lock);
+    pthread_join(pCtx->Resolver, NULL);
+    while ((pLookup = pCtx->pLookups) != NULL)
+    {
+        pCtx->pLookups = pLookup->pNext;
+        XmHttpMultiLookupFree(pLookup);
+    }
+    while ((pLookup = pCtx->pAnswers) != NULL)
+    {
+        pCtx->pAnswers = pLookup->pNext;
+        XmHttpMultiLookupFree(pLookup);
+    }
+
+    close(pCtx->EventFd);
+    close(pCtx->EpollFd);
+    pthread_cond_destroy(&pCtx->Queued);
+    pthread_mutex_destroy(&pCtx->Lock);
+    XmPHttpCleanup(&pCtx->PCtx);
+    free(pCtx);
+}
+
+
+int XmHttpMultiAdd(XM_HTTP_MULTI_HANDLE hMulti, char const *pszMethod, char const *pszURL,
+                   int iTimeout, XmHttpCallbacks *pHCB, void *pPrivate)
+{
+    XmHttpMultiCtx *pCtx = (XmHttpMultiCtx *) hMulti;
+    XmHttpXfer *pXfer;
+    XmHttpLookup *pLookup;
+    struct PHttpUrl PU;
+
+    XmPHttpParseInit(&PU);
+    if (XmPHttpParseUrl(&pCtx->PCtx, &PU, pszURL) < 0)
+        return -1;
+
+    if ((pXfer = (XmHttpXfer *) malloc(sizeof(XmHttpXfer))) == NULL)
+    {
+        XmPHttpParseFree(&PU);
+        return -1;
+    }
+    memset(pXfer, 0, offsetof(XmHttpXfer, Hdr));
+    pXfer->SockFd = -1;
+    pXfer->iState = XFER_RESOLVING;
+    pXfer->HCB = *pHCB;
+    pXfer->pPrivate = pPrivate;
+    pXfer->lContLen = -1;
+    pXfer->llDeadline = XmHttpMultiNow() + (iTimeout > 0 ? iTimeout: MULTI_STD_TIMEOUT);
+    if ((pLookup = (XmHttpLookup *) malloc(sizeof(XmHttpLookup))) == NULL ||
+        (pLookup->pszHost = strdup(PU.pszHost)) == NULL ||
+        (pXfer->pTx = XmHttpMultiRequest(pCtx, pszMethod, pszURL, &PU, pHCB, pPrivate,
+                                         &pXfer->iTxSize)) == NULL)
+    {
+        if (pLookup != NULL)
+        {
+            free(pLookup->pszHost);
+            free(pLookup);
+        }
+        XmPHttpParseFree(&PU);
+        free(pXfer);
+        return -1;
+    }
+    pLookup->pNext = NULL;
+    pLookup->pXfer = pXfer;
+    pLookup->iPort = PU.iPort;
+    pLookup->iAddrs = -1;
+    pXfer->pLookup = pLookup;
+    XmPHttpParseFree(&PU);
+
+    pXfer->pNext = pCtx->pActive;
+    if (pCtx->pActive != NULL)
+        pCtx->pActive->pPrev = pXfer;
+    pCtx->pActive = pXfer;
+    pCtx->iRunning++;
+
+    /* Resolution may block, so the resolver thread does it; the request waits in XFER_RESOLVING. */
+    pthread_mutex_lock(&pCtx->Lock);
+    if (pCtx->pLookupsTail != NULL)
+        pCtx->pLookupsTail->pNext = pLookup;
+    else
+        pCtx->pLookups = pLookup;
+    pCtx->pLookupsTail = pLookup;
+    pthread_cond_signal(&pCtx->Queued);
+    pthread_mutex_unlock(&pCtx->Lock);
+
+    return 0;
+}
+
+
+int XmHttpMultiPerform(XM_HTTP_MULTI_HANDLE hMulti, int iTimeout, int *piRunning)
+{
+    int i, iEvents;
+    long long llNow;
+    XmHttpMultiCtx *pCtx = (XmHttpMultiCtx *) hMulti;
+    XmHttpXfer *pXfer, *pNext;
+    struct epoll_event Events[MULTI_EVENTS];
+
+    if (pCtx->iRunning > 0)
+    {
+        llNow = XmHttpMultiNow();
+        for (pXfer = pCtx->pActive; pXfer != NULL; pXfer = pXfer->pNext)
+            if (iTimeout < 0 || pXfer->llDeadline - llNow < iTimeout)
+                iTimeout = (int) (pXfer->llDeadline > llNow ? pXfer->llDeadline - llNow: 0);
+
+        if ((iEvents = epoll_wait(pCtx->EpollFd, Events, MULTI_EVENTS, iTimeout)) < 0)
+        {
+            if (errno != EINTR)
+                return -1;
+            iEvents = 0;
+        }
+        for (i = 0; i < iEvents; i++)
+        {
+            if (Events[i].data.ptr != NULL)
+                XmHttpMultiEvent(pCtx, (XmHttpXfer *) Events[i].data.ptr);
+            else
+                XmHttpMultiAnswers(pCtx);
+        }
+
+        llNow = XmHttpMultiNow();
+        for (pXfer = pCtx->pActive; pXfer != NULL; pXfer = pNext)
+        {
+            pNext = pXfer->pNext;
+            if (pXfer->llDeadline <= llNow)
+                XmHttpMultiFinish(pCtx, pXfer, -XME_HTTP_TIMEOUT);
+        }
+    }
+    if (piRunning != NULL)
+        *piRunning = pCtx->iRunning;
+
+    return 0;
+}
+
+
+int XmHttpMultiInfoRead(XM_HTTP_MULTI_HANDLE hMulti, XmHttpMultiDone *pDone)
+{
+    XmHttpMultiCtx *pCtx = (XmHttpMultiCtx *) hMulti;
+    XmHttpXfer *pXfer;
+
+    if ((pXfer = pCtx->pDone) == NULL)
+        return 0;
+    if ((pCtx->pDone = pXfer->pNext) == NULL)
+        pCtx->pDoneTail = NULL;
+
+    pDone->pPrivate = pXfer->pPrivate;
+    pDone->iResult = pXfer->iResult;
+    pDone->iStatus = pXfer->iStatus;
+    free(pXfer);
+
+    return 1;
+}
+
+
+int XmHttpMultiFd(XM_HTTP_MULTI_HANDLE hMulti)
+{
+    return ((XmHttpMultiCtx *) hMulti)->EpollFd;
+}
@@ -0,0 +1,77 @@
+/*
+    Copyright (c) 2013, McAfee, Inc.
+    
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without modification,
+    are permitted provided that the following conditions are met:
+    
+    Redistributions of source code must retain the above copyright notice, this list
+    of conditions and the following disclaimer.
+    
+    Redistributions in binary form must reproduce the above copyright notice, this
+    list of conditions and the following disclaimer in the documentation and/or other
+    materials provided with the distribution.
+    
+    Neither the name of McAfee, Inc. nor the names of its contributors may be used
+    to endorse or promote products derived from this software without specific prior
+    written permission.
+    
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+    IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+    OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+    OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if !defined(_XMHTTPMULTI_H)
+#define _XMHTTPMULTI_H
+
+#include "XMHttp.h"
+
+/*
+ * Non-blocking engine that drives many HTTP requests from one thread.
+ *
+ * Requests are queued with XmHttpMultiAdd() and progressed by calls to
+ * XmHttpMultiPerform(), which waits on an epoll set for at most the given
+ * time (or the nearest request deadline). Finished requests are collected
+ * with XmHttpMultiInfoRead(). The request body is pulled through pfGetSize
+ * and pfRead when the request is added; the response body is pushed through
+ * pfWrite as it arrives, exactly as XmHttpExec() does.
+ *
+ * XmHttpMultiAdd() does not touch the network. Host names are resolved
+ * through XmDnsResolve() on a helper thread owned by the handle, and the
+ * request waits, under its deadline, until the addresses arrive. A name
+ * that does not resolve finishes with -XME_HTTP_UNKNOWN_HOST.
+ */
+
+XMHANDLE(XM_HTTP_MULTI_HANDLE);
+
+#define INVALID_XM_HTTP_MULTI_HANDLE ((XM_HTTP_MULTI_HANDLE) 0)
+
+typedef struct XmHttpMultiDone_struct
+{
+    void *pPrivate;     /* Value passed to XmHttpMultiAdd() */
+    int iResult;        /* 0 on success, -1 or -XME_HTTP_* on failure */
+    int iStatus;        /* HTTP status code, 0 if no response was received */
+} XmHttpMultiDone;
+
+
+EXTERNC_BEGIN;
+
+XM_HTTP_MULTI_HANDLE XmHttpMultiOpen();
+void XmHttpMultiClose(XM_HTTP_MULTI_HANDLE hMulti);
+int XmHttpMultiAdd(XM_HTTP_MULTI_HANDLE hMulti, char const *pszMethod, char const *pszURL,
+                   int iTimeout, XmHttpCallbacks *pHCB, void *pPrivate);
+int XmHttpMultiPerform(XM_HTTP_MULTI_HANDLE hMulti, int iTimeout, int *piRunning);
+int XmHttpMultiInfoRead(XM_HTTP_MULTI_HANDLE hMulti, XmHttpMultiDone *pDone);
+int XmHttpMultiFd(XM_HTTP_MULTI_HANDLE hMulti);
+
+EXTERNC_END;
+
+#endif
@@ -40,21 +40,18 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <signal.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <poll.h>
+#include <time.h>
 #include <stdarg.h>
 
 #include <XMPHttp.h>
-
-#define XME_HTTP_TIMEOUT 11300
-#define XME_HTTP_SELECT 11301
-#define XME_HTTP_SKREAD 11302
-#define XME_HTTP_SKWRITE 11303
-#define XME_HTTP_SETSOCKOPT 11003
-#define XME_HTTP_DISCONNECT 11005
-#define XME_HTTP_UNKNOWN_HOST 11006
-#define XME_HTTP_CONNECT 11007
+#include "XMDns.h"
 
 #define SOCK_STD_CONTIMEO 60
 #define SOCK_STD_RCVTIMEO 60
@@ -63,23 +60,28 @@
 #define HTTPS_DEFAULT_PORT 443
 #define CONTLEN_HEADER "Content-Length:"
 #define CONTENC_HEADER "Transfer-Encoding:"
+#define CONNECTION_HEADER "Connection:"
 #define CHUNKED_ENCODED(s) (strcasecmp(s, "chunked") == 0)
 #define XM_HTTP_HEADERS "XM_HTTP_HEADERS"
 #define XM_HTTP_VERSION "XM_HTTP_VERSION"
 #define XM_SKRECV_TIMEO "XM_NET_RECVTIMEO"
 #define XM_SKSEND_TIMEO "XM_NET_SENDTIMEO"
 #define XM_SKCONN_TIMEO "XM_NET_CONNTIMEO"
+#define XM_HTTP_POOL_SIZE "XM_HTTP_POOL_SIZE"
+#define XM_HTTP_IDLE_TIMEO "XM_HTTP_IDLE_TIMEO"
 
 
 #define SSTREAM_BUFFER_SIZE 4096
+#define PHTTP_STD_POOLSIZE 4
+#define PHTTP_STD_IDLETIMEO 15
+#define PHTTP_MAX_HOST 256
+
+/* Returned by XmPHttpReadResponse when not a single response byte arrived. */
+#define PHTTP_NORESPONSE (-2)
 
 #define URL_PROTO_HTTP  1
 #define URL_PROTO_HTTPS 2
 
-#if !defined(INADDR_NONE)
-#define INADDR_NONE ((XmUInt32) -1)
-#endif
-
 #define URL_PARSE_INIT  { 0, NULL, 0, NULL, NULL }
 
 #define PHTTP_MIN(a, b) ((a) < (b) ? (a): (b))
@@ -89,29 +91,39 @@
 #define PHTTP_DBGPRINT(c, args) do { if ((c)->iPHttpDebug) XmPHttpDbgPrintf args; } while (0)
 
 #define PHTTP_ENVGET(c, s) getenv(s)
-#define PHTTP_ENVFREE(e) free(e)
+#define PHTTP_ENVFREE(e) ((void) (e))
 
 
 #define INVALID_SOCKET (-1)
 #define closesocket(s) close(s)
 #define PHTTP_INPROGRESS(SockFd) (errno == EINPROGRESS || errno == EWOULDBLOCK)
 
+#if defined(MSG_NOSIGNAL)
+#define PHTTP_SENDFLAGS MSG_NOSIGNAL
+#else
+#define PHTTP_SENDFLAGS 0
+#endif
+#if !defined(MSG_MORE)
+#define MSG_MORE 0
+#endif
+
 typedef int SOCKET;
 
 
-struct PHttpUrl
+struct XmPHttpConn_struct
 {
-    int iProto;
-    char const *pszHost;
+    XmPHttpConn *pNext;
+    SOCKET SockFd;
     int iPort;
-    char const *pszDoc;
-    char const *pszUrl;
+    time_t Idle;
+    char szHost[PHTTP_MAX_HOST];
 };
 
 struct SStream
 {
     XmPHttpCtx *pCtx;
     SOCKET SockFd;
+    int iReused;
     int iReadTimeo, iWriteTimeo;
     int iIndex;
     int iInBuffer;
@@ -172,6 +184,7 @@ static int XmPHttpSkConnect(SOCKET SockFd, struct sockaddr *pAddr, int iAddrSize
     {
         struct timeval TV;
         fd_set FdSet;
+        socklen_t ErrLen = sizeof(iError);
 
         if (!PHTTP_INPROGRESS(SockFd))
             return -XME_HTTP_CONNECT;
@@ -183,6 +196,9 @@ static int XmPHttpSkConnect(SOCKET SockFd, struct sockaddr *pAddr, int iAddrSize
             return -XME_HTTP_SELECT;
         if (!FD_ISSET(SockFd, &FdSet))
             return -XME_HTTP_TIMEOUT;
+        /* A refused connection is writable too, so that the next address gets tried. */
+        if (getsockopt(SockFd, SOL_SOCKET, SO_ERROR, &iError, &ErrLen) != 0 || iError != 0)
+            return -XME_HTTP_CONNECT;
     }
 
     return XmPHttpSkBlocking(SockFd, 1);
@@ -210,31 +226,26 @@ static int XmPHttpSkRead(SOCKET SockFd, void *pData, int iSize, int iTimeout)
     return iRead;
 }
 
-static int XmPHttpSkWrite(SOCKET SockFd, void const *pData, int iSize, int iTimeout)
+static int XmPHttpSkAlive(SOCKET SockFd)
 {
-    int iWrite;
-    struct timeval TV;
-    fd_set FdSet;
+    struct pollfd PFd;
 
-    FD_ZERO(&FdSet);
-    FD_SET(SockFd, &FdSet);
-    TV.tv_sec = iTimeout;
-    TV.tv_usec = 0;
-    if (select((int) SockFd + 1, NULL, &FdSet, NULL, &TV) < 0)
-        return -XME_HTTP_SELECT;
-    if (!FD_ISSET(SockFd, &FdSet))
-        return -XME_HTTP_TIMEOUT;
-    if ((iWrite = send(SockFd, pData, iSize, 0)) < 0)
-        return -XME_HTTP_SKWRITE;
+    /*
+     * An idle connection has nothing to say: if it is readable the server either
+     * closed it or sent something we did not ask for, and it cannot be reused.
+     */
+    PFd.fd = SockFd;
+    PFd.events = POLLIN;
+    PFd.revents = 0;
 
-    return iWrite;
+    return poll(&PFd, 1, 0) == 0;
 }
 
-static SOCKET XmPHttpSocket(XmPHttpCtx *pCtx)
+static SOCKET XmPHttpSocket(XmPHttpCtx *pCtx, int iFamily)
 {
     SOCKET SockFd;
 
-    if ((SockFd = socket(AF_INET, SOCK_STREAM, 0)) == INVALID_SOCKET)
+    if ((SockFd = socket(iFamily, SOCK_STREAM, 0)) == INVALID_SOCKET)
     {
         PHTTP_DBGPRINT(pCtx, ("[phttp] Socket creation failed\n"));
         return INVALID_SOCKET;
@@ -247,6 +258,13 @@ int XmPHttpInit(XmPHttpCtx *pCtx)
 {
     pCtx->iPHttpDebug = 0;
     pCtx->iPHttpConnTimeo = XmPHttpGetIntEnv(pCtx, XM_SKCONN_TIMEO, SOCK_STD_CONTIMEO);
+    pCtx->iPHttpPoolSize = XmPHttpGetIntEnv(pCtx, XM_HTTP_POOL_SIZE, PHTTP_STD_POOLSIZE);
+    pCtx->iPHttpIdleTimeo = XmPHttpGetIntEnv(pCtx, XM_HTTP_IDLE_TIMEO, PHTTP_STD_IDLETIMEO);
+    pCtx->pPHttpIdle = NULL;
+    pCtx->pszPHttpTplKey = pCtx->pszPHttpTpl = NULL;
+    pCtx->iPHttpTplLen = 0;
+    if (pthread_mutex_init(&pCtx->PHttpLock, NULL) != 0)
+        return -1;
 
     PHTTP_DBGPRINT(pCtx, ("[phttp] Library initialization succeeded\n"));
 
@@ -255,6 +273,18 @@ int XmPHttpInit(XmPHttpCtx *pCtx)
 
 void XmPHttpCleanup(XmPHttpCtx *pCtx)
 {
+    XmPHttpConn *pConn;
+
+    while ((pConn = pCtx->pPHttpIdle) != NULL)
+    {
+        pCtx->pPHttpIdle = pConn->pNext;
+        closesocket(pConn->SockFd);
+        free(pConn);
+    }
+    free(pCtx->pszPHttpTplKey);
+    free(pCtx->pszPHttpTpl);
+    pthread_mutex_destroy(&pCtx->PHttpLock);
+
     PHTTP_DBGPRINT(pCtx, ("[phttp] Library cleanup done\n"));
 }
 
@@ -267,6 +297,7 @@ static struct SStream *XmPHttpStreamAttach(XmPHttpCtx *pCtx, SOCKET SockFd)
 
     pStream->pCtx = pCtx;
     pStream->SockFd = SockFd;
+    pStream->iReused = 0;
     pStream->iIndex = 0;
     pStream->iInBuffer = 0;
     pStream->iReadTimeo = XmPHttpGetIntEnv(pCtx, XM_SKRECV_TIMEO, SOCK_STD_RCVTIMEO);
@@ -373,165 +404,278 @@ static int XmPHttpRead(char *pData, int iSize, struct SStream *pStream)
     return iRead;
 }
 
-static int XmPHttpPrintf(struct SStream *pStream, char const *pszFmt, ...)
+static int XmPHttpWritev(struct SStream *pStream, struct iovec *pIov, int iCount, int iFlags)
 {
-    int iSize, iSent, iTxSize;
+    int iSent;
     XmPHttpCtx *pCtx = pStream->pCtx;
-    va_list Args;
-    char szBuffer[4096];
-
-    va_start(Args, pszFmt);
-
-    iSize = vsnprintf(szBuffer, sizeof(szBuffer) - 1, pszFmt, Args);
+    struct msghdr Msg;
 
-    va_end(Args);
-
-    PHTTP_DBGPRINT(pCtx, ("[phttp] Sending ...\n"
-                          "(\n"
-                          "%s"
-                          ")\n", szBuffer));
-    for (iSent = 0; iSent < iSize;)
+    memset(&Msg, 0, sizeof(Msg));
+    Msg.msg_iov = pIov;
+    Msg.msg_iovlen = iCount;
+    while (Msg.msg_iovlen > 0)
     {
         PHTTP_DBGPRINT(pCtx, ("[phttp] Writing socket: sock=%u\n", pStream->SockFd));
 
-        iTxSize = XmPHttpSkWrite(pStream->SockFd, szBuffer + iSent,
-                                 iSize - iSent, pStream->iWriteTimeo);
+        /* The socket carries SO_SNDTIMEO, so this blocks for iWriteTimeo at most. */
+        if ((iSent = sendmsg(pStream->SockFd, &Msg, PHTTP_SENDFLAGS | iFlags)) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK ? -XME_HTTP_TIMEOUT: -XME_HTTP_SKWRITE;
+        }
 
         PHTTP_DBGPRINT(pCtx, ("[phttp] Socket write done: sock=%u send=%d\n", pStream->SockFd,
-                              iTxSize));
-        if (iTxSize < 0)
-            break;
-        iSent += iTxSize;
+                              iSent));
+        for (; Msg.msg_iovlen > 0 && iSent >= (int) Msg.msg_iov->iov_len; Msg.msg_iov++, Msg.msg_iovlen--)
+            iSent -= (int) Msg.msg_iov->iov_len;
+        if (Msg.msg_iovlen > 0)
+        {
+            Msg.msg_iov->iov_base = (char *) Msg.msg_iov->iov_base + iSent;
+            Msg.msg_iov->iov_len -= iSent;
+        }
     }
 
-    return iSize;
+    return 0;
 }
 
-static int XmPHttpWrite(char const *pData, int iSize, struct SStream *pStream)
+static int XmPHttpSendFile(struct SStream *pStream, int iFd, long lOffset, long lSize)
 {
-    int iSent, iTxSize;
-    XmPHttpCtx *pCtx = pStream->pCtx;
-
-    for (iSent = 0; iSent < iSize;)
+    int iError = 0;
+    off_t Offset = (off_t) lOffset;
+    ssize_t Sent;
+    sigset_t Pipe, Saved;
+    struct timespec Zero = { 0, 0 };
+
+    /* sendfile() has no MSG_NOSIGNAL: hold SIGPIPE back and eat it on EPIPE. */
+    sigemptyset(&Pipe);
+    sigaddset(&Pipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &Pipe, &Saved);
+    while (lSize > 0)
     {
-        PHTTP_DBGPRINT(pCtx, ("[phttp] Writing socket: sock=%u\n", pStream->SockFd));
+        if ((Sent = sendfile(pStream->SockFd, iFd, &Offset, (size_t) lSize)) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EPIPE && !sigismember(&Saved, SIGPIPE))
+                sigtimedwait(&Pipe, NULL, &Zero);
+            iError = errno == EAGAIN ? -XME_HTTP_TIMEOUT: -XME_HTTP_SKWRITE;
+            break;
+        }
+        if (Sent == 0)
+        {
+            iError = -XME_HTTP_SKWRITE;
+            break;
+        }
+        lSize -= (long) Sent;
+    }
+    pthread_sigmask(SIG_SETMASK, &Saved, NULL);
 
-        iTxSize = XmPHttpSkWrite(pStream->SockFd, pData + iSent,
-                                 iSize - iSent, pStream->iWriteTimeo);
+    return iError;
+}
 
-        PHTTP_DBGPRINT(pCtx, ("[phttp] Socket write done: sock=%u send=%d\n", pStream->SockFd,
-                              iTxSize));
-        if (iTxSize < 0)
-            break;
-        iSent += iTxSize;
+int XmPHttpResolve(XmPHttpCtx *pCtx, char const *pszServer, int iPort,
+                   XmDnsAddr *pAddrs, int iMaxAddrs)
+{
+    int iAddrs;
+
+    PHTTP_DBGPRINT(pCtx, ("[phttp] Resolving server name: server='%s'\n", pszServer));
+    if ((iAddrs = XmDnsResolve(pszServer, iPort, pAddrs, iMaxAddrs)) < 0)
+    {
+        PHTTP_DBGPRINT(pCtx, ("[phttp] Server name resolve error: server='%s'\n", pszServer));
+        return -XME_HTTP_UNKNOWN_HOST;
     }
+    PHTTP_DBGPRINT(pCtx, ("[phttp] Server name resolved: server='%s' addrs=%d\n",
+                          pszServer, iAddrs));
 
-    return iSize;
+    return iAddrs;
 }
 
 static struct SStream *XmPHttpConnect(XmPHttpCtx *pCtx, char const *pszServer, int iPort)
 {
-    int iError;
-    SOCKET SockFd;
-    struct hostent *pHE;
+    int i, iAddrs;
+    SOCKET SockFd = INVALID_SOCKET;
     struct SStream *pStream;
-    struct in_addr InAddr;
-    struct sockaddr_in SAIn;
+    XmDnsAddr Addrs[XM_DNS_MAX_ADDRS];
+    struct timeval TV;
 
-    PHTTP_DBGPRINT(pCtx, ("[phttp] Resolving server name: server='%s'\n", pszServer));
-    if ((InAddr.s_addr = inet_addr(pszServer)) == INADDR_NONE)
+    if ((iAddrs = XmPHttpResolve(pCtx, pszServer, iPort, Addrs, XM_DNS_MAX_ADDRS)) < 0)
+        return NULL;
+
+    /* Try the addresses in order, so that e.g. an unreachable IPv6 one falls back to IPv4. */
+    for (i = 0; i < iAddrs && SockFd == INVALID_SOCKET; i++)
     {
-        if ((pHE = gethostbyname(pszServer)) == NULL)
+        if ((SockFd = XmPHttpSocket(pCtx, Addrs[i].Addr.ss_family)) == INVALID_SOCKET)
+            continue;
+
+        PHTTP_DBGPRINT(pCtx, ("[phttp] Connecting to remote server: server='%s' addr=%d\n",
+                              pszServer, i));
+        if (XmPHttpSkConnect(SockFd, (struct sockaddr *) &Addrs[i].Addr, Addrs[i].AddrLen,
+                             pCtx->iPHttpConnTimeo) < 0)
         {
-            PHTTP_DBGPRINT(pCtx, ("[phttp] Server name resolve error: server='%s'\n", pszServer));
-            return NULL;
+            PHTTP_DBGPRINT(pCtx, ("[phttp] Connect failed: server='%s' addr=%d\n",
+                                  pszServer, i));
+            closesocket(SockFd);
+            SockFd = INVALID_SOCKET;
         }
+    }
+    if (SockFd == INVALID_SOCKET)
+        return NULL;
+    PHTTP_DBGPRINT(pCtx, ("[phttp] Connect succeeded: server='%s'\n", pszServer));
 
-        memcpy(&InAddr.s_addr, pHE->h_addr_list[0], pHE->h_length);
+    if ((pStream = XmPHttpStreamAttach(pCtx, SockFd)) == NULL)
+    {
+        closesocket(SockFd);
+        return NULL;
     }
-    PHTTP_DBGPRINT(pCtx, ("[phttp] Server name resolved: server='%s'\n", pszServer));
 
-    if ((SockFd = XmPHttpSocket(pCtx)) == INVALID_SOCKET)
+    TV.tv_sec = pStream->iWriteTimeo;
+    TV.tv_usec = 0;
+    if (setsockopt(SockFd, SOL_SOCKET, SO_SNDTIMEO, &TV, sizeof(TV)) != 0)
+    {
+        XmPHttpStreamClose(pStream);
         return NULL;
+    }
 
-    memset(&SAIn, 0, sizeof(SAIn));
-    memcpy(&SAIn.sin_addr, &InAddr.s_addr, 4);
-    SAIn.sin_port = htons((short int) iPort);
-    SAIn.sin_family = AF_INET;
+    return pStream;
+}
+
+static struct SStream *XmPHttpPoolGet(XmPHttpCtx *pCtx, char const *pszServer, int iPort)
+{
+    time_t Now = time(NULL);
+    XmPHttpConn *pConn, **ppPrev;
+    struct SStream *pStream = NULL;
 
-    PHTTP_DBGPRINT(pCtx, ("[phttp] Connecting to remote server: server='%s'\n", pszServer));
-    if ((iError = XmPHttpSkConnect(SockFd, (struct sockaddr *) &SAIn, sizeof(SAIn),
-                                   pCtx->iPHttpConnTimeo)) < 0)
+    pthread_mutex_lock(&pCtx->PHttpLock);
+    for (ppPrev = &pCtx->pPHttpIdle; (pConn = *ppPrev) != NULL;)
     {
-        PHTTP_DBGPRINT(pCtx, ("[phttp] Connect failed: server='%s'\n", pszServer));
-        closesocket(SockFd);
+        if (Now - pConn->Idle >= pCtx->iPHttpIdleTimeo || !XmPHttpSkAlive(pConn->SockFd))
+        {
+            PHTTP_DBGPRINT(pCtx, ("[phttp] Dropping idle connection: sock=%u\n", pConn->SockFd));
+            *ppPrev = pConn->pNext;
+            closesocket(pConn->SockFd);
+            free(pConn);
+            continue;
+        }
+        if (pConn->iPort == iPort && strcasecmp(pConn->szHost, pszServer) == 0)
+        {
+            *ppPrev = pConn->pNext;
+            break;
+        }
+        ppPrev = &pConn->pNext;
+    }
+    pthread_mutex_unlock(&pCtx->PHttpLock);
+
+    if (pConn == NULL)
         return NULL;
+    if ((pStream = XmPHttpStreamAttach(pCtx, pConn->SockFd)) == NULL)
+        closesocket(pConn->SockFd);
+    else
+    {
+        pStream->iReused = 1;
+        PHTTP_DBGPRINT(pCtx, ("[phttp] Reusing connection: server='%s' sock=%u\n",
+                              pszServer, pStream->SockFd));
     }
-    PHTTP_DBGPRINT(pCtx, ("[phttp] Connect succeeded: server='%s'\n", pszServer));
+    free(pConn);
 
-    if ((pStream = XmPHttpStreamAttach(pCtx, SockFd)) == NULL)
+    return pStream;
+}
+
+static void XmPHttpPoolPut(struct SStream *pStream, char const *pszServer, int iPort)
+{
+    int iCount = 0;
+    XmPHttpCtx *pCtx = pStream->pCtx;
+    XmPHttpConn *pConn, *pIdle;
+
+    if (strlen(pszServer) >= PHTTP_MAX_HOST ||
+        (pConn = (XmPHttpConn *) malloc(sizeof(XmPHttpConn))) == NULL)
     {
-        closesocket(SockFd);
+        XmPHttpStreamClose(pStream);
+        return;
+    }
+    pConn->SockFd = pStream->SockFd;
+    pConn->iPort = iPort;
+    pConn->Idle = time(NULL);
+    strcpy(pConn->szHost, pszServer);
+
+    pthread_mutex_lock(&pCtx->PHttpLock);
+    for (pIdle = pCtx->pPHttpIdle; pIdle != NULL; pIdle = pIdle->pNext)
+        if (pIdle->iPort == iPort && strcasecmp(pIdle->szHost, pszServer) == 0)
+            iCount++;
+    if (iCount < pCtx->iPHttpPoolSize)
+    {
+        pConn->pNext = pCtx->pPHttpIdle;
+        pCtx->pPHttpIdle = pConn;
+        pConn = NULL;
+    }
+    pthread_mutex_unlock(&pCtx->PHttpLock);
+
+    if (pConn != NULL)
+    {
+        free(pConn);
+        XmPHttpStreamClose(pStream);
+        return;
+    }
+    PHTTP_DBGPRINT(pCtx, ("[phttp] Connection kept alive: server='%s' sock=%u\n",
+                          pszServer, pStream->SockFd));
+    free(pStream);
+}
+
+static char *XmPHttpReadBody(XmHttpCallbacks *pHCB, void *pPrivate, long lReqSize)
+{
+    char *pBody;
+
+    if ((pBody = (char *) malloc(lReqSize + 1)) == NULL)
+        return NULL;
+    if (lReqSize > 0 && pHCB->pfRead(pPrivate, pBody, (int) lReqSize) != lReqSize)
+    {
+        free(pBody);
         return NULL;
     }
 
-    return pStream;
+    return pBody;
 }
 
-static int XmPHttpSendRequest(struct SStream *pStream, char const *pszServer,
-                              char const *pszReq, char const *pszDoc,
-                              char const * const *ppszHdrs,
-                              XmHttpCallbacks *pHCB, void *pPrivate)
+static int XmPHttpSendRequest(struct SStream *pStream, char const *pszHead, int iHeadSize,
+                              char const *pBody, int iFd, long lOffset, long lReqSize)
 {
-    int i, iCurr;
-    long lReqSize, lRead;
+    int iCount = 2;
     XmPHttpCtx *pCtx = pStream->pCtx;
-    char *pszHttpVer;
-    char TxBuff[512];
+    struct iovec Iov[3];
+    char szContLen[64];
 
-    if ((lReqSize = pHCB->pfGetSize(pPrivate)) < 0)
-        return -1;
     PHTTP_DBGPRINT(pCtx, ("[phttp] Outbound data length retrieved: size=%ld\n",
                           lReqSize));
 
-    pszHttpVer = (char *) PHTTP_ENVGET(pCtx, XM_HTTP_VERSION);
-    if (XmPHttpPrintf(pStream, "%s %s %s\r\n", pszReq, pszDoc,
-                      pszHttpVer != NULL ? pszHttpVer: "HTTP/1.0") < 0 ||
-        XmPHttpPrintf(pStream, "Host: %s\r\n", pszServer) < 0)
+    Iov[0].iov_base = (void *) pszHead;
+    Iov[0].iov_len = iHeadSize;
+    Iov[1].iov_base = szContLen;
+    Iov[1].iov_len = snprintf(szContLen, sizeof(szContLen), "Content-Length: %ld\r\n\r\n", lReqSize);
+    if (pBody != NULL && lReqSize > 0)
     {
-        PHTTP_ENVFREE(pszHttpVer);
-        return -1;
+        Iov[2].iov_base = (void *) pBody;
+        Iov[2].iov_len = lReqSize;
+        iCount++;
     }
-    PHTTP_ENVFREE(pszHttpVer);
-    if (ppszHdrs)
-        for (i = 0; ppszHdrs[i]; i++)
-            if (XmPHttpPrintf(pStream, "%s\r\n", ppszHdrs[i]) < 0)
-                return -1;
 
-    if (XmPHttpPrintf(pStream, "Content-Length: %ld\r\n\r\n", lReqSize) < 0)
+    PHTTP_DBGPRINT(pCtx, ("[phttp] Sending ...\n"
+                          "(\n"
+                          "%.*s%s"
+                          ")\n", iHeadSize, pszHead, szContLen));
+    if (XmPHttpWritev(pStream, Iov, iCount, iFd >= 0 ? MSG_MORE: 0) < 0 ||
+        (iFd >= 0 && XmPHttpSendFile(pStream, iFd, lOffset, lReqSize) < 0))
         return -1;
-
-    PHTTP_DBGPRINT(pCtx, ("[phttp] Reading and sending outbound data: sock=%u\n",
-                          pStream->SockFd));
-    for (lRead = 0; lRead < lReqSize;)
-    {
-        iCurr = (int) PHTTP_MIN(lReqSize - lRead, sizeof(TxBuff));
-        if (pHCB->pfRead(pPrivate, TxBuff, iCurr) != iCurr ||
-            XmPHttpWrite(TxBuff, iCurr, pStream) != iCurr)
-            return -1;
-        lRead += iCurr;
-    }
     PHTTP_DBGPRINT(pCtx, ("[phttp] Outbound data sent: sock=%u\n", pStream->SockFd));
 
     return 0;
 }
 
-static void XmPHttpParseInit(struct PHttpUrl *pPU)
+void XmPHttpParseInit(struct PHttpUrl *pPU)
 {
     memset(pPU, 0, sizeof(*pPU));
 }
 
-static int XmPHttpParseUrl(XmPHttpCtx *pCtx, struct PHttpUrl *pPU, char const *pszUrl)
+int XmPHttpParseUrl(XmPHttpCtx *pCtx, struct PHttpUrl *pPU, char const *pszUrl)
 {
     char *pszDUrl = strdup(pszUrl), *pszTmp;
 
@@ -551,6 +695,14 @@ static int XmPHttpParseUrl(XmPHttpCtx *pCtx, struct PHttpUrl *pPU, char const *p
 
     pPU->pszHost = pszDUrl;
 
+    /* IPv6 literals come bracketed: http://[::1]:8080/ */
+    if (*pszDUrl == '[' && (pszTmp = strchr(pszDUrl, ']')) != NULL)
+    {
+        pPU->pszHost = pszDUrl + 1;
+        *pszTmp = '\0';
+        pszDUrl = pszTmp + 1;
+    }
+
     if ((pszTmp = strchr(pszDUrl, ':')) != NULL)
     {
         *pszTmp++ = '\0';
@@ -582,7 +734,7 @@ static int XmPHttpParseUrl(XmPHttpCtx *pCtx, struct PHttpUrl *pPU, char const *p
     return 0;
 }
 
-static void XmPHttpParseFree(struct PHttpUrl *pPU)
+void XmPHttpParseFree(struct PHttpUrl *pPU)
 {
     free((char *) pPU->pszUrl);
     free((char *) pPU->pszDoc);
@@ -600,7 +752,7 @@ static int XmPHttpReadChunked(struct SStream *pStream, XmHttpCallbacks *pHCB,
     {
         if (!XmPHttpRdLine(RxBuff, sizeof(RxBuff) - 1, pStream))
             return -1;
-        if (!sscanf(RxBuff, "%d", &iCkSize))
+        if (sscanf(RxBuff, "%x", &iCkSize) != 1 || iCkSize < 0)
             return -1;
         if (iCkSize)
         {
@@ -616,6 +768,8 @@ static int XmPHttpReadChunked(struct SStream *pStream, XmHttpCallbacks *pHCB,
                     return -1;
                 iSize += iRead;
             }
+            if (!XmPHttpRdLine(RxBuff, sizeof(RxBuff) - 1, pStream) || strlen(RxBuff) != 0)
+                return -1;
         }
     } while (iCkSize);
     while (XmPHttpRdLine(RxBuff, sizeof(RxBuff) - 1, pStream))
@@ -626,16 +780,17 @@ static int XmPHttpReadChunked(struct SStream *pStream, XmHttpCallbacks *pHCB,
 }
 
 static int XmPHttpReadResponse(struct SStream *pStream, XmHttpCallbacks *pHCB,
-                               void *pPrivate)
+                               void *pPrivate, int *piKeepAlive)
 {
-    int iHttpRCode, iChunked = 0, iValidRCode;
+    int iHttpRCode, iChunked = 0, iValidRCode, iKeepAlive;
     long lContLen = -1;
     char *pszValue;
     XmPHttpCtx *pCtx = pStream->pCtx;
     char szBuffer[512];
 
+    *piKeepAlive = 0;
     if (!XmPHttpRdLine(szBuffer, sizeof(szBuffer) - 1, pStream))
-        return -1;
+        return PHTTP_NORESPONSE;
 
     PHTTP_DBGPRINT(pCtx, ("[phttp] HTTP response: sock=%u resp='%s'\n", pStream->SockFd, szBuffer));
     if (!sscanf(szBuffer, "%*s %d %*s", &iHttpRCode))
@@ -646,6 +801,8 @@ static int XmPHttpReadResponse(struct SStream *pStream, XmHttpCallbacks *pHCB,
 
     // printf("[XMPHTTP] : HTTP CODE = %d\n", iHttpRCode);
     iValidRCode = iHttpRCode == 200 || iHttpRCode == 204;
+    /* HTTP/1.1 connections persist unless closed, HTTP/1.0 ones must ask to. */
+    iKeepAlive = strncasecmp(szBuffer, "HTTP/1.0", 8) != 0;
     if ((iHttpRCode >= 100 && iHttpRCode < 200) || iHttpRCode == 204 || iHttpRCode == 304)
         lContLen = 0;
 
@@ -666,6 +823,15 @@ static int XmPHttpReadResponse(struct SStream *pStream, XmHttpCallbacks *pHCB,
             PHTTP_SKIPSPACE(pszValue);
             iChunked = CHUNKED_ENCODED(pszValue);
         }
+        else if (!strncasecmp(szBuffer, CONNECTION_HEADER, PHTTP_CSTRSIZE(CONNECTION_HEADER)))
+        {
+            pszValue = szBuffer + PHTTP_CSTRSIZE(CONNECTION_HEADER);
+            PHTTP_SKIPSPACE(pszValue);
+            if (!strncasecmp(pszValue, "close", 5))
+                iKeepAlive = 0;
+            else if (!strncasecmp(pszValue, "keep-alive", 10))
+                iKeepAlive = 1;
+        }
     }
     if (lContLen >= 0)
     {
@@ -693,6 +859,8 @@ static int XmPHttpReadResponse(struct SStream *pStream, XmHttpCallbacks *pHCB,
         int iRead;
         long lSize;
 
+        /* The body runs until the server closes, so nothing is left to reuse. */
+        iKeepAlive = 0;
         for (lSize = 0;;)
         {
             if ((iRead = XmPHttpRead(szBuffer, sizeof(szBuffer), pStream)) <= 0)
@@ -704,6 +872,9 @@ static int XmPHttpReadResponse(struct SStream *pStream, XmHttpCallbacks *pHCB,
         }
     }
 
+    /* Bytes past the response would be mistaken for the next one. */
+    *piKeepAlive = iKeepAlive && pStream->iIndex >= pStream->iInBuffer;
+
     return iValidRCode ? 0: -1;
 }
 
@@ -740,49 +911,137 @@ static char **XmPHttpHdrSplit(char const *pszStr)
     return ppszPtrs;
 }
 
+char *XmPHttpTemplate(XmPHttpCtx *pCtx, char const *pszMethod, char const *pszUrl,
+                      struct PHttpUrl const *pPU, int *piSize)
+{
+    int i, iSize, iV6, iKeyLen = (int) strlen(pszMethod);
+    char *pszHead = NULL, *pszKey, *pszEnv, *pszHttpVer;
+    char **ppszHdrs = NULL;
+
+    pthread_mutex_lock(&pCtx->PHttpLock);
+    if ((pszKey = pCtx->pszPHttpTplKey) == NULL || strncmp(pszKey, pszMethod, iKeyLen) != 0 ||
+        pszKey[iKeyLen] != ' ' || strcmp(pszKey + iKeyLen + 1, pszUrl) != 0)
+    {
+        /*
+         * Everything up to Content-Length only depends on the method, the URL
+         * and the environment, so it is composed once and reused.
+         */
+        free(pCtx->pszPHttpTplKey);
+        free(pCtx->pszPHttpTpl);
+        pCtx->pszPHttpTplKey = pCtx->pszPHttpTpl = NULL;
+
+        if ((pszEnv = (char *) PHTTP_ENVGET(pCtx, XM_HTTP_HEADERS)) != NULL &&
+            (ppszHdrs = XmPHttpHdrSplit(pszEnv)) == NULL)
+        {
+            PHTTP_ENVFREE(pszEnv);
+            pthread_mutex_unlock(&pCtx->PHttpLock);
+            return NULL;
+        }
+        PHTTP_ENVFREE(pszEnv);
+        pszHttpVer = (char *) PHTTP_ENVGET(pCtx, XM_HTTP_VERSION);
+        if (pszHttpVer == NULL)
+            pszHttpVer = "HTTP/1.1";
+
+        /* IPv6 literals lost their brackets in XmPHttpParseUrl(), put them back. */
+        iV6 = strchr(pPU->pszHost, ':') != NULL;
+        iSize = iKeyLen + strlen(pPU->pszDoc) + strlen(pszHttpVer) + strlen(pPU->pszHost) + 64;
+        for (i = 0; ppszHdrs != NULL && ppszHdrs[i]; i++)
+            iSize += strlen(ppszHdrs[i]) + 2;
+
+        if ((pCtx->pszPHttpTpl = (char *) malloc(iSize)) != NULL &&
+            (pCtx->pszPHttpTplKey = (char *) malloc(iKeyLen + strlen(pszUrl) + 2)) != NULL)
+        {
+            pCtx->iPHttpTplLen = snprintf(pCtx->pszPHttpTpl, iSize, "%s %s %s\r\nHost: %s%s%s\r\n"
+                                          "Connection: %s\r\n", pszMethod, pPU->pszDoc,
+                                          pszHttpVer, iV6 ? "[": "", pPU->pszHost, iV6 ? "]": "",
+                                          pCtx->iPHttpPoolSize > 0 ? "keep-alive": "close");
+            for (i = 0; ppszHdrs != NULL && ppszHdrs[i]; i++)
+                pCtx->iPHttpTplLen += snprintf(pCtx->pszPHttpTpl + pCtx->iPHttpTplLen,
+                                               iSize - pCtx->iPHttpTplLen, "%s\r\n", ppszHdrs[i]);
+            sprintf(pCtx->pszPHttpTplKey, "%s %s", pszMethod, pszUrl);
+        }
+        else
+        {
+            free(pCtx->pszPHttpTpl);
+            pCtx->pszPHttpTpl = NULL;
+        }
+        PHTTP_ENVFREE(pszHttpVer);
+        free(ppszHdrs);
+    }
+    if (pCtx->pszPHttpTpl != NULL &&
+        (pszHead = (char *) malloc(pCtx->iPHttpTplLen + 1)) != NULL)
+    {
+        memcpy(pszHead, pCtx->pszPHttpTpl, pCtx->iPHttpTplLen + 1);
+        *piSize = pCtx->iPHttpTplLen;
+    }
+    pthread_mutex_unlock(&pCtx->PHttpLock);
+
+    return pszHead;
+}
+
 int XmPHttpExec(XmPHttpCtx *pCtx, char const *pszMethod, char const *pszUrl,
                 XmHttpCallbacks *pHCB, void *pPrivate)
 {
-    char *pszEnv = NULL;
-    char **ppszHdrs = NULL;
+    int iAttempt, iError = -1, iKeepAlive, iReused, iHeadSize, iFd = -1;
+    long lReqSize, lOffset = 0;
+    char *pszHead, *pBody = NULL;
     struct SStream *pStream;
     struct PHttpUrl PU;
 
     XmPHttpParseInit(&PU);
     if (XmPHttpParseUrl(pCtx, &PU, pszUrl) < 0)
         return -1;
-    if ((pStream = XmPHttpConnect(pCtx, PU.pszHost, PU.iPort)) == NULL)
+    if ((pszHead = XmPHttpTemplate(pCtx, pszMethod, pszUrl, &PU, &iHeadSize)) == NULL)
     {
 
         XmPHttpParseFree(&PU);
         return -1;
     }
-    if ((pszEnv = (char *) PHTTP_ENVGET(pCtx, XM_HTTP_HEADERS)) != NULL &&
-        (ppszHdrs = XmPHttpHdrSplit(pszEnv)) == NULL)
+
+    /*
+     * The body is read once up front, or sent straight from its file, so that
+     * a request sent over a pooled connection the server had already dropped
+     * can be replayed on a new one.
+     */
+    if (pHCB->pfGetFd != NULL)
+        iFd = pHCB->pfGetFd(pPrivate, &lOffset);
+    if ((lReqSize = pHCB->pfGetSize(pPrivate)) < 0 ||
+        (iFd < 0 && (pBody = XmPHttpReadBody(pHCB, pPrivate, lReqSize)) == NULL))
     {
 
-        PHTTP_ENVFREE(pszEnv);
-        XmPHttpStreamClose(pStream);
+        free(pszHead);
         XmPHttpParseFree(&PU);
         return -1;
     }
-    PHTTP_ENVFREE(pszEnv);
 
-    if (XmPHttpSendRequest(pStream, PU.pszHost, pszMethod, PU.pszDoc,
-                           (char const * const *) ppszHdrs, pHCB, pPrivate) < 0 ||
-        XmPHttpReadResponse(pStream, pHCB, pPrivate) < 0)
+    for (iAttempt = 0; iAttempt < 2; iAttempt++)
     {
+        if ((iAttempt > 0 || (pStream = XmPHttpPoolGet(pCtx, PU.pszHost, PU.iPort)) == NULL) &&
+            (pStream = XmPHttpConnect(pCtx, PU.pszHost, PU.iPort)) == NULL)
+        {
+            iError = -1;
+            break;
+        }
+        iReused = pStream->iReused;
 
-        if (ppszHdrs != NULL)
-            free(ppszHdrs);
-        XmPHttpStreamClose(pStream);
-        XmPHttpParseFree(&PU);
-        return -1;
+        if (XmPHttpSendRequest(pStream, pszHead, iHeadSize, pBody, iFd, lOffset, lReqSize) < 0)
+            iError = PHTTP_NORESPONSE;
+        else
+            iError = XmPHttpReadResponse(pStream, pHCB, pPrivate, &iKeepAlive);
+
+        if (iError == 0 && iKeepAlive)
+            XmPHttpPoolPut(pStream, PU.pszHost, PU.iPort);
+        else
+            XmPHttpStreamClose(pStream);
+        if (iError != PHTTP_NORESPONSE || !iReused)
+            break;
+
+        PHTTP_DBGPRINT(pCtx, ("[phttp] Pooled connection was dead, retrying: server='%s'\n",
+                              PU.pszHost));
     }
-    free(ppszHdrs);
-    XmPHttpStreamClose(pStream);
+    free(pBody);
+    free(pszHead);
     XmPHttpParseFree(&PU);
 
-    return 0;
+    return iError == 0 ? 0: -1;
 }
-
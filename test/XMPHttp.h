@@ -32,13 +32,53 @@
 #if !defined(_XMPOSIXHTTP_H)
 #define _XMPOSIXHTTP_H
 
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
 #include "XMHttp.h"
+#include "XMDns.h"
 
+#define XME_HTTP_TIMEOUT 11300
+#define XME_HTTP_SELECT 11301
+#define XME_HTTP_SKREAD 11302
+#define XME_HTTP_SKWRITE 11303
+#define XME_HTTP_SETSOCKOPT 11003
+#define XME_HTTP_DISCONNECT 11005
+#define XME_HTTP_UNKNOWN_HOST 11006
+#define XME_HTTP_CONNECT 11007
+#define XME_HTTP_PROTOCOL 11008
+#define XME_HTTP_CALLBACK 11009
 
+
+typedef struct XmPHttpConn_struct XmPHttpConn;
+
+struct PHttpUrl
+{
+    int iProto;
+    char const *pszHost;
+    int iPort;
+    char const *pszDoc;
+    char const *pszUrl;
+};
+
+/*
+ * Connections whose response was fully framed (Content-Length or chunked) and
+ * that the server did not ask to close are kept in pPHttpIdle, at most
+ * iPHttpPoolSize per host:port, for up to iPHttpIdleTimeo seconds. A pool
+ * size of zero disables persistent connections. pszPHttpTpl caches the request
+ * head (everything before Content-Length) for the last method and URL seen.
+ */
 typedef struct XmPHttpCtx_struct
 {
     int iPHttpConnTimeo;
     int iPHttpDebug;
+    int iPHttpPoolSize;
+    int iPHttpIdleTimeo;
+    XmPHttpConn *pPHttpIdle;
+    char *pszPHttpTplKey;
+    char *pszPHttpTpl;
+    int iPHttpTplLen;
+    pthread_mutex_t PHttpLock;
 } XmPHttpCtx;
 
 
@@ -48,6 +88,13 @@ int XmPHttpInit(XmPHttpCtx *pCtx);
 void XmPHttpCleanup(XmPHttpCtx *pCtx);
 int XmPHttpExec(XmPHttpCtx *pCtx, char const *pszMethod, char const *pszUrl,
                 XmHttpCallbacks *pHCB, void *pPrivate);
+void XmPHttpParseInit(struct PHttpUrl *pPU);
+int XmPHttpParseUrl(XmPHttpCtx *pCtx, struct PHttpUrl *pPU, char const *pszUrl);
+void XmPHttpParseFree(struct PHttpUrl *pPU);
+char *XmPHttpTemplate(XmPHttpCtx *pCtx, char const *pszMethod, char const *pszUrl,
+                      struct PHttpUrl const *pPU, int *piSize);
+int XmPHttpResolve(XmPHttpCtx *pCtx, char const *pszServer, int iPort,
+                   XmDnsAddr *pAddrs, int iMaxAddrs);
 
 EXTERNC_END;
 